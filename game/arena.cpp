@@ -0,0 +1,181 @@
+#include "arena.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mutex>
+
+// Live arenas, for the stats.
+static std::mutex arenas_mutex;
+static arena_t *arenas[MAX_ARENAS];
+static uint32_t arena_count;
+
+static arena_t frame_arena;
+
+// Frees the thread's arena when the thread exits.
+struct thread_arena_t
+{
+    arena_t arena;
+    bool initialized;
+
+    ~thread_arena_t()
+    {
+        if (initialized) free_arena(&arena);
+    }
+};
+
+static thread_local thread_arena_t thread_arena;
+
+bool
+init_arena(arena_t *arena, char *name, size_t size)
+{
+    arena->name = name;
+    arena->size = size;
+    arena->used = 0;
+    arena->high_water.store(0, std::memory_order_relaxed);
+    arena->failed_count.store(0, std::memory_order_relaxed);
+
+    arena->base = (uint8_t *)malloc(size);
+    if (!arena->base)
+    {
+        fprintf(stderr, "Could not allocate %zu bytes for arena '%s'.\n", size, name);
+        arena->size = 0;
+        return false;
+    }
+
+#if ARENA_POISON
+    memset(arena->base, 0xDD, size);
+#endif
+
+    std::lock_guard<std::mutex> lock(arenas_mutex);
+    if (arena_count < MAX_ARENAS) arenas[arena_count++] = arena;
+
+    return true;
+}
+
+void
+free_arena(arena_t *arena)
+{
+    {
+        std::lock_guard<std::mutex> lock(arenas_mutex);
+        for (uint32_t i = 0; i < arena_count; ++i)
+        {
+            if (arenas[i] == arena)
+            {
+                arenas[i] = arenas[--arena_count];
+                break;
+            }
+        }
+    }
+
+    free(arena->base);
+    arena->base = NULL;
+    arena->size = 0;
+    arena->used = 0;
+}
+
+void *
+push_arena(arena_t *arena, size_t size, size_t alignment)
+{
+    ASSERT((alignment & (alignment - 1)) == 0);
+
+    // The base comes from malloc, aligning the offset is enough up to its alignment.
+    size_t offset = (arena->used + alignment - 1) & ~(alignment - 1);
+    if (offset > arena->size || size > arena->size - offset)
+    {
+        if (arena->failed_count.fetch_add(1, std::memory_order_relaxed) == 0)
+        {
+            fprintf(stderr, "Arena '%s' is full, %zu bytes wanted with %zu of %zu used.\n", arena->name, size, arena->used, arena->size);
+        }
+        return NULL;
+    }
+
+    arena->used = offset + size;
+    if (arena->used > arena->high_water.load(std::memory_order_relaxed))
+    {
+        arena->high_water.store(arena->used, std::memory_order_relaxed);
+    }
+
+    uint8_t *result = arena->base + offset;
+#if ARENA_POISON
+    memset(result, 0xCD, size);
+#endif
+    return result;
+}
+
+size_t
+get_arena_marker(arena_t *arena)
+{
+    return arena->used;
+}
+
+void
+pop_arena_marker(arena_t *arena, size_t marker)
+{
+    ASSERT(marker <= arena->used);
+
+#if ARENA_POISON
+    memset(arena->base + marker, 0xDD, arena->used - marker);
+#endif
+    arena->used = marker;
+}
+
+void
+reset_arena(arena_t *arena)
+{
+    pop_arena_marker(arena, 0);
+}
+
+void
+init_arenas()
+{
+    init_arena(&frame_arena, "frame", FRAME_ARENA_SIZE);
+}
+
+void
+free_arenas()
+{
+    free_arena(&frame_arena);
+}
+
+arena_t *
+get_frame_arena()
+{
+    return &frame_arena;
+}
+
+void
+reset_frame_arena()
+{
+    reset_arena(&frame_arena);
+}
+
+arena_t *
+get_thread_arena()
+{
+    if (!thread_arena.initialized)
+    {
+        // A failed arena has no room, every push just comes back NULL.
+        init_arena(&thread_arena.arena, "thread", THREAD_ARENA_SIZE);
+        thread_arena.initialized = true;
+    }
+    return &thread_arena.arena;
+}
+
+uint32_t
+get_arena_stats(arena_stats_t *stats, uint32_t max_stats)
+{
+    std::lock_guard<std::mutex> lock(arenas_mutex);
+
+    uint32_t count = arena_count < max_stats ? arena_count : max_stats;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        arena_t *arena = arenas[i];
+        stats[i].name = arena->name;
+        stats[i].size = arena->size;
+        stats[i].high_water = arena->high_water.load(std::memory_order_relaxed);
+        stats[i].failed_count = arena->failed_count.load(std::memory_order_relaxed);
+    }
+    return arena_count;
+}
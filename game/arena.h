@@ -0,0 +1,99 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+// Linear arenas for memory that doesn't outlive a frame or a load. Allocating bumps a pointer and
+// everything is freed at once, by resetting or by popping back to a marker, so there's no per
+// allocation bookkeeping and nothing to leak. The GL thread has a frame arena that is reset after
+// every swap, and every thread gets its own arena for temporaries, which is only ever used in
+// scopes. In debug builds fresh memory is filled with 0xCD and freed memory with 0xDD, so stale
+// pointers show up instead of reading memory that still looks right.
+
+#ifndef ARENA_POISON
+#ifdef _DEBUG
+#define ARENA_POISON 1
+#else
+#define ARENA_POISON 0
+#endif
+#endif
+
+#define FRAME_ARENA_SIZE (16 << 20)
+#define THREAD_ARENA_SIZE (8 << 20)
+#define MAX_ARENAS 64
+
+struct arena_t
+{
+    char *name; // Not copied, use string literals.
+    uint8_t *base;
+    size_t size;
+    size_t used;
+
+    // Read by get_arena_stats from other threads.
+    std::atomic<size_t> high_water;
+    std::atomic<uint32_t> failed_count;
+};
+
+struct arena_stats_t
+{
+    char *name;
+    size_t size;
+    size_t high_water;
+    uint32_t failed_count;
+};
+
+bool init_arena(arena_t *arena, char *name, size_t size);
+void free_arena(arena_t *arena);
+
+// NULL when the arena is full, which is reported once per arena. alignment is a power of two.
+void *push_arena(arena_t *arena, size_t size, size_t alignment = 16);
+
+#define PUSH_ARRAY(arena, type, count) (type *)push_arena((arena), (count) * sizeof(type), alignof(type))
+
+// Everything pushed after the marker is freed when popping back to it.
+size_t get_arena_marker(arena_t *arena);
+void pop_arena_marker(arena_t *arena, size_t marker);
+
+// O(1) without poisoning.
+void reset_arena(arena_t *arena);
+
+struct arena_scope_t
+{
+    arena_t *arena;
+    size_t marker;
+
+    arena_scope_t(arena_t *scope_arena)
+    {
+        arena = scope_arena;
+        marker = get_arena_marker(arena);
+    }
+
+    ~arena_scope_t()
+    {
+        pop_arena_marker(arena, marker);
+    }
+};
+
+#define ARENA_SCOPE_JOIN2(a, b) a##b
+#define ARENA_SCOPE_JOIN(a, b) ARENA_SCOPE_JOIN2(a, b)
+
+// Frees whatever the rest of the enclosing block pushes to arena.
+#define ARENA_SCOPE(arena) arena_scope_t ARENA_SCOPE_JOIN(arena_scope_, __LINE__)(arena)
+
+void init_arenas();
+void free_arenas();
+
+// GL thread only, reset after glfwSwapBuffers.
+arena_t *get_frame_arena();
+void reset_frame_arena();
+
+// The calling thread's arena, created the first time it is asked for and freed when the thread
+// exits. Only use it inside an ARENA_SCOPE.
+arena_t *get_thread_arena();
+
+// Every live arena, returns how many there were.
+uint32_t get_arena_stats(arena_stats_t *stats, uint32_t max_stats);
+
+#endif
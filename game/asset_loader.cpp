@@ -0,0 +1,569 @@
+#include "asset_loader.h"
+#include "trace.h"
+#include "utils.h"
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+struct io_request_t
+{
+    int priority;
+    uint32_t sequence; // Same priority, first come first served.
+    uint32_t index; // Asset, or ASSET_MAX_ASSETS + I/O call slot.
+};
+
+struct io_call_t
+{
+    asset_io_proc_t *proc;
+    void *data;
+};
+
+// Room for every asset's own request and every call, plus the extra ones priority changes leave behind.
+#define IO_QUEUE_SIZE (ASSET_MAX_ASSETS * 4 + ASSET_MAX_IO_CALLS)
+
+static asset_t assets[ASSET_MAX_ASSETS];
+static uint32_t asset_count;
+
+static std::thread io_thread;
+static std::mutex io_mutex;
+static std::condition_variable io_ready;
+static bool quit;
+
+// Binary max heap, guarded by io_mutex. A priority change adds another request instead of moving
+// the old one, which is skipped when it comes up because it's no longer the asset's io_sequence.
+static io_request_t io_queue[IO_QUEUE_SIZE];
+static uint32_t io_queue_count;
+static uint32_t next_sequence;
+
+// Calls waiting in io_queue and a stack of free slots, guarded by io_mutex.
+static io_call_t io_calls[ASSET_MAX_IO_CALLS];
+static uint32_t free_io_calls[ASSET_MAX_IO_CALLS];
+static uint32_t free_io_call_count;
+
+// Read and waiting for the GL thread to start decoding, guarded by io_mutex.
+static uint32_t read_assets[ASSET_MAX_ASSETS];
+static uint32_t read_count;
+
+// GL thread only.
+static uint32_t decoding_assets[ASSET_MAX_ASSETS];
+static uint32_t decoding_count;
+static uint32_t upload_queue[ASSET_MAX_ASSETS];
+static uint32_t upload_count;
+
+static double ticks_to_seconds;
+static uint64_t upload_budget_ticks;
+
+static std::atomic<uint64_t> read_bytes;
+static float upload_ms;
+static uint32_t uploaded_count;
+
+static bool
+is_request_before(io_request_t *a, io_request_t *b)
+{
+    if (a->priority != b->priority) return a->priority > b->priority;
+    return (int32_t)(a->sequence - b->sequence) < 0;
+}
+
+// Under io_mutex.
+static void
+push_io_request(uint32_t index, int priority)
+{
+    ASSERT(io_queue_count < IO_QUEUE_SIZE);
+
+    io_request_t request;
+    request.priority = priority;
+    request.sequence = next_sequence++;
+    request.index = index;
+    if (index < ASSET_MAX_ASSETS) assets[index].io_sequence = request.sequence;
+
+    uint32_t i = io_queue_count++;
+    while (i > 0)
+    {
+        uint32_t parent = (i - 1) / 2;
+        if (!is_request_before(&request, &io_queue[parent])) break;
+        io_queue[i] = io_queue[parent];
+        i = parent;
+    }
+    io_queue[i] = request;
+}
+
+// Under io_mutex.
+static io_request_t
+pop_io_request()
+{
+    io_request_t result = io_queue[0];
+    io_request_t last = io_queue[--io_queue_count];
+
+    uint32_t i = 0;
+    for (;;)
+    {
+        uint32_t child = i * 2 + 1;
+        if (child >= io_queue_count) break;
+        if (child + 1 < io_queue_count && is_request_before(&io_queue[child + 1], &io_queue[child])) child++;
+        if (!is_request_before(&io_queue[child], &last)) break;
+        io_queue[i] = io_queue[child];
+        i = child;
+    }
+    if (io_queue_count) io_queue[i] = last;
+
+    return result;
+}
+
+static void
+finish_read(uint32_t index)
+{
+    std::lock_guard<std::mutex> lock(io_mutex);
+    read_assets[read_count++] = index;
+
+    // The state says reading until the GL thread takes it, this is what keeps priority changes
+    // from asking for another read meanwhile. One made during the read left a request that is
+    // now stale.
+    assets[index].read_finished = true;
+    assets[index].io_sequence = next_sequence++;
+}
+
+// Opens the file and allocates room for it, false if that fails.
+static bool
+open_asset_file(asset_t *asset)
+{
+    FILE *file = fopen(asset->path, "rb");
+    if (!file) return false;
+
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    if (length < 0 || length >= UINT32_MAX)
+    {
+        fclose(file);
+        return false;
+    }
+
+    asset->data = (uint8_t *)malloc(length + 1);
+    if (!asset->data)
+    {
+        fclose(file);
+        return false;
+    }
+
+    asset->file = file;
+    asset->size = (uint32_t)length;
+    asset->read_size = 0;
+    return true;
+}
+
+// Reads the asset a chunk at a time, stopping early when something more urgent shows up.
+static void
+read_asset(uint32_t index)
+{
+    asset_t *asset = &assets[index];
+    if (!asset->file)
+    {
+        asset->state = ASSET_STATE_READING;
+        if (!open_asset_file(asset))
+        {
+            fprintf(stderr, "Failed to read %s '%s'.\n", asset->type->name, asset->path);
+            finish_read(index);
+            return;
+        }
+    }
+
+    TRACE_SCOPE("read_asset");
+    FILE *file = (FILE *)asset->file;
+
+    while (asset->read_size < asset->size)
+    {
+        uint32_t size = asset->size - asset->read_size;
+        if (size > ASSET_READ_CHUNK_SIZE) size = ASSET_READ_CHUNK_SIZE;
+
+        if (fread(asset->data + asset->read_size, 1, size, file) != size)
+        {
+            fprintf(stderr, "Failed to read %s '%s'.\n", asset->type->name, asset->path);
+            fclose(file);
+            asset->file = NULL;
+            free(asset->data);
+            asset->data = NULL;
+            finish_read(index);
+            return;
+        }
+        asset->read_size += size;
+        read_bytes.fetch_add(size, std::memory_order_relaxed);
+
+        if (asset->read_size == asset->size) break;
+
+        // The file stays open, the rest is read when this comes up again.
+        std::lock_guard<std::mutex> lock(io_mutex);
+        int priority = asset->priority.load();
+        if (io_queue_count && io_queue[0].priority > priority)
+        {
+            push_io_request(index, priority);
+            return;
+        }
+    }
+
+    fclose(file);
+    asset->file = NULL;
+    asset->data[asset->size] = 0;
+    finish_read(index);
+}
+
+static void
+io_thread_main()
+{
+    set_trace_thread_name("asset io");
+
+    for (;;)
+    {
+        io_request_t request;
+        io_call_t call = {};
+        {
+            std::unique_lock<std::mutex> lock(io_mutex);
+            while (!quit && !io_queue_count) io_ready.wait(lock);
+            if (quit) return;
+
+            request = pop_io_request();
+            if (request.index >= ASSET_MAX_ASSETS)
+            {
+                uint32_t slot = request.index - ASSET_MAX_ASSETS;
+                call = io_calls[slot];
+                free_io_calls[free_io_call_count++] = slot;
+            }
+            else
+            {
+                // Left behind by a priority change.
+                asset_t *asset = &assets[request.index];
+                if (request.sequence != asset->io_sequence || asset->read_finished) continue;
+            }
+        }
+
+        if (call.proc)
+        {
+            TRACE_SCOPE("asset_io_call");
+            call.proc(call.data);
+        }
+        else
+        {
+            read_asset(request.index);
+        }
+    }
+}
+
+void
+init_asset_loader(float upload_budget_ms)
+{
+    asset_count = 0;
+    io_queue_count = 0;
+    next_sequence = 0;
+    read_count = 0;
+    decoding_count = 0;
+    upload_count = 0;
+    read_bytes = 0;
+
+    free_io_call_count = ASSET_MAX_IO_CALLS;
+    for (uint32_t i = 0; i < ASSET_MAX_IO_CALLS; ++i) free_io_calls[i] = ASSET_MAX_IO_CALLS - 1 - i;
+    upload_ms = 0.0f;
+    uploaded_count = 0;
+    quit = false;
+
+    ticks_to_seconds = 1.0 / (double)glfwGetTimerFrequency();
+    upload_budget_ticks = (uint64_t)(upload_budget_ms * 0.001 * glfwGetTimerFrequency());
+
+    io_thread = std::thread(io_thread_main);
+}
+
+void
+free_asset_loader()
+{
+    {
+        std::lock_guard<std::mutex> lock(io_mutex);
+        quit = true;
+    }
+    io_ready.notify_all();
+    io_thread.join();
+
+    // Decode jobs point at their assets.
+    for (uint32_t i = 0; i < decoding_count; ++i) wait_for_jobs(&assets[decoding_assets[i]].decode_counter);
+
+    for (uint32_t i = 0; i < asset_count; ++i)
+    {
+        asset_t *asset = &assets[i];
+        if (asset->file) fclose((FILE *)asset->file);
+        free(asset->data);
+        free(asset->path);
+        asset->file = NULL;
+        asset->data = NULL;
+        asset->path = NULL;
+    }
+    asset_count = 0;
+    io_queue_count = 0;
+    read_count = 0;
+    decoding_count = 0;
+    upload_count = 0;
+}
+
+asset_id_t
+load_asset(asset_type_t *type, char *path, void *target, asset_priority_t priority)
+{
+    if (asset_count == ASSET_MAX_ASSETS)
+    {
+        fprintf(stderr, "Out of assets loading '%s'.\n", path);
+        return 0;
+    }
+
+    uint32_t index = asset_count++;
+    asset_t *asset = &assets[index];
+
+    size_t length = strlen(path);
+    asset->path = (char *)malloc(length + 1);
+    memcpy(asset->path, path, length + 1);
+    asset->type = type;
+    asset->target = target;
+    asset->state = ASSET_STATE_QUEUED;
+    asset->priority = priority;
+    asset->data = NULL;
+    asset->size = 0;
+    asset->file = NULL;
+    asset->read_size = 0;
+    asset->read_finished = false;
+    asset->decode_success = false;
+    asset->queued_ticks = glfwGetTimerValue();
+    asset->load_seconds = 0.0f;
+
+    {
+        std::lock_guard<std::mutex> lock(io_mutex);
+        push_io_request(index, priority);
+    }
+    io_ready.notify_one();
+
+    return index + 1;
+}
+
+bool
+queue_asset_io(asset_io_proc_t *proc, void *data, asset_priority_t priority)
+{
+    {
+        std::lock_guard<std::mutex> lock(io_mutex);
+        if (!free_io_call_count) return false;
+
+        uint32_t slot = free_io_calls[--free_io_call_count];
+        io_calls[slot].proc = proc;
+        io_calls[slot].data = data;
+        push_io_request(ASSET_MAX_ASSETS + slot, priority);
+    }
+    io_ready.notify_one();
+    return true;
+}
+
+void
+set_asset_priority(asset_id_t id, asset_priority_t priority)
+{
+    if (!id || id > asset_count) return;
+
+    asset_t *asset = &assets[id - 1];
+    int state = asset->state.load();
+    if (state == ASSET_STATE_READY || state == ASSET_STATE_FAILED) return;
+
+    std::lock_guard<std::mutex> lock(io_mutex);
+    if (asset->priority.load() == priority) return;
+    asset->priority = priority;
+
+    // A full queue keeps the old request and order, uploads still go by the new priority.
+    if (!asset->read_finished && io_queue_count + ASSET_MAX_ASSETS + ASSET_MAX_IO_CALLS < IO_QUEUE_SIZE)
+    {
+        push_io_request(id - 1, priority);
+        io_ready.notify_one();
+    }
+}
+
+asset_state_t
+get_asset_state(asset_id_t id)
+{
+    if (!id || id > asset_count) return ASSET_STATE_FAILED;
+    return (asset_state_t)assets[id - 1].state.load();
+}
+
+asset_t *
+get_asset(asset_id_t id)
+{
+    if (!id || id > asset_count) return NULL;
+    return &assets[id - 1];
+}
+
+// Failures were reported by the stage they happened in.
+static void
+finish_asset(asset_t *asset, bool success)
+{
+    free(asset->data);
+    asset->data = NULL;
+    asset->load_seconds = (float)((glfwGetTimerValue() - asset->queued_ticks) * ticks_to_seconds);
+    asset->state = success ? ASSET_STATE_READY : ASSET_STATE_FAILED;
+}
+
+static void
+run_decode_job(void *data)
+{
+    TRACE_SCOPE("decode_asset");
+    asset_t *asset = (asset_t *)data;
+    asset->decode_success = asset->type->decode(asset);
+}
+
+// Starts decoding what the I/O thread read and queues what is decoded for upload.
+static void
+advance_assets()
+{
+    uint32_t indices[ASSET_MAX_ASSETS];
+    uint32_t count;
+    {
+        std::lock_guard<std::mutex> lock(io_mutex);
+        count = read_count;
+        memcpy(indices, read_assets, count * sizeof(uint32_t));
+        read_count = 0;
+    }
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        asset_t *asset = &assets[indices[i]];
+        if (!asset->data)
+        {
+            finish_asset(asset, false);
+            continue;
+        }
+
+        if (!asset->type->decode)
+        {
+            asset->state = ASSET_STATE_UPLOADING;
+            upload_queue[upload_count++] = indices[i];
+            continue;
+        }
+
+        asset->state = ASSET_STATE_DECODING;
+        asset->decode_job.proc = run_decode_job;
+        asset->decode_job.data = asset;
+        run_jobs(&asset->decode_job, 1, &asset->decode_counter);
+        decoding_assets[decoding_count++] = indices[i];
+    }
+
+    for (uint32_t i = 0; i < decoding_count; ++i)
+    {
+        uint32_t index = decoding_assets[i];
+        asset_t *asset = &assets[index];
+        if (asset->decode_counter.count.load(std::memory_order_acquire) > 0) continue;
+
+        decoding_assets[i--] = decoding_assets[--decoding_count];
+        if (!asset->decode_success)
+        {
+            fprintf(stderr, "Failed to decode %s '%s'.\n", asset->type->name, asset->path);
+            finish_asset(asset, false);
+            continue;
+        }
+
+        asset->state = ASSET_STATE_UPLOADING;
+        upload_queue[upload_count++] = index;
+    }
+}
+
+// Most urgent first, oldest first among equals. At least one, so a slow upload still gets through.
+static void
+upload_assets(uint64_t budget_ticks)
+{
+    uint64_t start = glfwGetTimerValue();
+
+    while (upload_count)
+    {
+        uint32_t best = 0;
+        for (uint32_t i = 1; i < upload_count; ++i)
+        {
+            if (assets[upload_queue[i]].priority.load() > assets[upload_queue[best]].priority.load()) best = i;
+        }
+
+        uint32_t index = upload_queue[best];
+        memmove(upload_queue + best, upload_queue + best + 1, (upload_count - best - 1) * sizeof(uint32_t));
+        upload_count--;
+
+        TRACE_SCOPE("upload_asset");
+        asset_t *asset = &assets[index];
+        bool success = !asset->type->upload || asset->type->upload(asset);
+        if (!success) fprintf(stderr, "Failed to upload %s '%s'.\n", asset->type->name, asset->path);
+        finish_asset(asset, success);
+        uploaded_count++;
+
+        if (glfwGetTimerValue() - start >= budget_ticks) break;
+    }
+
+    upload_ms += (float)((glfwGetTimerValue() - start) * ticks_to_seconds * 1000.0);
+}
+
+void
+update_asset_loader()
+{
+    upload_ms = 0.0f;
+    uploaded_count = 0;
+
+    advance_assets();
+    upload_assets(upload_budget_ticks);
+}
+
+bool
+wait_for_assets(asset_id_t *ids, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if (get_asset(ids[i]) && assets[ids[i] - 1].priority.load() < ASSET_PRIORITY_STARTUP)
+        {
+            set_asset_priority(ids[i], ASSET_PRIORITY_STARTUP);
+        }
+    }
+
+    for (;;)
+    {
+        bool done = true;
+        bool failed = false;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            asset_state_t state = get_asset_state(ids[i]);
+            if (state == ASSET_STATE_FAILED) failed = true;
+            else if (state != ASSET_STATE_READY) done = false;
+        }
+        if (done) return !failed;
+
+        advance_assets();
+        upload_assets(UINT64_MAX);
+
+        // Run the decodes rather than wait for a worker to get to them.
+        bool helped = false;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            asset_t *asset = get_asset(ids[i]);
+            if (asset && asset->state.load() == ASSET_STATE_DECODING)
+            {
+                wait_for_jobs(&asset->decode_counter);
+                helped = true;
+            }
+        }
+        if (!helped) std::this_thread::yield();
+    }
+}
+
+asset_loader_stats_t
+get_asset_loader_stats()
+{
+    asset_loader_stats_t stats = {};
+    for (uint32_t i = 0; i < asset_count; ++i)
+    {
+        int state = assets[i].state.load();
+        if (state == ASSET_STATE_QUEUED) stats.queued_count++;
+        else if (state == ASSET_STATE_READY) stats.ready_count++;
+        else if (state == ASSET_STATE_FAILED) stats.failed_count++;
+        else stats.loading_count++;
+    }
+    stats.read_bytes = read_bytes.load(std::memory_order_relaxed);
+    stats.upload_ms = upload_ms;
+    stats.uploaded_count = uploaded_count;
+    return stats;
+}
@@ -0,0 +1,132 @@
+#ifndef ASSET_LOADER_H
+#define ASSET_LOADER_H
+
+#include <stdint.h>
+#include <atomic>
+
+#include "jobs.h"
+
+// Loads assets in three stages so none of them has to happen all at once on the GL thread. One
+// I/O thread reads files, highest priority first, in chunks so a big background file holds up an
+// urgent one by one chunk at most. Decoding runs as a job on the job workers. Whatever needs GL
+// is left to update_asset_loader on the GL thread, which only spends its time budget per frame.
+//
+// What an asset is loaded into is up to its type's procs, the loader only moves it through the
+// states. Assets live until free_asset_loader.
+//
+// Systems that read files their own way, like the texture manager seeking to the levels it needs,
+// queue I/O calls instead. Those run on the same I/O thread in the same priority order, so one
+// thread does all the reading and nothing urgent waits behind background reads elsewhere.
+
+#define ASSET_MAX_ASSETS 256
+#define ASSET_MAX_IO_CALLS 1024 // Queued at once.
+#define ASSET_READ_CHUNK_SIZE (1 << 20)
+
+// 0 is never a valid id.
+typedef uint32_t asset_id_t;
+
+enum asset_state_t
+{
+    ASSET_STATE_QUEUED, // Waiting for the I/O thread.
+    ASSET_STATE_READING,
+    ASSET_STATE_DECODING,
+    ASSET_STATE_UPLOADING, // Waiting for, or in, the GL thread's budget.
+    ASSET_STATE_READY,
+    ASSET_STATE_FAILED,
+};
+
+// Higher goes first, on the I/O thread and for uploads.
+enum asset_priority_t
+{
+    ASSET_PRIORITY_BACKGROUND,
+    ASSET_PRIORITY_NORMAL,
+    ASSET_PRIORITY_VISIBLE,
+    ASSET_PRIORITY_STARTUP, // Needed before the first frame.
+};
+
+struct asset_t;
+
+// Both return false when the asset can't be loaded. A proc that keeps the file contents sets data
+// to NULL, anything left there is freed after the upload.
+typedef bool asset_decode_proc_t(asset_t *asset); // On a job worker, no GL.
+typedef bool asset_upload_proc_t(asset_t *asset); // On the GL thread.
+
+// Does the reading on the I/O thread, hands anything that needs decoding on elsewhere.
+typedef void asset_io_proc_t(void *data);
+
+struct asset_type_t
+{
+    char *name;
+    asset_decode_proc_t *decode; // Optional.
+    asset_upload_proc_t *upload; // Optional.
+};
+
+struct asset_t
+{
+    char *path;
+    asset_type_t *type;
+    void *target;
+
+    // Written by whichever stage has the asset, read anywhere.
+    std::atomic<int> state;
+    std::atomic<int> priority;
+
+    // The whole file, with a zero past the end so text can be used as is.
+    uint8_t *data;
+    uint32_t size;
+
+    // Only touched by the I/O thread while reading.
+    void *file;
+    uint32_t read_size;
+
+    // The I/O request that counts, older ones are stale, and whether the I/O thread is done with
+    // the asset. Guarded by the loader's I/O mutex.
+    uint32_t io_sequence;
+    bool read_finished;
+
+    job_t decode_job;
+    job_counter_t decode_counter;
+    bool decode_success;
+
+    uint64_t queued_ticks;
+    float load_seconds; // From queued to ready.
+};
+
+struct asset_loader_stats_t
+{
+    uint32_t queued_count;
+    uint32_t loading_count; // Reading, decoding or uploading.
+    uint32_t ready_count;
+    uint32_t failed_count;
+    uint64_t read_bytes;
+
+    float upload_ms; // This frame.
+    uint32_t uploaded_count; // This frame.
+};
+
+void init_asset_loader(float upload_budget_ms);
+void free_asset_loader();
+
+// Starts reading path into target, returns 0 when out of assets.
+asset_id_t load_asset(asset_type_t *type, char *path, void *target, asset_priority_t priority);
+
+// Runs proc on the I/O thread, ahead of lower priority reads. False when too many are queued.
+// Calls still queued when the loader is freed never run.
+bool queue_asset_io(asset_io_proc_t *proc, void *data, asset_priority_t priority);
+
+// Only moves assets that aren't uploaded yet, a raised priority takes effect on the next chunk read.
+void set_asset_priority(asset_id_t id, asset_priority_t priority);
+
+asset_state_t get_asset_state(asset_id_t id);
+asset_t *get_asset(asset_id_t id);
+
+// Once per frame on the GL thread: starts decoding what was read and uploads within the budget.
+void update_asset_loader();
+
+// Blocks until every id is ready or failed, ignoring the budget and helping with the decodes.
+// False if any failed.
+bool wait_for_assets(asset_id_t *ids, uint32_t count);
+
+asset_loader_stats_t get_asset_loader_stats();
+
+#endif
@@ -1,23 +1,31 @@
+OUT_IN vec3 normal;
+
 #ifdef VERTEX_SHADER
 
 in vec3 input_position;
 in vec3 input_normal;
 in vec2 input_uv;
 
+uniform mat4 object_to_proj;
+
 void main(void)
 {
-    gl_Position = vec4(input_position, 1.0);
+    gl_Position = object_to_proj * vec4(input_position, 1.0);
+    normal = input_normal;
 }
 
 #endif
 
 #ifdef FRAGMENT_SHADER
 
+uniform vec4 material_color;
+
 out vec4 output_color;
 
 void main(void)
 {
-    output_color = vec4(1.0, 0.5, 0.2, 1.0);
+    float light = 0.3 + 0.7 * max(dot(normalize(normal), normalize(vec3(0.4, 1.0, 0.6))), 0.0);
+    output_color = vec4(material_color.rgb * light, material_color.a);
 }
 
-#endif
\ No newline at end of file
+#endif
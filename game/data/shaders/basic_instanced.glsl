@@ -0,0 +1,35 @@
+OUT_IN vec3 normal;
+
+#ifdef VERTEX_SHADER
+
+in vec3 input_position;
+in vec3 input_normal;
+in vec2 input_uv;
+
+// Columns are the rows of object_to_world, the last row is always (0, 0, 0, 1).
+in mat3x4 input_instance_transform;
+
+uniform mat4 world_to_proj;
+
+void main(void)
+{
+    vec3 world_position = vec4(input_position, 1.0) * input_instance_transform;
+    gl_Position = world_to_proj * vec4(world_position, 1.0);
+    normal = vec4(input_normal, 0.0) * input_instance_transform;
+}
+
+#endif
+
+#ifdef FRAGMENT_SHADER
+
+uniform vec4 material_color;
+
+out vec4 output_color;
+
+void main(void)
+{
+    float light = 0.3 + 0.7 * max(dot(normalize(normal), normalize(vec3(0.4, 1.0, 0.6))), 0.0);
+    output_color = vec4(material_color.rgb * light, material_color.a);
+}
+
+#endif
@@ -0,0 +1,36 @@
+OUT_IN vec2 uv;
+
+#ifdef VERTEX_SHADER
+
+// Fullscreen triangle, no vertex buffer needed.
+void main(void)
+{
+    vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    uv = p;
+    gl_Position = vec4(p * 2.0 - 1.0, 0.0, 1.0);
+}
+
+#endif
+
+#ifdef FRAGMENT_SHADER
+
+uniform sampler2D texture_0;
+uniform vec2 texel_step;
+
+out vec4 output_color;
+
+// 9 tap gaussian along texel_step, run once horizontally and once vertically.
+const float weights[5] = float[](0.227027, 0.1945946, 0.1216216, 0.054054, 0.016216);
+
+void main(void)
+{
+    vec3 color = texture(texture_0, uv).rgb * weights[0];
+    for (int i = 1; i < 5; ++i)
+    {
+        color += texture(texture_0, uv + texel_step * float(i)).rgb * weights[i];
+        color += texture(texture_0, uv - texel_step * float(i)).rgb * weights[i];
+    }
+    output_color = vec4(color, 1.0);
+}
+
+#endif
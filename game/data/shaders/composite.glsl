@@ -0,0 +1,28 @@
+OUT_IN vec2 uv;
+
+#ifdef VERTEX_SHADER
+
+// Fullscreen triangle, no vertex buffer needed.
+void main(void)
+{
+    vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    uv = p;
+    gl_Position = vec4(p * 2.0 - 1.0, 0.0, 1.0);
+}
+
+#endif
+
+#ifdef FRAGMENT_SHADER
+
+uniform sampler2D texture_0;
+uniform sampler2D texture_1;
+
+out vec4 output_color;
+
+void main(void)
+{
+    vec3 color = texture(texture_0, uv).rgb + texture(texture_1, uv).rgb * 0.5;
+    output_color = vec4(color, 1.0);
+}
+
+#endif
@@ -0,0 +1,27 @@
+OUT_IN vec4 color;
+
+#ifdef VERTEX_SHADER
+
+in vec3 input_position;
+in vec4 input_color;
+
+uniform mat4 world_to_proj;
+
+void main(void)
+{
+    gl_Position = world_to_proj * vec4(input_position, 1.0);
+    color = input_color;
+}
+
+#endif
+
+#ifdef FRAGMENT_SHADER
+
+out vec4 output_color;
+
+void main(void)
+{
+    output_color = color;
+}
+
+#endif
@@ -0,0 +1,35 @@
+OUT_IN vec2 uv;
+OUT_IN vec4 color;
+OUT_IN float layer;
+
+#ifdef VERTEX_SHADER
+
+in vec2 input_position;
+in vec2 input_uv;
+in vec4 input_color;
+in float input_layer;
+
+uniform mat4 world_to_proj;
+
+void main(void)
+{
+    gl_Position = world_to_proj * vec4(input_position, 0.0, 1.0);
+    uv = input_uv;
+    color = input_color;
+    layer = input_layer;
+}
+
+#endif
+
+#ifdef FRAGMENT_SHADER
+
+uniform sampler2DArray texture_0;
+
+out vec4 output_color;
+
+void main(void)
+{
+    output_color = texture(texture_0, vec3(uv, layer)) * color;
+}
+
+#endif
@@ -0,0 +1,275 @@
+#include "debug_draw.h"
+
+#if DEBUG_DRAW
+
+#include "gl_state.h"
+#include "shader.h"
+#include "sprite_batch.h"
+#include "stream_buffer.h"
+#include "utils.h"
+
+#include <stdlib.h>
+#include <mutex>
+
+#define DEBUG_VERTEX_OFFSET_position 0
+#define DEBUG_VERTEX_OFFSET_color 12
+
+#define DEBUG_CIRCLE_SEGMENTS 24
+
+struct debug_vertex_t
+{
+    vec3 position;
+    uint32_t color; // RGBA8
+};
+
+struct debug_line_t
+{
+    vec3 a;
+    vec3 b;
+    uint32_t color;
+    float time_left;
+    bool depth_test;
+};
+
+static std::mutex mutex;
+static debug_line_t *lines;
+static uint32_t line_count;
+static uint32_t max_line_count;
+static uint32_t dropped_line_count;
+static debug_draw_stats_t stats;
+
+static shader_t shader;
+static bool shader_loaded;
+static stream_buffer_t vertex_stream;
+
+void
+init_debug_draw(uint32_t max_lines)
+{
+    lines = (debug_line_t *)malloc(max_lines * sizeof(debug_line_t));
+    line_count = 0;
+    max_line_count = max_lines;
+    dropped_line_count = 0;
+    stats = {};
+
+    shader_loaded = load_shader(&shader, "data/shaders/debug_line.glsl");
+    init_stream_buffer(&vertex_stream, GL_ARRAY_BUFFER, max_lines * 2 * sizeof(debug_vertex_t));
+}
+
+void
+free_debug_draw()
+{
+    free_stream_buffer(&vertex_stream);
+
+    free(lines);
+    lines = NULL;
+    line_count = 0;
+    max_line_count = 0;
+}
+
+// Caller holds the mutex.
+static void
+add_line(vec3 a, vec3 b, uint32_t color, float duration, bool depth_test)
+{
+    if (line_count == max_line_count)
+    {
+        dropped_line_count++;
+        return;
+    }
+
+    debug_line_t *line = &lines[line_count++];
+    line->a = a;
+    line->b = b;
+    line->color = color;
+    line->time_left = duration;
+    line->depth_test = depth_test;
+}
+
+void
+debug_line(vec3 a, vec3 b, vec4 color, float duration, bool depth_test)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    add_line(a, b, pack_color(color), duration, depth_test);
+}
+
+void
+debug_box(vec3 min, vec3 max, vec4 color, float duration, bool depth_test)
+{
+    vec3 corners[8];
+    for (int i = 0; i < 8; ++i)
+    {
+        corners[i] = make_vec3((i & 1) ? max.x : min.x, (i & 2) ? max.y : min.y, (i & 4) ? max.z : min.z);
+    }
+
+    // Corners that differ in one bit share an edge.
+    uint32_t packed_color = pack_color(color);
+    std::lock_guard<std::mutex> lock(mutex);
+    for (int i = 0; i < 8; ++i)
+    {
+        for (int bit = 1; bit < 8; bit <<= 1)
+        {
+            if (!(i & bit)) add_line(corners[i], corners[i | bit], packed_color, duration, depth_test);
+        }
+    }
+}
+
+void
+debug_sphere(vec3 center, float radius, vec4 color, float duration, bool depth_test)
+{
+    uint32_t packed_color = pack_color(color);
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // A circle in each axis plane.
+    vec3 previous[3];
+    for (int i = 0; i <= DEBUG_CIRCLE_SEGMENTS; ++i)
+    {
+        float angle = 2.0f * PI32 * i / DEBUG_CIRCLE_SEGMENTS;
+        float c = cosf(angle) * radius;
+        float s = sinf(angle) * radius;
+
+        vec3 points[3] =
+        {
+            center + make_vec3(c, s, 0.0f),
+            center + make_vec3(0.0f, c, s),
+            center + make_vec3(s, 0.0f, c),
+        };
+
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            if (i) add_line(previous[axis], points[axis], packed_color, duration, depth_test);
+            previous[axis] = points[axis];
+        }
+    }
+}
+
+void
+debug_axes(mat4 object_to_world, float size, float duration, bool depth_test)
+{
+    vec3 o = transform_point(object_to_world, make_vec3(0.0f, 0.0f, 0.0f));
+    vec3 x = o + normalize_or_zero(transform_direction(object_to_world, make_vec3(1.0f, 0.0f, 0.0f))) * size;
+    vec3 y = o + normalize_or_zero(transform_direction(object_to_world, make_vec3(0.0f, 1.0f, 0.0f))) * size;
+    vec3 z = o + normalize_or_zero(transform_direction(object_to_world, make_vec3(0.0f, 0.0f, 1.0f))) * size;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    add_line(o, x, pack_color(make_vec4(1.0f, 0.0f, 0.0f, 1.0f)), duration, depth_test);
+    add_line(o, y, pack_color(make_vec4(0.0f, 1.0f, 0.0f, 1.0f)), duration, depth_test);
+    add_line(o, z, pack_color(make_vec4(0.0f, 0.0f, 1.0f, 1.0f)), duration, depth_test);
+}
+
+void
+debug_frustum(mat4 world_to_proj, vec4 color, float duration, bool depth_test)
+{
+    // Corners of the clip cube taken back to world space, in the same bit order as debug_box.
+    mat4 proj_to_world = mat4_inverse(world_to_proj);
+    vec3 corners[8];
+    for (int i = 0; i < 8; ++i)
+    {
+        vec4 p = proj_to_world * make_vec4((i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, (i & 4) ? 1.0f : -1.0f, 1.0f);
+        corners[i] = make_vec3(p.x, p.y, p.z) / p.w;
+    }
+
+    uint32_t packed_color = pack_color(color);
+    std::lock_guard<std::mutex> lock(mutex);
+    for (int i = 0; i < 8; ++i)
+    {
+        for (int bit = 1; bit < 8; bit <<= 1)
+        {
+            if (!(i & bit)) add_line(corners[i], corners[i | bit], packed_color, duration, depth_test);
+        }
+    }
+}
+
+static void
+set_debug_vertex_format(size_t offset)
+{
+    GLint loc = shader.input_position_loc;
+    if (loc != -1)
+    {
+        set_vertex_attrib_pointer(loc, 3, GL_FLOAT, GL_FALSE, sizeof(debug_vertex_t), offset + DEBUG_VERTEX_OFFSET_position);
+        enable_vertex_attrib(loc, true);
+    }
+
+    loc = shader.input_color_loc;
+    if (loc != -1)
+    {
+        set_vertex_attrib_pointer(loc, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(debug_vertex_t), offset + DEBUG_VERTEX_OFFSET_color);
+        enable_vertex_attrib(loc, true);
+    }
+}
+
+void
+flush_debug_draw(mat4 world_to_proj, float dt)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (line_count && shader_loaded)
+    {
+        begin_stream_buffer_frame(&vertex_stream);
+
+        uint32_t offset;
+        debug_vertex_t *vertices = (debug_vertex_t *)map_stream_buffer(&vertex_stream, line_count * 2 * sizeof(debug_vertex_t),
+                                                                       sizeof(debug_vertex_t), &offset);
+        if (vertices)
+        {
+            // Depth tested lines first, then the ones on top.
+            uint32_t depth_tested_count = 0;
+            for (int pass = 0; pass < 2; ++pass)
+            {
+                for (uint32_t i = 0; i < line_count; ++i)
+                {
+                    debug_line_t *line = &lines[i];
+                    if (line->depth_test != (pass == 0)) continue;
+
+                    vertices[0].position = line->a;
+                    vertices[0].color = line->color;
+                    vertices[1].position = line->b;
+                    vertices[1].color = line->color;
+                    vertices += 2;
+
+                    if (pass == 0) depth_tested_count++;
+                }
+            }
+            unmap_stream_buffer(&vertex_stream);
+
+            set_shader(&shader);
+            glUniformMatrix4fv(shader.world_to_proj_loc, 1, GL_TRUE, &world_to_proj._11);
+            bind_buffer(GL_ARRAY_BUFFER, vertex_stream.buffer);
+            set_debug_vertex_format(offset);
+            set_blend_state(true, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+            if (depth_tested_count)
+            {
+                set_depth_state(true, false, GL_LEQUAL);
+                glDrawArrays(GL_LINES, 0, depth_tested_count * 2);
+            }
+
+            if (depth_tested_count < line_count)
+            {
+                set_depth_state(false, false, GL_LEQUAL);
+                glDrawArrays(GL_LINES, depth_tested_count * 2, (line_count - depth_tested_count) * 2);
+            }
+        }
+
+        end_stream_buffer_frame(&vertex_stream);
+    }
+
+    stats.line_count = line_count;
+    stats.dropped_lines = dropped_line_count;
+    dropped_line_count = 0;
+
+    // Age everything, lines for this frame only go negative straight away.
+    for (uint32_t i = 0; i < line_count;)
+    {
+        lines[i].time_left -= dt;
+        if (lines[i].time_left <= 0.0f) lines[i] = lines[--line_count];
+        else i++;
+    }
+}
+
+debug_draw_stats_t
+get_debug_draw_stats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+#endif
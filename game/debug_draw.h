@@ -0,0 +1,59 @@
+#ifndef DEBUG_DRAW_H
+#define DEBUG_DRAW_H
+
+#include <stdint.h>
+
+#include "my_math.h"
+
+// Immediate mode debug lines. Every shape is turned into line segments when it is added and
+// kept for duration seconds (0 is this frame only). flush_debug_draw writes everything into one
+// stream buffer and draws it in two calls, depth tested and on top.
+//
+// Release builds compile all of it out, calls included, so arguments are never evaluated.
+// Shapes can be added from any thread.
+
+#ifdef _DEBUG
+#define DEBUG_DRAW 1
+#endif
+
+#if DEBUG_DRAW
+
+struct debug_draw_stats_t
+{
+    uint32_t line_count;
+    uint32_t dropped_lines;
+};
+
+void init_debug_draw(uint32_t max_lines);
+void free_debug_draw();
+
+void debug_line(vec3 a, vec3 b, vec4 color, float duration = 0.0f, bool depth_test = true);
+void debug_box(vec3 min, vec3 max, vec4 color, float duration = 0.0f, bool depth_test = true);
+void debug_sphere(vec3 center, float radius, vec4 color, float duration = 0.0f, bool depth_test = true);
+
+// The axes of object_to_world, size long in world space whatever its scale. x red, y green, z blue.
+void debug_axes(mat4 object_to_world, float size, float duration = 0.0f, bool depth_test = true);
+
+// The volume world_to_proj maps to the clip cube, e.g. another camera's view_to_proj * world_to_view.
+void debug_frustum(mat4 world_to_proj, vec4 color, float duration = 0.0f, bool depth_test = true);
+
+// Draws into whatever framebuffer is bound and ages the lines by dt.
+void flush_debug_draw(mat4 world_to_proj, float dt);
+
+// Counts of the last flush.
+debug_draw_stats_t get_debug_draw_stats();
+
+#else
+
+#define init_debug_draw(...)
+#define free_debug_draw(...)
+#define debug_line(...)
+#define debug_box(...)
+#define debug_sphere(...)
+#define debug_axes(...)
+#define debug_frustum(...)
+#define flush_debug_draw(...)
+
+#endif
+
+#endif
@@ -0,0 +1,433 @@
+#include "font.h"
+#include "gl_state.h"
+#include "trace.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static uint8_t *
+read_entire_file(char *filepath, uint32_t *out_size)
+{
+    FILE *file = fopen(filepath, "rb");
+    if (!file) return NULL;
+
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    uint8_t *result = NULL;
+    if (length > 0)
+    {
+        result = (uint8_t *)malloc(length);
+        if (fread(result, 1, length, file) != (size_t)length)
+        {
+            free(result);
+            result = NULL;
+        }
+    }
+    fclose(file);
+
+    if (result) *out_size = (uint32_t)length;
+    return result;
+}
+
+bool
+load_font(font_t *font, char *filepath, float pixel_height)
+{
+    TRACE_SCOPE("load_font");
+
+    uint32_t size = 0;
+    uint8_t *file_data = read_entire_file(filepath, &size);
+    if (!file_data)
+    {
+        *font = {};
+        fprintf(stderr, "Failed to read font '%s'.\n", filepath);
+        return false;
+    }
+
+    if (!init_font(font, filepath, file_data, size, pixel_height))
+    {
+        free(file_data);
+        return false;
+    }
+
+    create_font_atlas(font);
+    return true;
+}
+
+bool
+init_font(font_t *font, char *filepath, uint8_t *file_data, uint32_t size, float pixel_height)
+{
+    TRACE_SCOPE("init_font");
+
+    *font = {};
+
+    truetype_font_t *tt = &font->truetype;
+    if (!init_truetype_font(tt, file_data, size))
+    {
+        fprintf(stderr, "'%s' is not a TrueType font this reader understands.\n", filepath);
+        *font = {};
+        return false;
+    }
+    font->file_data = file_data;
+
+    font->pixel_height = pixel_height;
+    font->scale = get_truetype_scale(tt, pixel_height);
+    font->ascent = tt->ascent * font->scale;
+    font->line_height = (float)(int)((tt->ascent - tt->descent + tt->line_gap) * font->scale + 0.5f);
+
+    font->glyphs = (font_glyph_t *)calloc(tt->glyph_count, sizeof(font_glyph_t));
+    for (uint32_t i = 0; i < ARRAY_SIZE(font->ascii_glyphs); ++i)
+    {
+        font->ascii_glyphs[i] = find_glyph_index(tt, i);
+    }
+
+    // Every cell fits the font's bounding box plus a pixel of padding on each side, capped for
+    // fonts with a few oversized glyphs. Widths are a multiple of 4 so uploads keep the default alignment.
+    int max_size = (int)(pixel_height * 2.0f) + 2;
+    font->cell_width = (int)((tt->bounds_max_x - tt->bounds_min_x) * font->scale) + 4;
+    font->cell_height = (int)((tt->bounds_max_y - tt->bounds_min_y) * font->scale) + 4;
+    if (font->cell_width > max_size) font->cell_width = max_size;
+    if (font->cell_height > max_size) font->cell_height = max_size;
+    font->cell_width = (font->cell_width + 3) & ~3;
+
+    font->cells_per_row = FONT_ATLAS_SIZE / font->cell_width;
+    font->cell_count = font->cells_per_row * (FONT_ATLAS_SIZE / font->cell_height);
+    font->cells = (font_cell_t *)malloc(font->cell_count * sizeof(font_cell_t));
+    for (uint32_t i = 0; i < font->cell_count; ++i)
+    {
+        font_cell_t *cell = &font->cells[i];
+        cell->glyph = UINT32_MAX;
+        cell->last_used_frame = 0;
+        cell->prev = (int32_t)i - 1;
+        cell->next = (i + 1 < font->cell_count) ? (int32_t)i + 1 : -1;
+    }
+    font->lru_head = 0;
+    font->lru_tail = font->cell_count - 1;
+    font->cell_pixels = (uint8_t *)malloc(font->cell_width * font->cell_height);
+
+    // Frame 0 marks cells that were never used.
+    font->frame = 1;
+
+    return true;
+}
+
+void
+create_font_atlas(font_t *font)
+{
+    glGenTextures(1, &font->atlas);
+    bind_texture(0, GL_TEXTURE_2D_ARRAY, font->atlas);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R8, FONT_ATLAS_SIZE, FONT_ATLAS_SIZE, 1, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    GLint swizzle[] = { GL_ONE, GL_ONE, GL_ONE, GL_RED };
+    glTexParameteriv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+}
+
+static void
+free_text_run(text_run_t *run)
+{
+    free(run->glyphs);
+    free(run->offsets);
+    free(run->text);
+    *run = {};
+}
+
+void
+free_font(font_t *font)
+{
+    for (uint32_t i = 0; i < FONT_RUN_CACHE_SIZE; ++i)
+    {
+        free_text_run(&font->run_cache[i]);
+    }
+    free_text_run(&font->scratch_run);
+
+    delete_gl_texture(font->atlas);
+    free(font->cell_pixels);
+    free(font->cells);
+    free(font->glyphs);
+    free(font->file_data);
+
+    *font = {};
+}
+
+void
+begin_font_frame(font_t *font)
+{
+    font->frame++;
+    font->stats = {};
+}
+
+static font_glyph_t *
+get_glyph(font_t *font, uint32_t glyph_index)
+{
+    font_glyph_t *glyph = &font->glyphs[glyph_index];
+    if (!glyph->loaded)
+    {
+        int advance;
+        get_glyph_hmetrics(&font->truetype, glyph_index, &advance, NULL);
+
+        int x0, y0, x1, y1;
+        get_glyph_bitmap_box(&font->truetype, glyph_index, font->scale, &x0, &y0, &x1, &y1);
+
+        // Clip to what fits in a cell.
+        if (x1 - x0 > font->cell_width - 2) x1 = x0 + font->cell_width - 2;
+        if (y1 - y0 > font->cell_height - 2) y1 = y0 + font->cell_height - 2;
+
+        glyph->loaded = true;
+        glyph->advance = advance * font->scale;
+        glyph->x0 = (int16_t)x0;
+        glyph->y0 = (int16_t)y0;
+        glyph->x1 = (int16_t)x1;
+        glyph->y1 = (int16_t)y1;
+        glyph->cell = -1;
+    }
+    return glyph;
+}
+
+static void
+unlink_cell(font_t *font, int32_t index)
+{
+    font_cell_t *cell = &font->cells[index];
+    if (cell->prev != -1) font->cells[cell->prev].next = cell->next;
+    else font->lru_head = cell->next;
+    if (cell->next != -1) font->cells[cell->next].prev = cell->prev;
+    else font->lru_tail = cell->prev;
+}
+
+static void
+touch_cell(font_t *font, int32_t index)
+{
+    font_cell_t *cell = &font->cells[index];
+    if (cell->last_used_frame == font->frame) return;
+
+    cell->last_used_frame = font->frame;
+    if (font->lru_head == index) return;
+
+    unlink_cell(font, index);
+    cell->prev = -1;
+    cell->next = font->lru_head;
+    font->cells[font->lru_head].prev = index;
+    font->lru_head = index;
+}
+
+// Returns the glyph's cell, rasterizing it into the least recently used one if needed,
+// or -1 if every cell is already drawn from this frame.
+static int32_t
+get_glyph_cell(font_t *font, uint32_t glyph_index, font_glyph_t *glyph)
+{
+    if (glyph->cell != -1)
+    {
+        touch_cell(font, glyph->cell);
+        return glyph->cell;
+    }
+
+    int32_t index = font->lru_tail;
+    font_cell_t *cell = &font->cells[index];
+    if (cell->last_used_frame == font->frame)
+    {
+        font->stats.glyphs_dropped++;
+        return -1;
+    }
+
+    if (cell->glyph != UINT32_MAX)
+    {
+        font->glyphs[cell->glyph].cell = -1;
+        font->stats.glyphs_evicted++;
+    }
+
+    cell->glyph = glyph_index;
+    glyph->cell = index;
+    touch_cell(font, index);
+
+    // The whole cell goes up so nothing of the previous glyph is left in the padding.
+    int width = glyph->x1 - glyph->x0;
+    int height = glyph->y1 - glyph->y0;
+    memset(font->cell_pixels, 0, font->cell_width * font->cell_height);
+    rasterize_glyph(&font->truetype, glyph_index, font->scale, glyph->x0, glyph->y0,
+                    font->cell_pixels + font->cell_width + 1, width, height, font->cell_width);
+
+    int cell_x = (index % font->cells_per_row) * font->cell_width;
+    int cell_y = (index / font->cells_per_row) * font->cell_height;
+
+    bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    bind_texture(0, GL_TEXTURE_2D_ARRAY, font->atlas);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, cell_x, cell_y, 0, font->cell_width, font->cell_height, 1,
+                    GL_RED, GL_UNSIGNED_BYTE, font->cell_pixels);
+
+    font->stats.glyphs_rasterized++;
+    return index;
+}
+
+// Decodes one UTF-8 sequence, malformed input comes out as U+FFFD one byte at a time.
+static uint32_t
+decode_utf8(char **text)
+{
+    uint8_t *s = (uint8_t *)*text;
+    uint32_t c = s[0];
+    int length = 1;
+
+    if (c >= 0xF8) { *text += 1; return 0xFFFD; }
+    else if (c >= 0xF0) { c &= 0x07; length = 4; }
+    else if (c >= 0xE0) { c &= 0x0F; length = 3; }
+    else if (c >= 0xC0) { c &= 0x1F; length = 2; }
+    else if (c >= 0x80) { *text += 1; return 0xFFFD; }
+
+    for (int i = 1; i < length; ++i)
+    {
+        if ((s[i] & 0xC0) != 0x80)
+        {
+            *text += 1;
+            return 0xFFFD;
+        }
+        c = (c << 6) | (s[i] & 0x3F);
+    }
+
+    // Overlong forms, surrogates and anything past U+10FFFF are malformed too.
+    static const uint32_t smallest[5] = { 0, 0, 0x80, 0x800, 0x10000 };
+    if (c < smallest[length] || (c >= 0xD800 && c <= 0xDFFF) || c > 0x10FFFF)
+    {
+        *text += 1;
+        return 0xFFFD;
+    }
+
+    *text += length;
+    return c;
+}
+
+static void
+shape_text(font_t *font, char *text, text_run_t *run)
+{
+    run->glyph_count = 0;
+
+    float x = 0.0f;
+    float y = 0.0f;
+    float width = 0.0f;
+    uint32_t previous = 0;
+
+    while (*text)
+    {
+        uint32_t codepoint = decode_utf8(&text);
+        if (codepoint == '\n')
+        {
+            if (x > width) width = x;
+            x = 0.0f;
+            y += font->line_height;
+            previous = 0;
+            continue;
+        }
+
+        uint32_t glyph_index = codepoint < ARRAY_SIZE(font->ascii_glyphs) ? font->ascii_glyphs[codepoint]
+                                                                         : find_glyph_index(&font->truetype, codepoint);
+        if (previous) x += get_glyph_kerning(&font->truetype, previous, glyph_index) * font->scale;
+        previous = glyph_index;
+
+        font_glyph_t *glyph = get_glyph(font, glyph_index);
+        if (glyph->x1 > glyph->x0)
+        {
+            if (run->glyph_count == run->glyph_capacity)
+            {
+                run->glyph_capacity = run->glyph_capacity ? run->glyph_capacity * 2 : 64;
+                run->glyphs = (uint32_t *)realloc(run->glyphs, run->glyph_capacity * sizeof(uint32_t));
+                run->offsets = (vec2 *)realloc(run->offsets, run->glyph_capacity * sizeof(vec2));
+            }
+
+            run->glyphs[run->glyph_count] = glyph_index;
+            run->offsets[run->glyph_count] = make_vec2(x, y);
+            run->glyph_count++;
+        }
+
+        x += glyph->advance;
+    }
+
+    if (x > width) width = x;
+    run->size = make_vec2(width, y + font->line_height);
+}
+
+static void
+draw_text_run(sprite_batch_t *batch, font_t *font, vec2 pos, text_run_t *run, vec4 color)
+{
+    float atlas_scale = 1.0f / FONT_ATLAS_SIZE;
+
+    // Pens snap to whole pixels so the glyph bitmaps map one to one onto the screen.
+    pos.y += font->ascent;
+
+    for (uint32_t i = 0; i < run->glyph_count; ++i)
+    {
+        font_glyph_t *glyph = &font->glyphs[run->glyphs[i]];
+
+        int32_t cell = get_glyph_cell(font, run->glyphs[i], glyph);
+        if (cell == -1) continue;
+
+        float x = floorf(pos.x + run->offsets[i].x + 0.5f);
+        float y = floorf(pos.y + run->offsets[i].y + 0.5f);
+        vec2 min = make_vec2(x + glyph->x0, y + glyph->y0);
+        vec2 max = make_vec2(x + glyph->x1, y + glyph->y1);
+
+        float u = (float)((cell % font->cells_per_row) * font->cell_width + 1);
+        float v = (float)((cell / font->cells_per_row) * font->cell_height + 1);
+        vec2 uv_min = make_vec2(u, v) * atlas_scale;
+        vec2 uv_max = make_vec2(u + glyph->x1 - glyph->x0, v + glyph->y1 - glyph->y0) * atlas_scale;
+
+        if (!draw_sprite(batch, font->atlas, 0.0f, min, max, uv_min, uv_max, color)) break;
+        font->stats.glyphs_drawn++;
+    }
+}
+
+void
+draw_text(sprite_batch_t *batch, font_t *font, vec2 pos, char *text, vec4 color)
+{
+    shape_text(font, text, &font->scratch_run);
+    draw_text_run(batch, font, pos, &font->scratch_run, color);
+}
+
+static uint32_t
+hash_text(char *text)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (uint8_t *s = (uint8_t *)text; *s; ++s)
+    {
+        hash ^= *s;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+void
+draw_cached_text(sprite_batch_t *batch, font_t *font, vec2 pos, char *text, vec4 color)
+{
+    uint32_t hash = hash_text(text);
+    text_run_t *run = &font->run_cache[hash % FONT_RUN_CACHE_SIZE];
+
+    if (run->text && run->hash == hash && strcmp(run->text, text) == 0)
+    {
+        font->stats.run_hits++;
+    }
+    else
+    {
+        // Direct mapped, a collision just replaces the old run.
+        font->stats.run_misses++;
+
+        size_t length = strlen(text);
+        run->text = (char *)realloc(run->text, length + 1);
+        memcpy(run->text, text, length + 1);
+        run->hash = hash;
+        shape_text(font, text, run);
+    }
+
+    draw_text_run(batch, font, pos, run, color);
+}
+
+vec2
+measure_text(font_t *font, char *text)
+{
+    shape_text(font, text, &font->scratch_run);
+    return font->scratch_run.size;
+}
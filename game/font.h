@@ -0,0 +1,117 @@
+#ifndef FONT_H
+#define FONT_H
+
+#include <GL/glew.h>
+#include <stdint.h>
+
+#include "my_math.h"
+#include "sprite_batch.h"
+#include "truetype.h"
+
+// Text drawn through the sprite batch. Glyphs are rasterized the first time they are drawn into
+// fixed size cells of a single channel atlas, swizzled so the sprite shader reads it as white
+// with coverage in alpha. When the atlas is full the least recently drawn glyph gives up its cell.
+// Shaping is trivial (cmap, advance, kern pairs), strings that don't change can keep their
+// shaped run in a small cache so drawing them is a hash and a copy into the batch.
+
+#define FONT_ATLAS_SIZE 1024
+#define FONT_RUN_CACHE_SIZE 256
+
+struct font_glyph_t
+{
+    bool loaded;
+    float advance;
+
+    // Bitmap box relative to the pen on the baseline, y down.
+    int16_t x0, y0, x1, y1;
+
+    // Atlas cell, -1 if not resident.
+    int32_t cell;
+};
+
+struct font_cell_t
+{
+    uint32_t glyph;
+    uint32_t last_used_frame;
+
+    // LRU list, most recently used first.
+    int32_t prev;
+    int32_t next;
+};
+
+// A shaped string, glyph indices and pen offsets from the top left of the text.
+struct text_run_t
+{
+    uint32_t *glyphs;
+    vec2 *offsets;
+    uint32_t glyph_count;
+    uint32_t glyph_capacity;
+    vec2 size;
+
+    // Only for cached runs.
+    uint32_t hash;
+    char *text;
+};
+
+struct font_stats_t
+{
+    uint32_t glyphs_drawn;
+    uint32_t glyphs_rasterized;
+    uint32_t glyphs_evicted;
+    uint32_t glyphs_dropped; // Every cell already used this frame.
+    uint32_t run_hits;
+    uint32_t run_misses;
+};
+
+struct font_t
+{
+    uint8_t *file_data;
+    truetype_font_t truetype;
+
+    float pixel_height;
+    float scale;
+    float ascent;
+    float line_height;
+
+    font_glyph_t *glyphs;
+    uint32_t ascii_glyphs[128];
+
+    GLuint atlas;
+    int cell_width;
+    int cell_height;
+    int cells_per_row;
+    uint32_t cell_count;
+    font_cell_t *cells;
+    int32_t lru_head;
+    int32_t lru_tail;
+    uint8_t *cell_pixels;
+
+    uint32_t frame;
+
+    text_run_t scratch_run;
+    text_run_t run_cache[FONT_RUN_CACHE_SIZE];
+
+    font_stats_t stats;
+};
+
+bool load_font(font_t *font, char *filepath, float pixel_height);
+
+// load_font in two steps, for loading in the background. init_font parses the file and sets up
+// the glyph tables without touching GL, and keeps file_data when it succeeds. create_font_atlas
+// then makes the atlas on the GL thread, the font can't be drawn before.
+bool init_font(font_t *font, char *filepath, uint8_t *file_data, uint32_t size, float pixel_height);
+void create_font_atlas(font_t *font);
+void free_font(font_t *font);
+
+// Starts a new frame for eviction purposes, call before the first draw_text of the frame.
+void begin_font_frame(font_t *font);
+
+// pos is the top left of the first line, text is UTF-8 and may contain '\n'.
+void draw_text(sprite_batch_t *batch, font_t *font, vec2 pos, char *text, vec4 color);
+
+// Same as draw_text but keeps the shaped run around, for strings that are drawn every frame.
+void draw_cached_text(sprite_batch_t *batch, font_t *font, vec2 pos, char *text, vec4 color);
+
+vec2 measure_text(font_t *font, char *text);
+
+#endif
@@ -0,0 +1,481 @@
+#include "frame_graph.h"
+#include "gl_state.h"
+#include "profiler.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <string.h>
+
+struct texture_format_info_t
+{
+    GLenum internal_format;
+    GLenum format;
+    GLenum type;
+    uint32_t bytes_per_pixel;
+};
+
+static texture_format_info_t texture_formats[] =
+{
+    { GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, 4 },
+    { GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT, 8 },
+    { GL_RGBA32F, GL_RGBA, GL_FLOAT, 16 },
+    { GL_R11F_G11F_B10F, GL_RGB, GL_FLOAT, 4 },
+    { GL_RG16F, GL_RG, GL_HALF_FLOAT, 4 },
+    { GL_R16F, GL_RED, GL_HALF_FLOAT, 2 },
+    { GL_R8, GL_RED, GL_UNSIGNED_BYTE, 1 },
+    { GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, 4 },
+    { GL_DEPTH_COMPONENT32F, GL_DEPTH_COMPONENT, GL_FLOAT, 4 },
+    { GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, 4 },
+};
+
+static texture_format_info_t *
+get_texture_format_info(GLenum internal_format)
+{
+    for (uint32_t i = 0; i < ARRAY_SIZE(texture_formats); ++i)
+    {
+        if (texture_formats[i].internal_format == internal_format) return &texture_formats[i];
+    }
+
+    ASSERT(!"Unsupported frame graph texture format");
+    return &texture_formats[0];
+}
+
+static bool
+is_depth_format(GLenum internal_format)
+{
+    return internal_format == GL_DEPTH_COMPONENT24 || internal_format == GL_DEPTH_COMPONENT32F || internal_format == GL_DEPTH24_STENCIL8;
+}
+
+static uint64_t
+get_texture_bytes(frame_graph_texture_desc_t desc)
+{
+    return (uint64_t)desc.width * desc.height * get_texture_format_info(desc.internal_format)->bytes_per_pixel;
+}
+
+static bool
+descs_match(frame_graph_texture_desc_t a, frame_graph_texture_desc_t b)
+{
+    return a.width == b.width && a.height == b.height && a.internal_format == b.internal_format;
+}
+
+void
+init_frame_graph(frame_graph_t *graph)
+{
+    *graph = {};
+}
+
+static void
+delete_framebuffer_at(frame_graph_t *graph, int index)
+{
+    delete_gl_framebuffer(graph->framebuffers[index].framebuffer);
+    graph->framebuffers[index] = graph->framebuffers[--graph->framebuffer_count];
+}
+
+static void
+delete_texture_at(frame_graph_t *graph, int index)
+{
+    GLuint texture = graph->textures[index].texture;
+
+    // Framebuffers that use it are useless now.
+    for (int i = 0; i < graph->framebuffer_count;)
+    {
+        frame_graph_framebuffer_t *framebuffer = &graph->framebuffers[i];
+
+        bool uses_texture = false;
+        for (int a = 0; a < framebuffer->attachment_count; ++a)
+        {
+            if (framebuffer->attachments[a] == texture) uses_texture = true;
+        }
+
+        if (uses_texture) delete_framebuffer_at(graph, i);
+        else i++;
+    }
+
+    delete_gl_texture(texture);
+    graph->textures[index] = graph->textures[--graph->texture_count];
+}
+
+void
+free_frame_graph(frame_graph_t *graph)
+{
+    while (graph->texture_count) delete_texture_at(graph, 0);
+    while (graph->framebuffer_count) delete_framebuffer_at(graph, 0);
+
+    *graph = {};
+}
+
+void
+begin_frame_graph(frame_graph_t *graph)
+{
+    graph->frame_index++;
+    graph->pass_count = 0;
+    graph->resource_count = 0;
+    graph->compiled = false;
+    graph->stats = {};
+}
+
+static frame_graph_resource_t
+add_resource(frame_graph_t *graph, char *name, frame_graph_texture_desc_t desc, bool imported)
+{
+    ASSERT(graph->resource_count < FRAME_GRAPH_MAX_RESOURCES);
+
+    frame_graph_resource_info_t *resource = &graph->resources[graph->resource_count++];
+    *resource = {};
+    resource->name = name;
+    resource->desc = desc;
+    resource->imported = imported;
+    resource->first_pass = -1;
+    resource->last_pass = -1;
+    resource->texture_index = -1;
+
+    return graph->resource_count;
+}
+
+static frame_graph_resource_info_t *
+get_resource(frame_graph_t *graph, frame_graph_resource_t resource)
+{
+    ASSERT(resource > 0 && resource <= (frame_graph_resource_t)graph->resource_count);
+    return &graph->resources[resource - 1];
+}
+
+frame_graph_resource_t
+import_backbuffer(frame_graph_t *graph, int width, int height)
+{
+    frame_graph_texture_desc_t desc = {};
+    desc.width = width;
+    desc.height = height;
+
+    return add_resource(graph, "backbuffer", desc, true);
+}
+
+int
+add_frame_graph_pass(frame_graph_t *graph, char *name, frame_graph_execute_proc_t *execute, void *data)
+{
+    ASSERT(graph->pass_count < FRAME_GRAPH_MAX_PASSES);
+
+    frame_graph_pass_t *pass = &graph->passes[graph->pass_count];
+    *pass = {};
+    pass->name = name;
+    pass->execute = execute;
+    pass->data = data;
+
+    return graph->pass_count++;
+}
+
+frame_graph_resource_t
+create_pass_texture(frame_graph_t *graph, int pass, char *name, frame_graph_texture_desc_t desc)
+{
+    frame_graph_resource_t result = add_resource(graph, name, desc, false);
+    write_pass_texture(graph, pass, result);
+    return result;
+}
+
+void
+read_pass_texture(frame_graph_t *graph, int pass, frame_graph_resource_t resource)
+{
+    frame_graph_pass_t *p = &graph->passes[pass];
+    ASSERT(p->read_count < FRAME_GRAPH_MAX_PASS_READS);
+
+    p->reads[p->read_count++] = resource;
+    get_resource(graph, resource)->reader_count++;
+}
+
+void
+write_pass_texture(frame_graph_t *graph, int pass, frame_graph_resource_t resource)
+{
+    frame_graph_pass_t *p = &graph->passes[pass];
+    ASSERT(p->write_count < FRAME_GRAPH_MAX_PASS_WRITES);
+
+    p->writes[p->write_count++] = resource;
+}
+
+void
+set_pass_side_effects(frame_graph_t *graph, int pass)
+{
+    graph->passes[pass].has_side_effects = true;
+}
+
+// Walks back from resources nobody reads, a pass goes once none of its outputs are read.
+static void
+cull_passes(frame_graph_t *graph)
+{
+    uint32_t reader_counts[FRAME_GRAPH_MAX_RESOURCES];
+    frame_graph_resource_t stack[FRAME_GRAPH_MAX_RESOURCES];
+    int stack_count = 0;
+
+    for (int i = 0; i < graph->resource_count; ++i)
+    {
+        frame_graph_resource_info_t *resource = &graph->resources[i];
+        reader_counts[i] = resource->reader_count;
+
+        if (!resource->imported && !resource->reader_count) stack[stack_count++] = i + 1;
+    }
+
+    for (int i = 0; i < graph->pass_count; ++i)
+    {
+        frame_graph_pass_t *pass = &graph->passes[i];
+        pass->output_refs = pass->write_count;
+        pass->culled = false;
+    }
+
+    while (stack_count)
+    {
+        frame_graph_resource_t unused = stack[--stack_count];
+
+        for (int i = 0; i < graph->pass_count; ++i)
+        {
+            frame_graph_pass_t *pass = &graph->passes[i];
+            if (pass->culled || pass->has_side_effects) continue;
+
+            for (int w = 0; w < pass->write_count; ++w)
+            {
+                if (pass->writes[w] != unused) continue;
+
+                if (--pass->output_refs == 0)
+                {
+                    pass->culled = true;
+
+                    for (int r = 0; r < pass->read_count; ++r)
+                    {
+                        frame_graph_resource_t read = pass->reads[r];
+                        if (--reader_counts[read - 1] == 0 && !get_resource(graph, read)->imported) stack[stack_count++] = read;
+                    }
+                }
+            }
+        }
+    }
+}
+
+static int
+acquire_texture(frame_graph_t *graph, frame_graph_texture_desc_t desc)
+{
+    for (int i = 0; i < graph->texture_count; ++i)
+    {
+        frame_graph_texture_t *texture = &graph->textures[i];
+        if (!texture->in_use && descs_match(texture->desc, desc))
+        {
+            texture->in_use = true;
+            texture->last_used_frame = graph->frame_index;
+            return i;
+        }
+    }
+
+    ASSERT(graph->texture_count < FRAME_GRAPH_MAX_TEXTURES);
+
+    int index = graph->texture_count++;
+    frame_graph_texture_t *texture = &graph->textures[index];
+    texture->desc = desc;
+    texture->in_use = true;
+    texture->last_used_frame = graph->frame_index;
+
+    texture_format_info_t *format = get_texture_format_info(desc.internal_format);
+    GLint filter = is_depth_format(desc.internal_format) ? GL_NEAREST : GL_LINEAR;
+
+    glGenTextures(1, &texture->texture);
+    bind_texture(0, GL_TEXTURE_2D, texture->texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, desc.internal_format, desc.width, desc.height, 0, format->format, format->type, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    return index;
+}
+
+void
+compile_frame_graph(frame_graph_t *graph)
+{
+    cull_passes(graph);
+
+    frame_graph_stats_t *stats = &graph->stats;
+    stats->pass_count = graph->pass_count;
+
+    for (int i = 0; i < graph->pass_count; ++i)
+    {
+        frame_graph_pass_t *pass = &graph->passes[i];
+        if (pass->culled)
+        {
+            stats->culled_pass_count++;
+            continue;
+        }
+
+        frame_graph_resource_t *lists[2] = { pass->reads, pass->writes };
+        int counts[2] = { pass->read_count, pass->write_count };
+        for (int l = 0; l < 2; ++l)
+        {
+            for (int j = 0; j < counts[l]; ++j)
+            {
+                frame_graph_resource_info_t *resource = get_resource(graph, lists[l][j]);
+                if (resource->first_pass == -1) resource->first_pass = i;
+                resource->last_pass = i;
+            }
+        }
+    }
+
+    // Retire textures and framebuffers that haven't been needed for a while. Has to happen before
+    // allocating, deleting moves textures around.
+    for (int i = 0; i < graph->texture_count;)
+    {
+        if (graph->frame_index - graph->textures[i].last_used_frame > FRAME_GRAPH_TEXTURE_RETIRE_FRAMES) delete_texture_at(graph, i);
+        else i++;
+    }
+    for (int i = 0; i < graph->framebuffer_count;)
+    {
+        if (graph->frame_index - graph->framebuffers[i].last_used_frame > FRAME_GRAPH_TEXTURE_RETIRE_FRAMES) delete_framebuffer_at(graph, i);
+        else i++;
+    }
+
+    for (int i = 0; i < graph->texture_count; ++i) graph->textures[i].in_use = false;
+
+    // Hand out textures at first use and take them back after last use. A texture released by
+    // pass i is only reused from pass i + 1 on, so a pass never reads and writes the same texture.
+    for (int i = 0; i < graph->pass_count; ++i)
+    {
+        if (graph->passes[i].culled) continue;
+
+        for (int r = 0; r < graph->resource_count; ++r)
+        {
+            frame_graph_resource_info_t *resource = &graph->resources[r];
+            if (resource->imported || resource->first_pass != i) continue;
+
+            resource->texture_index = acquire_texture(graph, resource->desc);
+
+            stats->transient_count++;
+            stats->transient_bytes += get_texture_bytes(resource->desc);
+        }
+
+        for (int r = 0; r < graph->resource_count; ++r)
+        {
+            frame_graph_resource_info_t *resource = &graph->resources[r];
+            if (resource->imported || resource->last_pass != i) continue;
+
+            graph->textures[resource->texture_index].in_use = false;
+        }
+    }
+
+    for (int i = 0; i < graph->texture_count; ++i)
+    {
+        if (graph->textures[i].last_used_frame != graph->frame_index) continue;
+
+        stats->physical_count++;
+        stats->physical_bytes += get_texture_bytes(graph->textures[i].desc);
+    }
+
+    graph->compiled = true;
+}
+
+static GLuint
+get_framebuffer(frame_graph_t *graph, GLuint *attachments, GLenum *formats, int attachment_count)
+{
+    for (int i = 0; i < graph->framebuffer_count; ++i)
+    {
+        frame_graph_framebuffer_t *framebuffer = &graph->framebuffers[i];
+        if (framebuffer->attachment_count != attachment_count) continue;
+        if (memcmp(framebuffer->attachments, attachments, attachment_count * sizeof(GLuint))) continue;
+
+        framebuffer->last_used_frame = graph->frame_index;
+        return framebuffer->framebuffer;
+    }
+
+    if (graph->framebuffer_count == FRAME_GRAPH_MAX_FRAMEBUFFERS)
+    {
+        // Throw out the least recently used one.
+        int oldest = 0;
+        for (int i = 1; i < graph->framebuffer_count; ++i)
+        {
+            if (graph->framebuffers[i].last_used_frame < graph->framebuffers[oldest].last_used_frame) oldest = i;
+        }
+        delete_framebuffer_at(graph, oldest);
+    }
+
+    frame_graph_framebuffer_t *framebuffer = &graph->framebuffers[graph->framebuffer_count++];
+    memcpy(framebuffer->attachments, attachments, attachment_count * sizeof(GLuint));
+    framebuffer->attachment_count = attachment_count;
+    framebuffer->last_used_frame = graph->frame_index;
+
+    glGenFramebuffers(1, &framebuffer->framebuffer);
+    bind_framebuffer(framebuffer->framebuffer);
+
+    GLenum draw_buffers[FRAME_GRAPH_MAX_PASS_WRITES];
+    int color_count = 0;
+    for (int i = 0; i < attachment_count; ++i)
+    {
+        GLenum attachment;
+        if (formats[i] == GL_DEPTH24_STENCIL8) attachment = GL_DEPTH_STENCIL_ATTACHMENT;
+        else if (is_depth_format(formats[i])) attachment = GL_DEPTH_ATTACHMENT;
+        else
+        {
+            attachment = GL_COLOR_ATTACHMENT0 + color_count;
+            draw_buffers[color_count++] = attachment;
+        }
+
+        glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, attachments[i], 0);
+    }
+
+    if (color_count) glDrawBuffers(color_count, draw_buffers);
+    else glDrawBuffer(GL_NONE);
+
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE)
+    {
+        fprintf(stderr, "Frame graph framebuffer is incomplete (0x%x).\n", status);
+    }
+
+    return framebuffer->framebuffer;
+}
+
+void
+execute_frame_graph(frame_graph_t *graph)
+{
+    ASSERT(graph->compiled);
+
+    for (int i = 0; i < graph->pass_count; ++i)
+    {
+        frame_graph_pass_t *pass = &graph->passes[i];
+        if (pass->culled) continue;
+
+        if (pass->write_count)
+        {
+            frame_graph_resource_info_t *first = get_resource(graph, pass->writes[0]);
+
+            if (first->imported)
+            {
+                ASSERT(pass->write_count == 1);
+                bind_framebuffer(0);
+            }
+            else
+            {
+                GLuint attachments[FRAME_GRAPH_MAX_PASS_WRITES];
+                GLenum formats[FRAME_GRAPH_MAX_PASS_WRITES];
+                for (int w = 0; w < pass->write_count; ++w)
+                {
+                    frame_graph_resource_info_t *resource = get_resource(graph, pass->writes[w]);
+                    ASSERT(!resource->imported);
+                    ASSERT(resource->desc.width == first->desc.width && resource->desc.height == first->desc.height);
+
+                    attachments[w] = graph->textures[resource->texture_index].texture;
+                    formats[w] = resource->desc.internal_format;
+                }
+
+                bind_framebuffer(get_framebuffer(graph, attachments, formats, pass->write_count));
+            }
+
+            set_viewport(0, 0, first->desc.width, first->desc.height);
+        }
+
+        begin_profile_scope(pass->name);
+        pass->execute(graph, pass->data);
+        end_profile_scope();
+    }
+
+    bind_framebuffer(0);
+}
+
+GLuint
+get_frame_graph_texture(frame_graph_t *graph, frame_graph_resource_t resource)
+{
+    frame_graph_resource_info_t *info = get_resource(graph, resource);
+    if (info->imported || info->texture_index == -1) return 0;
+
+    return graph->textures[info->texture_index].texture;
+}
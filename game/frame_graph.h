@@ -0,0 +1,154 @@
+#ifndef FRAME_GRAPH_H
+#define FRAME_GRAPH_H
+
+#include <GL/glew.h>
+#include <stdint.h>
+
+// Frame graph: every frame the passes are declared up front with the textures they read and write,
+// then compile_frame_graph drops passes whose output nobody reads, works out how long every
+// transient texture lives and gives it a physical texture from a pool. Transients whose lifetimes
+// don't overlap share a physical texture, so adding passes doesn't add VRAM unless they are live
+// at the same time.
+//
+// Passes run in declaration order, a read sees the last write declared before it.
+// Physical textures and framebuffers persist across frames, begin_frame_graph only resets the declarations.
+
+#define FRAME_GRAPH_MAX_PASSES 32
+#define FRAME_GRAPH_MAX_RESOURCES 64
+#define FRAME_GRAPH_MAX_PASS_READS 8
+#define FRAME_GRAPH_MAX_PASS_WRITES 5
+#define FRAME_GRAPH_MAX_TEXTURES 32
+#define FRAME_GRAPH_MAX_FRAMEBUFFERS 32
+
+// Physical textures that go unused for this many frames are freed, e.g. after a resize.
+#define FRAME_GRAPH_TEXTURE_RETIRE_FRAMES 8
+
+struct frame_graph_t;
+
+typedef void frame_graph_execute_proc_t(frame_graph_t *graph, void *data);
+
+// Index + 1, 0 is no resource.
+typedef uint32_t frame_graph_resource_t;
+
+struct frame_graph_texture_desc_t
+{
+    int width;
+    int height;
+
+    // Depth formats are attached as the depth attachment, everything else as a color attachment.
+    GLenum internal_format;
+};
+
+struct frame_graph_resource_info_t
+{
+    char *name;
+    frame_graph_texture_desc_t desc;
+
+    // The backbuffer is imported, it has no texture and is never culled.
+    bool imported;
+
+    int first_pass;
+    int last_pass;
+    uint32_t reader_count;
+
+    // Set by compile_frame_graph.
+    int texture_index;
+};
+
+struct frame_graph_pass_t
+{
+    char *name;
+    frame_graph_execute_proc_t *execute;
+    void *data;
+
+    frame_graph_resource_t reads[FRAME_GRAPH_MAX_PASS_READS];
+    int read_count;
+
+    frame_graph_resource_t writes[FRAME_GRAPH_MAX_PASS_WRITES];
+    int write_count;
+
+    // Passes with side effects (readbacks, queries) run even if nothing reads what they write.
+    bool has_side_effects;
+
+    uint32_t output_refs;
+    bool culled;
+};
+
+struct frame_graph_texture_t
+{
+    GLuint texture;
+    frame_graph_texture_desc_t desc;
+
+    bool in_use;
+    uint32_t last_used_frame;
+};
+
+struct frame_graph_framebuffer_t
+{
+    GLuint framebuffer;
+    GLuint attachments[FRAME_GRAPH_MAX_PASS_WRITES];
+    int attachment_count;
+
+    uint32_t last_used_frame;
+};
+
+struct frame_graph_stats_t
+{
+    uint32_t pass_count;
+    uint32_t culled_pass_count;
+
+    uint32_t transient_count;
+    uint32_t physical_count;
+
+    // What the transients would take without aliasing, and what the physical textures take.
+    uint64_t transient_bytes;
+    uint64_t physical_bytes;
+};
+
+struct frame_graph_t
+{
+    uint32_t frame_index;
+
+    frame_graph_pass_t passes[FRAME_GRAPH_MAX_PASSES];
+    int pass_count;
+
+    frame_graph_resource_info_t resources[FRAME_GRAPH_MAX_RESOURCES];
+    int resource_count;
+
+    frame_graph_texture_t textures[FRAME_GRAPH_MAX_TEXTURES];
+    int texture_count;
+
+    frame_graph_framebuffer_t framebuffers[FRAME_GRAPH_MAX_FRAMEBUFFERS];
+    int framebuffer_count;
+
+    bool compiled;
+    frame_graph_stats_t stats;
+};
+
+void init_frame_graph(frame_graph_t *graph);
+void free_frame_graph(frame_graph_t *graph);
+
+void begin_frame_graph(frame_graph_t *graph);
+
+frame_graph_resource_t import_backbuffer(frame_graph_t *graph, int width, int height);
+
+// Returns the pass index.
+int add_frame_graph_pass(frame_graph_t *graph, char *name, frame_graph_execute_proc_t *execute, void *data);
+
+// Declares a new transient texture written by pass.
+frame_graph_resource_t create_pass_texture(frame_graph_t *graph, int pass, char *name, frame_graph_texture_desc_t desc);
+
+void read_pass_texture(frame_graph_t *graph, int pass, frame_graph_resource_t resource);
+void write_pass_texture(frame_graph_t *graph, int pass, frame_graph_resource_t resource);
+void set_pass_side_effects(frame_graph_t *graph, int pass);
+
+// Culls, computes lifetimes and assigns physical textures.
+void compile_frame_graph(frame_graph_t *graph);
+
+// Runs the surviving passes, each one with its framebuffer and viewport already set.
+void execute_frame_graph(frame_graph_t *graph);
+
+// Only valid while the graph executes.
+GLuint get_frame_graph_texture(frame_graph_t *graph, frame_graph_resource_t resource);
+
+#endif
@@ -0,0 +1,184 @@
+#include "frame_pacing.h"
+#include "utils.h"
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <mmsystem.h>
+#endif
+
+// Sleeps are timed this many at a time before older ones start to weigh less, so the estimate
+// follows the system when it changes.
+#define SLEEP_SAMPLES 64
+
+void
+init_frame_pacer(frame_pacer_t *pacer, vsync_mode_t vsync_mode, float target_fps)
+{
+    memset(pacer, 0, sizeof(*pacer));
+
+#ifdef _WIN32
+    // Sleeps are otherwise rounded up to the 15.6 ms scheduler tick.
+    timeBeginPeriod(1);
+#endif
+
+    pacer->ticks_to_seconds = 1.0 / (double)glfwGetTimerFrequency();
+    pacer->frame_ticks = glfwGetTimerValue();
+    pacer->last_ticks = pacer->frame_ticks;
+
+    // Pessimistic until the first sleep has been timed.
+    pacer->sleep_mean = 0.005;
+
+    pacer->has_swap_tear = glfwExtensionSupported("WGL_EXT_swap_control_tear") ||
+                           glfwExtensionSupported("GLX_EXT_swap_control_tear");
+
+    set_vsync_mode(pacer, vsync_mode);
+    set_target_fps(pacer, target_fps);
+}
+
+void
+free_frame_pacer(frame_pacer_t *pacer)
+{
+#ifdef _WIN32
+    timeEndPeriod(1);
+#endif
+    memset(pacer, 0, sizeof(*pacer));
+}
+
+void
+set_vsync_mode(frame_pacer_t *pacer, vsync_mode_t vsync_mode)
+{
+    pacer->vsync_mode = vsync_mode;
+
+    if (vsync_mode == VSYNC_ADAPTIVE && pacer->has_swap_tear) glfwSwapInterval(-1);
+    else if (vsync_mode == VSYNC_OFF) glfwSwapInterval(0);
+    else glfwSwapInterval(1);
+}
+
+void
+set_target_fps(frame_pacer_t *pacer, float target_fps)
+{
+    pacer->target_ticks = target_fps > 0.0f ? (uint64_t)(1.0 / (target_fps * pacer->ticks_to_seconds)) : 0;
+}
+
+static void
+add_sleep_sample(frame_pacer_t *pacer, double seconds)
+{
+    if (pacer->sleep_count == SLEEP_SAMPLES)
+    {
+        pacer->sleep_count /= 2;
+        pacer->sleep_m2 /= 2.0;
+    }
+
+    // Welford.
+    pacer->sleep_count++;
+    double delta = seconds - pacer->sleep_mean;
+    pacer->sleep_mean += delta / pacer->sleep_count;
+    pacer->sleep_m2 += delta * (seconds - pacer->sleep_mean);
+}
+
+static void
+wait_until(frame_pacer_t *pacer, uint64_t deadline)
+{
+    // Sleep while even a slow sleep ends before the deadline.
+    for (;;)
+    {
+        uint64_t now = glfwGetTimerValue();
+        if (now >= deadline) return;
+
+        double remaining = (deadline - now) * pacer->ticks_to_seconds;
+        double deviation = pacer->sleep_count > 1 ? sqrt(pacer->sleep_m2 / (pacer->sleep_count - 1)) : 0.0;
+        if (remaining <= pacer->sleep_mean + deviation) break;
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        add_sleep_sample(pacer, (glfwGetTimerValue() - now) * pacer->ticks_to_seconds);
+    }
+
+    // Spin the rest, yielding in case something else wants the core.
+    while (glfwGetTimerValue() < deadline) std::this_thread::yield();
+}
+
+float
+pace_frame(frame_pacer_t *pacer)
+{
+    if (pacer->target_ticks)
+    {
+        uint64_t deadline = pacer->frame_ticks + pacer->target_ticks;
+        wait_until(pacer, deadline);
+
+        // Stay on the grid of deadlines when a frame was only a little late, so a late frame is
+        // made up by the next one. A frame more than a whole target late starts over from now.
+        uint64_t now = glfwGetTimerValue();
+        pacer->frame_ticks = now - deadline < pacer->target_ticks ? deadline : now;
+    }
+    else
+    {
+        pacer->frame_ticks = glfwGetTimerValue();
+    }
+
+    uint64_t now = glfwGetTimerValue();
+    float seconds = (float)((now - pacer->last_ticks) * pacer->ticks_to_seconds);
+    pacer->last_ticks = now;
+
+    pacer->frame_ms[pacer->frame_count % FRAME_PACING_HISTORY] = seconds * 1000.0f;
+    pacer->frame_count++;
+
+    return seconds;
+}
+
+static int
+compare_floats(const void *a, const void *b)
+{
+    float fa = *(float *)a;
+    float fb = *(float *)b;
+    return (fa < fb) ? -1 : (fa > fb) ? 1 : 0;
+}
+
+frame_pacing_stats_t
+get_frame_pacing_stats(frame_pacer_t *pacer)
+{
+    frame_pacing_stats_t stats = {};
+
+    // The first entry is the time to the first frame, not a frame.
+    uint32_t count = pacer->frame_count < FRAME_PACING_HISTORY ? pacer->frame_count : FRAME_PACING_HISTORY;
+    uint32_t first = pacer->frame_count <= FRAME_PACING_HISTORY ? 1 : 0;
+    if (count <= first) return stats;
+
+    float sorted[FRAME_PACING_HISTORY];
+    uint32_t sorted_count = 0;
+    double total = 0.0;
+    for (uint32_t i = first; i < count; ++i)
+    {
+        sorted[sorted_count++] = pacer->frame_ms[i];
+        total += pacer->frame_ms[i];
+    }
+    qsort(sorted, sorted_count, sizeof(float), compare_floats);
+
+    stats.frame_count = sorted_count;
+    stats.average_ms = (float)(total / sorted_count);
+    stats.p50_ms = sorted[(sorted_count - 1) * 50 / 100];
+    stats.p95_ms = sorted[(sorted_count - 1) * 95 / 100];
+    stats.p99_ms = sorted[(sorted_count - 1) * 99 / 100];
+    stats.max_ms = sorted[sorted_count - 1];
+    return stats;
+}
+
+char *
+get_vsync_mode_name(vsync_mode_t vsync_mode)
+{
+    switch (vsync_mode)
+    {
+        case VSYNC_OFF: return "off";
+        case VSYNC_ON: return "on";
+        case VSYNC_ADAPTIVE: return "adaptive";
+    }
+    return "unknown";
+}
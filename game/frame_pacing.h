@@ -0,0 +1,68 @@
+#ifndef FRAME_PACING_H
+#define FRAME_PACING_H
+
+#include <stdint.h>
+
+// Measures frame times on the GLFW timer and optionally holds frames to a target rate. The wait
+// sleeps while the remaining time comfortably covers how long a sleep really takes, which is
+// learned as it goes, and spins the rest, so the deadline is hit closely without burning a core.
+// Waiting happens before input is polled, so the frame is built from the freshest input.
+
+// Frame times kept for the percentiles, about 8 seconds at 60 Hz.
+#define FRAME_PACING_HISTORY 512
+
+enum vsync_mode_t
+{
+    VSYNC_OFF,
+    VSYNC_ON,
+    VSYNC_ADAPTIVE, // Tears instead of waiting a whole refresh when a frame is late, if the driver allows.
+};
+
+struct frame_pacing_stats_t
+{
+    uint32_t frame_count; // In the history.
+    float average_ms;
+    float p50_ms;
+    float p95_ms;
+    float p99_ms;
+    float max_ms;
+};
+
+struct frame_pacer_t
+{
+    double ticks_to_seconds;
+    uint64_t frame_ticks; // When the current frame was due to start, the next one is due target_ticks later.
+    uint64_t last_ticks; // When it actually started.
+    uint64_t target_ticks; // 0 for no limit.
+
+    vsync_mode_t vsync_mode; // What was asked for.
+    bool has_swap_tear;
+
+    // Running mean and variance of how long a 1 ms sleep actually takes.
+    double sleep_mean;
+    double sleep_m2;
+    uint32_t sleep_count;
+
+    float frame_ms[FRAME_PACING_HISTORY];
+    uint32_t frame_count;
+};
+
+// Needs the window's context current, for the swap interval.
+void init_frame_pacer(frame_pacer_t *pacer, vsync_mode_t vsync_mode, float target_fps);
+void free_frame_pacer(frame_pacer_t *pacer);
+
+// VSYNC_ADAPTIVE falls back to VSYNC_ON without swap_control_tear.
+void set_vsync_mode(frame_pacer_t *pacer, vsync_mode_t vsync_mode);
+
+// 0 for no limit.
+void set_target_fps(frame_pacer_t *pacer, float target_fps);
+
+// Waits out the target frame time, if any, starts the next frame and returns the seconds since
+// the last one started. Once per frame, before polling events.
+float pace_frame(frame_pacer_t *pacer);
+
+frame_pacing_stats_t get_frame_pacing_stats(frame_pacer_t *pacer);
+
+char *get_vsync_mode_name(vsync_mode_t vsync_mode);
+
+#endif
@@ -0,0 +1,175 @@
+#include "game_loop.h"
+#include "trace.h"
+#include "utils.h"
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+// After a stall, at most this many ticks are run to catch up, the rest of the time is dropped
+// rather than spiralling into ever longer frames.
+#define GAME_LOOP_MAX_CATCH_UP 8
+
+static void
+run_tick(game_loop_t *loop, void *previous, void *current)
+{
+    TRACE_SCOPE("sim_tick");
+    memcpy(previous, current, loop->state_size);
+    loop->tick(current, loop->tick_seconds, loop->data);
+}
+
+static void
+sim_main(game_loop_t *loop)
+{
+    set_trace_thread_name("sim");
+
+    uint64_t tick_count = 0;
+    uint64_t dropped_ticks = 0;
+
+    std::unique_lock<std::mutex> lock(loop->mutex);
+    uint64_t due = loop->shared_tick_time + loop->tick_ticks;
+
+    while (!loop->quit)
+    {
+        uint64_t now = glfwGetTimerValue();
+        if (now < due)
+        {
+            double seconds = (due - now) * loop->ticks_to_seconds;
+            loop->stop_signal.wait_for(lock, std::chrono::duration<double>(seconds));
+            continue;
+        }
+
+        uint64_t late = (now - due) / loop->tick_ticks;
+        if (late > GAME_LOOP_MAX_CATCH_UP)
+        {
+            due += (late - GAME_LOOP_MAX_CATCH_UP) * loop->tick_ticks;
+            dropped_ticks += late - GAME_LOOP_MAX_CATCH_UP;
+        }
+
+        // Nobody else touches the simulation's own pair, the GL thread only waits for the copy.
+        lock.unlock();
+        run_tick(loop, loop->sim_previous, loop->sim_current);
+        tick_count++;
+        lock.lock();
+
+        memcpy(loop->shared_previous, loop->sim_previous, loop->state_size);
+        memcpy(loop->shared_current, loop->sim_current, loop->state_size);
+        loop->shared_tick_time = due;
+        loop->shared_tick_count = tick_count;
+        loop->shared_dropped_ticks = dropped_ticks;
+
+        due += loop->tick_ticks;
+    }
+}
+
+bool
+init_game_loop(game_loop_t *loop, void *initial_state, size_t state_size, float ticks_per_second,
+               sim_tick_proc_t *tick, void *data, bool threaded)
+{
+    loop->tick = tick;
+    loop->data = data;
+    loop->state_size = state_size;
+
+    loop->tick_seconds = 1.0f / ticks_per_second;
+    loop->ticks_to_seconds = 1.0 / (double)glfwGetTimerFrequency();
+    loop->tick_ticks = (uint64_t)(loop->tick_seconds / loop->ticks_to_seconds);
+
+    loop->accumulator = 0.0;
+    loop->tick_count = 0;
+    loop->dropped_ticks = 0;
+
+    loop->threaded = threaded;
+    loop->thread = NULL;
+    loop->quit = false;
+
+    // previous, current, then the simulation thread's and the shared pairs when threaded.
+    int state_count = threaded ? 6 : 2;
+    uint8_t *states = (uint8_t *)malloc(state_count * state_size);
+    if (!states)
+    {
+        fprintf(stderr, "Could not allocate %d simulation states of %zu bytes.\n", state_count, state_size);
+        return false;
+    }
+
+    for (int i = 0; i < state_count; ++i) memcpy(states + i * state_size, initial_state, state_size);
+
+    loop->previous = states;
+    loop->current = states + state_size;
+    loop->sim_previous = threaded ? states + 2 * state_size : NULL;
+    loop->sim_current = threaded ? states + 3 * state_size : NULL;
+    loop->shared_previous = threaded ? states + 4 * state_size : NULL;
+    loop->shared_current = threaded ? states + 5 * state_size : NULL;
+    loop->shared_tick_time = glfwGetTimerValue();
+    loop->shared_tick_count = 0;
+    loop->shared_dropped_ticks = 0;
+
+    if (threaded) loop->thread = new std::thread(sim_main, loop);
+
+    return true;
+}
+
+void
+free_game_loop(game_loop_t *loop)
+{
+    if (loop->thread)
+    {
+        {
+            std::lock_guard<std::mutex> lock(loop->mutex);
+            loop->quit = true;
+        }
+        loop->stop_signal.notify_one();
+        loop->thread->join();
+        delete loop->thread;
+        loop->thread = NULL;
+    }
+
+    // One allocation, starting at previous.
+    free(loop->previous);
+    loop->previous = NULL;
+    loop->current = NULL;
+}
+
+float
+update_game_loop(game_loop_t *loop, float frame_seconds)
+{
+    if (loop->threaded)
+    {
+        uint64_t tick_time;
+        {
+            std::lock_guard<std::mutex> lock(loop->mutex);
+            if (loop->shared_tick_count != loop->tick_count)
+            {
+                memcpy(loop->previous, loop->shared_previous, loop->state_size);
+                memcpy(loop->current, loop->shared_current, loop->state_size);
+                loop->tick_count = loop->shared_tick_count;
+                loop->dropped_ticks = loop->shared_dropped_ticks;
+            }
+            tick_time = loop->shared_tick_time;
+        }
+
+        // Drawing a tick behind, from when current was due to when the next one is.
+        double alpha = (glfwGetTimerValue() - tick_time) * loop->ticks_to_seconds / loop->tick_seconds;
+        return alpha < 1.0 ? (float)alpha : 1.0f;
+    }
+
+    loop->accumulator += frame_seconds;
+
+    uint64_t due = (uint64_t)(loop->accumulator / loop->tick_seconds);
+    if (due > GAME_LOOP_MAX_CATCH_UP)
+    {
+        loop->accumulator -= (due - GAME_LOOP_MAX_CATCH_UP) * (double)loop->tick_seconds;
+        loop->dropped_ticks += due - GAME_LOOP_MAX_CATCH_UP;
+    }
+
+    while (loop->accumulator >= loop->tick_seconds)
+    {
+        run_tick(loop, loop->previous, loop->current);
+        loop->accumulator -= loop->tick_seconds;
+        loop->tick_count++;
+    }
+
+    return (float)(loop->accumulator / loop->tick_seconds);
+}
@@ -0,0 +1,66 @@
+#ifndef GAME_LOOP_H
+#define GAME_LOOP_H
+
+#include <stdint.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Fixed timestep simulation decoupled from the frame rate. The simulation state is a plain blob
+// that a tick advances in place by exactly tick_seconds, and rendering draws somewhere between the
+// last two states it has, so motion stays smooth whatever the two rates are.
+//
+// Single threaded, the frame's time goes into an accumulator that runs as many ticks as fit.
+// Threaded, the simulation ticks on its own thread in real time and publishes every new pair of
+// states, which the GL thread copies out under a lock, so a slow frame never holds it back. Then
+// the tick must only touch its state and whatever else it was handed that is safe to share.
+
+// Advances state by dt seconds, always the loop's tick length.
+typedef void sim_tick_proc_t(void *state, float dt, void *data);
+
+struct game_loop_t
+{
+    sim_tick_proc_t *tick;
+    void *data;
+    size_t state_size;
+
+    float tick_seconds;
+    double ticks_to_seconds;
+    uint64_t tick_ticks;
+
+    // What the GL thread renders from, the state before the latest tick and after it.
+    void *previous;
+    void *current;
+
+    // Simulated time not yet ticked, single threaded only.
+    double accumulator;
+
+    uint64_t tick_count;
+    uint64_t dropped_ticks; // Skipped to catch up after a stall.
+
+    bool threaded;
+    std::thread *thread;
+    std::mutex mutex;
+    std::condition_variable stop_signal;
+    bool quit;
+
+    // The simulation thread's pair and what it published last, under mutex.
+    void *sim_previous;
+    void *sim_current;
+    void *shared_previous;
+    void *shared_current;
+    uint64_t shared_tick_time; // When shared_current was due, on the GLFW timer.
+    uint64_t shared_tick_count;
+    uint64_t shared_dropped_ticks;
+};
+
+// initial_state is copied, state_size bytes of it.
+bool init_game_loop(game_loop_t *loop, void *initial_state, size_t state_size, float ticks_per_second,
+                    sim_tick_proc_t *tick, void *data, bool threaded);
+void free_game_loop(game_loop_t *loop);
+
+// Once a frame on the GL thread. Runs or picks up the ticks due by now and returns how far
+// rendering is from loop->previous to loop->current, 0 to 1. Threaded, frame_seconds is unused.
+float update_game_loop(game_loop_t *loop, float frame_seconds);
+
+#endif
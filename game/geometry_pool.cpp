@@ -0,0 +1,337 @@
+#include "geometry_pool.h"
+#include "gl_state.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct free_block_t
+{
+    uint32_t offset;
+    uint32_t size;
+};
+
+// Free list kept sorted by offset so neighbours can be coalesced on free.
+struct range_allocator_t
+{
+    uint32_t capacity;
+    uint32_t used;
+
+    free_block_t *blocks;
+    uint32_t block_count;
+    uint32_t block_capacity;
+};
+
+struct geometry_allocation_t
+{
+    geometry_range_t range;
+    bool in_use;
+};
+
+struct geometry_pool_t
+{
+    GLuint vertex_buffer;
+    GLuint index_buffer;
+
+    range_allocator_t vertex_allocator;
+    range_allocator_t index_allocator;
+
+    // Slot 0 is never handed out so 0 can mean "no geometry".
+    geometry_allocation_t *allocations;
+    uint32_t allocation_capacity;
+};
+
+static geometry_pool_t pool;
+
+static void
+init_range_allocator(range_allocator_t *allocator, uint32_t capacity)
+{
+    free(allocator->blocks);
+    *allocator = {};
+
+    allocator->capacity = capacity;
+    allocator->block_capacity = 64;
+    allocator->blocks = (free_block_t *)malloc(allocator->block_capacity * sizeof(free_block_t));
+
+    if (capacity)
+    {
+        allocator->blocks[0].offset = 0;
+        allocator->blocks[0].size = capacity;
+        allocator->block_count = 1;
+    }
+}
+
+// First fit, returns UINT32_MAX on failure.
+static uint32_t
+allocate_range(range_allocator_t *allocator, uint32_t size)
+{
+    if (size == 0) return 0;
+
+    for (uint32_t i = 0; i < allocator->block_count; ++i)
+    {
+        free_block_t *block = &allocator->blocks[i];
+        if (block->size < size) continue;
+
+        uint32_t result = block->offset;
+        block->offset += size;
+        block->size -= size;
+
+        if (block->size == 0)
+        {
+            memmove(block, block + 1, (allocator->block_count - i - 1) * sizeof(free_block_t));
+            allocator->block_count--;
+        }
+
+        allocator->used += size;
+        return result;
+    }
+
+    return UINT32_MAX;
+}
+
+static void
+free_range(range_allocator_t *allocator, uint32_t offset, uint32_t size)
+{
+    if (size == 0) return;
+
+    uint32_t insert = 0;
+    while (insert < allocator->block_count && allocator->blocks[insert].offset < offset) insert++;
+
+    bool merge_previous = insert > 0 &&
+        allocator->blocks[insert - 1].offset + allocator->blocks[insert - 1].size == offset;
+    bool merge_next = insert < allocator->block_count &&
+        offset + size == allocator->blocks[insert].offset;
+
+    if (merge_previous && merge_next)
+    {
+        allocator->blocks[insert - 1].size += size + allocator->blocks[insert].size;
+        memmove(&allocator->blocks[insert], &allocator->blocks[insert + 1], (allocator->block_count - insert - 1) * sizeof(free_block_t));
+        allocator->block_count--;
+    }
+    else if (merge_previous)
+    {
+        allocator->blocks[insert - 1].size += size;
+    }
+    else if (merge_next)
+    {
+        allocator->blocks[insert].offset = offset;
+        allocator->blocks[insert].size += size;
+    }
+    else
+    {
+        if (allocator->block_count == allocator->block_capacity)
+        {
+            allocator->block_capacity *= 2;
+            allocator->blocks = (free_block_t *)realloc(allocator->blocks, allocator->block_capacity * sizeof(free_block_t));
+        }
+
+        memmove(&allocator->blocks[insert + 1], &allocator->blocks[insert], (allocator->block_count - insert) * sizeof(free_block_t));
+        allocator->blocks[insert].offset = offset;
+        allocator->blocks[insert].size = size;
+        allocator->block_count++;
+    }
+
+    allocator->used -= size;
+}
+
+static GLuint
+create_pool_buffer(GLenum target, GLsizeiptr size)
+{
+    GLuint result;
+    glGenBuffers(1, &result);
+    bind_buffer(target, result);
+    glBufferData(target, size, NULL, GL_STATIC_DRAW);
+    return result;
+}
+
+void
+init_geometry_pool(uint32_t vertex_capacity, uint32_t index_capacity)
+{
+    init_range_allocator(&pool.vertex_allocator, vertex_capacity);
+    init_range_allocator(&pool.index_allocator, index_capacity);
+
+    pool.allocation_capacity = 64;
+    pool.allocations = (geometry_allocation_t *)calloc(pool.allocation_capacity, sizeof(geometry_allocation_t));
+    pool.allocations[0].in_use = true;
+
+    pool.vertex_buffer = create_pool_buffer(GL_ARRAY_BUFFER, vertex_capacity * sizeof(mesh_vertex_t));
+    pool.index_buffer = create_pool_buffer(GL_ELEMENT_ARRAY_BUFFER, index_capacity * sizeof(uint32_t));
+}
+
+void
+shutdown_geometry_pool()
+{
+    delete_gl_buffer(pool.vertex_buffer);
+    delete_gl_buffer(pool.index_buffer);
+
+    free(pool.vertex_allocator.blocks);
+    free(pool.index_allocator.blocks);
+    free(pool.allocations);
+
+    pool = {};
+}
+
+uint32_t
+allocate_geometry(uint32_t vertex_count, uint32_t index_count)
+{
+    range_allocator_t *vertices = &pool.vertex_allocator;
+    range_allocator_t *indices = &pool.index_allocator;
+
+    if (vertices->capacity - vertices->used < vertex_count ||
+        indices->capacity - indices->used < index_count)
+    {
+        fprintf(stderr, "Geometry pool is full (%u vertices, %u indices requested).\n", vertex_count, index_count);
+        return 0;
+    }
+
+    uint32_t first_vertex = allocate_range(vertices, vertex_count);
+    uint32_t first_index = allocate_range(indices, index_count);
+
+    if (first_vertex == UINT32_MAX || first_index == UINT32_MAX)
+    {
+        // There is enough space, it's just scattered.
+        if (first_vertex != UINT32_MAX) free_range(vertices, first_vertex, vertex_count);
+        if (first_index != UINT32_MAX) free_range(indices, first_index, index_count);
+
+        defragment_geometry_pool();
+
+        first_vertex = allocate_range(vertices, vertex_count);
+        first_index = allocate_range(indices, index_count);
+        ASSERT(first_vertex != UINT32_MAX && first_index != UINT32_MAX);
+    }
+
+    uint32_t id = 1;
+    while (id < pool.allocation_capacity && pool.allocations[id].in_use) id++;
+
+    if (id == pool.allocation_capacity)
+    {
+        pool.allocation_capacity *= 2;
+        pool.allocations = (geometry_allocation_t *)realloc(pool.allocations, pool.allocation_capacity * sizeof(geometry_allocation_t));
+        memset(pool.allocations + id, 0, (pool.allocation_capacity - id) * sizeof(geometry_allocation_t));
+    }
+
+    geometry_allocation_t *allocation = &pool.allocations[id];
+    allocation->in_use = true;
+    allocation->range.first_vertex = first_vertex;
+    allocation->range.vertex_count = vertex_count;
+    allocation->range.first_index = first_index;
+    allocation->range.index_count = index_count;
+
+    return id;
+}
+
+void
+free_geometry(uint32_t id)
+{
+    if (id == 0) return;
+    ASSERT(id < pool.allocation_capacity && pool.allocations[id].in_use);
+
+    geometry_allocation_t *allocation = &pool.allocations[id];
+    free_range(&pool.vertex_allocator, allocation->range.first_vertex, allocation->range.vertex_count);
+    free_range(&pool.index_allocator, allocation->range.first_index, allocation->range.index_count);
+
+    *allocation = {};
+}
+
+geometry_range_t *
+get_geometry(uint32_t id)
+{
+    ASSERT(id > 0 && id < pool.allocation_capacity && pool.allocations[id].in_use);
+    return &pool.allocations[id].range;
+}
+
+void
+upload_geometry(uint32_t id, mesh_vertex_t *vertices, uint32_t *indices)
+{
+    geometry_range_t *range = get_geometry(id);
+
+    bind_buffer(GL_ARRAY_BUFFER, pool.vertex_buffer);
+    glBufferSubData(GL_ARRAY_BUFFER, range->first_vertex * sizeof(mesh_vertex_t), range->vertex_count * sizeof(mesh_vertex_t), vertices);
+
+    bind_buffer(GL_ELEMENT_ARRAY_BUFFER, pool.index_buffer);
+    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, range->first_index * sizeof(uint32_t), range->index_count * sizeof(uint32_t), indices);
+}
+
+void
+bind_geometry_pool()
+{
+    bind_buffer(GL_ARRAY_BUFFER, pool.vertex_buffer);
+    bind_buffer(GL_ELEMENT_ARRAY_BUFFER, pool.index_buffer);
+}
+
+void
+defragment_geometry_pool()
+{
+    uint32_t vertex_capacity = pool.vertex_allocator.capacity;
+    uint32_t index_capacity = pool.index_allocator.capacity;
+
+    // Copying into new buffers avoids overlapping glCopyBufferSubData ranges within one buffer.
+    GLuint vertex_buffer = create_pool_buffer(GL_COPY_WRITE_BUFFER, vertex_capacity * sizeof(mesh_vertex_t));
+    GLuint index_buffer = create_pool_buffer(GL_COPY_WRITE_BUFFER, index_capacity * sizeof(uint32_t));
+
+    uint32_t vertex_cursor = 0;
+    uint32_t index_cursor = 0;
+
+    for (uint32_t id = 1; id < pool.allocation_capacity; ++id)
+    {
+        geometry_allocation_t *allocation = &pool.allocations[id];
+        if (!allocation->in_use) continue;
+
+        geometry_range_t *range = &allocation->range;
+
+        if (range->vertex_count)
+        {
+            bind_buffer(GL_COPY_READ_BUFFER, pool.vertex_buffer);
+            bind_buffer(GL_COPY_WRITE_BUFFER, vertex_buffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                                range->first_vertex * sizeof(mesh_vertex_t), vertex_cursor * sizeof(mesh_vertex_t),
+                                range->vertex_count * sizeof(mesh_vertex_t));
+        }
+
+        if (range->index_count)
+        {
+            bind_buffer(GL_COPY_READ_BUFFER, pool.index_buffer);
+            bind_buffer(GL_COPY_WRITE_BUFFER, index_buffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                                range->first_index * sizeof(uint32_t), index_cursor * sizeof(uint32_t),
+                                range->index_count * sizeof(uint32_t));
+        }
+
+        range->first_vertex = vertex_cursor;
+        range->first_index = index_cursor;
+        vertex_cursor += range->vertex_count;
+        index_cursor += range->index_count;
+    }
+
+    delete_gl_buffer(pool.vertex_buffer);
+    delete_gl_buffer(pool.index_buffer);
+    pool.vertex_buffer = vertex_buffer;
+    pool.index_buffer = index_buffer;
+
+    init_range_allocator(&pool.vertex_allocator, vertex_capacity);
+    init_range_allocator(&pool.index_allocator, index_capacity);
+    allocate_range(&pool.vertex_allocator, vertex_cursor);
+    allocate_range(&pool.index_allocator, index_cursor);
+}
+
+geometry_pool_stats_t
+get_geometry_pool_stats()
+{
+    geometry_pool_stats_t result = {};
+
+    result.vertex_capacity = pool.vertex_allocator.capacity;
+    result.vertices_used = pool.vertex_allocator.used;
+    result.vertex_free_blocks = pool.vertex_allocator.block_count;
+
+    result.index_capacity = pool.index_allocator.capacity;
+    result.indices_used = pool.index_allocator.used;
+    result.index_free_blocks = pool.index_allocator.block_count;
+
+    for (uint32_t id = 1; id < pool.allocation_capacity; ++id)
+    {
+        if (pool.allocations[id].in_use) result.allocation_count++;
+    }
+
+    return result;
+}
@@ -0,0 +1,55 @@
+#ifndef GEOMETRY_POOL_H
+#define GEOMETRY_POOL_H
+
+#include <GL/glew.h>
+#include <stdint.h>
+
+#include "mesh.h"
+
+// All static mesh data lives in one vertex buffer and one index buffer. Meshes get a range of
+// each, indices stay relative to the mesh so draws use glDrawElementsBaseVertex and nothing
+// has to be rebound between meshes.
+//
+// Ranges are referred to by id because defragment_geometry_pool moves them around.
+
+struct geometry_range_t
+{
+    uint32_t first_vertex;
+    uint32_t vertex_count;
+
+    uint32_t first_index;
+    uint32_t index_count;
+};
+
+void init_geometry_pool(uint32_t vertex_capacity, uint32_t index_capacity);
+void shutdown_geometry_pool();
+
+// Returns 0 when the pool is out of space even after defragmenting.
+uint32_t allocate_geometry(uint32_t vertex_count, uint32_t index_count);
+void free_geometry(uint32_t id);
+
+geometry_range_t *get_geometry(uint32_t id);
+void upload_geometry(uint32_t id, mesh_vertex_t *vertices, uint32_t *indices);
+
+// Binds the pool's vertex and index buffers.
+void bind_geometry_pool();
+
+// Packs all live ranges to the start of fresh buffers. Invalidates vertex attribute pointers.
+void defragment_geometry_pool();
+
+struct geometry_pool_stats_t
+{
+    uint32_t vertex_capacity;
+    uint32_t vertices_used;
+    uint32_t vertex_free_blocks;
+
+    uint32_t index_capacity;
+    uint32_t indices_used;
+    uint32_t index_free_blocks;
+
+    uint32_t allocation_count;
+};
+
+geometry_pool_stats_t get_geometry_pool_stats();
+
+#endif
@@ -0,0 +1,637 @@
+#include "gl_state.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <string.h>
+
+enum buffer_slot_t
+{
+    BUFFER_SLOT_ARRAY,
+    BUFFER_SLOT_ELEMENT_ARRAY,
+    BUFFER_SLOT_COPY_READ,
+    BUFFER_SLOT_COPY_WRITE,
+    BUFFER_SLOT_PIXEL_UNPACK,
+    BUFFER_SLOT_DRAW_INDIRECT,
+    BUFFER_SLOT_UNIFORM,
+
+    BUFFER_SLOT_COUNT,
+};
+
+static GLenum buffer_slot_targets[BUFFER_SLOT_COUNT] =
+{
+    GL_ARRAY_BUFFER,
+    GL_ELEMENT_ARRAY_BUFFER,
+    GL_COPY_READ_BUFFER,
+    GL_COPY_WRITE_BUFFER,
+    GL_PIXEL_UNPACK_BUFFER,
+    GL_DRAW_INDIRECT_BUFFER,
+    GL_UNIFORM_BUFFER,
+};
+
+static GLenum buffer_slot_queries[BUFFER_SLOT_COUNT] =
+{
+    GL_ARRAY_BUFFER_BINDING,
+    GL_ELEMENT_ARRAY_BUFFER_BINDING,
+    GL_COPY_READ_BUFFER_BINDING,
+    GL_COPY_WRITE_BUFFER_BINDING,
+    GL_PIXEL_UNPACK_BUFFER_BINDING,
+    GL_DRAW_INDIRECT_BUFFER_BINDING,
+    GL_UNIFORM_BUFFER_BINDING,
+};
+
+// (GLuint)-1 and an enabled of -1 mean unknown, the next call is issued whatever it sets.
+#define UNKNOWN_ENABLED -1
+
+struct vertex_attrib_state_t
+{
+    int enabled; // 0, 1 or UNKNOWN_ENABLED.
+    GLuint divisor;
+
+    GLuint buffer;
+    GLint size;
+    GLenum type;
+    GLboolean normalized;
+    GLsizei stride;
+    size_t offset;
+};
+
+// Element buffer and attributes are vertex array state, each vertex array gets its own shadow.
+struct vertex_array_state_t
+{
+    GLuint name;
+    GLuint element_buffer;
+    vertex_attrib_state_t attribs[GL_STATE_MAX_VERTEX_ATTRIBS];
+
+    uint32_t last_used; // For recycling the least recently bound.
+};
+
+#define GL_STATE_MAX_VERTEX_ARRAYS 8
+
+struct texture_unit_state_t
+{
+    GLuint texture_2d;
+    GLuint texture_2d_array;
+};
+
+struct gl_state_t
+{
+    GLuint program;
+    GLuint framebuffer;
+    GLuint buffers[BUFFER_SLOT_COUNT];
+
+    GLuint active_texture_unit;
+    texture_unit_state_t texture_units[GL_STATE_MAX_TEXTURE_UNITS];
+
+    vertex_array_state_t vertex_arrays[GL_STATE_MAX_VERTEX_ARRAYS];
+    int vertex_array_count;
+    vertex_array_state_t *vertex_array;
+    uint32_t vertex_array_clock;
+
+    // Once a shadow was recycled, a vertex array we don't know may be one we forgot.
+    bool vertex_arrays_recycled;
+
+    bool blend_enabled;
+    GLenum blend_source_factor;
+    GLenum blend_destination_factor;
+
+    bool depth_test_enabled;
+    bool depth_write_enabled;
+    GLenum depth_func;
+
+    bool cull_enabled;
+    GLenum cull_face;
+
+    GLint viewport[4];
+
+    // Set when the driver doesn't expose the query (no GL 4.0 for the indirect binding).
+    bool draw_indirect_supported;
+
+    gl_state_stats_t stats;
+};
+
+static gl_state_t state;
+
+static int
+get_buffer_slot(GLenum target)
+{
+    for (int i = 0; i < BUFFER_SLOT_COUNT; ++i)
+    {
+        if (buffer_slot_targets[i] == target) return i;
+    }
+    return -1;
+}
+
+static GLint
+get_gl_integer(GLenum name)
+{
+    GLint result = 0;
+    glGetIntegerv(name, &result);
+    return result;
+}
+
+// Only called for the vertex array that is bound at init, everything else starts from the GL defaults.
+static void
+read_vertex_array_state(vertex_array_state_t *vertex_array)
+{
+    vertex_array->element_buffer = get_gl_integer(GL_ELEMENT_ARRAY_BUFFER_BINDING);
+
+    for (GLuint loc = 0; loc < GL_STATE_MAX_VERTEX_ATTRIBS; ++loc)
+    {
+        vertex_attrib_state_t *attrib = &vertex_array->attribs[loc];
+
+        GLint value;
+        glGetVertexAttribiv(loc, GL_VERTEX_ATTRIB_ARRAY_ENABLED, &value);
+        attrib->enabled = value != 0 ? 1 : 0;
+        glGetVertexAttribiv(loc, GL_VERTEX_ATTRIB_ARRAY_DIVISOR, &value);
+        attrib->divisor = value;
+        glGetVertexAttribiv(loc, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, &value);
+        attrib->buffer = value;
+        glGetVertexAttribiv(loc, GL_VERTEX_ATTRIB_ARRAY_SIZE, &value);
+        attrib->size = value;
+        glGetVertexAttribiv(loc, GL_VERTEX_ATTRIB_ARRAY_TYPE, &value);
+        attrib->type = value;
+        glGetVertexAttribiv(loc, GL_VERTEX_ATTRIB_ARRAY_NORMALIZED, &value);
+        attrib->normalized = value ? GL_TRUE : GL_FALSE;
+        glGetVertexAttribiv(loc, GL_VERTEX_ATTRIB_ARRAY_STRIDE, &value);
+        attrib->stride = value;
+
+        void *pointer = NULL;
+        glGetVertexAttribPointerv(loc, GL_VERTEX_ATTRIB_ARRAY_POINTER, &pointer);
+        attrib->offset = (size_t)pointer;
+    }
+}
+
+static vertex_array_state_t *
+find_vertex_array_state(GLuint name)
+{
+    uint32_t clock = ++state.vertex_array_clock;
+    for (int i = 0; i < state.vertex_array_count; ++i)
+    {
+        if (state.vertex_arrays[i].name == name)
+        {
+            state.vertex_arrays[i].last_used = clock;
+            return &state.vertex_arrays[i];
+        }
+    }
+
+    // Past the table size the least recently bound entry gets recycled.
+    int index = state.vertex_array_count;
+    if (index == GL_STATE_MAX_VERTEX_ARRAYS)
+    {
+        index = 0;
+        for (int i = 1; i < GL_STATE_MAX_VERTEX_ARRAYS; ++i)
+        {
+            if (state.vertex_arrays[i].last_used < state.vertex_arrays[index].last_used) index = i;
+        }
+        state.vertex_arrays_recycled = true;
+    }
+    else
+    {
+        state.vertex_array_count++;
+    }
+
+    vertex_array_state_t *result = &state.vertex_arrays[index];
+    *result = {};
+    result->name = name;
+    result->last_used = clock;
+
+    // A fresh vertex array has everything disabled and unbound. One whose shadow was recycled has
+    // whatever it was left with, so nothing about it is known.
+    for (int loc = 0; loc < GL_STATE_MAX_VERTEX_ATTRIBS; ++loc)
+    {
+        vertex_attrib_state_t *attrib = &result->attribs[loc];
+        if (state.vertex_arrays_recycled)
+        {
+            attrib->enabled = UNKNOWN_ENABLED;
+            attrib->divisor = (GLuint)-1;
+            attrib->buffer = (GLuint)-1;
+            attrib->size = -1;
+        }
+        else
+        {
+            attrib->size = 4;
+            attrib->type = GL_FLOAT;
+        }
+    }
+    if (state.vertex_arrays_recycled) result->element_buffer = (GLuint)-1;
+
+    return result;
+}
+
+void
+init_gl_state()
+{
+    state = {};
+
+    state.draw_indirect_supported = GLEW_VERSION_4_0 || GLEW_ARB_draw_indirect;
+
+    state.program = get_gl_integer(GL_CURRENT_PROGRAM);
+    state.framebuffer = get_gl_integer(GL_DRAW_FRAMEBUFFER_BINDING);
+
+    for (int i = 0; i < BUFFER_SLOT_COUNT; ++i)
+    {
+        if (i == BUFFER_SLOT_DRAW_INDIRECT && !state.draw_indirect_supported) continue;
+        state.buffers[i] = get_gl_integer(buffer_slot_queries[i]);
+    }
+
+    state.active_texture_unit = get_gl_integer(GL_ACTIVE_TEXTURE) - GL_TEXTURE0;
+    for (GLuint unit = 0; unit < GL_STATE_MAX_TEXTURE_UNITS; ++unit)
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        state.texture_units[unit].texture_2d = get_gl_integer(GL_TEXTURE_BINDING_2D);
+        state.texture_units[unit].texture_2d_array = get_gl_integer(GL_TEXTURE_BINDING_2D_ARRAY);
+    }
+    glActiveTexture(GL_TEXTURE0 + state.active_texture_unit);
+
+    state.vertex_array = find_vertex_array_state(get_gl_integer(GL_VERTEX_ARRAY_BINDING));
+    read_vertex_array_state(state.vertex_array);
+    state.buffers[BUFFER_SLOT_ELEMENT_ARRAY] = state.vertex_array->element_buffer;
+
+    state.blend_enabled = glIsEnabled(GL_BLEND) != 0;
+    state.blend_source_factor = get_gl_integer(GL_BLEND_SRC_RGB);
+    state.blend_destination_factor = get_gl_integer(GL_BLEND_DST_RGB);
+
+    state.depth_test_enabled = glIsEnabled(GL_DEPTH_TEST) != 0;
+    state.depth_write_enabled = get_gl_integer(GL_DEPTH_WRITEMASK) != 0;
+    state.depth_func = get_gl_integer(GL_DEPTH_FUNC);
+
+    state.cull_enabled = glIsEnabled(GL_CULL_FACE) != 0;
+    state.cull_face = get_gl_integer(GL_CULL_FACE_MODE);
+
+    glGetIntegerv(GL_VIEWPORT, state.viewport);
+}
+
+void
+bind_program(GLuint program)
+{
+    if (state.program == program)
+    {
+        state.stats.calls_skipped++;
+        return;
+    }
+
+    state.program = program;
+    glUseProgram(program);
+    state.stats.calls_issued++;
+}
+
+void
+bind_vertex_array(GLuint vertex_array)
+{
+    if (state.vertex_array->name == vertex_array)
+    {
+        state.stats.calls_skipped++;
+        return;
+    }
+
+    state.vertex_array->element_buffer = state.buffers[BUFFER_SLOT_ELEMENT_ARRAY];
+
+    state.vertex_array = find_vertex_array_state(vertex_array);
+    glBindVertexArray(vertex_array);
+    state.stats.calls_issued++;
+
+    // The element buffer binding belongs to the vertex array we just switched to.
+    state.buffers[BUFFER_SLOT_ELEMENT_ARRAY] = state.vertex_array->element_buffer;
+}
+
+void
+bind_buffer(GLenum target, GLuint buffer)
+{
+    int slot = get_buffer_slot(target);
+    if (slot != -1)
+    {
+        if (state.buffers[slot] == buffer)
+        {
+            state.stats.calls_skipped++;
+            return;
+        }
+        state.buffers[slot] = buffer;
+    }
+
+    glBindBuffer(target, buffer);
+    state.stats.calls_issued++;
+}
+
+void
+bind_texture(GLuint unit, GLenum target, GLuint texture)
+{
+    ASSERT(unit < GL_STATE_MAX_TEXTURE_UNITS);
+
+    texture_unit_state_t *texture_unit = &state.texture_units[unit];
+    GLuint *binding = NULL;
+    if (target == GL_TEXTURE_2D) binding = &texture_unit->texture_2d;
+    else if (target == GL_TEXTURE_2D_ARRAY) binding = &texture_unit->texture_2d_array;
+
+    if (binding && *binding == texture)
+    {
+        state.stats.calls_skipped++;
+        return;
+    }
+
+    if (state.active_texture_unit != unit)
+    {
+        state.active_texture_unit = unit;
+        glActiveTexture(GL_TEXTURE0 + unit);
+        state.stats.calls_issued++;
+    }
+
+    if (binding) *binding = texture;
+    glBindTexture(target, texture);
+    state.stats.calls_issued++;
+}
+
+void
+bind_framebuffer(GLuint framebuffer)
+{
+    if (state.framebuffer == framebuffer)
+    {
+        state.stats.calls_skipped++;
+        return;
+    }
+
+    state.framebuffer = framebuffer;
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    state.stats.calls_issued++;
+}
+
+void
+set_vertex_attrib_pointer(GLuint loc, GLint size, GLenum type, GLboolean normalized, GLsizei stride, size_t offset)
+{
+    ASSERT(loc < GL_STATE_MAX_VERTEX_ATTRIBS);
+
+    vertex_attrib_state_t *attrib = &state.vertex_array->attribs[loc];
+    GLuint buffer = state.buffers[BUFFER_SLOT_ARRAY];
+
+    if (attrib->buffer == buffer && attrib->size == size && attrib->type == type &&
+        attrib->normalized == normalized && attrib->stride == stride && attrib->offset == offset)
+    {
+        state.stats.calls_skipped++;
+        return;
+    }
+
+    attrib->buffer = buffer;
+    attrib->size = size;
+    attrib->type = type;
+    attrib->normalized = normalized;
+    attrib->stride = stride;
+    attrib->offset = offset;
+
+    glVertexAttribPointer(loc, size, type, normalized, stride, (void *)offset);
+    state.stats.calls_issued++;
+}
+
+void
+enable_vertex_attrib(GLuint loc, bool enabled)
+{
+    ASSERT(loc < GL_STATE_MAX_VERTEX_ATTRIBS);
+
+    vertex_attrib_state_t *attrib = &state.vertex_array->attribs[loc];
+    if (attrib->enabled == (enabled ? 1 : 0))
+    {
+        state.stats.calls_skipped++;
+        return;
+    }
+
+    attrib->enabled = enabled ? 1 : 0;
+    if (enabled) glEnableVertexAttribArray(loc);
+    else glDisableVertexAttribArray(loc);
+    state.stats.calls_issued++;
+}
+
+void
+set_vertex_attrib_divisor(GLuint loc, GLuint divisor)
+{
+    ASSERT(loc < GL_STATE_MAX_VERTEX_ATTRIBS);
+
+    vertex_attrib_state_t *attrib = &state.vertex_array->attribs[loc];
+    if (attrib->divisor == divisor)
+    {
+        state.stats.calls_skipped++;
+        return;
+    }
+
+    attrib->divisor = divisor;
+    glVertexAttribDivisor(loc, divisor);
+    state.stats.calls_issued++;
+}
+
+static void
+set_capability(GLenum capability, bool *shadow, bool enabled)
+{
+    if (*shadow == enabled)
+    {
+        state.stats.calls_skipped++;
+        return;
+    }
+
+    *shadow = enabled;
+    if (enabled) glEnable(capability);
+    else glDisable(capability);
+    state.stats.calls_issued++;
+}
+
+void
+set_blend_state(bool enabled, GLenum source_factor, GLenum destination_factor)
+{
+    set_capability(GL_BLEND, &state.blend_enabled, enabled);
+
+    // Factors don't matter while blending is off, leave them for whoever turns it back on.
+    if (!enabled) return;
+
+    if (state.blend_source_factor == source_factor && state.blend_destination_factor == destination_factor)
+    {
+        state.stats.calls_skipped++;
+        return;
+    }
+
+    state.blend_source_factor = source_factor;
+    state.blend_destination_factor = destination_factor;
+    glBlendFunc(source_factor, destination_factor);
+    state.stats.calls_issued++;
+}
+
+void
+set_depth_state(bool test_enabled, bool write_enabled, GLenum func)
+{
+    set_capability(GL_DEPTH_TEST, &state.depth_test_enabled, test_enabled);
+
+    if (state.depth_write_enabled != write_enabled)
+    {
+        state.depth_write_enabled = write_enabled;
+        glDepthMask(write_enabled ? GL_TRUE : GL_FALSE);
+        state.stats.calls_issued++;
+    }
+    else
+    {
+        state.stats.calls_skipped++;
+    }
+
+    if (test_enabled && state.depth_func != func)
+    {
+        state.depth_func = func;
+        glDepthFunc(func);
+        state.stats.calls_issued++;
+    }
+}
+
+void
+set_cull_state(bool enabled, GLenum face)
+{
+    set_capability(GL_CULL_FACE, &state.cull_enabled, enabled);
+
+    if (enabled && state.cull_face != face)
+    {
+        state.cull_face = face;
+        glCullFace(face);
+        state.stats.calls_issued++;
+    }
+}
+
+void
+set_viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    GLint *v = state.viewport;
+    if (v[0] == x && v[1] == y && v[2] == width && v[3] == height)
+    {
+        state.stats.calls_skipped++;
+        return;
+    }
+
+    v[0] = x;
+    v[1] = y;
+    v[2] = width;
+    v[3] = height;
+    glViewport(x, y, width, height);
+    state.stats.calls_issued++;
+}
+
+void
+delete_gl_buffer(GLuint buffer)
+{
+    if (!buffer) return;
+
+    for (int i = 0; i < BUFFER_SLOT_COUNT; ++i)
+    {
+        if (state.buffers[i] == buffer) state.buffers[i] = 0;
+    }
+
+    // Attributes keep pointing at the dead buffer, forget them so a recycled name can't match.
+    for (int i = 0; i < state.vertex_array_count; ++i)
+    {
+        vertex_array_state_t *vertex_array = &state.vertex_arrays[i];
+        if (vertex_array->element_buffer == buffer) vertex_array->element_buffer = 0;
+
+        for (int loc = 0; loc < GL_STATE_MAX_VERTEX_ATTRIBS; ++loc)
+        {
+            if (vertex_array->attribs[loc].buffer == buffer) vertex_array->attribs[loc].buffer = (GLuint)-1;
+        }
+    }
+
+    glDeleteBuffers(1, &buffer);
+}
+
+void
+delete_gl_texture(GLuint texture)
+{
+    if (!texture) return;
+
+    for (int unit = 0; unit < GL_STATE_MAX_TEXTURE_UNITS; ++unit)
+    {
+        texture_unit_state_t *texture_unit = &state.texture_units[unit];
+        if (texture_unit->texture_2d == texture) texture_unit->texture_2d = 0;
+        if (texture_unit->texture_2d_array == texture) texture_unit->texture_2d_array = 0;
+    }
+
+    glDeleteTextures(1, &texture);
+}
+
+void
+delete_gl_framebuffer(GLuint framebuffer)
+{
+    if (!framebuffer) return;
+
+    if (state.framebuffer == framebuffer) state.framebuffer = 0;
+    glDeleteFramebuffers(1, &framebuffer);
+}
+
+static bool
+check_value(char *name, GLint expected, GLint actual)
+{
+    if (expected == actual) return true;
+
+    fprintf(stderr, "GL state out of sync: %s is %d, shadow has %d.\n", name, actual, expected);
+    return false;
+}
+
+bool
+validate_gl_state()
+{
+    bool result = true;
+
+    result &= check_value("program", state.program, get_gl_integer(GL_CURRENT_PROGRAM));
+    result &= check_value("draw framebuffer", state.framebuffer, get_gl_integer(GL_DRAW_FRAMEBUFFER_BINDING));
+    result &= check_value("read framebuffer", state.framebuffer, get_gl_integer(GL_READ_FRAMEBUFFER_BINDING));
+    result &= check_value("vertex array", state.vertex_array->name, get_gl_integer(GL_VERTEX_ARRAY_BINDING));
+
+    for (int i = 0; i < BUFFER_SLOT_COUNT; ++i)
+    {
+        if (i == BUFFER_SLOT_DRAW_INDIRECT && !state.draw_indirect_supported) continue;
+        if (state.buffers[i] == (GLuint)-1) continue;
+        result &= check_value("buffer binding", state.buffers[i], get_gl_integer(buffer_slot_queries[i]));
+    }
+
+    for (GLuint unit = 0; unit < GL_STATE_MAX_TEXTURE_UNITS; ++unit)
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        result &= check_value("texture 2d", state.texture_units[unit].texture_2d, get_gl_integer(GL_TEXTURE_BINDING_2D));
+        result &= check_value("texture 2d array", state.texture_units[unit].texture_2d_array, get_gl_integer(GL_TEXTURE_BINDING_2D_ARRAY));
+    }
+    glActiveTexture(GL_TEXTURE0 + state.active_texture_unit);
+    result &= check_value("active texture", GL_TEXTURE0 + state.active_texture_unit, get_gl_integer(GL_ACTIVE_TEXTURE));
+
+    for (GLuint loc = 0; loc < GL_STATE_MAX_VERTEX_ATTRIBS; ++loc)
+    {
+        vertex_attrib_state_t *attrib = &state.vertex_array->attribs[loc];
+
+        GLint value;
+        if (attrib->enabled != UNKNOWN_ENABLED)
+        {
+            glGetVertexAttribiv(loc, GL_VERTEX_ATTRIB_ARRAY_ENABLED, &value);
+            result &= check_value("attrib enabled", attrib->enabled, value != 0);
+        }
+        if (attrib->divisor != (GLuint)-1)
+        {
+            glGetVertexAttribiv(loc, GL_VERTEX_ATTRIB_ARRAY_DIVISOR, &value);
+            result &= check_value("attrib divisor", attrib->divisor, value);
+        }
+
+        if (attrib->buffer != (GLuint)-1)
+        {
+            glGetVertexAttribiv(loc, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, &value);
+            result &= check_value("attrib buffer", attrib->buffer, value);
+        }
+    }
+
+    result &= check_value("blend", state.blend_enabled, glIsEnabled(GL_BLEND) != 0);
+    result &= check_value("depth test", state.depth_test_enabled, glIsEnabled(GL_DEPTH_TEST) != 0);
+    result &= check_value("depth write", state.depth_write_enabled, get_gl_integer(GL_DEPTH_WRITEMASK) != 0);
+    result &= check_value("cull", state.cull_enabled, glIsEnabled(GL_CULL_FACE) != 0);
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    for (int i = 0; i < 4; ++i) result &= check_value("viewport", state.viewport[i], viewport[i]);
+
+    return result;
+}
+
+gl_state_stats_t
+get_gl_state_stats()
+{
+    return state.stats;
+}
+
+void
+reset_gl_state_stats()
+{
+    state.stats = {};
+}
@@ -0,0 +1,58 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <GL/glew.h>
+#include <stdint.h>
+
+// Shadow copy of the GL state we touch, so redundant calls never reach the driver.
+// Everything that binds or toggles state should go through here, otherwise the shadow goes stale.
+// Debug builds can cross-check the shadow against glGet* with validate_gl_state.
+
+#ifdef _DEBUG
+#define GL_STATE_VALIDATION 1
+#endif
+
+#define GL_STATE_MAX_TEXTURE_UNITS 16
+#define GL_STATE_MAX_VERTEX_ATTRIBS 16
+
+struct gl_state_stats_t
+{
+    uint32_t calls_issued;
+    uint32_t calls_skipped;
+};
+
+// Reads the current GL state into the shadow, call once after the context is created.
+void init_gl_state();
+
+void bind_program(GLuint program);
+void bind_vertex_array(GLuint vertex_array);
+
+// GL_ELEMENT_ARRAY_BUFFER is part of the vertex array, the shadow follows bind_vertex_array.
+void bind_buffer(GLenum target, GLuint buffer);
+void bind_texture(GLuint unit, GLenum target, GLuint texture);
+
+// Binds both the draw and read framebuffer.
+void bind_framebuffer(GLuint framebuffer);
+
+// Attribute state applies to the current vertex array, pointers source from the current GL_ARRAY_BUFFER.
+void set_vertex_attrib_pointer(GLuint loc, GLint size, GLenum type, GLboolean normalized, GLsizei stride, size_t offset);
+void enable_vertex_attrib(GLuint loc, bool enabled);
+void set_vertex_attrib_divisor(GLuint loc, GLuint divisor);
+
+void set_blend_state(bool enabled, GLenum source_factor, GLenum destination_factor);
+void set_depth_state(bool test_enabled, bool write_enabled, GLenum func);
+void set_cull_state(bool enabled, GLenum face);
+void set_viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+// GL silently unbinds deleted objects, the shadow has to be told.
+void delete_gl_buffer(GLuint buffer);
+void delete_gl_texture(GLuint texture);
+void delete_gl_framebuffer(GLuint framebuffer);
+
+// Compares the shadow against the real state, prints every mismatch. Returns true when in sync.
+bool validate_gl_state();
+
+gl_state_stats_t get_gl_state_stats();
+void reset_gl_state_stats();
+
+#endif
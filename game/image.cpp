@@ -0,0 +1,1206 @@
+#include "image.h"
+#include "trace.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+bool
+is_compressed_format(image_format_t format)
+{
+    return format != IMAGE_FORMAT_RGBA8;
+}
+
+uint32_t
+get_image_row_size(image_format_t format, int width)
+{
+    switch (format)
+    {
+        case IMAGE_FORMAT_RGBA8: return width * 4;
+        case IMAGE_FORMAT_BC1: return ((width + 3) / 4) * 8;
+        default: return ((width + 3) / 4) * 16;
+    }
+}
+
+uint32_t
+get_image_level_size(image_format_t format, int width, int height)
+{
+    int rows = is_compressed_format(format) ? (height + 3) / 4 : height;
+    return get_image_row_size(format, width) * rows;
+}
+
+bool
+allocate_image(image_t *image, image_format_t format, int width, int height, int level_count)
+{
+    if (width <= 0 || height <= 0 || width > 16384 || height > 16384) return false;
+    if (level_count < 1 || level_count > IMAGE_MAX_LEVELS) return false;
+
+    image->format = format;
+    image->width = width;
+    image->height = height;
+    image->level_count = level_count;
+
+    uint32_t offset = 0;
+    for (int i = 0; i < level_count; ++i)
+    {
+        image_level_t *level = &image->levels[i];
+        level->width = width;
+        level->height = height;
+        level->offset = offset;
+        level->size = get_image_level_size(format, width, height);
+        offset += level->size;
+
+        if (width > 1) width /= 2;
+        if (height > 1) height /= 2;
+    }
+
+    image->data_size = offset;
+    image->data = (uint8_t *)malloc(offset);
+    return image->data != NULL;
+}
+
+void
+free_image(image_t *image)
+{
+    free(image->data);
+    *image = {};
+}
+
+static uint16_t
+read_u16_be(uint8_t *p)
+{
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static uint32_t
+read_u32_be(uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint16_t
+read_u16_le(uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t
+read_u32_le(uint8_t *p)
+{
+    return p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+//
+// Inflate (RFC 1951), enough for PNG. Output size is known up front so the output is a fixed buffer.
+//
+
+#define HUFFMAN_FAST_BITS 9
+
+struct huffman_t
+{
+    // (length << 9) | symbol for codes of up to HUFFMAN_FAST_BITS, indexed by the next bits of input.
+    uint16_t fast[1 << HUFFMAN_FAST_BITS];
+
+    // Canonical code, for the longer ones.
+    uint16_t counts[16];
+    uint16_t symbols[288];
+};
+
+struct inflate_t
+{
+    uint8_t *in;
+    uint8_t *in_end;
+    uint64_t bits;
+    int bit_count;
+    int overrun;
+
+    uint8_t *out;
+    uint32_t out_size;
+    uint32_t out_used;
+};
+
+static void
+refill_bits(inflate_t *s)
+{
+    while (s->bit_count <= 56)
+    {
+        uint64_t byte = 0;
+        if (s->in < s->in_end) byte = *s->in++;
+        else s->overrun++;
+
+        s->bits |= byte << s->bit_count;
+        s->bit_count += 8;
+    }
+}
+
+static uint32_t
+get_bits(inflate_t *s, int count)
+{
+    if (!count) return 0;
+    if (s->bit_count < count) refill_bits(s);
+
+    uint32_t result = (uint32_t)(s->bits & ((1ull << count) - 1));
+    s->bits >>= count;
+    s->bit_count -= count;
+    return result;
+}
+
+static bool
+build_huffman(huffman_t *h, uint8_t *lengths, int count)
+{
+    memset(h, 0, sizeof(*h));
+
+    for (int i = 0; i < count; ++i) h->counts[lengths[i]]++;
+    h->counts[0] = 0;
+
+    uint16_t offsets[16];
+    int index = 0;
+    for (int len = 1; len < 16; ++len)
+    {
+        offsets[len] = (uint16_t)index;
+        index += h->counts[len];
+    }
+
+    for (int i = 0; i < count; ++i)
+    {
+        if (lengths[i]) h->symbols[offsets[lengths[i]]++] = (uint16_t)i;
+    }
+
+    // Canonical codes, assigned in symbol order within each length. Incomplete codes are fine, oversubscribed ones are not.
+    uint16_t next_code[16] = {};
+    int code = 0;
+    for (int len = 1; len < 16; ++len)
+    {
+        code = (code + h->counts[len - 1]) << 1;
+        next_code[len] = (uint16_t)code;
+        if (code + h->counts[len] > (1 << len)) return false;
+    }
+
+    for (int i = 0; i < count; ++i)
+    {
+        int len = lengths[i];
+        if (!len || len > HUFFMAN_FAST_BITS) continue;
+
+        // Input bits come in reversed order.
+        int c = next_code[len]++;
+        int reversed = 0;
+        for (int b = 0; b < len; ++b) reversed |= ((c >> b) & 1) << (len - 1 - b);
+
+        for (int fill = reversed; fill < (1 << HUFFMAN_FAST_BITS); fill += 1 << len)
+        {
+            h->fast[fill] = (uint16_t)((len << 9) | i);
+        }
+    }
+
+    return true;
+}
+
+static int
+decode_symbol(inflate_t *s, huffman_t *h)
+{
+    if (s->bit_count < 16) refill_bits(s);
+
+    uint16_t entry = h->fast[s->bits & ((1 << HUFFMAN_FAST_BITS) - 1)];
+    if (entry)
+    {
+        int len = entry >> 9;
+        s->bits >>= len;
+        s->bit_count -= len;
+        return entry & 0x1FF;
+    }
+
+    // Walk the canonical code a bit at a time.
+    int code = 0;
+    int first = 0;
+    int index = 0;
+    for (int len = 1; len < 16; ++len)
+    {
+        code |= (int)((s->bits >> (len - 1)) & 1);
+        int count = h->counts[len];
+        if (code - first < count)
+        {
+            s->bits >>= len;
+            s->bit_count -= len;
+            return h->symbols[index + code - first];
+        }
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+
+    return -1;
+}
+
+static const uint16_t length_base[] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t length_extra[] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t distance_base[] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t distance_extra[] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+static bool
+inflate_block(inflate_t *s, huffman_t *literals, huffman_t *distances)
+{
+    for (;;)
+    {
+        int symbol = decode_symbol(s, literals);
+        if (symbol < 0) return false;
+
+        if (symbol < 256)
+        {
+            if (s->out_used == s->out_size) return false;
+            s->out[s->out_used++] = (uint8_t)symbol;
+        }
+        else if (symbol == 256)
+        {
+            return true;
+        }
+        else
+        {
+            symbol -= 257;
+            if (symbol >= 29) return false;
+            uint32_t length = length_base[symbol] + get_bits(s, length_extra[symbol]);
+
+            int distance_symbol = decode_symbol(s, distances);
+            if (distance_symbol < 0 || distance_symbol >= 30) return false;
+            uint32_t distance = distance_base[distance_symbol] + get_bits(s, distance_extra[distance_symbol]);
+
+            if (distance > s->out_used || length > s->out_size - s->out_used) return false;
+
+            // Byte by byte, the source may overlap what is being written.
+            uint8_t *dest = s->out + s->out_used;
+            uint8_t *src = dest - distance;
+            for (uint32_t i = 0; i < length; ++i) dest[i] = src[i];
+            s->out_used += length;
+        }
+
+        if (s->overrun > 8) return false;
+    }
+}
+
+static bool
+read_dynamic_tables(inflate_t *s, huffman_t *literals, huffman_t *distances)
+{
+    static const uint8_t order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+    int literal_count = get_bits(s, 5) + 257;
+    int distance_count = get_bits(s, 5) + 1;
+    int code_length_count = get_bits(s, 4) + 4;
+
+    // The fields can encode up to 288 and 32, more than deflate allows or lengths has room for.
+    if (literal_count > 286 || distance_count > 30) return false;
+
+    uint8_t code_lengths[19] = {};
+    for (int i = 0; i < code_length_count; ++i) code_lengths[order[i]] = (uint8_t)get_bits(s, 3);
+
+    huffman_t code_length_huffman;
+    if (!build_huffman(&code_length_huffman, code_lengths, 19)) return false;
+
+    uint8_t lengths[286 + 30];
+    int total = literal_count + distance_count;
+    int n = 0;
+    while (n < total)
+    {
+        int symbol = decode_symbol(s, &code_length_huffman);
+        if (symbol < 0) return false;
+
+        if (symbol < 16)
+        {
+            lengths[n++] = (uint8_t)symbol;
+            continue;
+        }
+
+        int repeat;
+        uint8_t value = 0;
+        if (symbol == 16)
+        {
+            if (!n) return false;
+            value = lengths[n - 1];
+            repeat = 3 + get_bits(s, 2);
+        }
+        else if (symbol == 17) repeat = 3 + get_bits(s, 3);
+        else repeat = 11 + get_bits(s, 7);
+
+        if (n + repeat > total) return false;
+        memset(lengths + n, value, repeat);
+        n += repeat;
+    }
+
+    return build_huffman(literals, lengths, literal_count) &&
+           build_huffman(distances, lengths + literal_count, distance_count);
+}
+
+// zlib stream in, exactly out_size bytes out.
+static bool
+zlib_decompress(uint8_t *in, uint32_t in_size, uint8_t *out, uint32_t out_size)
+{
+    if (in_size < 2) return false;
+
+    uint8_t cmf = in[0];
+    uint8_t flg = in[1];
+    if ((cmf & 15) != 8 || ((cmf << 8) | flg) % 31 != 0 || (flg & 32)) return false;
+
+    inflate_t s = {};
+    s.in = in + 2;
+    s.in_end = in + in_size;
+    s.out = out;
+    s.out_size = out_size;
+
+    huffman_t *literals = (huffman_t *)malloc(2 * sizeof(huffman_t));
+    huffman_t *distances = literals + 1;
+
+    bool ok = true;
+    bool last = false;
+    while (ok && !last)
+    {
+        last = get_bits(&s, 1) != 0;
+        uint32_t type = get_bits(&s, 2);
+
+        if (type == 0)
+        {
+            // Stored, drop to a byte boundary.
+            get_bits(&s, s.bit_count & 7);
+            uint32_t length = get_bits(&s, 16);
+            uint32_t inverse = get_bits(&s, 16);
+            if ((length ^ 0xFFFF) != inverse || length > s.out_size - s.out_used)
+            {
+                ok = false;
+                break;
+            }
+
+            for (uint32_t i = 0; i < length; ++i) s.out[s.out_used++] = (uint8_t)get_bits(&s, 8);
+            if (s.overrun > 8) ok = false;
+        }
+        else if (type == 1)
+        {
+            uint8_t lengths[288 + 32];
+            memset(lengths, 8, 144);
+            memset(lengths + 144, 9, 112);
+            memset(lengths + 256, 7, 24);
+            memset(lengths + 280, 8, 8);
+            memset(lengths + 288, 5, 32);
+
+            ok = build_huffman(literals, lengths, 288) && build_huffman(distances, lengths + 288, 32) &&
+                 inflate_block(&s, literals, distances);
+        }
+        else if (type == 2)
+        {
+            ok = read_dynamic_tables(&s, literals, distances) && inflate_block(&s, literals, distances);
+        }
+        else
+        {
+            ok = false;
+        }
+    }
+
+    free(literals);
+    return ok && s.out_used == out_size;
+}
+
+//
+// PNG
+//
+
+struct png_info_t
+{
+    int width;
+    int height;
+    int bit_depth;
+    int color_type;
+    int channels;
+
+    uint8_t palette[256 * 4];
+    bool has_key;
+    uint16_t key[3];
+};
+
+static int
+paeth(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = abs(p - a);
+    int pb = abs(p - b);
+    int pc = abs(p - c);
+    if (pa <= pb && pa <= pc) return a;
+    if (pb <= pc) return b;
+    return c;
+}
+
+static uint32_t
+get_png_stride(png_info_t *png, int width)
+{
+    return (width * png->channels * png->bit_depth + 7) / 8;
+}
+
+// Undoes the filters of one (sub)image in place, every row is a filter byte and stride bytes.
+static bool
+unfilter_png(png_info_t *png, uint8_t *data, int width, int height)
+{
+    uint32_t stride = get_png_stride(png, width);
+    int bpp = (png->channels * png->bit_depth + 7) / 8;
+
+    uint8_t *previous = NULL;
+    for (int y = 0; y < height; ++y)
+    {
+        uint8_t *row = data + y * (stride + 1);
+        int filter = row[0];
+        uint8_t *p = row + 1;
+
+        for (uint32_t x = 0; x < stride; ++x)
+        {
+            int a = x >= (uint32_t)bpp ? p[x - bpp] : 0;
+            int b = previous ? previous[x] : 0;
+            int c = (previous && x >= (uint32_t)bpp) ? previous[x - bpp] : 0;
+
+            switch (filter)
+            {
+                case 0: break;
+                case 1: p[x] = (uint8_t)(p[x] + a); break;
+                case 2: p[x] = (uint8_t)(p[x] + b); break;
+                case 3: p[x] = (uint8_t)(p[x] + ((a + b) >> 1)); break;
+                case 4: p[x] = (uint8_t)(p[x] + paeth(a, b, c)); break;
+                default: return false;
+            }
+        }
+
+        previous = p;
+    }
+    return true;
+}
+
+static int
+get_png_sample(uint8_t *row, int index, int bit_depth)
+{
+    switch (bit_depth)
+    {
+        case 8: return row[index];
+        case 16: return read_u16_be(row + index * 2);
+        default:
+        {
+            int per_byte = 8 / bit_depth;
+            int shift = 8 - bit_depth * (index % per_byte + 1);
+            return (row[index / per_byte] >> shift) & ((1 << bit_depth) - 1);
+        }
+    }
+}
+
+// Converts one unfiltered (sub)image to RGBA8, writing pixel (x, y) to dest + (y * y_step + y_start) * pitch + (x * x_step + x_start) * 4.
+static void
+expand_png(png_info_t *png, uint8_t *data, int width, int height, uint8_t *dest, uint32_t pitch,
+           int x_start, int y_start, int x_step, int y_step)
+{
+    uint32_t stride = get_png_stride(png, width);
+    int max_value = (1 << png->bit_depth) - 1;
+
+    for (int y = 0; y < height; ++y)
+    {
+        uint8_t *row = data + y * (stride + 1) + 1;
+        uint8_t *out_row = dest + (y * y_step + y_start) * pitch;
+
+        for (int x = 0; x < width; ++x)
+        {
+            uint8_t *out = out_row + (x * x_step + x_start) * 4;
+            int s[4];
+            for (int c = 0; c < png->channels; ++c) s[c] = get_png_sample(row, x * png->channels + c, png->bit_depth);
+
+            if (png->color_type == 3)
+            {
+                memcpy(out, png->palette + (s[0] & 255) * 4, 4);
+                continue;
+            }
+
+            int r, g, b, a = 255;
+            switch (png->color_type)
+            {
+                case 0: r = g = b = s[0] * 255 / max_value; break;
+                case 4: r = g = b = s[0] * 255 / max_value; a = s[1] * 255 / max_value; break;
+                case 2: r = s[0] * 255 / max_value; g = s[1] * 255 / max_value; b = s[2] * 255 / max_value; break;
+                default: r = s[0] * 255 / max_value; g = s[1] * 255 / max_value; b = s[2] * 255 / max_value; a = s[3] * 255 / max_value; break;
+            }
+
+            if (png->has_key)
+            {
+                if ((png->color_type == 0 && s[0] == png->key[0]) ||
+                    (png->color_type == 2 && s[0] == png->key[0] && s[1] == png->key[1] && s[2] == png->key[2]))
+                {
+                    a = 0;
+                }
+            }
+
+            out[0] = (uint8_t)r;
+            out[1] = (uint8_t)g;
+            out[2] = (uint8_t)b;
+            out[3] = (uint8_t)a;
+        }
+    }
+}
+
+static bool
+decode_png(image_t *image, uint8_t *data, uint32_t size)
+{
+    png_info_t png = {};
+    for (int i = 0; i < 256; ++i) png.palette[i * 4 + 3] = 255;
+
+    uint8_t *compressed = NULL;
+    uint32_t compressed_size = 0;
+    uint32_t compressed_capacity = 0;
+    int interlace = 0;
+    bool seen_header = false;
+
+    uint32_t offset = 8;
+    while (offset + 12 <= size)
+    {
+        uint32_t length = read_u32_be(data + offset);
+        uint8_t *type = data + offset + 4;
+        uint8_t *chunk = data + offset + 8;
+        if (length > size - offset - 12) break;
+
+        if (memcmp(type, "IHDR", 4) == 0 && length >= 13)
+        {
+            png.width = (int)read_u32_be(chunk);
+            png.height = (int)read_u32_be(chunk + 4);
+            png.bit_depth = chunk[8];
+            png.color_type = chunk[9];
+            interlace = chunk[12];
+            seen_header = true;
+        }
+        else if (memcmp(type, "PLTE", 4) == 0)
+        {
+            for (uint32_t i = 0; i < length / 3 && i < 256; ++i) memcpy(png.palette + i * 4, chunk + i * 3, 3);
+        }
+        else if (memcmp(type, "tRNS", 4) == 0)
+        {
+            if (png.color_type == 3)
+            {
+                for (uint32_t i = 0; i < length && i < 256; ++i) png.palette[i * 4 + 3] = chunk[i];
+            }
+            else if (length >= 2)
+            {
+                png.has_key = true;
+                for (uint32_t i = 0; i < 3 && i * 2 + 2 <= length; ++i) png.key[i] = read_u16_be(chunk + i * 2);
+            }
+        }
+        else if (memcmp(type, "IDAT", 4) == 0)
+        {
+            if (compressed_size + length > compressed_capacity)
+            {
+                compressed_capacity = (compressed_size + length) * 2;
+                compressed = (uint8_t *)realloc(compressed, compressed_capacity);
+            }
+            memcpy(compressed + compressed_size, chunk, length);
+            compressed_size += length;
+        }
+        else if (memcmp(type, "IEND", 4) == 0)
+        {
+            break;
+        }
+
+        offset += length + 12;
+    }
+
+    switch (png.color_type)
+    {
+        case 0: png.channels = 1; break;
+        case 2: png.channels = 3; break;
+        case 3: png.channels = 1; break;
+        case 4: png.channels = 2; break;
+        case 6: png.channels = 4; break;
+        default: png.channels = 0; break;
+    }
+
+    bool valid_depth = png.bit_depth == 1 || png.bit_depth == 2 || png.bit_depth == 4 || png.bit_depth == 8 || png.bit_depth == 16;
+    if (!seen_header || !compressed || !png.channels || !valid_depth || interlace > 1 ||
+        !allocate_image(image, IMAGE_FORMAT_RGBA8, png.width, png.height, 1))
+    {
+        free(compressed);
+        return false;
+    }
+
+    // Adam7 is seven sub images one after the other, each filtered on its own.
+    static const int pass_x[7] = { 0, 4, 0, 2, 0, 1, 0 };
+    static const int pass_y[7] = { 0, 0, 4, 0, 2, 0, 1 };
+    static const int pass_dx[7] = { 8, 8, 4, 4, 2, 2, 1 };
+    static const int pass_dy[7] = { 8, 8, 8, 4, 4, 2, 2 };
+
+    int pass_count = interlace ? 7 : 1;
+    int pass_width[7];
+    int pass_height[7];
+    uint32_t raw_size = 0;
+    for (int pass = 0; pass < pass_count; ++pass)
+    {
+        if (interlace)
+        {
+            pass_width[pass] = (png.width - pass_x[pass] + pass_dx[pass] - 1) / pass_dx[pass];
+            pass_height[pass] = (png.height - pass_y[pass] + pass_dy[pass] - 1) / pass_dy[pass];
+            if (pass_width[pass] <= 0 || pass_height[pass] <= 0) pass_width[pass] = pass_height[pass] = 0;
+        }
+        else
+        {
+            pass_width[pass] = png.width;
+            pass_height[pass] = png.height;
+        }
+
+        if (pass_width[pass]) raw_size += (get_png_stride(&png, pass_width[pass]) + 1) * pass_height[pass];
+    }
+
+    uint8_t *raw = (uint8_t *)malloc(raw_size);
+    bool ok = zlib_decompress(compressed, compressed_size, raw, raw_size);
+    free(compressed);
+
+    uint8_t *pass_data = raw;
+    for (int pass = 0; ok && pass < pass_count; ++pass)
+    {
+        int w = pass_width[pass];
+        int h = pass_height[pass];
+        if (!w) continue;
+
+        ok = unfilter_png(&png, pass_data, w, h);
+        if (!ok) break;
+
+        if (interlace) expand_png(&png, pass_data, w, h, image->data, png.width * 4, pass_x[pass], pass_y[pass], pass_dx[pass], pass_dy[pass]);
+        else expand_png(&png, pass_data, w, h, image->data, png.width * 4, 0, 0, 1, 1);
+
+        pass_data += (get_png_stride(&png, w) + 1) * h;
+    }
+
+    free(raw);
+    if (!ok) free_image(image);
+    return ok;
+}
+
+//
+// TGA, true color and grayscale, raw or RLE.
+//
+
+static bool
+decode_tga(image_t *image, uint8_t *data, uint32_t size)
+{
+    if (size < 18) return false;
+
+    int id_length = data[0];
+    int colormap_type = data[1];
+    int image_type = data[2];
+    int width = read_u16_le(data + 12);
+    int height = read_u16_le(data + 14);
+    int bits = data[16];
+    int descriptor = data[17];
+
+    bool rle = image_type == 10 || image_type == 11;
+    bool gray = image_type == 3 || image_type == 11;
+    if (colormap_type != 0 || !(image_type == 2 || image_type == 3 || rle)) return false;
+    if (gray ? bits != 8 : (bits != 24 && bits != 32)) return false;
+
+    int bytes = bits / 8;
+    uint8_t *p = data + 18 + id_length;
+    uint8_t *end = data + size;
+
+    if (!allocate_image(image, IMAGE_FORMAT_RGBA8, width, height, 1)) return false;
+
+    int pixel_count = width * height;
+    int packet_left = 0;
+    bool packet_repeat = false;
+    uint8_t pixel[4] = {};
+
+    for (int i = 0; i < pixel_count; ++i)
+    {
+        if (rle && !packet_left)
+        {
+            if (p >= end) break;
+            packet_left = (*p & 0x7F) + 1;
+            packet_repeat = (*p & 0x80) != 0;
+            p++;
+
+            if (packet_repeat)
+            {
+                if (p + bytes > end) break;
+                memcpy(pixel, p, bytes);
+                p += bytes;
+            }
+        }
+
+        if (!rle || !packet_repeat)
+        {
+            if (p + bytes > end) break;
+            memcpy(pixel, p, bytes);
+            p += bytes;
+        }
+        if (rle) packet_left--;
+
+        // Bottom up unless the descriptor says otherwise.
+        int x = i % width;
+        int y = i / width;
+        if (!(descriptor & 0x20)) y = height - 1 - y;
+
+        uint8_t *out = image->data + (y * width + x) * 4;
+        if (gray)
+        {
+            out[0] = out[1] = out[2] = pixel[0];
+            out[3] = 255;
+        }
+        else
+        {
+            out[0] = pixel[2];
+            out[1] = pixel[1];
+            out[2] = pixel[0];
+            out[3] = bytes == 4 ? pixel[3] : 255;
+        }
+    }
+
+    return true;
+}
+
+//
+// DDS and KTX, single 2D images with optional mips.
+//
+
+#define DDS_FOURCC(a, b, c, d) ((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+
+// Fills in where each level starts in the file, from offset on. Levels are tightly packed, or for
+// KTX prefixed with their size and padded to 4 bytes.
+static bool
+set_level_offsets(image_layout_t *layout, uint64_t offset)
+{
+    if (layout->width <= 0 || layout->height <= 0 || layout->width > 16384 || layout->height > 16384) return false;
+    if (layout->level_count < 1 || layout->level_count > IMAGE_MAX_LEVELS) return false;
+
+    int width = layout->width;
+    int height = layout->height;
+    for (int i = 0; i < layout->level_count; ++i)
+    {
+        uint32_t size = get_image_level_size(layout->format, width, height);
+        if (layout->size_prefixed) offset += 4;
+        if (offset + size > UINT32_MAX) return false;
+
+        layout->level_offsets[i] = (uint32_t)offset;
+        layout->level_sizes[i] = size;
+        offset += layout->size_prefixed ? (size + 3) & ~3u : size;
+
+        if (width > 1) width /= 2;
+        if (height > 1) height /= 2;
+    }
+    return true;
+}
+
+static bool
+read_dds_layout(image_layout_t *layout, uint8_t *data, uint32_t size)
+{
+    if (size < 128) return false;
+
+    uint8_t *header = data + 4;
+    uint32_t flags = read_u32_le(header + 4);
+    int height = (int)read_u32_le(header + 8);
+    int width = (int)read_u32_le(header + 12);
+    int level_count = (flags & 0x20000) ? (int)read_u32_le(header + 24) : 1;
+    if (level_count < 1) level_count = 1;
+
+    uint32_t pixel_flags = read_u32_le(header + 76);
+    uint32_t fourcc = read_u32_le(header + 80);
+    uint32_t rgb_bits = read_u32_le(header + 84);
+    uint32_t red_mask = read_u32_le(header + 88);
+    uint32_t alpha_mask = read_u32_le(header + 100);
+    uint32_t caps2 = read_u32_le(header + 108);
+
+    // No cube maps or volumes.
+    if (caps2 & 0x200 || caps2 & 0x200000) return false;
+
+    uint32_t offset = 128;
+    image_format_t format = IMAGE_FORMAT_COUNT;
+    bool swap_red_blue = false;
+
+    if (pixel_flags & 0x4)
+    {
+        if (fourcc == DDS_FOURCC('D', 'X', 'T', '1')) format = IMAGE_FORMAT_BC1;
+        else if (fourcc == DDS_FOURCC('D', 'X', 'T', '5')) format = IMAGE_FORMAT_BC3;
+        else if (fourcc == DDS_FOURCC('A', 'T', 'I', '2') || fourcc == DDS_FOURCC('B', 'C', '5', 'U')) format = IMAGE_FORMAT_BC5;
+        else if (fourcc == DDS_FOURCC('D', 'X', '1', '0'))
+        {
+            if (size < 148) return false;
+
+            uint32_t dxgi_format = read_u32_le(data + 128);
+            uint32_t dimension = read_u32_le(data + 132);
+            uint32_t array_size = read_u32_le(data + 140);
+            if (dimension != 3 || array_size > 1) return false;
+
+            switch (dxgi_format)
+            {
+                case 28: case 29: format = IMAGE_FORMAT_RGBA8; break;
+                case 87: case 91: format = IMAGE_FORMAT_RGBA8; swap_red_blue = true; break;
+                case 71: case 72: format = IMAGE_FORMAT_BC1; break;
+                case 77: case 78: format = IMAGE_FORMAT_BC3; break;
+                case 83: format = IMAGE_FORMAT_BC5; break;
+                case 98: case 99: format = IMAGE_FORMAT_BC7; break;
+            }
+            offset = 148;
+        }
+    }
+    else if ((pixel_flags & 0x40) && rgb_bits == 32 && alpha_mask == 0xFF000000)
+    {
+        if (red_mask == 0x000000FF) format = IMAGE_FORMAT_RGBA8;
+        else if (red_mask == 0x00FF0000)
+        {
+            format = IMAGE_FORMAT_RGBA8;
+            swap_red_blue = true;
+        }
+    }
+
+    if (format == IMAGE_FORMAT_COUNT) return false;
+
+    *layout = {};
+    layout->format = format;
+    layout->width = width;
+    layout->height = height;
+    layout->level_count = level_count;
+    layout->swap_red_blue = swap_red_blue;
+    return set_level_offsets(layout, offset);
+}
+
+static void
+write_u32_le(uint8_t *p, uint32_t value)
+{
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+    p[2] = (uint8_t)(value >> 16);
+    p[3] = (uint8_t)(value >> 24);
+}
+
+bool
+save_dds(image_t *image, char *filepath)
+{
+    uint8_t header[148] = {};
+    uint32_t header_size = 128;
+
+    memcpy(header, "DDS ", 4);
+    uint8_t *h = header + 4;
+
+    // CAPS | HEIGHT | WIDTH | PIXELFORMAT | MIPMAPCOUNT, and PITCH or LINEARSIZE.
+    uint32_t flags = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000;
+    flags |= is_compressed_format(image->format) ? 0x80000 : 0x8;
+
+    write_u32_le(h + 0, 124);
+    write_u32_le(h + 4, flags);
+    write_u32_le(h + 8, image->height);
+    write_u32_le(h + 12, image->width);
+    write_u32_le(h + 16, is_compressed_format(image->format) ? image->levels[0].size : get_image_row_size(image->format, image->width));
+    write_u32_le(h + 24, image->level_count);
+    write_u32_le(h + 72, 32);
+
+    switch (image->format)
+    {
+        case IMAGE_FORMAT_RGBA8:
+            write_u32_le(h + 76, 0x41); // RGB | ALPHAPIXELS
+            write_u32_le(h + 84, 32);
+            write_u32_le(h + 88, 0x000000FF);
+            write_u32_le(h + 92, 0x0000FF00);
+            write_u32_le(h + 96, 0x00FF0000);
+            write_u32_le(h + 100, 0xFF000000);
+            break;
+        case IMAGE_FORMAT_BC1:
+            write_u32_le(h + 76, 0x4);
+            write_u32_le(h + 80, DDS_FOURCC('D', 'X', 'T', '1'));
+            break;
+        case IMAGE_FORMAT_BC3:
+            write_u32_le(h + 76, 0x4);
+            write_u32_le(h + 80, DDS_FOURCC('D', 'X', 'T', '5'));
+            break;
+        case IMAGE_FORMAT_BC5:
+            write_u32_le(h + 76, 0x4);
+            write_u32_le(h + 80, DDS_FOURCC('A', 'T', 'I', '2'));
+            break;
+        case IMAGE_FORMAT_BC7:
+            write_u32_le(h + 76, 0x4);
+            write_u32_le(h + 80, DDS_FOURCC('D', 'X', '1', '0'));
+            write_u32_le(header + 128, 98); // DXGI_FORMAT_BC7_UNORM
+            write_u32_le(header + 132, 3); // TEXTURE2D
+            write_u32_le(header + 140, 1);
+            header_size = 148;
+            break;
+        default:
+            return false;
+    }
+
+    // TEXTURE, plus COMPLEX | MIPMAP when there is a chain.
+    write_u32_le(h + 104, image->level_count > 1 ? 0x401008 : 0x1000);
+
+    FILE *file = fopen(filepath, "wb");
+    if (!file) return false;
+
+    bool result = fwrite(header, 1, header_size, file) == header_size &&
+                  fwrite(image->data, 1, image->data_size, file) == image->data_size;
+    fclose(file);
+    return result;
+}
+
+static const uint8_t ktx_identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+static bool
+read_ktx_layout(image_layout_t *layout, uint8_t *data, uint32_t size)
+{
+    if (size < 64 || read_u32_le(data + 12) != 0x04030201) return false;
+
+    uint32_t gl_type = read_u32_le(data + 16);
+    uint32_t gl_format = read_u32_le(data + 24);
+    uint32_t gl_internal_format = read_u32_le(data + 28);
+    int width = (int)read_u32_le(data + 36);
+    int height = (int)read_u32_le(data + 40);
+    uint32_t depth = read_u32_le(data + 44);
+    uint32_t array_elements = read_u32_le(data + 48);
+    uint32_t faces = read_u32_le(data + 52);
+    int level_count = (int)read_u32_le(data + 56);
+    uint32_t key_value_size = read_u32_le(data + 60);
+    if (level_count < 1) level_count = 1;
+
+    if (depth > 1 || array_elements > 1 || faces != 1) return false;
+
+    // GL enums, spelled out so this file doesn't need the GL headers.
+    image_format_t format = IMAGE_FORMAT_COUNT;
+    switch (gl_internal_format)
+    {
+        case 0x8058: if (gl_type == 0x1401 && gl_format == 0x1908) format = IMAGE_FORMAT_RGBA8; break; // GL_RGBA8, GL_UNSIGNED_BYTE, GL_RGBA
+        case 0x83F0: case 0x83F1: format = IMAGE_FORMAT_BC1; break; // GL_COMPRESSED_RGB(A)_S3TC_DXT1_EXT
+        case 0x83F3: format = IMAGE_FORMAT_BC3; break; // GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+        case 0x8DBD: format = IMAGE_FORMAT_BC5; break; // GL_COMPRESSED_RG_RGTC2
+        case 0x8E8C: format = IMAGE_FORMAT_BC7; break; // GL_COMPRESSED_RGBA_BPTC_UNORM
+    }
+    if (format == IMAGE_FORMAT_COUNT) return false;
+
+    *layout = {};
+    layout->format = format;
+    layout->width = width;
+    layout->height = height;
+    layout->level_count = level_count;
+    layout->size_prefixed = true;
+    return set_level_offsets(layout, 64 + (uint64_t)key_value_size);
+}
+
+bool
+read_image_layout(image_layout_t *layout, uint8_t *header, uint32_t size)
+{
+    if (size >= 4 && memcmp(header, "DDS ", 4) == 0) return read_dds_layout(layout, header, size);
+    if (size >= 12 && memcmp(header, ktx_identifier, 12) == 0) return read_ktx_layout(layout, header, size);
+    return false;
+}
+
+static void
+swap_red_blue(image_t *image)
+{
+    for (uint32_t i = 0; i < image->data_size; i += 4)
+    {
+        uint8_t t = image->data[i];
+        image->data[i] = image->data[i + 2];
+        image->data[i + 2] = t;
+    }
+}
+
+// The whole file is in memory, copies every level out of it.
+static bool
+copy_image_levels(image_t *image, image_layout_t *layout, uint8_t *data, uint32_t size)
+{
+    if (!allocate_image(image, layout->format, layout->width, layout->height, layout->level_count)) return false;
+
+    for (int i = 0; i < layout->level_count; ++i)
+    {
+        uint32_t offset = layout->level_offsets[i];
+        uint32_t level_size = layout->level_sizes[i];
+        if (level_size > size || offset > size - level_size ||
+            (layout->size_prefixed && read_u32_le(data + offset - 4) != level_size))
+        {
+            free_image(image);
+            return false;
+        }
+
+        memcpy(image->data + image->levels[i].offset, data + offset, level_size);
+    }
+
+    if (layout->swap_red_blue) swap_red_blue(image);
+    return true;
+}
+
+bool
+read_image_levels(image_t *image, FILE *file, image_layout_t *layout, int first_level, int level_count)
+{
+    TRACE_SCOPE("read_image_levels");
+
+    *image = {};
+    if (first_level < 0 || level_count < 1 || first_level + level_count > layout->level_count) return false;
+
+    int width = layout->width >> first_level;
+    int height = layout->height >> first_level;
+    if (!allocate_image(image, layout->format, width ? width : 1, height ? height : 1, level_count)) return false;
+
+    for (int i = 0; i < level_count; ++i)
+    {
+        image_level_t *level = &image->levels[i];
+        uint32_t offset = layout->level_offsets[first_level + i];
+
+        bool ok;
+        if (layout->size_prefixed)
+        {
+            uint8_t prefix[4];
+            ok = fseek(file, (long)offset - 4, SEEK_SET) == 0 && fread(prefix, 1, 4, file) == 4 &&
+                 read_u32_le(prefix) == level->size;
+        }
+        else
+        {
+            ok = fseek(file, (long)offset, SEEK_SET) == 0;
+        }
+
+        if (!ok || fread(image->data + level->offset, 1, level->size, file) != level->size)
+        {
+            free_image(image);
+            return false;
+        }
+    }
+
+    if (layout->swap_red_blue) swap_red_blue(image);
+    return true;
+}
+
+bool
+decode_image(image_t *image, uint8_t *data, uint32_t size)
+{
+    static const uint8_t png_signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+    *image = {};
+
+    if (size >= 8 && memcmp(data, png_signature, 8) == 0) return decode_png(image, data, size);
+
+    image_layout_t layout;
+    if (read_image_layout(&layout, data, size)) return copy_image_levels(image, &layout, data, size);
+    if ((size >= 4 && memcmp(data, "DDS ", 4) == 0) || (size >= 12 && memcmp(data, ktx_identifier, 12) == 0)) return false;
+
+    // TGA has no signature, it is whatever is left.
+    return decode_tga(image, data, size);
+}
+
+bool
+load_image(image_t *image, char *filepath)
+{
+    TRACE_SCOPE("load_image");
+
+    *image = {};
+
+    FILE *file = fopen(filepath, "rb");
+    if (!file) return false;
+
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    uint8_t *data = NULL;
+    if (length > 0)
+    {
+        data = (uint8_t *)malloc(length);
+        if (fread(data, 1, length, file) != (size_t)length)
+        {
+            free(data);
+            data = NULL;
+        }
+    }
+    fclose(file);
+
+    if (!data) return false;
+
+    bool result = decode_image(image, data, (uint32_t)length);
+    free(data);
+    return result;
+}
+
+int
+get_mip_level_count(int width, int height)
+{
+    int level_count = 1;
+    for (int size = width > height ? width : height; size > 1; size /= 2) level_count++;
+    return level_count < IMAGE_MAX_LEVELS ? level_count : IMAGE_MAX_LEVELS;
+}
+
+// Averages the scale x scale block of source texels under each dest texel, cut off at the edges.
+static void
+box_filter_level(uint8_t *src, int src_width, int src_height, uint8_t *dest, int dest_width, int dest_height, int scale)
+{
+    for (int y = 0; y < dest_height; ++y)
+    {
+        int y0 = y * scale;
+        int y1 = y0 + scale < src_height ? y0 + scale : src_height;
+
+        for (int x = 0; x < dest_width; ++x)
+        {
+            int x0 = x * scale;
+            int x1 = x0 + scale < src_width ? x0 + scale : src_width;
+
+            uint64_t sum[4] = {};
+            for (int sy = y0; sy < y1; ++sy)
+            {
+                uint8_t *p = src + (sy * src_width + x0) * 4;
+                for (int sx = x0; sx < x1; ++sx, p += 4)
+                {
+                    sum[0] += p[0];
+                    sum[1] += p[1];
+                    sum[2] += p[2];
+                    sum[3] += p[3];
+                }
+            }
+
+            uint64_t count = (uint64_t)(x1 - x0) * (y1 - y0);
+            uint8_t *out = dest + (y * dest_width + x) * 4;
+            for (int c = 0; c < 4; ++c) out[c] = (uint8_t)((sum[c] + count / 2) / count);
+        }
+    }
+}
+
+bool
+generate_image_mips(image_t *image, int first_level)
+{
+    if (image->format != IMAGE_FORMAT_RGBA8 || image->level_count != 1) return false;
+
+    int level_count = get_mip_level_count(image->width, image->height);
+    if (first_level < 0 || first_level >= level_count) return false;
+
+    int width = image->width >> first_level;
+    int height = image->height >> first_level;
+
+    image_t result = {};
+    if (!allocate_image(&result, IMAGE_FORMAT_RGBA8, width ? width : 1, height ? height : 1, level_count - first_level)) return false;
+
+    // Straight down to first_level, the levels in between are never made.
+    if (first_level)
+    {
+        box_filter_level(image->data, image->width, image->height, result.data,
+                         result.levels[0].width, result.levels[0].height, 1 << first_level);
+    }
+    else
+    {
+        memcpy(result.data, image->data, image->levels[0].size);
+    }
+
+    // 2x2 box filter, odd sizes repeat the last row or column.
+    for (int i = 1; i < result.level_count; ++i)
+    {
+        image_level_t *src_level = &result.levels[i - 1];
+        image_level_t *dest_level = &result.levels[i];
+        uint8_t *src = result.data + src_level->offset;
+        uint8_t *dest = result.data + dest_level->offset;
+
+        for (int y = 0; y < dest_level->height; ++y)
+        {
+            int y0 = y * 2;
+            int y1 = y0 + 1 < src_level->height ? y0 + 1 : y0;
+            uint8_t *row0 = src + y0 * src_level->width * 4;
+            uint8_t *row1 = src + y1 * src_level->width * 4;
+
+            for (int x = 0; x < dest_level->width; ++x)
+            {
+                int x0 = x * 2 * 4;
+                int x1 = x * 2 + 1 < src_level->width ? x0 + 4 : x0;
+                uint8_t *out = dest + (y * dest_level->width + x) * 4;
+
+                for (int c = 0; c < 4; ++c)
+                {
+                    out[c] = (uint8_t)((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >> 2);
+                }
+            }
+        }
+    }
+
+    free_image(image);
+    *image = result;
+    return true;
+}
@@ -0,0 +1,99 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// CPU side images with their mip chain. PNG and TGA decode to RGBA8, DDS and KTX keep whatever
+// is stored in them, block compressed levels included. Nothing here touches GL, so all of it can
+// run on worker threads.
+
+#define IMAGE_MAX_LEVELS 16
+
+enum image_format_t
+{
+    IMAGE_FORMAT_RGBA8,
+    IMAGE_FORMAT_BC1, // RGB + 1 bit alpha, 8 bytes per 4x4 block
+    IMAGE_FORMAT_BC3, // RGBA, 16 bytes per block
+    IMAGE_FORMAT_BC5, // Two channels, for normal maps, 16 bytes per block
+    IMAGE_FORMAT_BC7, // RGBA, 16 bytes per block
+
+    IMAGE_FORMAT_COUNT,
+};
+
+struct image_level_t
+{
+    int width;
+    int height;
+    uint32_t offset;
+    uint32_t size;
+};
+
+struct image_t
+{
+    image_format_t format;
+    int width;
+    int height;
+
+    int level_count;
+    image_level_t levels[IMAGE_MAX_LEVELS];
+
+    // All levels, largest first.
+    uint8_t *data;
+    uint32_t data_size;
+};
+
+// Picks the decoder from the file contents.
+bool load_image(image_t *image, char *filepath);
+bool decode_image(image_t *image, uint8_t *data, uint32_t size);
+void free_image(image_t *image);
+
+// Fills in the level table for level_count tightly packed levels, each half the previous one, and allocates data.
+bool allocate_image(image_t *image, image_format_t format, int width, int height, int level_count);
+
+// Where the levels of a DDS or KTX file are, so a range of them can be read without the rest.
+// PNG and TGA have no such thing, they are decoded whole.
+#define IMAGE_LAYOUT_HEADER_SIZE 148
+
+struct image_layout_t
+{
+    image_format_t format;
+    int width;
+    int height;
+    int level_count;
+
+    // File offsets of each level's data, largest first.
+    uint32_t level_offsets[IMAGE_MAX_LEVELS];
+    uint32_t level_sizes[IMAGE_MAX_LEVELS];
+
+    bool swap_red_blue;
+    bool size_prefixed; // KTX, the 4 bytes before each level hold its size.
+};
+
+// From the first IMAGE_LAYOUT_HEADER_SIZE bytes of the file, or all of it when it is shorter.
+// False for PNG, TGA and anything decode_image would reject.
+bool read_image_layout(image_layout_t *layout, uint8_t *header, uint32_t size);
+
+// Reads level_count levels from first_level on, seeking past everything else. image's level 0
+// is the file's first_level.
+bool read_image_levels(image_t *image, FILE *file, image_layout_t *layout, int first_level, int level_count);
+
+// DDS with a DX10 header only where the legacy one can't say it (BC7).
+bool save_dds(image_t *image, char *filepath);
+
+// Box filters an RGBA8 image with a single level down to 1x1, keeping the levels from first_level
+// on. Level first_level is filtered straight from the source, the finer ones are never made.
+bool generate_image_mips(image_t *image, int first_level);
+
+// Levels in a full chain down to 1x1, capped at IMAGE_MAX_LEVELS.
+int get_mip_level_count(int width, int height);
+
+bool is_compressed_format(image_format_t format);
+
+// Bytes of a width * height level, for compressed formats rounded up to whole blocks.
+uint32_t get_image_level_size(image_format_t format, int width, int height);
+
+// Bytes per row of pixels, or per row of 4x4 blocks for compressed formats.
+uint32_t get_image_row_size(image_format_t format, int width);
+
+#endif
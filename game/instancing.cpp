@@ -0,0 +1,199 @@
+#include "instancing.h"
+#include "geometry_pool.h"
+#include "gl_state.h"
+#include "utils.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void
+init_instance_renderer(instance_renderer_t *renderer, uint32_t max_instances)
+{
+    *renderer = {};
+
+    renderer->max_instances = max_instances;
+    renderer->instances = (instance_t *)malloc(max_instances * sizeof(instance_t));
+    renderer->buckets = (instance_bucket_t *)malloc(max_instances * sizeof(instance_bucket_t));
+
+    init_stream_buffer(&renderer->instance_stream, GL_ARRAY_BUFFER, max_instances * sizeof(instance_transform_t));
+}
+
+void
+free_instance_renderer(instance_renderer_t *renderer)
+{
+    free_stream_buffer(&renderer->instance_stream);
+
+    free(renderer->instances);
+    free(renderer->buckets);
+
+    *renderer = {};
+}
+
+void
+begin_instances(instance_renderer_t *renderer)
+{
+    renderer->instance_count = 0;
+    renderer->bucket_count = 0;
+
+    begin_stream_buffer_frame(&renderer->instance_stream);
+}
+
+instance_t
+make_instance(handle_t mesh, int lod_index, handle_t material, mat4 object_to_world)
+{
+    instance_t result;
+    result.material = material;
+    result.mesh = mesh;
+    result.lod_index = lod_index;
+    result.transform.rows[0] = object_to_world.rows[0];
+    result.transform.rows[1] = object_to_world.rows[1];
+    result.transform.rows[2] = object_to_world.rows[2];
+    return result;
+}
+
+bool
+add_instance(instance_renderer_t *renderer, handle_t mesh, int lod_index, handle_t material, mat4 object_to_world)
+{
+    if (renderer->instance_count == renderer->max_instances) return false;
+
+    renderer->instances[renderer->instance_count++] = make_instance(mesh, lod_index, material, object_to_world);
+    return true;
+}
+
+bool
+append_instances(instance_renderer_t *renderer, instance_t *instances, uint32_t count)
+{
+    bool result = true;
+    if (count > renderer->max_instances - renderer->instance_count)
+    {
+        count = renderer->max_instances - renderer->instance_count;
+        result = false;
+    }
+
+    memcpy(renderer->instances + renderer->instance_count, instances, count * sizeof(instance_t));
+    renderer->instance_count += count;
+
+    return result;
+}
+
+static int
+compare_instances(const void *a, const void *b)
+{
+    instance_t *ia = (instance_t *)a;
+    instance_t *ib = (instance_t *)b;
+
+    // Material first so shader changes are grouped together.
+    if (ia->material != ib->material) return (ia->material < ib->material) ? -1 : 1;
+    if (ia->mesh != ib->mesh) return (ia->mesh < ib->mesh) ? -1 : 1;
+    return ia->lod_index - ib->lod_index;
+}
+
+// Writes the sorted transforms straight into the (write combined) stream buffer memory.
+static void
+build_instance_buckets(instance_renderer_t *renderer, instance_transform_t *transforms)
+{
+    qsort(renderer->instances, renderer->instance_count, sizeof(instance_t), compare_instances);
+
+    instance_bucket_t *bucket = NULL;
+    for (uint32_t i = 0; i < renderer->instance_count; ++i)
+    {
+        instance_t *instance = &renderer->instances[i];
+        transforms[i] = instance->transform;
+
+        if (!bucket ||
+            bucket->material != instance->material ||
+            bucket->mesh != instance->mesh ||
+            bucket->lod_index != instance->lod_index)
+        {
+            bucket = &renderer->buckets[renderer->bucket_count++];
+            bucket->material = instance->material;
+            bucket->mesh = instance->mesh;
+            bucket->lod_index = instance->lod_index;
+            bucket->first_instance = i;
+            bucket->instance_count = 0;
+        }
+
+        bucket->instance_count++;
+    }
+}
+
+static void
+set_instance_format(GLint loc, size_t offset)
+{
+    for (int row = 0; row < 3; ++row)
+    {
+        set_vertex_attrib_pointer(loc + row, 4, GL_FLOAT, GL_FALSE, sizeof(instance_transform_t), offset + row * sizeof(vec4));
+        set_vertex_attrib_divisor(loc + row, 1);
+        enable_vertex_attrib(loc + row, true);
+    }
+}
+
+static void
+clear_instance_format(GLint loc)
+{
+    for (int row = 0; row < 3; ++row)
+    {
+        set_vertex_attrib_divisor(loc + row, 0);
+        enable_vertex_attrib(loc + row, false);
+    }
+}
+
+void
+draw_instances(instance_renderer_t *renderer, mat4 world_to_proj)
+{
+    renderer->draw_call_count = 0;
+    if (!renderer->instance_count) return;
+
+    uint32_t transforms_size = renderer->instance_count * sizeof(instance_transform_t);
+    uint32_t transforms_offset;
+    instance_transform_t *transforms = (instance_transform_t *)map_stream_buffer(&renderer->instance_stream, transforms_size, sizeof(vec4), &transforms_offset);
+    if (!transforms) return;
+
+    build_instance_buckets(renderer, transforms);
+    unmap_stream_buffer(&renderer->instance_stream);
+
+    GLint instance_loc = -1;
+    shader_t *prepared = NULL;
+    for (uint32_t i = 0; i < renderer->bucket_count; ++i)
+    {
+        instance_bucket_t *bucket = &renderer->buckets[i];
+
+        mesh_t *mesh = get_mesh(bucket->mesh);
+        material_t *material = get_material(bucket->material);
+        if (!mesh || !material) continue;
+
+        mesh_lod_t *lod = &mesh->lods[bucket->lod_index];
+
+        set_material(bucket->material);
+
+        shader_t *shader = material->shader;
+        ASSERT(shader->input_instance_transform_loc != -1);
+
+        // Every mesh lives in the geometry pool, so the vertex format only changes with the shader.
+        // Skipped buckets don't count, the first drawn one sets everything up.
+        if (shader != prepared)
+        {
+            prepared = shader;
+            glUniformMatrix4fv(shader->world_to_proj_loc, 1, GL_TRUE, &world_to_proj._11);
+
+            bind_geometry_pool();
+            set_vertex_format_to_mesh();
+        }
+
+        if (instance_loc != -1 && instance_loc != shader->input_instance_transform_loc) clear_instance_format(instance_loc);
+        instance_loc = shader->input_instance_transform_loc;
+
+        bind_buffer(GL_ARRAY_BUFFER, renderer->instance_stream.buffer);
+        set_instance_format(instance_loc, transforms_offset + bucket->first_instance * sizeof(instance_transform_t));
+
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, lod->index_count, GL_UNSIGNED_INT,
+                                          get_mesh_index_offset(mesh, lod->first_index),
+                                          bucket->instance_count, get_mesh_base_vertex(mesh));
+        renderer->draw_call_count++;
+    }
+
+    // Divisors live in the VAO, don't leak them into non instanced draws.
+    if (instance_loc != -1) clear_instance_format(instance_loc);
+
+    end_stream_buffer_frame(&renderer->instance_stream);
+}
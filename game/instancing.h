@@ -0,0 +1,64 @@
+#ifndef INSTANCING_H
+#define INSTANCING_H
+
+#include "mesh.h"
+#include "material.h"
+#include "stream_buffer.h"
+
+// First three rows of object_to_world, the fourth one is always (0, 0, 0, 1).
+struct instance_transform_t
+{
+    vec4 rows[3];
+};
+
+struct instance_t
+{
+    handle_t material;
+    handle_t mesh;
+    int lod_index;
+
+    instance_transform_t transform;
+};
+
+// A run of instances sharing mesh, LOD and material, drawn with one glDrawElementsInstanced.
+struct instance_bucket_t
+{
+    handle_t material;
+    handle_t mesh;
+    int lod_index;
+
+    uint32_t first_instance;
+    uint32_t instance_count;
+};
+
+struct instance_renderer_t
+{
+    stream_buffer_t instance_stream;
+    uint32_t max_instances;
+
+    instance_t *instances;
+    uint32_t instance_count;
+
+    instance_bucket_t *buckets;
+    uint32_t bucket_count;
+
+    // Stats of the last draw_instances.
+    uint32_t draw_call_count;
+};
+
+void init_instance_renderer(instance_renderer_t *renderer, uint32_t max_instances);
+void free_instance_renderer(instance_renderer_t *renderer);
+
+void begin_instances(instance_renderer_t *renderer);
+
+// The material's shader must read input_instance_transform. Returns false once max_instances is reached.
+bool add_instance(instance_renderer_t *renderer, handle_t mesh, int lod_index, handle_t material, mat4 object_to_world);
+
+// For recording on other threads, instances built with make_instance can be handed over in bulk.
+instance_t make_instance(handle_t mesh, int lod_index, handle_t material, mat4 object_to_world);
+bool append_instances(instance_renderer_t *renderer, instance_t *instances, uint32_t count);
+
+// Buckets everything added since begin_instances and draws one instanced call per bucket.
+void draw_instances(instance_renderer_t *renderer, mat4 world_to_proj);
+
+#endif
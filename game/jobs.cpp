@@ -0,0 +1,661 @@
+#include "jobs.h"
+#include "trace.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <ucontext.h>
+#endif
+
+// Lê, Pop, Cohen and Zappa Nardelli's C11 version of the Chase-Lev deque, without growing.
+// bottom is only written by the owner, top moves forward on every pop that races a steal.
+struct job_deque_t
+{
+    std::atomic<int64_t> top;
+    std::atomic<int64_t> bottom;
+    std::atomic<job_t *> jobs[JOBS_DEQUE_SIZE];
+};
+
+struct job_thread_t;
+
+// A stack to run jobs on. A fiber runs one job after another until a job waits, then it's parked
+// with that job still on it and its thread carries on with another fiber. Whichever thread sees
+// the counter reach zero makes it ready, and the next thread with nothing better to do resumes it.
+struct fiber_t
+{
+#ifdef _WIN32
+    void *handle;
+    void *caller;
+#else
+    ucontext_t context;
+    ucontext_t *caller;
+    void *stack;
+#endif
+
+    job_thread_t *thread; // Running it, set on every resume.
+    job_t *job; // Next to run.
+    job_counter_t *wait_counter; // What it's parked on.
+    bool finished; // Done with its job, free for another.
+};
+
+struct job_thread_t
+{
+    job_deque_t deque;
+    uint32_t random; // For picking whom to steal from.
+
+    // Runs the jobs this thread starts, until one of them parks it.
+    fiber_t *spare_fiber;
+
+    std::atomic<uint64_t> jobs_run;
+    std::atomic<uint64_t> jobs_stolen;
+};
+
+static job_thread_t *threads;
+static int thread_count;
+
+static std::thread *workers;
+static int worker_count;
+
+// Jobs pushed but not taken yet and ready fibers, for workers to know when to sleep.
+static std::atomic<int> queued_jobs;
+static std::atomic<int> sleeping_workers;
+static std::mutex sleep_mutex;
+static std::condition_variable wake_up;
+static bool quit;
+
+// The free, parked and ready fibers, under fiber_mutex. The counts are there to look at without
+// taking it.
+static fiber_t *fibers;
+static std::mutex fiber_mutex;
+static fiber_t *free_fibers[JOBS_FIBER_COUNT];
+static int free_fiber_count;
+static fiber_t *parked_fibers[JOBS_FIBER_COUNT];
+static int parked_fiber_count;
+static fiber_t *ready_fibers[JOBS_FIBER_COUNT];
+static int ready_fiber_count;
+static std::atomic<int> parked_count;
+static std::atomic<int> ready_count;
+static std::atomic<uint64_t> fiber_waits;
+
+static thread_local int this_thread_index = -1;
+static thread_local fiber_t *this_fiber;
+
+// Spins before a worker with nothing to do goes to sleep.
+#define IDLE_SPINS 64
+
+static bool
+push_job(job_deque_t *deque, job_t *job)
+{
+    int64_t bottom = deque->bottom.load(std::memory_order_relaxed);
+    int64_t top = deque->top.load(std::memory_order_acquire);
+    if (bottom - top >= JOBS_DEQUE_SIZE) return false;
+
+    deque->jobs[bottom & (JOBS_DEQUE_SIZE - 1)].store(job, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    deque->bottom.store(bottom + 1, std::memory_order_relaxed);
+    return true;
+}
+
+// Owner only, newest first.
+static job_t *
+pop_job(job_deque_t *deque)
+{
+    int64_t bottom = deque->bottom.load(std::memory_order_relaxed) - 1;
+    deque->bottom.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = deque->top.load(std::memory_order_relaxed);
+
+    job_t *job = NULL;
+    if (top <= bottom)
+    {
+        job = deque->jobs[bottom & (JOBS_DEQUE_SIZE - 1)].load(std::memory_order_relaxed);
+        if (top == bottom)
+        {
+            // The last one, a thief may be after it too.
+            if (!deque->top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            {
+                job = NULL;
+            }
+            deque->bottom.store(bottom + 1, std::memory_order_relaxed);
+        }
+    }
+    else
+    {
+        deque->bottom.store(bottom + 1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+// Any thread, oldest first. NULL when empty or when another thread got there first.
+static job_t *
+steal_job(job_deque_t *deque)
+{
+    int64_t top = deque->top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t bottom = deque->bottom.load(std::memory_order_acquire);
+    if (top >= bottom) return NULL;
+
+    job_t *job = deque->jobs[top & (JOBS_DEQUE_SIZE - 1)].load(std::memory_order_relaxed);
+    if (!deque->top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+    {
+        return NULL;
+    }
+    return job;
+}
+
+static void
+wake_workers()
+{
+    if (sleeping_workers.load() > 0)
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        wake_up.notify_all();
+    }
+}
+
+// Under fiber_mutex.
+static void
+make_fiber_ready(fiber_t *fiber)
+{
+    fiber->wait_counter = NULL;
+    ready_fibers[ready_fiber_count++] = fiber;
+    ready_count.fetch_add(1);
+    queued_jobs.fetch_add(1);
+}
+
+// After counter reached zero. It may be gone already, only parked fibers' counters are looked at.
+static void
+release_parked_fibers(job_counter_t *counter)
+{
+    if (parked_count.load() == 0) return;
+
+    bool released = false;
+    {
+        std::lock_guard<std::mutex> lock(fiber_mutex);
+        for (int i = 0; i < parked_fiber_count; ++i)
+        {
+            fiber_t *fiber = parked_fibers[i];
+            if (fiber->wait_counter != counter || fiber->wait_counter->count.load() > 0) continue;
+
+            parked_fibers[i--] = parked_fibers[--parked_fiber_count];
+            parked_count.fetch_sub(1);
+            make_fiber_ready(fiber);
+            released = true;
+        }
+    }
+
+    if (released) wake_workers();
+}
+
+static void
+execute_job(job_thread_t *thread, job_t *job)
+{
+    job_counter_t *counter = job->counter;
+    job->proc(job->data);
+    thread->jobs_run.fetch_add(1, std::memory_order_relaxed);
+
+    // The job may be gone as soon as the counter says so.
+    if (counter->count.fetch_sub(1) == 1) release_parked_fibers(counter);
+}
+
+static void
+switch_to_caller(fiber_t *fiber)
+{
+#ifdef _WIN32
+    SwitchToFiber(fiber->caller);
+#else
+    swapcontext(&fiber->context, fiber->caller);
+#endif
+}
+
+// Never returns, after every job it goes back to whoever resumed it.
+static void
+fiber_main(fiber_t *fiber)
+{
+    for (;;)
+    {
+        execute_job(fiber->thread, fiber->job);
+        fiber->finished = true;
+        switch_to_caller(fiber);
+    }
+}
+
+#ifdef _WIN32
+static void WINAPI
+fiber_start(void *data)
+{
+    fiber_main((fiber_t *)data);
+}
+#else
+static void
+fiber_start(int index)
+{
+    fiber_main(&fibers[index]);
+}
+#endif
+
+// From a thread's own stack, never from a fiber. Returns when the fiber finished its job or parked.
+static void
+resume_fiber(job_thread_t *thread, fiber_t *fiber)
+{
+    fiber->thread = thread;
+    this_fiber = fiber;
+#ifdef _WIN32
+    fiber->caller = GetCurrentFiber();
+    SwitchToFiber(fiber->handle);
+#else
+    ucontext_t caller;
+    fiber->caller = &caller;
+    swapcontext(&caller, &fiber->context);
+#endif
+    this_fiber = NULL;
+
+    if (fiber->finished)
+    {
+        fiber->finished = false;
+        if (thread->spare_fiber == fiber) return;
+
+        if (!thread->spare_fiber)
+        {
+            thread->spare_fiber = fiber;
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(fiber_mutex);
+        free_fibers[free_fiber_count++] = fiber;
+        return;
+    }
+
+    // Parked. Only now that nothing runs on its stack can it be handed to whoever finishes the
+    // counter, and the counter may have made it already.
+    if (thread->spare_fiber == fiber) thread->spare_fiber = NULL;
+    fiber_waits.fetch_add(1, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(fiber_mutex);
+    parked_count.fetch_add(1);
+    if (fiber->wait_counter->count.load() > 0)
+    {
+        parked_fibers[parked_fiber_count++] = fiber;
+        return;
+    }
+    parked_count.fetch_sub(1);
+    make_fiber_ready(fiber);
+}
+
+// Own jobs first, then everybody else's starting at a random thread.
+static job_t *
+find_job(job_thread_t *thread)
+{
+    job_t *job = pop_job(&thread->deque);
+    if (job) return job;
+
+    // xorshift
+    thread->random ^= thread->random << 13;
+    thread->random ^= thread->random >> 17;
+    thread->random ^= thread->random << 5;
+
+    int first = (int)(thread->random % (uint32_t)thread_count);
+    for (int i = 0; i < thread_count; ++i)
+    {
+        job_thread_t *victim = &threads[(first + i) % thread_count];
+        if (victim == thread) continue;
+
+        job = steal_job(&victim->deque);
+        if (job)
+        {
+            thread->jobs_stolen.fetch_add(1, std::memory_order_relaxed);
+            return job;
+        }
+    }
+    return NULL;
+}
+
+// Resumes a ready fiber or starts a new job, false if there was neither. Only off fibers.
+static bool
+run_next(job_thread_t *thread)
+{
+    fiber_t *fiber = NULL;
+    if (ready_count.load() > 0)
+    {
+        std::lock_guard<std::mutex> lock(fiber_mutex);
+        if (ready_fiber_count)
+        {
+            fiber = ready_fibers[--ready_fiber_count];
+            ready_count.fetch_sub(1);
+        }
+    }
+    if (fiber)
+    {
+        queued_jobs.fetch_sub(1);
+        resume_fiber(thread, fiber);
+        return true;
+    }
+
+    job_t *job = find_job(thread);
+    if (!job) return false;
+    queued_jobs.fetch_sub(1);
+
+    fiber = thread->spare_fiber;
+    if (!fiber)
+    {
+        std::lock_guard<std::mutex> lock(fiber_mutex);
+        if (free_fiber_count) fiber = free_fibers[--free_fiber_count];
+    }
+
+    // Every fiber is parked. Running the job right here still works, its waits just can't park.
+    if (!fiber)
+    {
+        execute_job(thread, job);
+        return true;
+    }
+
+    thread->spare_fiber = fiber;
+    fiber->job = job;
+    resume_fiber(thread, fiber);
+    return true;
+}
+
+static void
+worker_main(int index)
+{
+    this_thread_index = index;
+    job_thread_t *thread = &threads[index];
+
+#ifdef _WIN32
+    ConvertThreadToFiber(NULL);
+#endif
+    set_trace_thread_name("job worker");
+
+    int idle = 0;
+    for (;;)
+    {
+        if (run_next(thread))
+        {
+            idle = 0;
+            continue;
+        }
+
+        if (++idle < IDLE_SPINS)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        // Counting ourselves as asleep before looking at the queue again means a push either
+        // sees us and wakes us, or we see its job.
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        sleeping_workers.fetch_add(1);
+        while (!quit && queued_jobs.load() <= 0) wake_up.wait(lock);
+        sleeping_workers.fetch_sub(1);
+        if (quit) break;
+        idle = 0;
+    }
+
+#ifdef _WIN32
+    ConvertFiberToThread();
+#endif
+}
+
+// getcontext returns twice as far as the compiler knows, kept out of line so it can't clobber
+// the caller's locals.
+#ifdef _WIN32
+static void
+#else
+static __attribute__((noinline)) void
+#endif
+create_fiber(int index)
+{
+    fiber_t *fiber = &fibers[index];
+#ifdef _WIN32
+    fiber->handle = CreateFiber(JOBS_FIBER_STACK_SIZE, fiber_start, fiber);
+#else
+    fiber->stack = malloc(JOBS_FIBER_STACK_SIZE);
+    getcontext(&fiber->context);
+    fiber->context.uc_stack.ss_sp = fiber->stack;
+    fiber->context.uc_stack.ss_size = JOBS_FIBER_STACK_SIZE;
+    fiber->context.uc_link = NULL;
+    makecontext(&fiber->context, (void (*)())fiber_start, 1, index);
+#endif
+}
+
+void
+init_jobs(int count)
+{
+    if (count < 0) count = (int)std::thread::hardware_concurrency() - 1;
+    if (count < 0) count = 0;
+    if (count > JOBS_MAX_THREADS - 1) count = JOBS_MAX_THREADS - 1;
+
+    thread_count = count + 1;
+    threads = (job_thread_t *)calloc(thread_count, sizeof(job_thread_t));
+    for (int i = 0; i < thread_count; ++i) threads[i].random = 0x9E3779B9u * (i + 1);
+
+    fibers = (fiber_t *)calloc(JOBS_FIBER_COUNT, sizeof(fiber_t));
+    for (int i = 0; i < JOBS_FIBER_COUNT; ++i)
+    {
+        create_fiber(i);
+        free_fibers[i] = &fibers[i];
+    }
+    free_fiber_count = JOBS_FIBER_COUNT;
+    parked_fiber_count = 0;
+    ready_fiber_count = 0;
+    parked_count = 0;
+    ready_count = 0;
+    fiber_waits = 0;
+
+    queued_jobs = 0;
+    sleeping_workers = 0;
+    quit = false;
+
+    this_thread_index = 0;
+#ifdef _WIN32
+    ConvertThreadToFiber(NULL);
+#endif
+
+    worker_count = count;
+    workers = new std::thread[worker_count];
+    for (int i = 0; i < worker_count; ++i) workers[i] = std::thread(worker_main, i + 1);
+}
+
+void
+free_jobs()
+{
+    // Nothing queued is dropped, whoever is waiting on it would wait forever.
+    if (this_thread_index == 0)
+    {
+        while (queued_jobs.load() > 0 || parked_count.load() > 0)
+        {
+            if (!run_next(&threads[0])) std::this_thread::yield();
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        quit = true;
+    }
+    wake_up.notify_all();
+
+    for (int i = 0; i < worker_count; ++i) workers[i].join();
+    delete[] workers;
+    workers = NULL;
+    worker_count = 0;
+
+    // Nothing can be parked by now, every wait has returned.
+    ASSERT(parked_fiber_count == 0 && ready_fiber_count == 0);
+    for (int i = 0; i < JOBS_FIBER_COUNT; ++i)
+    {
+#ifdef _WIN32
+        DeleteFiber(fibers[i].handle);
+#else
+        free(fibers[i].stack);
+#endif
+    }
+    free(fibers);
+    fibers = NULL;
+
+#ifdef _WIN32
+    ConvertFiberToThread();
+#endif
+
+    free(threads);
+    threads = NULL;
+    thread_count = 0;
+    this_thread_index = -1;
+}
+
+int
+get_job_thread_count()
+{
+    return thread_count;
+}
+
+int
+get_job_thread_index()
+{
+    return this_thread_index;
+}
+
+void
+run_jobs(job_t *jobs, uint32_t job_count, job_counter_t *counter)
+{
+    counter->count.fetch_add((int)job_count, std::memory_order_relaxed);
+    for (uint32_t i = 0; i < job_count; ++i) jobs[i].counter = counter;
+
+    if (this_thread_index < 0)
+    {
+        for (uint32_t i = 0; i < job_count; ++i)
+        {
+            jobs[i].proc(jobs[i].data);
+            counter->count.fetch_sub(1, std::memory_order_acq_rel);
+        }
+        return;
+    }
+
+    // Read once, a job that waits may carry on on another thread.
+    job_thread_t *thread = &threads[this_thread_index];
+    for (uint32_t i = 0; i < job_count; ++i)
+    {
+        if (push_job(&thread->deque, &jobs[i]))
+        {
+            queued_jobs.fetch_add(1);
+        }
+        else
+        {
+            execute_job(thread, &jobs[i]);
+        }
+    }
+
+    wake_workers();
+}
+
+void
+wait_for_jobs(job_counter_t *counter)
+{
+    if (this_thread_index < 0)
+    {
+        // Jobs from elsewhere can't be helped with, only waited for.
+        while (counter->count.load(std::memory_order_acquire) > 0) std::this_thread::yield();
+        return;
+    }
+
+    // In a job, park until the counter is done. A stale wake up from an earlier counter at the
+    // same address just parks again.
+    fiber_t *fiber = this_fiber;
+    if (fiber)
+    {
+        while (counter->count.load(std::memory_order_acquire) > 0)
+        {
+            fiber->wait_counter = counter;
+            switch_to_caller(fiber);
+        }
+        return;
+    }
+
+    // On a thread's own stack, run other work until it's done.
+    job_thread_t *thread = &threads[this_thread_index];
+    while (counter->count.load(std::memory_order_acquire) > 0)
+    {
+        if (!run_next(thread)) std::this_thread::yield();
+    }
+}
+
+struct parallel_for_chunk_t
+{
+    parallel_for_proc_t *proc;
+    void *data;
+    uint32_t first;
+    uint32_t count;
+};
+
+static void
+run_parallel_for_chunk(void *data)
+{
+    TRACE_SCOPE("parallel_for");
+    parallel_for_chunk_t *chunk = (parallel_for_chunk_t *)data;
+    chunk->proc(chunk->first, chunk->count, chunk->data);
+}
+
+void
+parallel_for(uint32_t count, uint32_t min_batch, parallel_for_proc_t *proc, void *data)
+{
+    if (!count) return;
+
+    if (this_thread_index < 0)
+    {
+        proc(0, count, data);
+        return;
+    }
+
+    // A few chunks per thread evens out the load, any more is just overhead.
+    uint32_t batch = (count + thread_count * 4 - 1) / (thread_count * 4);
+    if (batch < min_batch) batch = min_batch;
+    if (batch < 1) batch = 1;
+
+    uint32_t chunk_count = (count + batch - 1) / batch;
+    if (chunk_count == 1)
+    {
+        proc(0, count, data);
+        return;
+    }
+
+    // On the stack, not the thread arena: waiting can move this to another thread, and jobs run
+    // on this thread in the meantime would push and pop the arena underneath us.
+    parallel_for_chunk_t chunks[JOBS_MAX_THREADS * 4];
+    job_t jobs[JOBS_MAX_THREADS * 4];
+
+    for (uint32_t i = 0; i < chunk_count; ++i)
+    {
+        chunks[i].proc = proc;
+        chunks[i].data = data;
+        chunks[i].first = i * batch;
+        chunks[i].count = i + 1 < chunk_count ? batch : count - i * batch;
+
+        jobs[i].proc = run_parallel_for_chunk;
+        jobs[i].data = &chunks[i];
+    }
+
+    job_counter_t counter;
+    run_jobs(jobs, chunk_count, &counter);
+    wait_for_jobs(&counter);
+}
+
+job_stats_t
+get_job_stats()
+{
+    job_stats_t stats = {};
+    for (int i = 0; i < thread_count; ++i)
+    {
+        stats.jobs_run += threads[i].jobs_run.load(std::memory_order_relaxed);
+        stats.jobs_stolen += threads[i].jobs_stolen.load(std::memory_order_relaxed);
+    }
+    stats.fiber_waits = fiber_waits.load(std::memory_order_relaxed);
+    return stats;
+}
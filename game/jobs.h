@@ -0,0 +1,74 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <stdint.h>
+#include <atomic>
+
+// Work stealing job system. Every thread has a Chase-Lev deque of jobs: the owner pushes and pops
+// at the bottom without locking, idle threads steal the oldest jobs from the top, so work spreads
+// out on its own and the owner keeps working on what is still warm in its cache. Fork/join goes
+// through counters: run_jobs adds the jobs to one, wait_for_jobs runs other jobs until it drops
+// to zero, so a waiting thread never sits idle while there is work.
+//
+// Jobs run on fibers, so a job that waits doesn't hold up its thread either: its fiber is parked
+// and the thread goes on with other jobs, the fiber is picked up again by whichever thread is free
+// once the counter is done. That can be a different thread, so anything per thread has to be
+// looked up again after a wait, and thread arena memory can't be held across one.
+//
+// The thread that calls init_jobs is job thread 0, the workers follow. Only job threads can push,
+// anywhere else run_jobs just runs the jobs right away.
+
+#define JOBS_MAX_THREADS 64
+#define JOBS_DEQUE_SIZE 4096 // Per thread, a push that doesn't fit runs the job right away.
+#define JOBS_FIBER_COUNT 128 // Jobs waiting at once, past that new jobs run on the thread's stack and block.
+#define JOBS_FIBER_STACK_SIZE (256 << 10)
+
+typedef void job_proc_t(void *data);
+
+struct job_counter_t
+{
+    std::atomic<int> count;
+
+    job_counter_t() : count(0) {}
+};
+
+struct job_t
+{
+    job_proc_t *proc;
+    void *data;
+    job_counter_t *counter; // Set by run_jobs.
+};
+
+// worker_count below 0 picks one per core besides the calling thread's.
+void init_jobs(int worker_count);
+
+// From the thread that called init_jobs, runs whatever is still queued first.
+void free_jobs();
+
+// Workers plus the thread that called init_jobs.
+int get_job_thread_count();
+
+// 0 to get_job_thread_count() - 1 on job threads, -1 elsewhere. Stable between waits, so jobs can
+// index per thread data with it as long as they don't wait in the meantime.
+int get_job_thread_index();
+
+// The jobs are read when they run, they have to stay put until counter is waited on.
+void run_jobs(job_t *jobs, uint32_t job_count, job_counter_t *counter);
+void wait_for_jobs(job_counter_t *counter);
+
+typedef void parallel_for_proc_t(uint32_t first, uint32_t count, void *data);
+
+// Calls proc on chunks of [0, count) from all threads and returns when all are done. Chunks are
+// sized for a few per thread, so uneven items even out, and at least min_batch items.
+void parallel_for(uint32_t count, uint32_t min_batch, parallel_for_proc_t *proc, void *data);
+
+struct job_stats_t
+{
+    uint64_t jobs_run;
+    uint64_t jobs_stolen;
+    uint64_t fiber_waits; // Jobs that parked in wait_for_jobs.
+};
+
+job_stats_t get_job_stats();
+
+#endif
@@ -1,70 +1,797 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <GLFW/glfw3.h>
 #include <GL/glew.h>
 
 #include "shader.h"
+#include "mesh.h"
+#include "mesh_cluster.h"
+#include "material.h"
+#include "instancing.h"
+#include "geometry_pool.h"
+#include "render_queue.h"
+#include "render_recorder.h"
+#include "jobs.h"
+#include "asset_loader.h"
+#include "static_scene.h"
+#include "frame_graph.h"
+#include "sprite_batch.h"
+#include "font.h"
+#include "debug_draw.h"
+#include "texture_manager.h"
+#include "texture_compression.h"
+#include "profiler.h"
+#include "frame_pacing.h"
+#include "game_loop.h"
+#include "arena.h"
+#include "trace.h"
+#include "gl_state.h"
 #include "my_math.h"
+#include "utils.h"
 
-struct mesh_vertex_t
+static shader_t shader_basic;
+static shader_t shader_basic_instanced;
+static shader_t shader_bloom_bright;
+static shader_t shader_bloom_blur;
+static shader_t shader_composite;
+static shader_t shader_sprite;
+
+static texture_manager_t texture_manager;
+
+static handle_t material_basic;
+static handle_t material_basic_blue;
+static handle_t material_basic_instanced;
+
+static asset_id_t shader_assets[6];
+
+static bool
+upload_shader_asset(asset_t *asset)
+{
+    return create_shader((shader_t *)asset->target, asset->path, (char *)asset->data);
+}
+
+static asset_type_t shader_asset_type = { "shader", NULL, upload_shader_asset };
+
+// Only queued, the rest of startup runs while they are read. Wait on shader_assets before drawing.
+static void
+load_shaders()
+{
+    shader_assets[0] = load_asset(&shader_asset_type, "data/shaders/basic.glsl", &shader_basic, ASSET_PRIORITY_STARTUP);
+    shader_assets[1] = load_asset(&shader_asset_type, "data/shaders/basic_instanced.glsl", &shader_basic_instanced, ASSET_PRIORITY_STARTUP);
+    shader_assets[2] = load_asset(&shader_asset_type, "data/shaders/bloom_bright.glsl", &shader_bloom_bright, ASSET_PRIORITY_STARTUP);
+    shader_assets[3] = load_asset(&shader_asset_type, "data/shaders/bloom_blur.glsl", &shader_bloom_blur, ASSET_PRIORITY_STARTUP);
+    shader_assets[4] = load_asset(&shader_asset_type, "data/shaders/composite.glsl", &shader_composite, ASSET_PRIORITY_STARTUP);
+    shader_assets[5] = load_asset(&shader_asset_type, "data/shaders/sprite.glsl", &shader_sprite, ASSET_PRIORITY_STARTUP);
+}
+
+static void
+init_materials()
+{
+    init_material_pool();
+    material_basic = create_material(&shader_basic, make_vec4(1.0f, 0.5f, 0.2f, 1.0f));
+    material_basic_blue = create_material(&shader_basic, make_vec4(0.2f, 0.4f, 1.0f, 1.0f));
+    material_basic_instanced = create_material(&shader_basic_instanced, make_vec4(1.0f, 0.5f, 0.2f, 1.0f));
+}
+
+#define SIM_TICKS_PER_SECOND 30
+
+// Everything that moves. Ticks at a fixed rate, frames draw in between two states.
+struct world_state_t
+{
+    float probe_angle;
+    float wave_phase;
+};
+
+static void
+tick_world(void *state, float dt, void *data)
+{
+    world_state_t *world = (world_state_t *)state;
+    world->probe_angle += 0.3f * dt;
+    world->wave_phase += 2.0f * dt;
+}
+
+static world_state_t
+interpolate_world(world_state_t *previous, world_state_t *current, float alpha)
+{
+    world_state_t result;
+    result.probe_angle = previous->probe_angle + (current->probe_angle - previous->probe_angle) * alpha;
+    result.wave_phase = previous->wave_phase + (current->wave_phase - previous->wave_phase) * alpha;
+    return result;
+}
+
+#define CORRIDOR_ROWS 64
+#define CORRIDOR_COLUMNS 5
+
+struct corridor_t
+{
+    render_view_t *view;
+    handle_t mesh;
+    float viewport_height;
+    float wave_phase;
+};
+
+// A corridor of spheres running off into the distance, far ones fall back to coarser LODs.
+// Runs on the recorder's threads, one item per sphere.
+static void
+record_corridor(render_command_list_t *list, uint32_t first_item, uint32_t item_count, void *data)
+{
+    corridor_t *corridor = (corridor_t *)data;
+    render_view_t *view = corridor->view;
+
+    mesh_t *mesh = get_mesh(corridor->mesh);
+    if (!mesh) return;
+
+    for (uint32_t item = first_item; item < first_item + item_count; ++item)
+    {
+        int row = item / CORRIDOR_COLUMNS;
+        int col = item % CORRIDOR_COLUMNS - CORRIDOR_COLUMNS / 2;
+
+        float height = sinf(corridor->wave_phase + row * 0.35f) * 0.25f;
+        mat4 object_to_world = mat4_translation(make_vec3(col * 1.5f, height, -row * 3.0f));
+
+        int lod_index = select_mesh_lod(mesh, object_to_world, view->world_to_view, view->view_to_proj, corridor->viewport_height, 1.0f);
+
+        // Close up it pays to only submit the clusters that are on screen and facing us,
+        // everything else is batched up by LOD and drawn instanced.
+        if (lod_index == 0 && mesh->cluster_count)
+        {
+            render_draw_t draw;
+            draw.kind = RENDER_COMMAND_MESH_CLUSTERS;
+            draw.material = (col & 1) ? material_basic_blue : material_basic;
+            draw.mesh = corridor->mesh;
+            draw.lod_index = 0;
+            draw.object_to_world = object_to_world;
+            push_render_command(&list->queue, RENDER_LAYER_OPAQUE, view, &draw);
+        }
+        else
+        {
+            record_instance(list, corridor->mesh, lod_index, material_basic_instanced, object_to_world);
+        }
+    }
+}
+
+struct scene_pass_t
 {
-    vec3 position;
-    vec3 normal;
-    vec2 uv;
+    static_scene_t *static_scene;
+    render_queue_t *render_queue;
+    instance_renderer_t *instance_renderer;
+    mat4 world_to_proj;
+    float dt;
 };
 
-#define MESH_VERTEX_OFFSET_position 0
-#define MESH_VERTEX_OFFSET_normal 12
-#define MESH_VERTEX_OFFSET_uv 24
+static void
+execute_scene_pass(frame_graph_t *graph, void *data)
+{
+    scene_pass_t *pass = (scene_pass_t *)data;
+
+    // Depth writes have to be on for the clear to reach the depth buffer.
+    set_depth_state(true, true, GL_LESS);
+    set_blend_state(false, GL_ONE, GL_ZERO);
+
+    glClearColor(0.2f, 0.5f, 0.8f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    draw_static_scene(pass->static_scene, pass->world_to_proj);
+    execute_render_queue(pass->render_queue);
+    draw_instances(pass->instance_renderer, pass->world_to_proj);
+
+    // Lines go in with the scene so they are depth tested against it and pick up bloom.
+    flush_debug_draw(pass->world_to_proj, pass->dt);
+}
+
+struct fullscreen_pass_t
+{
+    shader_t *shader;
+    frame_graph_resource_t inputs[2];
+    vec2 texel_step;
+};
 
 static void
-set_vertex_format_to_mesh(void)
+execute_fullscreen_pass(frame_graph_t *graph, void *data)
+{
+    fullscreen_pass_t *pass = (fullscreen_pass_t *)data;
+    shader_t *shader = pass->shader;
+
+    set_depth_state(false, false, GL_LESS);
+    set_blend_state(false, GL_ONE, GL_ZERO);
+    set_material(NULL_HANDLE);
+    set_shader(shader);
+
+    for (uint32_t i = 0; i < ARRAY_SIZE(pass->inputs); ++i)
+    {
+        if (pass->inputs[i]) bind_texture(i, GL_TEXTURE_2D, get_frame_graph_texture(graph, pass->inputs[i]));
+    }
+
+    glUniform1i(shader->texture_0_loc, 0);
+    glUniform1i(shader->texture_1_loc, 1);
+    glUniform2f(shader->texel_step_loc, pass->texel_step.x, pass->texel_step.y);
+
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+// Two 32x32 layers, a soft dot and a ring.
+static GLuint
+make_particle_texture()
 {
-    shader_t *shader = get_current_shader();
+    const int SIZE = 32;
+    uint32_t *pixels = (uint32_t *)malloc(SIZE * SIZE * 2 * sizeof(uint32_t));
 
-    GLint loc = shader->input_position_loc;
-    if (loc != -1)
+    for (int y = 0; y < SIZE; ++y)
     {
-        glVertexAttribPointer(loc, 3, GL_FLOAT, GL_FALSE, sizeof(mesh_vertex_t), (void *)MESH_VERTEX_OFFSET_position);
-        glEnableVertexAttribArray(loc);
+        for (int x = 0; x < SIZE; ++x)
+        {
+            float dx = (x + 0.5f) / SIZE * 2.0f - 1.0f;
+            float dy = (y + 0.5f) / SIZE * 2.0f - 1.0f;
+            float d = sqrtf(dx*dx + dy*dy);
+
+            float dot = clamp(0.0f, 1.0f - d, 1.0f);
+            float ring = clamp(0.0f, 1.0f - fabsf(d - 0.7f) * 8.0f, 1.0f);
+
+            pixels[y * SIZE + x] = pack_color(make_vec4(1.0f, 1.0f, 1.0f, dot * dot));
+            pixels[SIZE * SIZE + y * SIZE + x] = pack_color(make_vec4(1.0f, 1.0f, 1.0f, ring));
+        }
     }
-    else
+
+    GLuint result = create_texture_array(SIZE, SIZE, 2, pixels);
+    free(pixels);
+    return result;
+}
+
+struct hud_pass_t
+{
+    sprite_batch_t *sprites;
+    GLuint particle_texture;
+    font_t *font; // NULL if no font could be loaded.
+    char *text;
+    vec2 text_size;
+    int width;
+    int height;
+    float time;
+    bool show_profiler;
+};
+
+static void
+execute_hud_pass(frame_graph_t *graph, void *data)
+{
+    hud_pass_t *pass = (hud_pass_t *)data;
+    sprite_batch_t *sprites = pass->sprites;
+
+    // Pixels, origin at the top left.
+    mat4 pixels_to_proj = mat4_orthographic(0.0f, (float)pass->width, (float)pass->height, 0.0f, -1.0f, 1.0f);
+    begin_sprites(sprites, &shader_sprite, pixels_to_proj);
+
+    vec2 panel_min = make_vec2(16.0f, 16.0f);
+    vec2 panel_max = make_vec2(272.0f, 272.0f);
+    draw_rect(sprites, panel_min, panel_max, make_vec4(0.0f, 0.0f, 0.0f, 0.5f));
+
+    // A swirl of particles inside the panel.
+    vec2 center = (panel_min + panel_max) * 0.5f;
+    for (int i = 0; i < 2000; ++i)
     {
-        glDisableVertexAttribArray(loc);
+        float t = pass->time * 0.5f + i * 0.0314f;
+        float radius = 8.0f + (i % 100) * 1.1f;
+        vec2 p = center + make_vec2(cosf(t * (1.0f + (i % 7) * 0.1f)), sinf(t)) * radius;
+
+        float size = 3.0f + (i % 5);
+        vec4 color = make_vec4(0.5f + 0.5f * sinf(i * 0.1f), 0.5f + 0.5f * sinf(i * 0.07f + 2.0f), 1.0f, 0.8f);
+        draw_sprite(sprites, pass->particle_texture, (float)(i & 1), p - make_vec2(size, size), p + make_vec2(size, size),
+                    make_vec2(0.0f, 0.0f), make_vec2(1.0f, 1.0f), color);
     }
 
-    loc = shader->input_normal_loc;
-    if (loc != -1)
+    if (pass->font)
     {
-        glVertexAttribPointer(loc, 3, GL_FLOAT, GL_FALSE, sizeof(mesh_vertex_t), (void *)MESH_VERTEX_OFFSET_normal);
-        glEnableVertexAttribArray(loc);
+        // The text only changes once a second, the cached run saves shaping it every frame.
+        vec2 text_pos = make_vec2(24.0f, 288.0f);
+        draw_rect(sprites, make_vec2(16.0f, 280.0f), text_pos + pass->text_size + make_vec2(8.0f, 8.0f), make_vec4(0.0f, 0.0f, 0.0f, 0.5f));
+        draw_cached_text(sprites, pass->font, text_pos, pass->text, make_vec4(1.0f, 1.0f, 1.0f, 1.0f));
     }
-    else
+
+    if (pass->show_profiler) draw_profiler(sprites, pass->font, make_vec2(296.0f, 20.0f), 480.0f);
+
+    end_sprites(sprites);
+}
+
+// Pushes 100k sprites per frame through the batcher and prints what it costs.
+static void
+run_sprite_benchmark(GLFWwindow *window, sprite_batch_t *sprites, GLuint particle_texture)
+{
+    const int SPRITE_COUNT = 100000;
+    const int FRAME_COUNT = 200;
+
+    int width, height;
+    glfwGetFramebufferSize(window, &width, &height);
+    mat4 pixels_to_proj = mat4_orthographic(0.0f, (float)width, (float)height, 0.0f, -1.0f, 1.0f);
+
+    double submit_seconds = 0.0;
+    double frame_seconds = 0.0;
+
+    for (int frame = 0; frame < FRAME_COUNT; ++frame)
     {
-        glDisableVertexAttribArray(loc);
+        glfwPollEvents();
+        set_viewport(0, 0, width, height);
+        glClear(GL_COLOR_BUFFER_BIT);
+        glFinish();
+
+        double start = glfwGetTime();
+
+        begin_sprites(sprites, &shader_sprite, pixels_to_proj);
+        for (int i = 0; i < SPRITE_COUNT; ++i)
+        {
+            float x = (float)((i * 37 + frame) % width);
+            float y = (float)((i / 97 * 5 + frame) % height);
+            draw_sprite(sprites, particle_texture, (float)(i & 1), make_vec2(x, y), make_vec2(x + 4.0f, y + 4.0f),
+                        make_vec2(0.0f, 0.0f), make_vec2(1.0f, 1.0f), make_vec4(1.0f, 1.0f, 1.0f, 0.5f));
+        }
+        end_sprites(sprites);
+
+        double submitted = glfwGetTime();
+        glFinish();
+        double finished = glfwGetTime();
+
+        submit_seconds += submitted - start;
+        frame_seconds += finished - start;
+
+        glfwSwapBuffers(window);
     }
 
-    loc = shader->input_uv_loc;
-    if (loc != -1)
+    printf("sprites    %6u sprites, %6u draw calls, CPU submit %7.3f ms, CPU+GPU %7.3f ms\n",
+           sprites->stats.sprite_count, sprites->stats.draw_calls,
+           1000.0 * submit_seconds / FRAME_COUNT, 1000.0 * frame_seconds / FRAME_COUNT);
+}
+
+// Fills the screen with 8k characters per frame, half of them changing every frame and half through the run cache.
+static void
+run_text_benchmark(GLFWwindow *window, sprite_batch_t *sprites, font_t *font)
+{
+    const int LINE_COUNT = 80;
+    const int FRAME_COUNT = 200;
+
+    int width, height;
+    glfwGetFramebufferSize(window, &width, &height);
+    mat4 pixels_to_proj = mat4_orthographic(0.0f, (float)width, (float)height, 0.0f, -1.0f, 1.0f);
+
+    double submit_seconds = 0.0;
+    double frame_seconds = 0.0;
+    uint32_t glyph_count = 0;
+    uint32_t rasterized_count = 0;
+
+    for (int frame = 0; frame < FRAME_COUNT; ++frame)
     {
-        glVertexAttribPointer(loc, 2, GL_FLOAT, GL_FALSE, sizeof(mesh_vertex_t), (void *)MESH_VERTEX_OFFSET_uv);
-        glEnableVertexAttribArray(loc);
+        glfwPollEvents();
+        set_viewport(0, 0, width, height);
+        glClear(GL_COLOR_BUFFER_BIT);
+        glFinish();
+
+        double start = glfwGetTime();
+
+        begin_font_frame(font);
+        begin_sprites(sprites, &shader_sprite, pixels_to_proj);
+        for (int i = 0; i < LINE_COUNT; ++i)
+        {
+            char line[128];
+            vec2 pos = make_vec2(8.0f, 8.0f + (i % 40) * font->line_height);
+            if (i < LINE_COUNT / 2)
+            {
+                snprintf(line, sizeof(line), "frame %6d line %3d: %08x %08x %08x The quick brown fox jumps",
+                         frame, i, frame * 2654435761u, (frame + i) * 40503u, i * 16777619u);
+                draw_text(sprites, font, pos, line, make_vec4(1.0f, 1.0f, 1.0f, 1.0f));
+            }
+            else
+            {
+                snprintf(line, sizeof(line), "static line %3d: Sphinx of black quartz, judge my vow. 0123456789", i);
+                pos.x += width * 0.5f;
+                draw_cached_text(sprites, font, pos, line, make_vec4(1.0f, 0.8f, 0.4f, 1.0f));
+            }
+        }
+        end_sprites(sprites);
+
+        double submitted = glfwGetTime();
+        glFinish();
+        double finished = glfwGetTime();
+
+        submit_seconds += submitted - start;
+        frame_seconds += finished - start;
+        glyph_count = font->stats.glyphs_drawn;
+        rasterized_count += font->stats.glyphs_rasterized;
+
+        glfwSwapBuffers(window);
     }
-    else
+
+    printf("text       %6u glyphs, %6u rasterized in total, CPU submit %7.3f ms, CPU+GPU %7.3f ms\n",
+           glyph_count, rasterized_count, 1000.0 * submit_seconds / FRAME_COUNT, 1000.0 * frame_seconds / FRAME_COUNT);
+}
+
+// Loads the given files and keeps presenting frames until they are all resident, reporting what the
+// GL thread spent per frame. Everything expensive should show up as wall time, not as frame time.
+static void
+run_texture_benchmark(GLFWwindow *window, texture_manager_t *manager, char **paths, int path_count)
+{
+    const int MAX_FRAMES = 10000;
+
+    double start = glfwGetTime();
+
+    texture_id_t ids[64];
+    if (path_count > (int)ARRAY_SIZE(ids)) path_count = ARRAY_SIZE(ids);
+    for (int i = 0; i < path_count; ++i) ids[i] = load_texture(manager, paths[i]);
+
+    double update_seconds = 0.0;
+    double worst_update_seconds = 0.0;
+    uint64_t uploaded_bytes = 0;
+    int frame = 0;
+
+    for (; frame < MAX_FRAMES; ++frame)
     {
-        glDisableVertexAttribArray(loc);
+        glfwPollEvents();
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        for (int i = 0; i < path_count; ++i) get_texture(manager, ids[i]);
+
+        double update_start = glfwGetTime();
+        update_texture_manager(manager);
+        double update_time = glfwGetTime() - update_start;
+
+        update_seconds += update_time;
+        if (update_time > worst_update_seconds) worst_update_seconds = update_time;
+        uploaded_bytes += manager->stats.uploaded_bytes;
+
+        glfwSwapBuffers(window);
+        if (!manager->stats.pending_count) break;
     }
+
+    int resident = 0;
+    for (int i = 0; i < path_count; ++i) resident += get_texture_state(manager, ids[i]) == TEXTURE_STATE_RESIDENT;
+
+    printf("textures   %d of %d resident, %.1f MB in %.3f s over %d frames, update %.3f ms avg %.3f ms worst\n",
+           resident, path_count, uploaded_bytes / (1024.0 * 1024.0), glfwGetTime() - start, frame + 1,
+           1000.0 * update_seconds / (frame + 1), 1000.0 * worst_update_seconds);
 }
 
-static shader_t shader_basic;
+#define FONT_PIXEL_HEIGHT 16.0f
 
+// Parsing the tables is the slow part, that happens on a worker.
 static bool
-init_shaders()
+decode_font_asset(asset_t *asset)
 {
-    if (!load_shader(&shader_basic, "data/shaders/basic.glsl")) return false;
+    if (!init_font((font_t *)asset->target, asset->path, asset->data, asset->size, FONT_PIXEL_HEIGHT)) return false;
 
+    // The font reads its glyphs from the file as it goes.
+    asset->data = NULL;
     return true;
 }
 
+static bool
+upload_font_asset(asset_t *asset)
+{
+    create_font_atlas((font_t *)asset->target);
+    return true;
+}
+
+static asset_type_t font_asset_type = { "font", decode_font_asset, upload_font_asset };
+
+// The repo doesn't ship a font, so fall back to whatever the system has. Text stays off until
+// the asset is ready, 0 if there is no font at all.
+static asset_id_t
+load_default_font(font_t *font)
+{
+    char *paths[] =
+    {
+        "data/fonts/default.ttf",
+        "C:/Windows/Fonts/consola.ttf",
+        "C:/Windows/Fonts/arial.ttf",
+    };
+
+    for (uint32_t i = 0; i < ARRAY_SIZE(paths); ++i)
+    {
+        FILE *file = fopen(paths[i], "rb");
+        if (!file) continue;
+        fclose(file);
+
+        return load_asset(&font_asset_type, paths[i], font, ASSET_PRIORITY_NORMAL);
+    }
+    return 0;
+}
+
+// Draws the same grid of meshes one draw call per object and then instanced, and prints what each costs.
+// The coarsest LOD is used so the GPU isn't the bottleneck.
+static void
+run_instancing_benchmark(GLFWwindow *window, handle_t mesh_handle, instance_renderer_t *renderer)
+{
+    const int GRID_SIZE = 100;
+    const int FRAME_COUNT = 200;
+
+    mesh_t *mesh = get_mesh(mesh_handle);
+    if (!mesh) return;
+
+    int lod_index = mesh->lod_count - 1;
+    mesh_lod_t *lod = &mesh->lods[lod_index];
+
+    mat4 view_to_proj = mat4_perspective(to_radians(60.0f), 16.0f / 9.0f, 0.1f, 500.0f);
+    mat4 world_to_view = mat4_look_at(make_vec3(0.0f, 60.0f, 60.0f), make_vec3(0.0f, 0.0f, 0.0f), make_vec3(0.0f, 1.0f, 0.0f));
+    mat4 world_to_proj = view_to_proj * world_to_view;
+
+    for (int instanced = 0; instanced < 2; ++instanced)
+    {
+        double submit_seconds = 0.0;
+        double frame_seconds = 0.0;
+        uint32_t draw_calls = 0;
+
+        for (int frame = 0; frame < FRAME_COUNT; ++frame)
+        {
+            glfwPollEvents();
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            glFinish();
+
+            double start = glfwGetTime();
+
+            if (instanced)
+            {
+                begin_instances(renderer);
+                for (int z = 0; z < GRID_SIZE; ++z)
+                {
+                    for (int x = 0; x < GRID_SIZE; ++x)
+                    {
+                        mat4 object_to_world = mat4_translation(make_vec3(x - GRID_SIZE * 0.5f, 0.0f, z - GRID_SIZE * 0.5f));
+                        add_instance(renderer, mesh_handle, lod_index, material_basic_instanced, object_to_world);
+                    }
+                }
+                draw_instances(renderer, world_to_proj);
+                draw_calls = renderer->draw_call_count;
+            }
+            else
+            {
+                set_material(material_basic);
+                bind_geometry_pool();
+                set_vertex_format_to_mesh();
+
+                void *index_offset = get_mesh_index_offset(mesh, lod->first_index);
+                GLint base_vertex = get_mesh_base_vertex(mesh);
+
+                draw_calls = 0;
+                for (int z = 0; z < GRID_SIZE; ++z)
+                {
+                    for (int x = 0; x < GRID_SIZE; ++x)
+                    {
+                        mat4 object_to_world = mat4_translation(make_vec3(x - GRID_SIZE * 0.5f, 0.0f, z - GRID_SIZE * 0.5f));
+                        mat4 object_to_proj = world_to_proj * object_to_world;
+                        glUniformMatrix4fv(shader_basic.object_to_proj_loc, 1, GL_TRUE, &object_to_proj._11);
+                        glDrawElementsBaseVertex(GL_TRIANGLES, lod->index_count, GL_UNSIGNED_INT, index_offset, base_vertex);
+                        draw_calls++;
+                    }
+                }
+            }
+
+            double submitted = glfwGetTime();
+            glFinish();
+            double finished = glfwGetTime();
+
+            submit_seconds += submitted - start;
+            frame_seconds += finished - start;
+
+            glfwSwapBuffers(window);
+        }
+
+        printf("%-10s %6d objects, %6u draw calls, CPU submit %7.3f ms, CPU+GPU %7.3f ms\n",
+               instanced ? "instanced" : "per-object", GRID_SIZE * GRID_SIZE, draw_calls,
+               1000.0 * submit_seconds / FRAME_COUNT, 1000.0 * frame_seconds / FRAME_COUNT);
+    }
+}
+
+// Flies a camera from far away up to a quad showing each of the given textures and requests the
+// footprint it sees. Only coarse levels load at first, the finer ones stream in on the way.
+static void
+run_streaming_benchmark(GLFWwindow *window, texture_manager_t *manager, char **paths, int path_count)
+{
+    const int FRAME_COUNT = 600;
+
+    texture_id_t ids[64];
+    if (path_count > (int)ARRAY_SIZE(ids)) path_count = ARRAY_SIZE(ids);
+    for (int i = 0; i < path_count; ++i) ids[i] = load_texture(manager, paths[i]);
+
+    mat4 view_to_proj = mat4_perspective(to_radians(60.0f), 16.0f / 9.0f, 0.1f, 500.0f);
+    mat4 world_to_view = mat4_look_at(make_vec3(0.0f, 0.0f, 0.0f), make_vec3(0.0f, 0.0f, -1.0f), make_vec3(0.0f, 1.0f, 0.0f));
+
+    double worst_update_seconds = 0.0;
+    uint64_t uploaded_bytes = 0;
+    uint64_t peak_bytes = 0;
+
+    for (int frame = 0; frame < FRAME_COUNT; ++frame)
+    {
+        glfwPollEvents();
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        // 400 units out to 2, the quads are 2 units across.
+        float t = (float)frame / (FRAME_COUNT - 1);
+        float distance = 400.0f * powf(2.0f / 400.0f, t);
+        float pixels = estimate_texture_pixels(make_vec3(0.0f, 0.0f, -distance), 1.0f, 2.0f, world_to_view, view_to_proj, 720.0f);
+
+        for (int i = 0; i < path_count; ++i)
+        {
+            get_texture(manager, ids[i]);
+            request_texture_pixels(manager, ids[i], pixels);
+        }
+
+        double update_start = glfwGetTime();
+        update_texture_manager(manager);
+        double update_time = glfwGetTime() - update_start;
+
+        if (update_time > worst_update_seconds) worst_update_seconds = update_time;
+        uploaded_bytes += manager->stats.uploaded_bytes;
+        if (manager->stats.resident_bytes > peak_bytes) peak_bytes = manager->stats.resident_bytes;
+
+        if (frame == 0 || frame == FRAME_COUNT / 2 || frame == FRAME_COUNT - 1)
+        {
+            printf("streaming  %6.1f units, %6.1f px: %.2f MB resident, %u streaming\n", distance, pixels,
+                   manager->stats.resident_bytes / (1024.0 * 1024.0), manager->stats.streaming_count);
+        }
+
+        glfwSwapBuffers(window);
+    }
+
+    printf("streaming  %.1f MB uploaded, %.1f MB peak, update %.3f ms worst\n",
+           uploaded_bytes / (1024.0 * 1024.0), peak_bytes / (1024.0 * 1024.0), 1000.0 * worst_update_seconds);
+}
+
+struct jobs_benchmark_t
+{
+    float *results;
+    bool uneven;
+    uint32_t group_size; // Nested runs only.
+};
+
+// Some arithmetic per item, uneven makes the items up to 5x as expensive towards the end.
+static void
+run_benchmark_items(uint32_t first, uint32_t count, void *data)
+{
+    jobs_benchmark_t *benchmark = (jobs_benchmark_t *)data;
+    for (uint32_t i = first; i < first + count; ++i)
+    {
+        int steps = benchmark->uneven ? 16 + (int)(i >> 14) : 64;
+        float x = (float)i;
+        for (int step = 0; step < steps; ++step) x = sinf(x) * 0.9f + 0.1f;
+        benchmark->results[i] = x;
+    }
+}
+
+// Every item a group of items done with another parallel_for, so most jobs wait on others.
+static void
+run_benchmark_groups(uint32_t first, uint32_t count, void *data)
+{
+    jobs_benchmark_t *benchmark = (jobs_benchmark_t *)data;
+    for (uint32_t group = first; group < first + count; ++group)
+    {
+        jobs_benchmark_t inner = *benchmark;
+        inner.results += group * benchmark->group_size;
+        parallel_for(benchmark->group_size, 256, run_benchmark_items, &inner);
+    }
+}
+
+// The same parallel_for on 1 to all job threads, restarting the job system for every count.
+static void
+run_jobs_benchmark()
+{
+    const uint32_t ITEM_COUNT = 1 << 20;
+    const uint32_t GROUP_COUNT = 64;
+    int max_threads = get_job_thread_count();
+
+    jobs_benchmark_t benchmark;
+    benchmark.results = (float *)malloc(ITEM_COUNT * sizeof(float));
+    benchmark.group_size = ITEM_COUNT / GROUP_COUNT;
+
+    char *mode_names[] = {"even  ", "uneven", "nested"};
+    for (int mode = 0; mode < 3; ++mode)
+    {
+        benchmark.uneven = mode == 1;
+        uint32_t count = mode == 2 ? GROUP_COUNT : ITEM_COUNT;
+        uint32_t min_batch = mode == 2 ? 1 : 256;
+        parallel_for_proc_t *proc = mode == 2 ? run_benchmark_groups : run_benchmark_items;
+
+        double single_thread_seconds = 0.0;
+        for (int threads = 1; threads <= max_threads; ++threads)
+        {
+            free_jobs();
+            init_jobs(threads - 1);
+
+            // Warm up, then the best of a few.
+            parallel_for(count, min_batch, proc, &benchmark);
+            job_stats_t before = get_job_stats();
+
+            double best = 1e9;
+            for (int run = 0; run < 5; ++run)
+            {
+                double start = glfwGetTime();
+                parallel_for(count, min_batch, proc, &benchmark);
+                double seconds = glfwGetTime() - start;
+                if (seconds < best) best = seconds;
+            }
+
+            job_stats_t after = get_job_stats();
+            if (threads == 1) single_thread_seconds = best;
+
+            printf("jobs       %s, %2d threads: %7.2f ms, %5.2fx, %llu of %llu jobs stolen, %llu waits parked\n",
+                   mode_names[mode], threads, 1000.0 * best, single_thread_seconds / best,
+                   (unsigned long long)(after.jobs_stolen - before.jobs_stolen), (unsigned long long)(after.jobs_run - before.jobs_run),
+                   (unsigned long long)(after.fiber_waits - before.fiber_waits));
+        }
+    }
+
+    free_jobs();
+    init_jobs(max_threads - 1);
+    free(benchmark.results);
+}
+
+// Offline texture cooking: loads an image, builds its mips, block compresses every level and writes
+// a DDS the texture manager uploads without touching the pixels. Prints how much was lost.
+static bool
+cook_texture(char *format_name, char *input_path, char *output_path)
+{
+    static char *format_names[IMAGE_FORMAT_COUNT] = { "rgba8", "bc1", "bc3", "bc5", "bc7" };
+
+    image_format_t format = IMAGE_FORMAT_COUNT;
+    for (int i = 1; i < IMAGE_FORMAT_COUNT; ++i)
+    {
+        if (strcmp(format_name, format_names[i]) == 0) format = (image_format_t)i;
+    }
+    if (format == IMAGE_FORMAT_COUNT)
+    {
+        fprintf(stderr, "Unknown format '%s', expected bc1, bc3, bc5 or bc7.\n", format_name);
+        return false;
+    }
+
+    image_t source;
+    if (!load_image(&source, input_path)) return false;
+    if (source.format != IMAGE_FORMAT_RGBA8)
+    {
+        fprintf(stderr, "'%s' is already compressed.\n", input_path);
+        free_image(&source);
+        return false;
+    }
+    if (source.level_count == 1 && !generate_image_mips(&source, 0))
+    {
+        free_image(&source);
+        return false;
+    }
+
+    double start = glfwGetTime();
+    image_t compressed;
+    bool success = compress_image(&compressed, &source, format);
+    double seconds = glfwGetTime() - start;
+
+    if (success)
+    {
+        success = save_dds(&compressed, output_path);
+
+        // Error of the top level, over the channels the format keeps.
+        image_t decompressed;
+        if (success && decompress_image(&decompressed, &compressed))
+        {
+            int channels = format == IMAGE_FORMAT_BC5 ? 2 : (format == IMAGE_FORMAT_BC1 ? 3 : 4);
+            uint32_t pixel_count = source.levels[0].width * source.levels[0].height;
+
+            double squared_error = 0.0;
+            for (uint32_t i = 0; i < pixel_count; ++i)
+            {
+                for (int c = 0; c < channels; ++c)
+                {
+                    double d = (double)source.data[i * 4 + c] - decompressed.data[i * 4 + c];
+                    squared_error += d * d;
+                }
+            }
+
+            double mse = squared_error / ((double)pixel_count * channels);
+            double psnr = mse > 0.0 ? 10.0 * log10(255.0 * 255.0 / mse) : 99.0;
+            printf("%s: %dx%d, %d levels, %s, %.1f KB -> %.1f KB in %.3f s, RMSE %.2f, PSNR %.2f dB\n",
+                   output_path, source.width, source.height, source.level_count, format_names[format],
+                   source.data_size / 1024.0, compressed.data_size / 1024.0, seconds, sqrt(mse), psnr);
+            free_image(&decompressed);
+        }
+        free_image(&compressed);
+    }
+
+    free_image(&source);
+    return success;
+}
+
 int
 main(int argc, char **argv)
 {
@@ -73,7 +800,18 @@ main(int argc, char **argv)
         printf("glfwInit failed.\n");
         return 1;
     }
-    
+    set_trace_thread_name("main");
+    init_arenas();
+
+    // -cook <bc1|bc3|bc5|bc7> <input> <output.dds> compresses a texture and exits without opening a window.
+    if (argc == 5 && strcmp(argv[1], "-cook") == 0)
+    {
+        bool success = cook_texture(argv[2], argv[3], argv[4]);
+        free_arenas();
+        glfwTerminate();
+        return success ? 0 : 1;
+    }
+
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
@@ -87,62 +825,413 @@ main(int argc, char **argv)
         return 1;
     }
     
-    if (!init_shaders())
+    init_gl_state();
+    init_profiler();
+
+    // A worker for every core but the GL thread's, which runs jobs too while it waits on them.
+    init_jobs(-1);
+
+    // Uploads get 2 ms a frame, startup waits on what it needs without a budget.
+    double startup_start = glfwGetTime();
+    init_asset_loader(2.0f);
+    load_shaders();
+
+    font_t font = {};
+    asset_id_t font_asset = load_default_font(&font);
+    if (!font_asset) fprintf(stderr, "No font found, text is disabled.\n");
+
+    init_materials();
+
+    GLuint vao;
+    glGenVertexArrays(1, &vao);
+    bind_vertex_array(vao);
+
+    init_geometry_pool(1 << 20, 4 << 20);
+    init_mesh_pool();
+    
+    mesh_t sphere_mesh;
+    make_sphere_mesh(&sphere_mesh, 64, 32);
+    build_mesh_clusters(&sphere_mesh, MESH_CLUSTER_MAX_VERTICES, MESH_CLUSTER_MAX_TRIANGLES);
+    generate_mesh_lods(&sphere_mesh, 5, 0.5f);
+    upload_mesh(&sphere_mesh);
+    int sphere_lod_count = sphere_mesh.lod_count;
+    handle_t sphere = create_mesh(&sphere_mesh);
+
+    render_queue_t render_queue;
+    init_render_queue(&render_queue, 4096);
+
+    instance_renderer_t instance_renderer;
+    init_instance_renderer(&instance_renderer, 16384);
+
+    // A field of small spheres below the corridor that never moves, it all goes out in a couple of multi draws.
+    static_scene_t static_scene;
+    init_static_scene(&static_scene, 32 * 32);
+    for (int z = 0; z < 32; ++z)
+    {
+        for (int x = 0; x < 32; ++x)
+        {
+            mat4 object_to_world = mat4_translation(make_vec3((x - 16) * 2.0f, -1.5f, -z * 6.0f)) * mat4_scale(0.8f);
+            handle_t material = ((x + z) & 1) ? material_basic_blue : material_basic;
+            add_static_mesh(&static_scene, sphere, sphere_lod_count - 1, material, object_to_world);
+        }
+    }
+
+    frame_graph_t frame_graph;
+    init_frame_graph(&frame_graph);
+
+    sprite_batch_t sprite_batch;
+    init_sprite_batch(&sprite_batch, 128 * 1024);
+    GLuint particle_texture = make_particle_texture();
+
+    init_debug_draw(64 * 1024);
+
+    // 8 MB of uploads per frame is about 1 ms of copying on the GL thread.
+    init_texture_manager(&texture_manager, 8 << 20, 256ull << 20);
+
+    render_recorder_t render_recorder;
+    init_render_recorder(&render_recorder, 4096, 16384);
+
+    // Everything else was set up while the shaders loaded.
+    if (!wait_for_assets(shader_assets, ARRAY_SIZE(shader_assets)))
     {
         getchar();
         return 1;
     }
+    printf("startup    %.3f s until the shaders were ready\n", glfwGetTime() - startup_start);
 
-    GLuint vao;
-    glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
-    
-    mesh_vertex_t vertices[] =
+    // Benchmarks run with the driver's swap interval, the pacing options only apply to the main loop.
+    vsync_mode_t vsync_mode = VSYNC_ADAPTIVE;
+    float target_fps = 0.0f;
+    bool sim_thread = false;
+
+    for (int i = 1; i < argc; ++i)
     {
-        { { -0.5f, -0.5f, 0.0f }, { 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f } },
-        { { +0.5f, -0.5f, 0.0f }, { 0.0f, 0.0f, 1.0f }, { 1.0f, 0.0f } },
-        { { +0.5f, +0.5f, 0.0f }, { 0.0f, 0.0f, 1.0f }, { 1.0f, 1.0f } },
-        { { -0.5f, +0.5f, 0.0f }, { 0.0f, 0.0f, 1.0f }, { 0.0f, 1.0f } },
-    };
+        if (strcmp(argv[i], "-vsync") == 0 && i + 1 < argc)
+        {
+            i++;
+            if (strcmp(argv[i], "off") == 0) vsync_mode = VSYNC_OFF;
+            else if (strcmp(argv[i], "on") == 0) vsync_mode = VSYNC_ON;
+            else if (strcmp(argv[i], "adaptive") == 0) vsync_mode = VSYNC_ADAPTIVE;
+            else fprintf(stderr, "Unknown vsync mode '%s'.\n", argv[i]);
+        }
+        else if (strcmp(argv[i], "-fps") == 0 && i + 1 < argc)
+        {
+            target_fps = (float)atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-sim_thread") == 0)
+        {
+            sim_thread = true;
+        }
+        else if (strcmp(argv[i], "-bench_jobs") == 0)
+        {
+            run_jobs_benchmark();
+        }
+        else if (strcmp(argv[i], "-bench_instancing") == 0)
+        {
+            run_instancing_benchmark(window, sphere, &instance_renderer);
+        }
+        else if (strcmp(argv[i], "-bench_sprites") == 0)
+        {
+            run_sprite_benchmark(window, &sprite_batch, particle_texture);
+        }
+        else if (strcmp(argv[i], "-bench_text") == 0 && font_asset)
+        {
+            if (wait_for_assets(&font_asset, 1)) run_text_benchmark(window, &sprite_batch, &font);
+        }
+        else if (strcmp(argv[i], "-bench_textures") == 0)
+        {
+            // Every argument up to the next option is a texture.
+            int first = i + 1;
+            while (i + 1 < argc && argv[i + 1][0] != '-') i++;
+            run_texture_benchmark(window, &texture_manager, argv + first, i + 1 - first);
+        }
+        else if (strcmp(argv[i], "-bench_streaming") == 0)
+        {
+            int first = i + 1;
+            while (i + 1 < argc && argv[i + 1][0] != '-') i++;
+            run_streaming_benchmark(window, &texture_manager, argv + first, i + 1 - first);
+        }
+    }
+
+    frame_pacer_t frame_pacer;
+    init_frame_pacer(&frame_pacer, vsync_mode, target_fps);
 
-    uint8_t indices[] =
+    world_state_t initial_world = {};
+    game_loop_t game_loop;
+    if (!init_game_loop(&game_loop, &initial_world, sizeof(initial_world), SIM_TICKS_PER_SECOND, tick_world, NULL, sim_thread))
     {
-        0, 1, 2,
-        0, 2, 3,
-    };
+        return 1;
+    }
 
-    GLuint vbo;
-    glGenBuffers(1, &vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    double last_title_update = 0.0;
+    char hud_text[512] = "";
+    bool has_font = false;
+    vec2 hud_text_size = make_vec2(0.0f, 0.0f);
+
+    // F2 shows the profiler, F3 writes what it has to profile.csv, F4 writes the trace to trace.json,
+    // F5 cycles through the vsync modes.
+    bool show_profiler = false;
+    bool f2_was_down = false;
+    bool f3_was_down = false;
+    bool f4_was_down = false;
+    bool f5_was_down = false;
 
-    GLuint ibo;
-    glGenBuffers(1, &ibo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
-    
     while (!glfwWindowShouldClose(window))
     {
+        // Outside the profiled frame, the wait isn't work.
+        float dt = pace_frame(&frame_pacer);
+
+        begin_profiler_frame();
+
+        begin_profile_scope("poll_events");
         glfwPollEvents();
+        end_profile_scope();
+        reset_gl_state_stats();
+
+        bool f2_down = glfwGetKey(window, GLFW_KEY_F2) == GLFW_PRESS;
+        bool f3_down = glfwGetKey(window, GLFW_KEY_F3) == GLFW_PRESS;
+        bool f4_down = glfwGetKey(window, GLFW_KEY_F4) == GLFW_PRESS;
+        bool f5_down = glfwGetKey(window, GLFW_KEY_F5) == GLFW_PRESS;
+        if (f2_down && !f2_was_down) show_profiler = !show_profiler;
+        if (f3_down && !f3_was_down) export_profiler("profile.csv");
+        if (f4_down && !f4_was_down) dump_trace("trace.json");
+        if (f5_down && !f5_was_down) set_vsync_mode(&frame_pacer, (vsync_mode_t)((frame_pacer.vsync_mode + 1) % 3));
+        f2_was_down = f2_down;
+        f3_was_down = f3_down;
+        f4_was_down = f4_down;
+        f5_was_down = f5_down;
+
+        begin_profile_scope("simulate");
+        float alpha = update_game_loop(&game_loop, dt);
+        world_state_t world = interpolate_world((world_state_t *)game_loop.previous, (world_state_t *)game_loop.current, alpha);
+        end_profile_scope();
 
         int window_width, window_height;
         glfwGetFramebufferSize(window, &window_width, &window_height);
-        glViewport(0, 0, window_width, window_height);
-        
-        glClearColor(0.2f, 0.5f, 0.8f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        set_shader(&shader_basic);
-        
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+        float aspect_ratio = window_height ? (float)window_width / (float)window_height : 1.0f;
+        mat4 view_to_proj = mat4_perspective(to_radians(60.0f), aspect_ratio, 0.1f, 500.0f);
+        vec3 camera_position = make_vec3(0.0f, 1.5f, 3.0f);
+        mat4 world_to_view = mat4_look_at(camera_position, make_vec3(0.0f, 0.0f, -10.0f), make_vec3(0.0f, 1.0f, 0.0f));
+        mat4 world_to_proj = view_to_proj * world_to_view;
+
+        render_view_t view;
+        view.world_to_view = world_to_view;
+        view.view_to_proj = view_to_proj;
+        view.world_to_proj = world_to_proj;
+        view.camera_position = camera_position;
+
+        begin_profile_scope("assets");
+        update_asset_loader();
+        has_font = get_asset_state(font_asset) == ASSET_STATE_READY;
+        end_profile_scope();
+
+        begin_render_queue(&render_queue);
+        begin_instances(&instance_renderer);
+        if (has_font) begin_font_frame(&font);
+
+        begin_profile_scope("textures");
+        update_texture_manager(&texture_manager);
+        end_profile_scope();
+
+        corridor_t corridor;
+        corridor.view = &view;
+        corridor.mesh = sphere;
+        corridor.viewport_height = (float)window_height;
+        corridor.wave_phase = world.wave_phase;
+
+        begin_profile_scope("record");
+        record_render_commands(&render_recorder, record_corridor, &corridor, CORRIDOR_ROWS * CORRIDOR_COLUMNS,
+                               &render_queue, &instance_renderer);
+        end_profile_scope();
+
+#if DEBUG_DRAW
+        // A probe camera circling over the sphere field, showing what it would keep after culling.
+        {
+            float t = world.probe_angle;
+            vec3 field_center = make_vec3(0.0f, -1.5f, -60.0f);
+            vec3 probe_position = field_center + make_vec3(sinf(t) * 20.0f, 6.0f, cosf(t) * 20.0f);
+            mat4 probe_world_to_view = mat4_look_at(probe_position, field_center, make_vec3(0.0f, 1.0f, 0.0f));
+            mat4 probe_world_to_proj = mat4_perspective(to_radians(40.0f), 1.0f, 1.0f, 30.0f) * probe_world_to_view;
+
+            static vec3 last_probe_position = probe_position;
+            debug_line(last_probe_position, probe_position, make_vec4(1.0f, 1.0f, 0.0f, 1.0f), 3.0f);
+            last_probe_position = probe_position;
+
+            debug_frustum(probe_world_to_proj, make_vec4(1.0f, 1.0f, 0.0f, 1.0f));
+            debug_axes(mat4_inverse(probe_world_to_view), 2.0f, 0.0f, false);
+
+            frustum_t probe_frustum = make_frustum(probe_world_to_proj);
+            for (uint32_t i = 0; i < static_scene.object_count; ++i)
+            {
+                static_object_t *object = &static_scene.objects[i];
+                if (sphere_in_frustum(&probe_frustum, object->bounds_center, object->bounds_radius))
+                {
+                    debug_sphere(object->bounds_center, object->bounds_radius, make_vec4(0.2f, 1.0f, 0.2f, 0.6f));
+                }
+            }
+
+            debug_box(make_vec3(-32.8f, -2.3f, -186.8f), make_vec3(30.8f, -0.7f, 0.8f), make_vec4(1.0f, 0.3f, 0.3f, 1.0f));
+            debug_axes(mat4_identity(), 1.0f);
+        }
+#endif
+
+        // Scene into an HDR target, then a small bloom chain. bloom_bright is dead once the horizontal
+        // blur has read it, so the frame graph hands its texture to the vertical blur.
+        if (window_width && window_height)
+        {
+            begin_frame_graph(&frame_graph);
+            frame_graph_resource_t backbuffer = import_backbuffer(&frame_graph, window_width, window_height);
+
+            frame_graph_texture_desc_t scene_color_desc = { window_width, window_height, GL_RGBA16F };
+            frame_graph_texture_desc_t scene_depth_desc = { window_width, window_height, GL_DEPTH_COMPONENT24 };
+            frame_graph_texture_desc_t bloom_desc = { (window_width + 1) / 2, (window_height + 1) / 2, GL_RGBA16F };
+
+            scene_pass_t scene_pass;
+            scene_pass.static_scene = &static_scene;
+            scene_pass.render_queue = &render_queue;
+            scene_pass.instance_renderer = &instance_renderer;
+            scene_pass.world_to_proj = world_to_proj;
+            scene_pass.dt = dt;
 
-        set_vertex_format_to_mesh();
+            int scene = add_frame_graph_pass(&frame_graph, "scene", execute_scene_pass, &scene_pass);
+            frame_graph_resource_t scene_color = create_pass_texture(&frame_graph, scene, "scene_color", scene_color_desc);
+            create_pass_texture(&frame_graph, scene, "scene_depth", scene_depth_desc);
 
-        glDrawElements(GL_TRIANGLES, ARRAY_SIZE(indices), GL_UNSIGNED_BYTE, NULL);
-        
+            fullscreen_pass_t bright_pass = { &shader_bloom_bright };
+            int bright = add_frame_graph_pass(&frame_graph, "bloom_bright", execute_fullscreen_pass, &bright_pass);
+            read_pass_texture(&frame_graph, bright, scene_color);
+            frame_graph_resource_t bloom_bright = create_pass_texture(&frame_graph, bright, "bloom_bright", bloom_desc);
+            bright_pass.inputs[0] = scene_color;
+
+            fullscreen_pass_t blur_x_pass = { &shader_bloom_blur };
+            int blur_x = add_frame_graph_pass(&frame_graph, "bloom_blur_x", execute_fullscreen_pass, &blur_x_pass);
+            read_pass_texture(&frame_graph, blur_x, bloom_bright);
+            frame_graph_resource_t bloom_blur_x = create_pass_texture(&frame_graph, blur_x, "bloom_blur_x", bloom_desc);
+            blur_x_pass.inputs[0] = bloom_bright;
+            blur_x_pass.texel_step = make_vec2(1.0f / bloom_desc.width, 0.0f);
+
+            fullscreen_pass_t blur_y_pass = { &shader_bloom_blur };
+            int blur_y = add_frame_graph_pass(&frame_graph, "bloom_blur_y", execute_fullscreen_pass, &blur_y_pass);
+            read_pass_texture(&frame_graph, blur_y, bloom_blur_x);
+            frame_graph_resource_t bloom = create_pass_texture(&frame_graph, blur_y, "bloom", bloom_desc);
+            blur_y_pass.inputs[0] = bloom_blur_x;
+            blur_y_pass.texel_step = make_vec2(0.0f, 1.0f / bloom_desc.height);
+
+            fullscreen_pass_t composite_pass = { &shader_composite };
+            int composite = add_frame_graph_pass(&frame_graph, "composite", execute_fullscreen_pass, &composite_pass);
+            read_pass_texture(&frame_graph, composite, scene_color);
+            read_pass_texture(&frame_graph, composite, bloom);
+            write_pass_texture(&frame_graph, composite, backbuffer);
+            composite_pass.inputs[0] = scene_color;
+            composite_pass.inputs[1] = bloom;
+
+            hud_pass_t hud_pass;
+            hud_pass.sprites = &sprite_batch;
+            hud_pass.particle_texture = particle_texture;
+            hud_pass.font = has_font ? &font : NULL;
+            hud_pass.text = hud_text;
+            hud_pass.text_size = hud_text_size;
+            hud_pass.width = window_width;
+            hud_pass.height = window_height;
+            hud_pass.time = (float)glfwGetTime();
+            hud_pass.show_profiler = show_profiler;
+
+            int hud = add_frame_graph_pass(&frame_graph, "hud", execute_hud_pass, &hud_pass);
+            write_pass_texture(&frame_graph, hud, backbuffer);
+
+            compile_frame_graph(&frame_graph);
+
+            PROFILE_SCOPE("frame_graph");
+            execute_frame_graph(&frame_graph);
+        }
+
+#if GL_STATE_VALIDATION
+        validate_gl_state();
+#endif
+
+        double now = glfwGetTime();
+        if (now - last_title_update > 1.0)
+        {
+            font_stats_t *font_stats = &font.stats;
+            frame_pacing_stats_t pacing = get_frame_pacing_stats(&frame_pacer);
+            asset_loader_stats_t asset_stats = get_asset_loader_stats();
+
+            // High water marks, the most any one thread arena has held.
+            arena_stats_t arena_stats[MAX_ARENAS];
+            uint32_t arena_count = get_arena_stats(arena_stats, MAX_ARENAS);
+            size_t frame_arena_peak = 0;
+            size_t thread_arena_peak = 0;
+            for (uint32_t i = 0; i < arena_count; ++i)
+            {
+                if (strcmp(arena_stats[i].name, "frame") == 0) frame_arena_peak = arena_stats[i].high_water;
+                else if (arena_stats[i].high_water > thread_arena_peak) thread_arena_peak = arena_stats[i].high_water;
+            }
+            snprintf(hud_text, sizeof(hud_text), "%.2f ms per frame, p50 %.2f, p95 %.2f, p99 %.2f, max %.2f\nvsync: %s%s, limit: %.0f fps\nsim: %d Hz%s, %llu ticks, %llu dropped\narenas: frame %.0f KB, threads %.0f KB at most\nglyphs: %u drawn, %u rasterized, %u evicted\nruns: %u cached, %u shaped\ntextures: %u resident, %u pending, %u streaming, %.1f of %.0f MB\nassets: %u ready, %u loading, %u queued, %u failed, %.1f MB read",
+                     pacing.average_ms, pacing.p50_ms, pacing.p95_ms, pacing.p99_ms, pacing.max_ms,
+                     get_vsync_mode_name(frame_pacer.vsync_mode),
+                     frame_pacer.vsync_mode == VSYNC_ADAPTIVE && !frame_pacer.has_swap_tear ? " (not supported, on)" : "",
+                     frame_pacer.target_ticks ? 1.0 / (frame_pacer.target_ticks * frame_pacer.ticks_to_seconds) : 0.0,
+                     SIM_TICKS_PER_SECOND, game_loop.threaded ? " on its own thread" : "",
+                     (unsigned long long)game_loop.tick_count, (unsigned long long)game_loop.dropped_ticks,
+                     frame_arena_peak / 1024.0, thread_arena_peak / 1024.0,
+                     font_stats->glyphs_drawn, font_stats->glyphs_rasterized, font_stats->glyphs_evicted,
+                     font_stats->run_hits, font_stats->run_misses,
+                     texture_manager.stats.resident_count, texture_manager.stats.pending_count, texture_manager.stats.streaming_count,
+                     texture_manager.stats.resident_bytes / (1024.0 * 1024.0), texture_manager.budget_bytes / (1024.0 * 1024.0),
+                     asset_stats.ready_count, asset_stats.loading_count, asset_stats.queued_count, asset_stats.failed_count,
+                     asset_stats.read_bytes / (1024.0 * 1024.0));
+            if (has_font) hud_text_size = measure_text(&font, hud_text);
+
+            render_queue_stats_t *stats = &render_queue.stats;
+            gl_state_stats_t gl_stats = get_gl_state_stats();
+
+            frame_graph_stats_t *graph_stats = &frame_graph.stats;
+
+            char title[512];
+            snprintf(title, sizeof(title), "Game | sprites: %u in %u draws | frame graph: %u/%u passes, %u transients in %u textures, %.1f MB aliased to %.1f MB | record: %.3f ms on %d threads, merge %.3f ms | static: %u objects in %u %s | queue: %u draws, %u shader / %u material changes | instanced: %u draws | gl state: %u issued, %u skipped",
+                     sprite_batch.stats.sprite_count, sprite_batch.stats.draw_calls,
+                     graph_stats->pass_count - graph_stats->culled_pass_count, graph_stats->pass_count,
+                     graph_stats->transient_count, graph_stats->physical_count,
+                     graph_stats->transient_bytes / (1024.0 * 1024.0), graph_stats->physical_bytes / (1024.0 * 1024.0),
+                     1000.0 * render_recorder.record_seconds, render_recorder.list_count, 1000.0 * render_recorder.merge_seconds,
+                     static_scene.stats.visible_objects, static_scene.stats.draw_calls, static_scene.use_indirect ? "MDI" : "multi draws",
+                     stats->draw_calls, stats->shader_changes, stats->material_changes, instance_renderer.draw_call_count,
+                     gl_stats.calls_issued, gl_stats.calls_skipped);
+            glfwSetWindowTitle(window, title);
+            last_title_update = now;
+        }
+
+        begin_profile_scope("swap");
         glfwSwapBuffers(window);
+        end_profile_scope();
+
+        reset_frame_arena();
+
+        end_profiler_frame();
     }
+
+    // Decodes in flight write into the font, reads into the texture manager.
+    free_asset_loader();
+    free_font(&font);
+    free_texture_manager(&texture_manager);
+    free_debug_draw();
+    delete_gl_texture(particle_texture);
+    free_sprite_batch(&sprite_batch);
+    free_frame_graph(&frame_graph);
+    free_render_recorder(&render_recorder);
+    free_jobs();
+    free_static_scene(&static_scene);
+    free_instance_renderer(&instance_renderer);
+    free_render_queue(&render_queue);
+    free_mesh_pool();
+    free_material_pool();
+    free_profiler();
+    free_frame_pacer(&frame_pacer);
+    free_game_loop(&game_loop);
+    free_arenas();
+
+    shutdown_geometry_pool();
     
     glfwTerminate();
     
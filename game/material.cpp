@@ -0,0 +1,70 @@
+#include "material.h"
+#include "utils.h"
+
+static pool_t materials;
+static handle_t current_material;
+
+void
+init_material_pool()
+{
+    init_pool(&materials, sizeof(material_t), MAX_MATERIALS);
+}
+
+void
+free_material_pool()
+{
+    free_pool(&materials);
+    current_material = NULL_HANDLE;
+}
+
+handle_t
+create_material(shader_t *shader, vec4 color)
+{
+    handle_t handle = add_pool_item(&materials);
+    if (handle == NULL_HANDLE) return NULL_HANDLE;
+
+    material_t *material = POOL_ITEM(&materials, material_t, handle);
+    material->shader = shader;
+    material->color = color;
+    return handle;
+}
+
+void
+destroy_material(handle_t material)
+{
+    if (current_material == material) current_material = NULL_HANDLE;
+    remove_pool_item(&materials, material);
+}
+
+material_t *
+get_material(handle_t material)
+{
+    return POOL_ITEM(&materials, material_t, material);
+}
+
+void
+set_material(handle_t handle)
+{
+    material_t *material = get_material(handle);
+    ASSERT(material || handle == NULL_HANDLE);
+
+    // Somebody else may have switched shaders behind our back.
+    if (current_material == handle && (!material || get_current_shader() == material->shader)) return;
+
+    current_material = material ? handle : NULL_HANDLE;
+
+    if (material)
+    {
+        set_shader(material->shader);
+        if (material->shader->material_color_loc != -1)
+        {
+            glUniform4fv(material->shader->material_color_loc, 1, &material->color.x);
+        }
+    }
+}
+
+handle_t
+get_current_material()
+{
+    return current_material;
+}
@@ -0,0 +1,35 @@
+#ifndef MATERIAL_H
+#define MATERIAL_H
+
+#include "shader.h"
+#include "pool.h"
+#include "my_math.h"
+
+// Materials live in a pool and everything else refers to them by handle. The handle's index is
+// small and unique, it doubles as the material's place in sort keys.
+
+#define MAX_MATERIALS 4096 // The sort keys have 12 bits for it.
+
+struct material_t
+{
+    shader_t *shader;
+    vec4 color;
+};
+
+void init_material_pool();
+void free_material_pool();
+
+// NULL_HANDLE when there are MAX_MATERIALS already.
+handle_t create_material(shader_t *shader, vec4 color);
+void destroy_material(handle_t material);
+
+// NULL for a stale handle. The pointer is only good until a material is destroyed.
+material_t *get_material(handle_t material);
+
+// Binds the material's shader and uploads its uniforms, skips the work if it is already current.
+// NULL_HANDLE just forgets the current material.
+void set_material(handle_t material);
+
+handle_t get_current_material();
+
+#endif
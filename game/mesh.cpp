@@ -0,0 +1,429 @@
+#include "mesh.h"
+#include "mesh_simplify.h"
+#include "shader.h"
+#include "geometry_pool.h"
+#include "gl_state.h"
+#include "trace.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MESH_FILE_MAGIC 0x4853454D // 'MESH'
+#define MESH_FILE_VERSION 2
+
+struct mesh_file_header_t
+{
+    uint32_t magic;
+    uint32_t version;
+
+    uint32_t vertex_count;
+    uint32_t index_count;
+
+    uint32_t lod_count;
+    mesh_lod_t lods[MESH_MAX_LODS];
+
+    uint32_t cluster_count;
+
+    vec3 bounds_center;
+    float bounds_radius;
+};
+
+static bool
+is_index_range_valid(mesh_t *mesh, uint32_t first_index, uint32_t index_count)
+{
+    return (uint64_t)first_index + index_count <= mesh->index_count;
+}
+
+// Everything drawing and culling index with comes from the file, none of it can point outside.
+static bool
+validate_mesh(mesh_t *mesh)
+{
+    for (int i = 0; i < mesh->lod_count; ++i)
+    {
+        if (!is_index_range_valid(mesh, mesh->lods[i].first_index, mesh->lods[i].index_count)) return false;
+    }
+
+    for (uint32_t i = 0; i < mesh->cluster_count; ++i)
+    {
+        if (!is_index_range_valid(mesh, mesh->clusters[i].first_index, mesh->clusters[i].index_count)) return false;
+    }
+
+    for (uint32_t i = 0; i < mesh->index_count; ++i)
+    {
+        if (mesh->indices[i] >= mesh->vertex_count) return false;
+    }
+
+    return true;
+}
+
+bool
+load_mesh(mesh_t *mesh, char *filepath)
+{
+    TRACE_SCOPE("load_mesh");
+
+    FILE *file = fopen(filepath, "rb");
+    if (!file)
+    {
+        fprintf(stderr, "Failed to read file '%s'.\n", filepath);
+        return false;
+    }
+
+    mesh_file_header_t header;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        header.magic != MESH_FILE_MAGIC ||
+        header.version != MESH_FILE_VERSION ||
+        header.lod_count == 0 || header.lod_count > MESH_MAX_LODS)
+    {
+        fprintf(stderr, "'%s' is not a valid mesh file.\n", filepath);
+        fclose(file);
+        return false;
+    }
+
+    // The counts decide how much is allocated, check them against what the file can hold first.
+    fseek(file, 0, SEEK_END);
+    uint64_t file_size = (uint64_t)ftell(file);
+    fseek(file, sizeof(header), SEEK_SET);
+
+    uint64_t expected_size = sizeof(header) + (uint64_t)header.vertex_count * sizeof(mesh_vertex_t) +
+                             (uint64_t)header.index_count * sizeof(uint32_t) +
+                             (uint64_t)header.cluster_count * sizeof(mesh_cluster_t);
+    if (expected_size > file_size)
+    {
+        fprintf(stderr, "'%s' is truncated.\n", filepath);
+        fclose(file);
+        return false;
+    }
+
+    *mesh = {};
+    mesh->vertex_count = header.vertex_count;
+    mesh->index_count = header.index_count;
+    mesh->lod_count = header.lod_count;
+    memcpy(mesh->lods, header.lods, sizeof(mesh->lods));
+    mesh->cluster_count = header.cluster_count;
+    mesh->bounds_center = header.bounds_center;
+    mesh->bounds_radius = header.bounds_radius;
+
+    mesh->vertices = (mesh_vertex_t *)malloc(mesh->vertex_count * sizeof(mesh_vertex_t));
+    mesh->indices = (uint32_t *)malloc(mesh->index_count * sizeof(uint32_t));
+    mesh->clusters = (mesh_cluster_t *)malloc(mesh->cluster_count * sizeof(mesh_cluster_t));
+
+    bool success = fread(mesh->vertices, sizeof(mesh_vertex_t), mesh->vertex_count, file) == mesh->vertex_count &&
+                   fread(mesh->indices, sizeof(uint32_t), mesh->index_count, file) == mesh->index_count &&
+                   fread(mesh->clusters, sizeof(mesh_cluster_t), mesh->cluster_count, file) == mesh->cluster_count;
+    fclose(file);
+
+    if (!success)
+    {
+        fprintf(stderr, "'%s' is truncated.\n", filepath);
+        free_mesh(mesh);
+        return false;
+    }
+
+    if (!validate_mesh(mesh))
+    {
+        fprintf(stderr, "'%s' has ranges outside of its vertices or indices.\n", filepath);
+        free_mesh(mesh);
+        return false;
+    }
+
+    return true;
+}
+
+bool
+save_mesh(mesh_t *mesh, char *filepath)
+{
+    FILE *file = fopen(filepath, "wb");
+    if (!file)
+    {
+        fprintf(stderr, "Failed to open '%s' for writing.\n", filepath);
+        return false;
+    }
+
+    mesh_file_header_t header = {};
+    header.magic = MESH_FILE_MAGIC;
+    header.version = MESH_FILE_VERSION;
+    header.vertex_count = mesh->vertex_count;
+    header.index_count = mesh->index_count;
+    header.lod_count = mesh->lod_count;
+    memcpy(header.lods, mesh->lods, sizeof(header.lods));
+    header.cluster_count = mesh->cluster_count;
+    header.bounds_center = mesh->bounds_center;
+    header.bounds_radius = mesh->bounds_radius;
+
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(mesh->vertices, sizeof(mesh_vertex_t), mesh->vertex_count, file);
+    fwrite(mesh->indices, sizeof(uint32_t), mesh->index_count, file);
+    fwrite(mesh->clusters, sizeof(mesh_cluster_t), mesh->cluster_count, file);
+    fclose(file);
+
+    return true;
+}
+
+void
+free_mesh(mesh_t *mesh)
+{
+    free_geometry(mesh->geometry_id);
+
+    free(mesh->vertices);
+    free(mesh->indices);
+    free(mesh->clusters);
+
+    *mesh = {};
+}
+
+static pool_t meshes;
+
+void
+init_mesh_pool()
+{
+    init_pool(&meshes, sizeof(mesh_t), MAX_MESHES);
+}
+
+void
+free_mesh_pool()
+{
+    for (uint32_t i = 0; i < meshes.count; ++i) free_mesh(&POOL_ITEMS(&meshes, mesh_t)[i]);
+    free_pool(&meshes);
+}
+
+handle_t
+create_mesh(mesh_t *mesh)
+{
+    handle_t handle = add_pool_item(&meshes);
+    if (handle == NULL_HANDLE) return NULL_HANDLE;
+
+    *POOL_ITEM(&meshes, mesh_t, handle) = *mesh;
+    *mesh = {};
+    return handle;
+}
+
+void
+destroy_mesh(handle_t handle)
+{
+    mesh_t *mesh = get_mesh(handle);
+    if (!mesh) return;
+
+    free_mesh(mesh);
+    remove_pool_item(&meshes, handle);
+}
+
+mesh_t *
+get_mesh(handle_t mesh)
+{
+    return POOL_ITEM(&meshes, mesh_t, mesh);
+}
+
+void
+make_sphere_mesh(mesh_t *mesh, int slices, int stacks)
+{
+    *mesh = {};
+
+    mesh->vertex_count = (slices + 1) * (stacks + 1);
+    mesh->index_count = slices * stacks * 6;
+    mesh->vertices = (mesh_vertex_t *)malloc(mesh->vertex_count * sizeof(mesh_vertex_t));
+    mesh->indices = (uint32_t *)malloc(mesh->index_count * sizeof(uint32_t));
+
+    mesh_vertex_t *v = mesh->vertices;
+    for (int stack = 0; stack <= stacks; ++stack)
+    {
+        float theta = PI32 * (float)stack / (float)stacks;
+        for (int slice = 0; slice <= slices; ++slice)
+        {
+            float phi = 2.0f * PI32 * (float)slice / (float)slices;
+
+            vec3 n = make_vec3(sinf(theta) * cosf(phi), cosf(theta), -sinf(theta) * sinf(phi));
+            v->position = n * 0.5f;
+            v->normal = n;
+            v->uv = make_vec2((float)slice / (float)slices, 1.0f - (float)stack / (float)stacks);
+            v++;
+        }
+    }
+
+    uint32_t *index = mesh->indices;
+    for (int stack = 0; stack < stacks; ++stack)
+    {
+        for (int slice = 0; slice < slices; ++slice)
+        {
+            uint32_t i0 = stack * (slices + 1) + slice;
+            uint32_t i1 = i0 + 1;
+            uint32_t i2 = i0 + (slices + 1);
+            uint32_t i3 = i2 + 1;
+
+            *index++ = i0;
+            *index++ = i2;
+            *index++ = i1;
+
+            *index++ = i1;
+            *index++ = i2;
+            *index++ = i3;
+        }
+    }
+
+    mesh->lod_count = 1;
+    mesh->lods[0].first_index = 0;
+    mesh->lods[0].index_count = mesh->index_count;
+    mesh->lods[0].error = 0.0f;
+
+    compute_mesh_bounds(mesh);
+}
+
+void
+compute_mesh_bounds(mesh_t *mesh)
+{
+    if (!mesh->vertex_count) return;
+
+    vec3 min = mesh->vertices[0].position;
+    vec3 max = min;
+    for (uint32_t i = 1; i < mesh->vertex_count; ++i)
+    {
+        vec3 p = mesh->vertices[i].position;
+        if (p.x < min.x) min.x = p.x;
+        if (p.y < min.y) min.y = p.y;
+        if (p.z < min.z) min.z = p.z;
+        if (p.x > max.x) max.x = p.x;
+        if (p.y > max.y) max.y = p.y;
+        if (p.z > max.z) max.z = p.z;
+    }
+
+    vec3 center = (min + max) * 0.5f;
+    float radius_sq = 0.0f;
+    for (uint32_t i = 0; i < mesh->vertex_count; ++i)
+    {
+        float d = length_squared(mesh->vertices[i].position - center);
+        if (d > radius_sq) radius_sq = d;
+    }
+
+    mesh->bounds_center = center;
+    mesh->bounds_radius = sqrtf(radius_sq);
+}
+
+void
+generate_mesh_lods(mesh_t *mesh, int lod_count, float reduction_per_lod)
+{
+    ASSERT(mesh->lod_count >= 1);
+    if (lod_count > MESH_MAX_LODS) lod_count = MESH_MAX_LODS;
+
+    mesh_lod_t *base = &mesh->lods[0];
+
+    // Worst case every LOD is as big as the base one.
+    uint32_t max_index_count = base->index_count * lod_count;
+    uint32_t *indices = (uint32_t *)malloc(max_index_count * sizeof(uint32_t));
+    memcpy(indices, mesh->indices + base->first_index, base->index_count * sizeof(uint32_t));
+
+    mesh->lod_count = 1;
+    base->first_index = 0;
+
+    uint32_t index_count = base->index_count;
+    while (mesh->lod_count < lod_count)
+    {
+        mesh_lod_t *previous = &mesh->lods[mesh->lod_count - 1];
+
+        uint32_t target = (uint32_t)((float)previous->index_count * reduction_per_lod);
+        target -= target % 3;
+
+        float error = 0.0f;
+        uint32_t count = simplify_mesh(indices + index_count, indices + previous->first_index, previous->index_count,
+                                       mesh->vertices, mesh->vertex_count, target, &error);
+
+        // Stop once the simplifier can't make meaningful progress, it is locked by seams and borders.
+        if (count == 0 || count > previous->index_count - previous->index_count / 10) break;
+
+        mesh_lod_t *lod = &mesh->lods[mesh->lod_count++];
+        lod->first_index = index_count;
+        lod->index_count = count;
+        lod->error = previous->error + error;
+
+        index_count += count;
+    }
+
+    free(mesh->indices);
+    mesh->indices = indices;
+
+    // LOD 0 was copied as is, so the clusters still point at the right indices.
+    mesh->index_count = index_count;
+}
+
+void
+upload_mesh(mesh_t *mesh)
+{
+    free_geometry(mesh->geometry_id);
+
+    mesh->geometry_id = allocate_geometry(mesh->vertex_count, mesh->index_count);
+    if (mesh->geometry_id) upload_geometry(mesh->geometry_id, mesh->vertices, mesh->indices);
+}
+
+void *
+get_mesh_index_offset(mesh_t *mesh, uint32_t first_index)
+{
+    geometry_range_t *range = get_geometry(mesh->geometry_id);
+    return (void *)((size_t)(range->first_index + first_index) * sizeof(uint32_t));
+}
+
+GLint
+get_mesh_base_vertex(mesh_t *mesh)
+{
+    geometry_range_t *range = get_geometry(mesh->geometry_id);
+    return (GLint)range->first_vertex;
+}
+
+void
+set_vertex_format_to_mesh(void)
+{
+    shader_t *shader = get_current_shader();
+
+    GLint loc = shader->input_position_loc;
+    if (loc != -1)
+    {
+        set_vertex_attrib_pointer(loc, 3, GL_FLOAT, GL_FALSE, sizeof(mesh_vertex_t), MESH_VERTEX_OFFSET_position);
+        enable_vertex_attrib(loc, true);
+    }
+
+    loc = shader->input_normal_loc;
+    if (loc != -1)
+    {
+        set_vertex_attrib_pointer(loc, 3, GL_FLOAT, GL_FALSE, sizeof(mesh_vertex_t), MESH_VERTEX_OFFSET_normal);
+        enable_vertex_attrib(loc, true);
+    }
+
+    loc = shader->input_uv_loc;
+    if (loc != -1)
+    {
+        set_vertex_attrib_pointer(loc, 2, GL_FLOAT, GL_FALSE, sizeof(mesh_vertex_t), MESH_VERTEX_OFFSET_uv);
+        enable_vertex_attrib(loc, true);
+    }
+}
+
+int
+select_mesh_lod(mesh_t *mesh, mat4 object_to_world, mat4 world_to_view, mat4 view_to_proj, float viewport_height, float max_pixel_error)
+{
+    // Errors are stored in object space, scale them by the largest axis of the transform.
+    float scale_sq = 0.0f;
+    for (int col = 0; col < 3; ++col)
+    {
+        vec3 axis = make_vec3(object_to_world.elements[0][col], object_to_world.elements[1][col], object_to_world.elements[2][col]);
+        float len_sq = length_squared(axis);
+        if (len_sq > scale_sq) scale_sq = len_sq;
+    }
+    float scale = sqrtf(scale_sq);
+
+    vec3 center = transform_point(world_to_view * object_to_world, mesh->bounds_center);
+
+    // Distance to the closest point of the bounding sphere, the camera looks down -z.
+    float distance = -center.z - mesh->bounds_radius * scale;
+    if (distance < 0.001f) return 0;
+
+    // _22 is cot(fov_y / 2), which maps view space units at distance 1 to half the viewport.
+    float pixels_per_unit = view_to_proj._22 * 0.5f * viewport_height / distance;
+
+    int result = 0;
+    for (int i = 1; i < mesh->lod_count; ++i)
+    {
+        float pixel_error = mesh->lods[i].error * scale * pixels_per_unit;
+        if (pixel_error > max_pixel_error) break;
+        result = i;
+    }
+
+    return result;
+}
@@ -1,9 +1,112 @@
 #ifndef MESH_H
 #define MESH_H
 
+#include <GL/glew.h>
+#include <stdint.h>
+
+#include "pool.h"
+#include "my_math.h"
+
+struct mesh_vertex_t
+{
+    vec3 position;
+    vec3 normal;
+    vec2 uv;
+};
+
+#define MESH_VERTEX_OFFSET_position 0
+#define MESH_VERTEX_OFFSET_normal 12
+#define MESH_VERTEX_OFFSET_uv 24
+
+#define MESH_MAX_LODS 8
+
+struct mesh_lod_t
+{
+    uint32_t first_index;
+    uint32_t index_count;
+
+    // Object space distance that this LOD may deviate from the original surface.
+    float error;
+};
+
+// A small patch of LOD 0 triangles that can be culled on its own.
+// The cone bounds the triangle normals: the cluster is backfacing from every point p with
+// dot(normalize(cone_apex - p), cone_axis) >= cone_cutoff. A cutoff above 1 never culls.
+struct mesh_cluster_t
+{
+    uint32_t first_index;
+    uint32_t index_count;
+
+    vec3 center;
+    float radius;
+
+    vec3 cone_apex;
+    vec3 cone_axis;
+    float cone_cutoff;
+};
+
+// All LODs share the vertex buffer, their indices are stored back to back in one index buffer.
 struct mesh_t
 {
-    
+    mesh_vertex_t *vertices;
+    uint32_t vertex_count;
+
+    uint32_t *indices;
+    uint32_t index_count;
+
+    int lod_count;
+    mesh_lod_t lods[MESH_MAX_LODS];
+
+    // Partition of LOD 0, empty until build_mesh_clusters has run.
+    mesh_cluster_t *clusters;
+    uint32_t cluster_count;
+
+    vec3 bounds_center;
+    float bounds_radius;
+
+    // Range in the geometry pool, 0 until upload_mesh.
+    uint32_t geometry_id;
 };
 
+// Meshes that get drawn live in a pool, draws and instances refer to them by handle and are
+// dropped instead of dereferenced once their mesh is gone.
+#define MAX_MESHES 4096
+
+void init_mesh_pool();
+
+// Frees the meshes still in the pool too.
+void free_mesh_pool();
+
+// Takes over mesh and leaves it empty. NULL_HANDLE when there are MAX_MESHES already.
+handle_t create_mesh(mesh_t *mesh);
+
+// Frees the mesh and its geometry.
+void destroy_mesh(handle_t mesh);
+
+// NULL for a stale handle. The pointer is only good until a mesh is destroyed.
+mesh_t *get_mesh(handle_t mesh);
+
+bool load_mesh(mesh_t *mesh, char *filepath);
+bool save_mesh(mesh_t *mesh, char *filepath);
+void free_mesh(mesh_t *mesh);
+
+void make_sphere_mesh(mesh_t *mesh, int slices, int stacks);
+void compute_mesh_bounds(mesh_t *mesh);
+
+// Builds lod_count - 1 additional LODs, each one trying to keep reduction_per_lod of the triangles of the previous one.
+void generate_mesh_lods(mesh_t *mesh, int lod_count, float reduction_per_lod);
+
+// Copies the mesh into the geometry pool.
+void upload_mesh(mesh_t *mesh);
+
+// Draw parameters for indices of an uploaded mesh: byte offset into the pool's index buffer and base vertex.
+void *get_mesh_index_offset(mesh_t *mesh, uint32_t first_index);
+GLint get_mesh_base_vertex(mesh_t *mesh);
+
+// Points the attributes of the current shader at the bound mesh vertex buffer.
+void set_vertex_format_to_mesh(void);
+
+// Picks the coarsest LOD whose error projected on screen stays under max_pixel_error.
+int select_mesh_lod(mesh_t *mesh, mat4 object_to_world, mat4 world_to_view, mat4 view_to_proj, float viewport_height, float max_pixel_error);
+
 #endif
@@ -0,0 +1,253 @@
+#include "mesh_cluster.h"
+#include "utils.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+
+static void
+compute_cluster_bounds(mesh_cluster_t *cluster, uint32_t *indices, mesh_vertex_t *vertices)
+{
+    uint32_t triangle_count = cluster->index_count / 3;
+
+    vec3 min = make_vec3(FLT_MAX);
+    vec3 max = make_vec3(-FLT_MAX);
+    for (uint32_t i = 0; i < cluster->index_count; ++i)
+    {
+        vec3 p = vertices[indices[i]].position;
+        if (p.x < min.x) min.x = p.x;
+        if (p.y < min.y) min.y = p.y;
+        if (p.z < min.z) min.z = p.z;
+        if (p.x > max.x) max.x = p.x;
+        if (p.y > max.y) max.y = p.y;
+        if (p.z > max.z) max.z = p.z;
+    }
+
+    vec3 center = (min + max) * 0.5f;
+    float radius_sq = 0.0f;
+    for (uint32_t i = 0; i < cluster->index_count; ++i)
+    {
+        float d = length_squared(vertices[indices[i]].position - center);
+        if (d > radius_sq) radius_sq = d;
+    }
+
+    cluster->center = center;
+    cluster->radius = sqrtf(radius_sq);
+
+    // Normal cone.
+    vec3 axis = {};
+    for (uint32_t t = 0; t < triangle_count; ++t)
+    {
+        vec3 a = vertices[indices[t*3 + 0]].position;
+        vec3 b = vertices[indices[t*3 + 1]].position;
+        vec3 c = vertices[indices[t*3 + 2]].position;
+        axis += normalize_or_zero(cross_product(b - a, c - a));
+    }
+    axis = normalize_or_zero(axis);
+
+    float min_dp = 1.0f;
+    for (uint32_t t = 0; t < triangle_count; ++t)
+    {
+        vec3 a = vertices[indices[t*3 + 0]].position;
+        vec3 b = vertices[indices[t*3 + 1]].position;
+        vec3 c = vertices[indices[t*3 + 2]].position;
+        vec3 n = normalize_or_zero(cross_product(b - a, c - a));
+
+        float dp = dot_product(n, axis);
+        if (dp < min_dp) min_dp = dp;
+    }
+
+    cluster->cone_axis = axis;
+    cluster->cone_apex = center;
+
+    if (min_dp <= 0.0f || length_squared(axis) == 0.0f)
+    {
+        // Normals spread over more than a hemisphere, the cluster is never entirely backfacing.
+        cluster->cone_cutoff = 2.0f;
+        return;
+    }
+
+    cluster->cone_cutoff = sqrtf(1.0f - min_dp*min_dp);
+
+    // Slide the apex back along the axis until it is behind every triangle plane.
+    float max_t = 0.0f;
+    for (uint32_t t = 0; t < triangle_count; ++t)
+    {
+        vec3 a = vertices[indices[t*3 + 0]].position;
+        vec3 b = vertices[indices[t*3 + 1]].position;
+        vec3 c = vertices[indices[t*3 + 2]].position;
+        vec3 n = normalize_or_zero(cross_product(b - a, c - a));
+
+        float dn = dot_product(n, axis);
+        if (dn <= 0.0f) continue;
+
+        float t_plane = dot_product(n, center - a) / dn;
+        if (t_plane > max_t) max_t = t_plane;
+    }
+
+    cluster->cone_apex = center - axis * max_t;
+}
+
+void
+build_mesh_clusters(mesh_t *mesh, uint32_t max_vertices, uint32_t max_triangles)
+{
+    ASSERT(mesh->lod_count >= 1);
+    ASSERT(max_vertices >= 3);
+    ASSERT(max_triangles >= 1);
+
+    mesh_lod_t *lod = &mesh->lods[0];
+    uint32_t *indices = mesh->indices + lod->first_index;
+    uint32_t index_count = lod->index_count;
+    uint32_t triangle_count = index_count / 3;
+    uint32_t vertex_count = mesh->vertex_count;
+    mesh_vertex_t *vertices = mesh->vertices;
+
+    // Vertex to triangle adjacency.
+    uint32_t *triangle_offsets = (uint32_t *)calloc(vertex_count + 1, sizeof(uint32_t));
+    uint32_t *triangle_list = (uint32_t *)malloc(index_count * sizeof(uint32_t));
+    for (uint32_t i = 0; i < index_count; ++i) triangle_offsets[indices[i] + 1]++;
+    for (uint32_t i = 0; i < vertex_count; ++i) triangle_offsets[i + 1] += triangle_offsets[i];
+    for (uint32_t i = 0; i < index_count; ++i) triangle_list[triangle_offsets[indices[i]]++] = i / 3;
+    for (uint32_t i = vertex_count; i > 0; --i) triangle_offsets[i] = triangle_offsets[i - 1];
+    triangle_offsets[0] = 0;
+
+    bool *emitted = (bool *)calloc(triangle_count, sizeof(bool));
+    uint32_t *vertex_cluster = (uint32_t *)malloc(vertex_count * sizeof(uint32_t));
+    memset(vertex_cluster, 0xFF, vertex_count * sizeof(uint32_t));
+
+    uint32_t *cluster_vertices = (uint32_t *)malloc(max_vertices * sizeof(uint32_t));
+    uint32_t *reordered = (uint32_t *)malloc(index_count * sizeof(uint32_t));
+    mesh_cluster_t *clusters = (mesh_cluster_t *)malloc((triangle_count + 1) * sizeof(mesh_cluster_t));
+
+    uint32_t cluster_count = 0;
+    uint32_t written = 0;
+    uint32_t seed = 0;
+
+    while (written < index_count)
+    {
+        while (emitted[seed]) seed++;
+
+        mesh_cluster_t *cluster = &clusters[cluster_count];
+        cluster->first_index = written;
+
+        uint32_t cluster_vertex_count = 0;
+        uint32_t cluster_triangle_count = 0;
+        vec3 centroid_sum = {};
+
+        uint32_t triangle = seed;
+        for (;;)
+        {
+            emitted[triangle] = true;
+            for (int k = 0; k < 3; ++k)
+            {
+                uint32_t v = indices[triangle*3 + k];
+                if (vertex_cluster[v] != cluster_count)
+                {
+                    vertex_cluster[v] = cluster_count;
+                    cluster_vertices[cluster_vertex_count++] = v;
+                }
+                reordered[written++] = v;
+                centroid_sum += vertices[v].position;
+            }
+            cluster_triangle_count++;
+
+            if (cluster_triangle_count == max_triangles) break;
+
+            // Grow towards the neighbour that adds the fewest new vertices, ties go to the closest one.
+            vec3 centroid = centroid_sum / (float)(cluster_triangle_count * 3);
+            uint32_t best = 0xFFFFFFFF;
+            uint32_t best_new_vertices = 4;
+            float best_distance = FLT_MAX;
+
+            for (uint32_t i = 0; i < cluster_vertex_count; ++i)
+            {
+                uint32_t v = cluster_vertices[i];
+                for (uint32_t t = triangle_offsets[v]; t < triangle_offsets[v + 1]; ++t)
+                {
+                    uint32_t candidate = triangle_list[t];
+                    if (emitted[candidate]) continue;
+
+                    uint32_t *tri = indices + candidate*3;
+                    uint32_t new_vertices = 0;
+                    vec3 tri_center = {};
+                    for (int k = 0; k < 3; ++k)
+                    {
+                        if (vertex_cluster[tri[k]] != cluster_count) new_vertices++;
+                        tri_center += vertices[tri[k]].position;
+                    }
+                    if (cluster_vertex_count + new_vertices > max_vertices) continue;
+
+                    float distance = length_squared(tri_center / 3.0f - centroid);
+                    if (new_vertices < best_new_vertices ||
+                        (new_vertices == best_new_vertices && distance < best_distance))
+                    {
+                        best = candidate;
+                        best_new_vertices = new_vertices;
+                        best_distance = distance;
+                    }
+                }
+            }
+
+            if (best == 0xFFFFFFFF) break;
+            triangle = best;
+        }
+
+        cluster->index_count = written - cluster->first_index;
+        compute_cluster_bounds(cluster, reordered + cluster->first_index, vertices);
+        cluster->first_index += lod->first_index;
+        cluster_count++;
+    }
+
+    memcpy(indices, reordered, index_count * sizeof(uint32_t));
+
+    free(mesh->clusters);
+    mesh->clusters = (mesh_cluster_t *)realloc(clusters, cluster_count * sizeof(mesh_cluster_t));
+    mesh->cluster_count = cluster_count;
+
+    free(reordered);
+    free(cluster_vertices);
+    free(vertex_cluster);
+    free(emitted);
+    free(triangle_list);
+    free(triangle_offsets);
+}
+
+GLsizei
+cull_mesh_clusters(mesh_t *mesh, mat4 object_to_world, mat4 world_to_proj, vec3 camera_position,
+                   GLsizei *counts, void **offsets, GLint *base_vertices)
+{
+    // Cull in object space so the clusters don't have to be transformed.
+    frustum_t frustum = make_frustum(world_to_proj * object_to_world);
+    vec3 camera = transform_point(mat4_inverse(object_to_world), camera_position);
+
+    GLint base_vertex = get_mesh_base_vertex(mesh);
+
+    GLsizei draw_count = 0;
+    uint32_t range_end = 0xFFFFFFFF;
+
+    for (uint32_t i = 0; i < mesh->cluster_count; ++i)
+    {
+        mesh_cluster_t *cluster = &mesh->clusters[i];
+
+        if (!sphere_in_frustum(&frustum, cluster->center, cluster->radius)) continue;
+
+        vec3 view = normalize_or_zero(cluster->cone_apex - camera);
+        if (dot_product(view, cluster->cone_axis) >= cluster->cone_cutoff) continue;
+
+        if (cluster->first_index == range_end)
+        {
+            counts[draw_count - 1] += cluster->index_count;
+        }
+        else
+        {
+            counts[draw_count] = cluster->index_count;
+            offsets[draw_count] = get_mesh_index_offset(mesh, cluster->first_index);
+            base_vertices[draw_count] = base_vertex;
+            draw_count++;
+        }
+
+        range_end = cluster->first_index + cluster->index_count;
+    }
+
+    return draw_count;
+}
@@ -0,0 +1,19 @@
+#ifndef MESH_CLUSTER_H
+#define MESH_CLUSTER_H
+
+#include "mesh.h"
+
+#define MESH_CLUSTER_MAX_VERTICES 64
+#define MESH_CLUSTER_MAX_TRIANGLES 124
+
+// Offline pass: reorders the LOD 0 indices so that every cluster is a contiguous range
+// and fills in the cluster bounds and normal cones.
+void build_mesh_clusters(mesh_t *mesh, uint32_t max_vertices, uint32_t max_triangles);
+
+// Culls clusters against the frustum and for backfacing, adjacent survivors are merged into one range.
+// counts, offsets and base_vertices need room for mesh->cluster_count entries and are meant for
+// glMultiDrawElementsBaseVertex with GL_UNSIGNED_INT indices on the geometry pool. Returns the number of ranges written.
+GLsizei cull_mesh_clusters(mesh_t *mesh, mat4 object_to_world, mat4 world_to_proj, vec3 camera_position,
+                           GLsizei *counts, void **offsets, GLint *base_vertices);
+
+#endif
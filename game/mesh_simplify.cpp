@@ -0,0 +1,377 @@
+#include "mesh_simplify.h"
+#include "utils.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+
+struct quadric_t
+{
+    float a2, b2, c2, d2;
+    float ab, ac, ad;
+    float bc, bd;
+    float cd;
+    float weight;
+};
+
+struct collapse_t
+{
+    uint32_t from;
+    uint32_t to;
+    float error;
+};
+
+static void
+add_plane_to_quadric(quadric_t *q, vec3 n, float d, float weight)
+{
+    q->a2 += weight * n.x * n.x;
+    q->b2 += weight * n.y * n.y;
+    q->c2 += weight * n.z * n.z;
+    q->d2 += weight * d * d;
+
+    q->ab += weight * n.x * n.y;
+    q->ac += weight * n.x * n.z;
+    q->ad += weight * n.x * d;
+
+    q->bc += weight * n.y * n.z;
+    q->bd += weight * n.y * d;
+
+    q->cd += weight * n.z * d;
+
+    q->weight += weight;
+}
+
+static void
+add_quadric(quadric_t *q, quadric_t *other)
+{
+    q->a2 += other->a2;
+    q->b2 += other->b2;
+    q->c2 += other->c2;
+    q->d2 += other->d2;
+    q->ab += other->ab;
+    q->ac += other->ac;
+    q->ad += other->ad;
+    q->bc += other->bc;
+    q->bd += other->bd;
+    q->cd += other->cd;
+    q->weight += other->weight;
+}
+
+// Weighted average squared distance from v to the planes accumulated in q.
+static float
+quadric_error(quadric_t *q, vec3 v)
+{
+    float rx = q->a2*v.x + q->ab*v.y + q->ac*v.z + q->ad;
+    float ry = q->ab*v.x + q->b2*v.y + q->bc*v.z + q->bd;
+    float rz = q->ac*v.x + q->bc*v.y + q->c2*v.z + q->cd;
+    float r = rx*v.x + ry*v.y + rz*v.z + q->ad*v.x + q->bd*v.y + q->cd*v.z + q->d2;
+
+    if (r < 0.0f) r = -r;
+    if (q->weight > 0.0f) r /= q->weight;
+
+    return r;
+}
+
+static uint32_t
+hash_position(vec3 p)
+{
+    uint32_t bits[3];
+    memcpy(bits, &p, sizeof(bits));
+
+    uint32_t h = bits[0] * 73856093u;
+    h ^= bits[1] * 19349663u;
+    h ^= bits[2] * 83492791u;
+    return h;
+}
+
+// remap[i] is the first vertex that shares the position of vertex i.
+static void
+build_position_remap(uint32_t *remap, mesh_vertex_t *vertices, uint32_t vertex_count)
+{
+    uint32_t table_size = 1;
+    while (table_size < vertex_count * 2) table_size *= 2;
+
+    uint32_t *table = (uint32_t *)malloc(table_size * sizeof(uint32_t));
+    memset(table, 0xFF, table_size * sizeof(uint32_t));
+
+    for (uint32_t i = 0; i < vertex_count; ++i)
+    {
+        vec3 p = vertices[i].position;
+        uint32_t slot = hash_position(p) & (table_size - 1);
+
+        for (;;)
+        {
+            uint32_t existing = table[slot];
+            if (existing == 0xFFFFFFFF)
+            {
+                table[slot] = i;
+                remap[i] = i;
+                break;
+            }
+
+            vec3 q = vertices[existing].position;
+            if (q.x == p.x && q.y == p.y && q.z == p.z)
+            {
+                remap[i] = existing;
+                break;
+            }
+
+            slot = (slot + 1) & (table_size - 1);
+        }
+    }
+
+    free(table);
+}
+
+static int
+compare_edges(const void *a, const void *b)
+{
+    uint64_t ea = *(uint64_t *)a;
+    uint64_t eb = *(uint64_t *)b;
+    return (ea < eb) ? -1 : (ea > eb) ? 1 : 0;
+}
+
+static int
+compare_collapses(const void *a, const void *b)
+{
+    float ea = ((collapse_t *)a)->error;
+    float eb = ((collapse_t *)b)->error;
+    return (ea < eb) ? -1 : (ea > eb) ? 1 : 0;
+}
+
+static void
+lock_seam_and_border_vertices(bool *locked, uint32_t *remap, uint32_t *indices, uint32_t index_count, uint32_t vertex_count)
+{
+    // Any vertex that shares its position with another one sits on an attribute seam.
+    for (uint32_t i = 0; i < vertex_count; ++i)
+    {
+        if (remap[i] != i)
+        {
+            locked[i] = true;
+            locked[remap[i]] = true;
+        }
+    }
+
+    // A directed edge without its reverse is an open border.
+    uint64_t *edges = (uint64_t *)malloc(index_count * sizeof(uint64_t));
+    for (uint32_t i = 0; i < index_count; i += 3)
+    {
+        for (int e = 0; e < 3; ++e)
+        {
+            uint64_t a = remap[indices[i + e]];
+            uint64_t b = remap[indices[i + (e + 1) % 3]];
+            edges[i + e] = (a << 32) | b;
+        }
+    }
+    qsort(edges, index_count, sizeof(uint64_t), compare_edges);
+
+    for (uint32_t i = 0; i < index_count; ++i)
+    {
+        uint64_t edge = edges[i];
+        uint64_t reverse = (edge << 32) | (edge >> 32);
+        if (!bsearch(&reverse, edges, index_count, sizeof(uint64_t), compare_edges))
+        {
+            uint32_t a = (uint32_t)(edge >> 32);
+            uint32_t b = (uint32_t)(edge & 0xFFFFFFFF);
+            locked[a] = true;
+            locked[b] = true;
+        }
+    }
+
+    // Propagate to every vertex at a locked position.
+    for (uint32_t i = 0; i < vertex_count; ++i)
+    {
+        if (locked[remap[i]]) locked[i] = true;
+    }
+
+    free(edges);
+}
+
+static vec3
+triangle_normal(vec3 a, vec3 b, vec3 c)
+{
+    return cross_product(b - a, c - a);
+}
+
+// Collapsing from onto to must not turn any of the triangles around from upside down.
+static bool
+collapse_flips_triangles(uint32_t from, uint32_t to, uint32_t *indices, uint32_t *triangle_offsets, uint32_t *triangle_list, mesh_vertex_t *vertices)
+{
+    vec3 target = vertices[to].position;
+
+    for (uint32_t t = triangle_offsets[from]; t < triangle_offsets[from + 1]; ++t)
+    {
+        uint32_t *tri = indices + triangle_list[t] * 3;
+        if (tri[0] == to || tri[1] == to || tri[2] == to) continue;
+
+        vec3 p[3];
+        vec3 q[3];
+        for (int k = 0; k < 3; ++k)
+        {
+            p[k] = vertices[tri[k]].position;
+            q[k] = (tri[k] == from) ? target : p[k];
+        }
+
+        vec3 before = triangle_normal(p[0], p[1], p[2]);
+        vec3 after = triangle_normal(q[0], q[1], q[2]);
+        if (dot_product(before, after) <= 0.0f) return true;
+    }
+
+    return false;
+}
+
+uint32_t
+simplify_mesh(uint32_t *destination, uint32_t *indices, uint32_t index_count,
+              mesh_vertex_t *vertices, uint32_t vertex_count,
+              uint32_t target_index_count, float *out_error)
+{
+    ASSERT(index_count % 3 == 0);
+
+    if (destination != indices) memcpy(destination, indices, index_count * sizeof(uint32_t));
+
+    float max_error = 0.0f;
+
+    uint32_t *remap = (uint32_t *)malloc(vertex_count * sizeof(uint32_t));
+    bool *locked = (bool *)calloc(vertex_count, sizeof(bool));
+    build_position_remap(remap, vertices, vertex_count);
+    lock_seam_and_border_vertices(locked, remap, destination, index_count, vertex_count);
+
+    quadric_t *quadrics = (quadric_t *)calloc(vertex_count, sizeof(quadric_t));
+    for (uint32_t i = 0; i < index_count; i += 3)
+    {
+        vec3 a = vertices[destination[i + 0]].position;
+        vec3 b = vertices[destination[i + 1]].position;
+        vec3 c = vertices[destination[i + 2]].position;
+
+        vec3 n = triangle_normal(a, b, c);
+        float area = length(n);
+        if (area <= 0.0f) continue;
+
+        n = n / area;
+        float d = -dot_product(n, a);
+
+        for (int k = 0; k < 3; ++k)
+        {
+            add_plane_to_quadric(&quadrics[remap[destination[i + k]]], n, d, area);
+        }
+    }
+
+    uint32_t *collapse_target = (uint32_t *)malloc(vertex_count * sizeof(uint32_t));
+    bool *touched = (bool *)malloc(vertex_count * sizeof(bool));
+    uint32_t *triangle_offsets = (uint32_t *)malloc((vertex_count + 1) * sizeof(uint32_t));
+    uint32_t *triangle_list = (uint32_t *)malloc(index_count * sizeof(uint32_t));
+    collapse_t *collapses = (collapse_t *)malloc(index_count * sizeof(collapse_t));
+
+    while (index_count > target_index_count)
+    {
+        uint32_t triangle_count = index_count / 3;
+
+        // Vertex to triangle adjacency.
+        memset(triangle_offsets, 0, (vertex_count + 1) * sizeof(uint32_t));
+        for (uint32_t i = 0; i < index_count; ++i) triangle_offsets[destination[i] + 1]++;
+        for (uint32_t i = 0; i < vertex_count; ++i) triangle_offsets[i + 1] += triangle_offsets[i];
+        for (uint32_t i = 0; i < index_count; ++i)
+        {
+            uint32_t v = destination[i];
+            uint32_t slot = triangle_offsets[v]++;
+            triangle_list[slot] = i / 3;
+        }
+        for (uint32_t i = vertex_count; i > 0; --i) triangle_offsets[i] = triangle_offsets[i - 1];
+        triangle_offsets[0] = 0;
+
+        uint32_t collapse_count = 0;
+        for (uint32_t i = 0; i < index_count; ++i)
+        {
+            uint32_t a = destination[i];
+            uint32_t b = destination[(i % 3 == 2) ? i - 2 : i + 1];
+
+            quadric_t q = quadrics[remap[a]];
+            add_quadric(&q, &quadrics[remap[b]]);
+
+            collapse_t collapse = {};
+            collapse.error = FLT_MAX;
+
+            if (!locked[a])
+            {
+                collapse.from = a;
+                collapse.to = b;
+                collapse.error = quadric_error(&q, vertices[b].position);
+            }
+            if (!locked[b])
+            {
+                float error = quadric_error(&q, vertices[a].position);
+                if (error < collapse.error)
+                {
+                    collapse.from = b;
+                    collapse.to = a;
+                    collapse.error = error;
+                }
+            }
+
+            if (collapse.error < FLT_MAX) collapses[collapse_count++] = collapse;
+        }
+
+        qsort(collapses, collapse_count, sizeof(collapse_t), compare_collapses);
+
+        for (uint32_t i = 0; i < vertex_count; ++i) collapse_target[i] = i;
+        memset(touched, 0, vertex_count * sizeof(bool));
+
+        uint32_t triangles_to_remove = (index_count - target_index_count) / 3;
+        uint32_t triangles_removed = 0;
+        uint32_t applied = 0;
+
+        for (uint32_t c = 0; c < collapse_count && triangles_removed < triangles_to_remove; ++c)
+        {
+            collapse_t *collapse = &collapses[c];
+            uint32_t from = collapse->from;
+            uint32_t to = collapse->to;
+
+            if (touched[from] || touched[to]) continue;
+            if (collapse_flips_triangles(from, to, destination, triangle_offsets, triangle_list, vertices)) continue;
+
+            // Everything around the collapsed vertex changes shape, keep it out of this pass.
+            for (uint32_t t = triangle_offsets[from]; t < triangle_offsets[from + 1]; ++t)
+            {
+                uint32_t *tri = destination + triangle_list[t] * 3;
+                if (tri[0] == to || tri[1] == to || tri[2] == to) triangles_removed++;
+
+                touched[tri[0]] = true;
+                touched[tri[1]] = true;
+                touched[tri[2]] = true;
+            }
+
+            collapse_target[from] = to;
+            add_quadric(&quadrics[remap[to]], &quadrics[remap[from]]);
+            if (collapse->error > max_error) max_error = collapse->error;
+            applied++;
+        }
+
+        if (!applied) break;
+
+        uint32_t write = 0;
+        for (uint32_t t = 0; t < triangle_count; ++t)
+        {
+            uint32_t a = collapse_target[destination[t*3 + 0]];
+            uint32_t b = collapse_target[destination[t*3 + 1]];
+            uint32_t c = collapse_target[destination[t*3 + 2]];
+            if (a == b || b == c || a == c) continue;
+
+            destination[write++] = a;
+            destination[write++] = b;
+            destination[write++] = c;
+        }
+        index_count = write;
+    }
+
+    free(collapses);
+    free(triangle_list);
+    free(triangle_offsets);
+    free(touched);
+    free(collapse_target);
+    free(quadrics);
+    free(locked);
+    free(remap);
+
+    if (out_error) *out_error = sqrtf(max_error);
+    return index_count;
+}
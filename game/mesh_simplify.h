@@ -0,0 +1,16 @@
+#ifndef MESH_SIMPLIFY_H
+#define MESH_SIMPLIFY_H
+
+#include "mesh.h"
+
+// Quadric error metric edge collapse simplification (Garland & Heckbert).
+// Vertices are never moved or created, collapses snap one endpoint onto the other,
+// so the result indexes the same vertex buffer as the input.
+// Vertices on open borders and on attribute seams (several vertices at one position) are locked.
+// Returns the number of indices written to destination, which must be able to hold index_count indices.
+// out_error receives the largest object space distance introduced by the collapses.
+uint32_t simplify_mesh(uint32_t *destination, uint32_t *indices, uint32_t index_count,
+                       mesh_vertex_t *vertices, uint32_t vertex_count,
+                       uint32_t target_index_count, float *out_error);
+
+#endif
@@ -21,6 +21,14 @@ to_degrees(float radians)
     return result;
 }
 
+inline float
+clamp(float min, float value, float max)
+{
+    if (value < min) return min;
+    if (value > max) return max;
+    return value;
+}
+
 struct vec2
 {
     union
@@ -149,7 +157,7 @@ operator/(vec2 a, float b)
 }
 
 inline vec2 &
-operator+(vec2 &a, vec2 b)
+operator+=(vec2 &a, vec2 b)
 {
     a.x += b.x;
     a.y += b.y;
@@ -157,7 +165,7 @@ operator+(vec2 &a, vec2 b)
 }
 
 inline vec2 &
-operator-(vec2 &a, vec2 b)
+operator-=(vec2 &a, vec2 b)
 {
     a.x -= b.x;
     a.y -= b.y;
@@ -165,7 +173,7 @@ operator-(vec2 &a, vec2 b)
 }
 
 inline vec2 &
-operator*(vec2 &a, float b)
+operator*=(vec2 &a, float b)
 {
     a.x *= b;
     a.y *= b;
@@ -173,7 +181,7 @@ operator*(vec2 &a, float b)
 }
 
 inline vec2 &
-operator/(vec2 &a, vec2 b)
+operator/=(vec2 &a, vec2 b)
 {
     a.x /= b.x;
     a.y /= b.y;
@@ -181,7 +189,7 @@ operator/(vec2 &a, vec2 b)
 }
 
 inline vec2 &
-operator/(vec2 &a, float b)
+operator/=(vec2 &a, float b)
 {
     float inv_b = 1.0f / b;
     
@@ -376,7 +384,7 @@ operator/(vec3 a, float b)
 }
 
 inline vec3 &
-operator+(vec3 &a, vec3 b)
+operator+=(vec3 &a, vec3 b)
 {
     a.x += b.x;
     a.y += b.y;
@@ -386,7 +394,7 @@ operator+(vec3 &a, vec3 b)
 }
 
 inline vec3 &
-operator-(vec3 &a, vec3 b)
+operator-=(vec3 &a, vec3 b)
 {
     a.x -= b.x;
     a.y -= b.y;
@@ -396,7 +404,7 @@ operator-(vec3 &a, vec3 b)
 }
 
 inline vec3 &
-operator*(vec3 &a, float b)
+operator*=(vec3 &a, float b)
 {
     a.x *= b;
     a.y *= b;
@@ -406,7 +414,7 @@ operator*(vec3 &a, float b)
 }
 
 inline vec3 &
-operator/(vec3 &a, vec3 b)
+operator/=(vec3 &a, vec3 b)
 {
     a.x /= b.x;
     a.y /= b.y;
@@ -416,7 +424,7 @@ operator/(vec3 &a, vec3 b)
 }
 
 inline vec3 &
-operator/(vec3 &a, float b)
+operator/=(vec3 &a, float b)
 {
     float inv_b = 1.0f / b;
     
@@ -476,6 +484,8 @@ cross_product(vec3 a, vec3 b)
     result.x = a.y*b.z - a.z*b.y;
     result.y = a.z*b.x - a.x*b.z;
     result.z = a.x*b.y - a.y*b.x;
+
+    return result;
 }
 
 inline vec3
@@ -634,7 +644,7 @@ operator/(vec4 a, float b)
 }
 
 inline vec4 &
-operator+(vec4 &a, vec4 b)
+operator+=(vec4 &a, vec4 b)
 {
     a.x += b.x;
     a.y += b.y;
@@ -645,7 +655,7 @@ operator+(vec4 &a, vec4 b)
 }
 
 inline vec4 &
-operator-(vec4 &a, vec4 b)
+operator-=(vec4 &a, vec4 b)
 {
     a.x -= b.x;
     a.y -= b.y;
@@ -656,7 +666,7 @@ operator-(vec4 &a, vec4 b)
 }
 
 inline vec4 &
-operator*(vec4 &a, float b)
+operator*=(vec4 &a, float b)
 {
     a.x *= b;
     a.y *= b;
@@ -667,7 +677,7 @@ operator*(vec4 &a, float b)
 }
 
 inline vec4 &
-operator/(vec4 &a, vec4 b)
+operator/=(vec4 &a, vec4 b)
 {
     a.x /= b.x;
     a.y /= b.y;
@@ -678,7 +688,7 @@ operator/(vec4 &a, vec4 b)
 }
 
 inline vec4 &
-operator/(vec4 &a, float b)
+operator/=(vec4 &a, float b)
 {
     float inv_b = 1.0f / b;
     
@@ -835,8 +845,9 @@ operator*(mat4 a, mat4 b)
             float accum = 0.0f;
             for (int element_index = 0; element_index < 4; element_index++)
             {
-                result.elements[row][col] = a.elements[row][element_index] * b.elements[element_index][col];
+                accum += a.elements[row][element_index] * b.elements[element_index][col];
             }
+            result.elements[row][col] = accum;
         }
     }
     
@@ -943,6 +954,168 @@ mat4_z_rotation(float phi)
     return result;
 }
 
+inline vec4
+operator*(mat4 m, vec4 v)
+{
+    vec4 result;
+
+    result.x = dot_product(m.rows[0], v);
+    result.y = dot_product(m.rows[1], v);
+    result.z = dot_product(m.rows[2], v);
+    result.w = dot_product(m.rows[3], v);
+
+    return result;
+}
+
+inline vec3
+transform_point(mat4 m, vec3 p)
+{
+    vec4 result = m * make_vec4(p.x, p.y, p.z, 1.0f);
+    return make_vec3(result.x, result.y, result.z);
+}
+
+inline vec3
+transform_direction(mat4 m, vec3 d)
+{
+    vec4 result = m * make_vec4(d.x, d.y, d.z, 0.0f);
+    return make_vec3(result.x, result.y, result.z);
+}
+
+// Right handed, looking down -z, clip space z in [-1, 1] like OpenGL wants it.
+inline mat4
+mat4_perspective(float fov_y, float aspect_ratio, float z_near, float z_far)
+{
+    mat4 result = {};
+
+    float f = 1.0f / tanf(0.5f * fov_y);
+
+    result._11 = f / aspect_ratio;
+    result._22 = f;
+    result._33 = (z_far + z_near) / (z_near - z_far);
+    result._34 = (2.0f * z_far * z_near) / (z_near - z_far);
+    result._43 = -1.0f;
+
+    return result;
+}
+
+// Maps [left, right] x [bottom, top] x [-z_near, -z_far] to clip space.
+inline mat4
+mat4_orthographic(float left, float right, float bottom, float top, float z_near, float z_far)
+{
+    mat4 result = mat4_identity();
+
+    result._11 = 2.0f / (right - left);
+    result._22 = 2.0f / (top - bottom);
+    result._33 = -2.0f / (z_far - z_near);
+    result._14 = -(right + left) / (right - left);
+    result._24 = -(top + bottom) / (top - bottom);
+    result._34 = -(z_far + z_near) / (z_far - z_near);
+
+    return result;
+}
+
+inline mat4
+mat4_look_at(vec3 eye, vec3 target, vec3 up)
+{
+    mat4 result = mat4_identity();
+
+    vec3 f = normalize_or_zero(target - eye);
+    vec3 s = normalize_or_zero(cross_product(f, up));
+    vec3 u = cross_product(s, f);
+
+    result._11 = s.x;
+    result._12 = s.y;
+    result._13 = s.z;
+    result._14 = -dot_product(s, eye);
+
+    result._21 = u.x;
+    result._22 = u.y;
+    result._23 = u.z;
+    result._24 = -dot_product(u, eye);
+
+    result._31 = -f.x;
+    result._32 = -f.y;
+    result._33 = -f.z;
+    result._34 = dot_product(f, eye);
+
+    return result;
+}
+
+// Cofactor expansion, returns identity for singular matrices.
+inline mat4
+mat4_inverse(mat4 m)
+{
+    float *a = &m._11;
+    float inv[16];
+
+    inv[0] = a[5]*a[10]*a[15] - a[5]*a[11]*a[14] - a[9]*a[6]*a[15] + a[9]*a[7]*a[14] + a[13]*a[6]*a[11] - a[13]*a[7]*a[10];
+    inv[4] = -a[4]*a[10]*a[15] + a[4]*a[11]*a[14] + a[8]*a[6]*a[15] - a[8]*a[7]*a[14] - a[12]*a[6]*a[11] + a[12]*a[7]*a[10];
+    inv[8] = a[4]*a[9]*a[15] - a[4]*a[11]*a[13] - a[8]*a[5]*a[15] + a[8]*a[7]*a[13] + a[12]*a[5]*a[11] - a[12]*a[7]*a[9];
+    inv[12] = -a[4]*a[9]*a[14] + a[4]*a[10]*a[13] + a[8]*a[5]*a[14] - a[8]*a[6]*a[13] - a[12]*a[5]*a[10] + a[12]*a[6]*a[9];
+    inv[1] = -a[1]*a[10]*a[15] + a[1]*a[11]*a[14] + a[9]*a[2]*a[15] - a[9]*a[3]*a[14] - a[13]*a[2]*a[11] + a[13]*a[3]*a[10];
+    inv[5] = a[0]*a[10]*a[15] - a[0]*a[11]*a[14] - a[8]*a[2]*a[15] + a[8]*a[3]*a[14] + a[12]*a[2]*a[11] - a[12]*a[3]*a[10];
+    inv[9] = -a[0]*a[9]*a[15] + a[0]*a[11]*a[13] + a[8]*a[1]*a[15] - a[8]*a[3]*a[13] - a[12]*a[1]*a[11] + a[12]*a[3]*a[9];
+    inv[13] = a[0]*a[9]*a[14] - a[0]*a[10]*a[13] - a[8]*a[1]*a[14] + a[8]*a[2]*a[13] + a[12]*a[1]*a[10] - a[12]*a[2]*a[9];
+    inv[2] = a[1]*a[6]*a[15] - a[1]*a[7]*a[14] - a[5]*a[2]*a[15] + a[5]*a[3]*a[14] + a[13]*a[2]*a[7] - a[13]*a[3]*a[6];
+    inv[6] = -a[0]*a[6]*a[15] + a[0]*a[7]*a[14] + a[4]*a[2]*a[15] - a[4]*a[3]*a[14] - a[12]*a[2]*a[7] + a[12]*a[3]*a[6];
+    inv[10] = a[0]*a[5]*a[15] - a[0]*a[7]*a[13] - a[4]*a[1]*a[15] + a[4]*a[3]*a[13] + a[12]*a[1]*a[7] - a[12]*a[3]*a[5];
+    inv[14] = -a[0]*a[5]*a[14] + a[0]*a[6]*a[13] + a[4]*a[1]*a[14] - a[4]*a[2]*a[13] - a[12]*a[1]*a[6] + a[12]*a[2]*a[5];
+    inv[3] = -a[1]*a[6]*a[11] + a[1]*a[7]*a[10] + a[5]*a[2]*a[11] - a[5]*a[3]*a[10] - a[9]*a[2]*a[7] + a[9]*a[3]*a[6];
+    inv[7] = a[0]*a[6]*a[11] - a[0]*a[7]*a[10] - a[4]*a[2]*a[11] + a[4]*a[3]*a[10] + a[8]*a[2]*a[7] - a[8]*a[3]*a[6];
+    inv[11] = -a[0]*a[5]*a[11] + a[0]*a[7]*a[9] + a[4]*a[1]*a[11] - a[4]*a[3]*a[9] - a[8]*a[1]*a[7] + a[8]*a[3]*a[5];
+    inv[15] = a[0]*a[5]*a[10] - a[0]*a[6]*a[9] - a[4]*a[1]*a[10] + a[4]*a[2]*a[9] + a[8]*a[1]*a[6] - a[8]*a[2]*a[5];
+
+    float det = a[0]*inv[0] + a[1]*inv[4] + a[2]*inv[8] + a[3]*inv[12];
+    if (det == 0.0f) return mat4_identity();
+
+    mat4 result;
+    float inv_det = 1.0f / det;
+    for (int i = 0; i < 16; ++i) (&result._11)[i] = inv[i] * inv_det;
+
+    return result;
+}
+
+// Planes are stored as (normal, d) with the normal pointing inside, a point p is inside when dot(normal, p) + d >= 0.
+struct frustum_t
+{
+    vec4 planes[6];
+};
+
+// Gribb & Hartmann. Extracting from object_to_proj gives the planes in object space.
+inline frustum_t
+make_frustum(mat4 m)
+{
+    frustum_t result;
+
+    result.planes[0] = m.rows[3] + m.rows[0]; // Left
+    result.planes[1] = m.rows[3] - m.rows[0]; // Right
+    result.planes[2] = m.rows[3] + m.rows[1]; // Bottom
+    result.planes[3] = m.rows[3] - m.rows[1]; // Top
+    result.planes[4] = m.rows[3] + m.rows[2]; // Near
+    result.planes[5] = m.rows[3] - m.rows[2]; // Far
+
+    for (int i = 0; i < 6; ++i)
+    {
+        vec4 p = result.planes[i];
+        float len = sqrtf(p.x*p.x + p.y*p.y + p.z*p.z);
+        if (len > 0.0f) result.planes[i] = p / len;
+    }
+
+    return result;
+}
+
+inline bool
+sphere_in_frustum(frustum_t *frustum, vec3 center, float radius)
+{
+    for (int i = 0; i < 6; ++i)
+    {
+        vec4 p = frustum->planes[i];
+        if (p.x*center.x + p.y*center.y + p.z*center.z + p.w < -radius) return false;
+    }
+
+    return true;
+}
+
 struct quaternion
 {
     float w;
@@ -0,0 +1,119 @@
+#include "pool.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NO_SLOT 0xFFFFFFFF
+#define MAX_GENERATION ((1u << POOL_GENERATION_BITS) - 1)
+
+static handle_t
+make_handle(uint32_t slot, uint32_t generation)
+{
+    return (generation << POOL_INDEX_BITS) | slot;
+}
+
+bool
+init_pool(pool_t *pool, uint32_t item_size, uint32_t capacity)
+{
+    *pool = {};
+    ASSERT(capacity <= POOL_MAX_CAPACITY);
+
+    pool->items = (uint8_t *)malloc((size_t)item_size * capacity);
+    pool->item_handles = (handle_t *)malloc(capacity * sizeof(handle_t));
+    pool->slot_items = (uint32_t *)malloc(capacity * sizeof(uint32_t));
+    pool->slot_generations = (uint16_t *)malloc(capacity * sizeof(uint16_t));
+    if (!pool->items || !pool->item_handles || !pool->slot_items || !pool->slot_generations)
+    {
+        fprintf(stderr, "Could not allocate a pool of %u items of %u bytes.\n", capacity, item_size);
+        free_pool(pool);
+        return false;
+    }
+
+    pool->item_size = item_size;
+    pool->capacity = capacity;
+
+    // Low slots first, so a new pool hands out small indices.
+    for (uint32_t slot = 0; slot < capacity; ++slot)
+    {
+        pool->slot_items[slot] = slot + 1 < capacity ? slot + 1 : NO_SLOT;
+        pool->slot_generations[slot] = 1;
+    }
+    pool->first_free_slot = capacity ? 0 : NO_SLOT;
+
+    return true;
+}
+
+void
+free_pool(pool_t *pool)
+{
+    free(pool->items);
+    free(pool->item_handles);
+    free(pool->slot_items);
+    free(pool->slot_generations);
+    *pool = {};
+}
+
+handle_t
+add_pool_item(pool_t *pool)
+{
+    uint32_t slot = pool->first_free_slot;
+    if (slot == NO_SLOT) return NULL_HANDLE;
+
+    pool->first_free_slot = pool->slot_items[slot];
+
+    uint32_t index = pool->count++;
+    handle_t handle = make_handle(slot, pool->slot_generations[slot]);
+
+    pool->slot_items[slot] = index;
+    pool->item_handles[index] = handle;
+    memset(pool->items + (size_t)index * pool->item_size, 0, pool->item_size);
+
+    return handle;
+}
+
+// The slot's item, or NO_SLOT if the handle is stale.
+static uint32_t
+find_item(pool_t *pool, handle_t handle)
+{
+    uint32_t slot = handle & POOL_INDEX_MASK;
+    if (handle == NULL_HANDLE || slot >= pool->capacity) return NO_SLOT;
+    if (pool->slot_generations[slot] != (handle >> POOL_INDEX_BITS)) return NO_SLOT;
+    return pool->slot_items[slot];
+}
+
+bool
+remove_pool_item(pool_t *pool, handle_t handle)
+{
+    uint32_t index = find_item(pool, handle);
+    if (index == NO_SLOT) return false;
+
+    // Keep the items packed, the last one moves into the hole.
+    uint32_t last = --pool->count;
+    if (index != last)
+    {
+        memcpy(pool->items + (size_t)index * pool->item_size, pool->items + (size_t)last * pool->item_size, pool->item_size);
+        handle_t moved = pool->item_handles[last];
+        pool->item_handles[index] = moved;
+        pool->slot_items[moved & POOL_INDEX_MASK] = index;
+    }
+
+    // Generations wrap around to 1, a handle only aliases after 4095 reuses of its slot.
+    uint32_t slot = handle & POOL_INDEX_MASK;
+    uint32_t generation = pool->slot_generations[slot];
+    pool->slot_generations[slot] = (uint16_t)(generation == MAX_GENERATION ? 1 : generation + 1);
+
+    pool->slot_items[slot] = pool->first_free_slot;
+    pool->first_free_slot = slot;
+
+    return true;
+}
+
+void *
+get_pool_item(pool_t *pool, handle_t handle)
+{
+    uint32_t index = find_item(pool, handle);
+    if (index == NO_SLOT) return NULL;
+    return pool->items + (size_t)index * pool->item_size;
+}
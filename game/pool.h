@@ -0,0 +1,64 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdint.h>
+
+// Fixed capacity pool of same sized items, referenced by 32 bit handles instead of pointers.
+// A handle is a slot index in the low bits and that slot's generation in the high bits. Freeing
+// bumps the generation, so a handle kept past its item's lifetime no longer resolves instead of
+// quietly pointing at whatever took its place. The items themselves are packed at the front of
+// one array, freeing moves the last item into the hole, so walking them touches nothing else.
+// That also means pointers to items are only good until the next remove.
+
+typedef uint32_t handle_t;
+
+#define POOL_INDEX_BITS 20
+#define POOL_INDEX_MASK ((1u << POOL_INDEX_BITS) - 1)
+#define POOL_GENERATION_BITS (32 - POOL_INDEX_BITS)
+#define POOL_MAX_CAPACITY (1u << POOL_INDEX_BITS)
+
+// Never a valid handle, generations start at 1.
+#define NULL_HANDLE 0
+
+struct pool_t
+{
+    uint32_t item_size;
+    uint32_t capacity;
+    uint32_t count;
+
+    // count items, then room for the rest.
+    uint8_t *items;
+    handle_t *item_handles;
+
+    // Per slot. A free slot's dense index links to the next free slot.
+    uint32_t *slot_items;
+    uint16_t *slot_generations;
+    uint32_t first_free_slot;
+};
+
+bool init_pool(pool_t *pool, uint32_t item_size, uint32_t capacity);
+void free_pool(pool_t *pool);
+
+// The new item is zeroed. NULL_HANDLE when the pool is full.
+handle_t add_pool_item(pool_t *pool);
+
+// False if the handle is stale.
+bool remove_pool_item(pool_t *pool, handle_t handle);
+
+// NULL if the handle is stale. Only reads, any number of threads can look up at once as long as
+// nothing is added or removed meanwhile.
+void *get_pool_item(pool_t *pool, handle_t handle);
+
+// Small and unique among live items, for sort keys and tables.
+inline uint32_t
+get_handle_index(handle_t handle)
+{
+    return handle & POOL_INDEX_MASK;
+}
+
+#define POOL_ITEM(pool, type, handle) ((type *)get_pool_item((pool), (handle)))
+
+// The live items, pool->count of them.
+#define POOL_ITEMS(pool, type) ((type *)(pool)->items)
+
+#endif
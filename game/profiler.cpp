@@ -0,0 +1,383 @@
+#include "profiler.h"
+#include "trace.h"
+#include "utils.h"
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <stdio.h>
+#include <string.h>
+
+// Frame begin and end, then begin and end of every scope.
+#define PROFILER_FRAME_QUERIES (2 + PROFILER_MAX_SCOPES * 2)
+
+struct profiler_pending_frame_t
+{
+    GLuint queries[PROFILER_FRAME_QUERIES];
+    profiler_frame_t frame; // CPU times, GPU times are filled in on read back.
+    bool in_flight;
+};
+
+static profiler_pending_frame_t pending[PROFILER_FRAME_LAG];
+static profiler_pending_frame_t *current;
+static uint32_t frame_number;
+static bool in_frame;
+
+static double ticks_to_ms;
+static uint64_t frame_start_ticks;
+
+// Open scopes, -1 for ones that were dropped, and when they began for the trace.
+static int stack[PROFILER_MAX_DEPTH];
+static uint64_t stack_ticks[PROFILER_MAX_DEPTH];
+static int stack_depth;
+static uint32_t dropped_depth;
+
+static profiler_frame_t history[PROFILER_HISTORY];
+static uint32_t history_count;
+static uint32_t history_next;
+
+static profiler_average_t averages[PROFILER_MAX_AVERAGES];
+static uint32_t average_count;
+
+static profiler_stats_t stats;
+
+void
+init_profiler()
+{
+    for (int i = 0; i < PROFILER_FRAME_LAG; ++i)
+    {
+        glGenQueries(PROFILER_FRAME_QUERIES, pending[i].queries);
+        pending[i].in_flight = false;
+    }
+
+    current = NULL;
+    frame_number = 0;
+    in_frame = false;
+    ticks_to_ms = 1000.0 / (double)glfwGetTimerFrequency();
+    history_count = 0;
+    history_next = 0;
+    average_count = 0;
+    stats = {};
+}
+
+void
+free_profiler()
+{
+    for (int i = 0; i < PROFILER_FRAME_LAG; ++i)
+    {
+        glDeleteQueries(PROFILER_FRAME_QUERIES, pending[i].queries);
+        pending[i].in_flight = false;
+    }
+    current = NULL;
+}
+
+static float
+get_cpu_ms()
+{
+    return (float)((glfwGetTimerValue() - frame_start_ticks) * ticks_to_ms);
+}
+
+static void
+update_averages(profiler_frame_t *frame)
+{
+    for (uint32_t i = 0; i < frame->scope_count; ++i)
+    {
+        profiler_scope_t *scope = &frame->scopes[i];
+        float cpu_ms = scope->cpu_end - scope->cpu_begin;
+        float gpu_ms = scope->gpu_end - scope->gpu_begin;
+
+        // Names are literals, the same scope has the same pointer.
+        profiler_average_t *average = NULL;
+        for (uint32_t j = 0; j < average_count; ++j)
+        {
+            if (averages[j].name == scope->name && averages[j].depth == scope->depth) average = &averages[j];
+        }
+
+        if (!average)
+        {
+            if (average_count == PROFILER_MAX_AVERAGES) continue;
+
+            average = &averages[average_count++];
+            average->name = scope->name;
+            average->depth = scope->depth;
+            average->cpu_ms = cpu_ms;
+            average->gpu_ms = gpu_ms;
+        }
+
+        average->cpu_ms += (cpu_ms - average->cpu_ms) * 0.05f;
+        average->gpu_ms += (gpu_ms - average->gpu_ms) * 0.05f;
+    }
+}
+
+// Reads a frame's queries if the GPU got to the end of it, drops it otherwise.
+static void
+read_back_frame(profiler_pending_frame_t *pending_frame)
+{
+    pending_frame->in_flight = false;
+
+    GLint available = 0;
+    glGetQueryObjectiv(pending_frame->queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+    {
+        stats.dropped_frames++;
+        return;
+    }
+
+    // Queries finish in order, the frame end being done means every scope is.
+    profiler_frame_t *frame = &pending_frame->frame;
+    GLuint64 frame_begin, frame_end;
+    glGetQueryObjectui64v(pending_frame->queries[0], GL_QUERY_RESULT, &frame_begin);
+    glGetQueryObjectui64v(pending_frame->queries[1], GL_QUERY_RESULT, &frame_end);
+    frame->gpu_ms = (float)((frame_end - frame_begin) * 1e-6);
+
+    for (uint32_t i = 0; i < frame->scope_count; ++i)
+    {
+        GLuint64 begin, end;
+        glGetQueryObjectui64v(pending_frame->queries[2 + i * 2], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(pending_frame->queries[3 + i * 2], GL_QUERY_RESULT, &end);
+        frame->scopes[i].gpu_begin = (float)((begin - frame_begin) * 1e-6);
+        frame->scopes[i].gpu_end = (float)((end - frame_begin) * 1e-6);
+    }
+
+    history[history_next] = *frame;
+    history_next = (history_next + 1) % PROFILER_HISTORY;
+    if (history_count < PROFILER_HISTORY) history_count++;
+
+    update_averages(frame);
+}
+
+void
+begin_profiler_frame()
+{
+    ASSERT(!in_frame);
+
+    // The slot was last used PROFILER_FRAME_LAG frames ago.
+    current = &pending[frame_number % PROFILER_FRAME_LAG];
+    if (current->in_flight) read_back_frame(current);
+
+    current->frame.frame_number = frame_number;
+    current->frame.scope_count = 0;
+    stack_depth = 0;
+    dropped_depth = 0;
+    in_frame = true;
+
+    frame_start_ticks = glfwGetTimerValue();
+    glQueryCounter(current->queries[0], GL_TIMESTAMP);
+}
+
+void
+end_profiler_frame()
+{
+    ASSERT(in_frame);
+    ASSERT(stack_depth == 0);
+
+    glQueryCounter(current->queries[1], GL_TIMESTAMP);
+    current->frame.cpu_ms = get_cpu_ms();
+
+#if TRACE
+    if (trace_enabled.load(std::memory_order_relaxed)) add_trace_event("frame", frame_start_ticks, glfwGetTimerValue());
+#endif
+
+    current->in_flight = true;
+
+    in_frame = false;
+    frame_number++;
+}
+
+void
+begin_profile_scope(char *name)
+{
+    if (!in_frame) return;
+
+    profiler_frame_t *frame = &current->frame;
+    if (stack_depth == PROFILER_MAX_DEPTH)
+    {
+        // Deeper than the stack, only count them so the ends still match up.
+        dropped_depth++;
+        stats.dropped_scopes++;
+        return;
+    }
+    if (frame->scope_count == PROFILER_MAX_SCOPES)
+    {
+        stack[stack_depth++] = -1;
+        stats.dropped_scopes++;
+        return;
+    }
+
+    uint32_t index = frame->scope_count++;
+    uint64_t ticks = glfwGetTimerValue();
+
+    profiler_scope_t *scope = &frame->scopes[index];
+    scope->name = name;
+    scope->depth = stack_depth;
+    scope->cpu_begin = (float)((ticks - frame_start_ticks) * ticks_to_ms);
+    scope->cpu_end = scope->cpu_begin;
+    scope->gpu_begin = 0.0f;
+    scope->gpu_end = 0.0f;
+
+    stack_ticks[stack_depth] = ticks;
+    stack[stack_depth++] = index;
+    glQueryCounter(current->queries[2 + index * 2], GL_TIMESTAMP);
+}
+
+void
+end_profile_scope()
+{
+    if (!in_frame) return;
+
+    if (dropped_depth)
+    {
+        dropped_depth--;
+        return;
+    }
+
+    ASSERT(stack_depth > 0);
+    int index = stack[--stack_depth];
+    if (index < 0) return;
+
+    glQueryCounter(current->queries[3 + index * 2], GL_TIMESTAMP);
+
+    uint64_t ticks = glfwGetTimerValue();
+    profiler_scope_t *scope = &current->frame.scopes[index];
+    scope->cpu_end = (float)((ticks - frame_start_ticks) * ticks_to_ms);
+
+    // Profiled scopes show up in the trace too.
+#if TRACE
+    if (trace_enabled.load(std::memory_order_relaxed)) add_trace_event(scope->name, stack_ticks[stack_depth], ticks);
+#endif
+}
+
+profiler_frame_t *
+get_profiler_frame()
+{
+    if (!history_count) return NULL;
+    return &history[(history_next + PROFILER_HISTORY - 1) % PROFILER_HISTORY];
+}
+
+profiler_stats_t
+get_profiler_stats()
+{
+    return stats;
+}
+
+// A stable color per scope name.
+static vec4
+get_scope_color(char *name)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (uint8_t *s = (uint8_t *)name; *s; ++s)
+    {
+        hash ^= *s;
+        hash *= 16777619u;
+    }
+
+    return make_vec4(0.35f + 0.65f * ((hash >> 0) & 255) / 255.0f,
+                     0.35f + 0.65f * ((hash >> 8) & 255) / 255.0f,
+                     0.35f + 0.65f * ((hash >> 16) & 255) / 255.0f, 0.9f);
+}
+
+void
+draw_profiler(sprite_batch_t *batch, font_t *font, vec2 pos, float width)
+{
+    profiler_frame_t *frame = get_profiler_frame();
+    if (!frame) return;
+
+    const float ROW_HEIGHT = 6.0f;
+    const int ROWS = 4;
+    const float BAND_HEIGHT = ROW_HEIGHT * ROWS;
+
+    // A 60 Hz frame fills the width, longer frames squeeze it.
+    float frame_ms = 1000.0f / 60.0f;
+    if (frame->cpu_ms > frame_ms) frame_ms = frame->cpu_ms;
+    if (frame->gpu_ms > frame_ms) frame_ms = frame->gpu_ms;
+    float pixels_per_ms = width / frame_ms;
+
+    float label_width = font ? 40.0f : 0.0f;
+    float bar_x = pos.x + label_width;
+    float cpu_y = pos.y;
+    float gpu_y = pos.y + BAND_HEIGHT + 4.0f;
+    float bottom = gpu_y + BAND_HEIGHT;
+
+    draw_rect(batch, pos - make_vec2(4.0f, 4.0f), make_vec2(bar_x + width + 4.0f, bottom + 4.0f), make_vec4(0.0f, 0.0f, 0.0f, 0.6f));
+
+    // The 60 Hz budget.
+    float budget_x = bar_x + 1000.0f / 60.0f * pixels_per_ms;
+    draw_rect(batch, make_vec2(budget_x, cpu_y), make_vec2(budget_x + 1.0f, bottom), make_vec4(1.0f, 0.2f, 0.2f, 0.8f));
+
+    for (uint32_t i = 0; i < frame->scope_count; ++i)
+    {
+        profiler_scope_t *scope = &frame->scopes[i];
+        if (scope->depth >= ROWS) continue;
+
+        vec4 color = get_scope_color(scope->name);
+        float y = scope->depth * ROW_HEIGHT;
+
+        // At least a pixel wide so short scopes don't vanish.
+        float cpu_x0 = bar_x + scope->cpu_begin * pixels_per_ms;
+        float cpu_x1 = bar_x + scope->cpu_end * pixels_per_ms;
+        draw_rect(batch, make_vec2(cpu_x0, cpu_y + y), make_vec2(cpu_x1 + 1.0f, cpu_y + y + ROW_HEIGHT - 1.0f), color);
+
+        float gpu_x0 = bar_x + scope->gpu_begin * pixels_per_ms;
+        float gpu_x1 = bar_x + scope->gpu_end * pixels_per_ms;
+        draw_rect(batch, make_vec2(gpu_x0, gpu_y + y), make_vec2(gpu_x1 + 1.0f, gpu_y + y + ROW_HEIGHT - 1.0f), color);
+    }
+
+    if (!font) return;
+
+    draw_text(batch, font, make_vec2(pos.x, cpu_y + BAND_HEIGHT * 0.5f - font->line_height * 0.5f), "CPU", make_vec4(1.0f, 1.0f, 1.0f, 1.0f));
+    draw_text(batch, font, make_vec2(pos.x, gpu_y + BAND_HEIGHT * 0.5f - font->line_height * 0.5f), "GPU", make_vec4(1.0f, 1.0f, 1.0f, 1.0f));
+
+    // Averages, indented by depth, in the order the scopes first showed up.
+    float y = bottom + 8.0f;
+    draw_rect(batch, make_vec2(pos.x - 4.0f, y - 4.0f), make_vec2(bar_x + width + 4.0f, y + (average_count + 1) * font->line_height + 4.0f),
+              make_vec4(0.0f, 0.0f, 0.0f, 0.6f));
+
+    char line[128];
+    snprintf(line, sizeof(line), "frame %u: CPU %.2f ms, GPU %.2f ms, %u dropped", frame->frame_number, frame->cpu_ms, frame->gpu_ms, stats.dropped_frames);
+    draw_text(batch, font, make_vec2(pos.x, y), line, make_vec4(1.0f, 1.0f, 1.0f, 1.0f));
+    y += font->line_height;
+
+    for (uint32_t i = 0; i < average_count; ++i)
+    {
+        profiler_average_t *average = &averages[i];
+        float indent = average->depth * 12.0f;
+
+        draw_rect(batch, make_vec2(pos.x + indent, y + 3.0f), make_vec2(pos.x + indent + 8.0f, y + font->line_height - 3.0f), get_scope_color(average->name));
+        draw_text(batch, font, make_vec2(pos.x + indent + 12.0f, y), average->name, make_vec4(1.0f, 1.0f, 1.0f, 1.0f));
+        snprintf(line, sizeof(line), "%6.2f %6.2f", average->cpu_ms, average->gpu_ms);
+        draw_text(batch, font, make_vec2(bar_x + width - 110.0f, y), line, make_vec4(1.0f, 1.0f, 1.0f, 1.0f));
+        y += font->line_height;
+    }
+}
+
+bool
+export_profiler(char *filepath)
+{
+    FILE *file = fopen(filepath, "w");
+    if (!file)
+    {
+        fprintf(stderr, "Could not open '%s' for writing.\n", filepath);
+        return false;
+    }
+
+    fprintf(file, "frame,scope,depth,cpu_begin_ms,cpu_end_ms,gpu_begin_ms,gpu_end_ms\n");
+
+    // Oldest first.
+    uint32_t first = (history_next + PROFILER_HISTORY - history_count) % PROFILER_HISTORY;
+    for (uint32_t i = 0; i < history_count; ++i)
+    {
+        profiler_frame_t *frame = &history[(first + i) % PROFILER_HISTORY];
+        fprintf(file, "%u,frame,-1,0,%.4f,0,%.4f\n", frame->frame_number, frame->cpu_ms, frame->gpu_ms);
+
+        for (uint32_t j = 0; j < frame->scope_count; ++j)
+        {
+            profiler_scope_t *scope = &frame->scopes[j];
+            fprintf(file, "%u,%s,%d,%.4f,%.4f,%.4f,%.4f\n", frame->frame_number, scope->name, scope->depth,
+                    scope->cpu_begin, scope->cpu_end, scope->gpu_begin, scope->gpu_end);
+        }
+    }
+
+    fclose(file);
+    printf("Wrote %u frames to '%s'.\n", history_count, filepath);
+    return true;
+}
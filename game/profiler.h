@@ -0,0 +1,93 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdint.h>
+
+#include "my_math.h"
+#include "sprite_batch.h"
+#include "font.h"
+
+// Frame profiler for the GL thread. A scope records CPU time from the GLFW timer and GPU time
+// from GL_TIMESTAMP queries at both ends, timestamps nest where GL_TIME_ELAPSED queries can't.
+// Every frame has its own set of queries in a ring and reads them back PROFILER_FRAME_LAG frames
+// later, when the GPU is long done with them, so nothing ever waits on a result. A frame whose
+// queries still aren't done by then is dropped.
+
+#define PROFILER_MAX_SCOPES 128
+#define PROFILER_MAX_DEPTH 16
+#define PROFILER_FRAME_LAG 4
+#define PROFILER_HISTORY 240
+#define PROFILER_MAX_AVERAGES 64
+
+struct profiler_scope_t
+{
+    char *name; // Not copied, use string literals.
+    int depth;
+
+    // Milliseconds since the start of the frame, on the CPU and on the GPU.
+    float cpu_begin;
+    float cpu_end;
+    float gpu_begin;
+    float gpu_end;
+};
+
+struct profiler_frame_t
+{
+    uint32_t frame_number;
+    float cpu_ms;
+    float gpu_ms;
+
+    profiler_scope_t scopes[PROFILER_MAX_SCOPES];
+    uint32_t scope_count;
+};
+
+// Smoothed times of a scope over the frames read back so far.
+struct profiler_average_t
+{
+    char *name;
+    int depth;
+    float cpu_ms;
+    float gpu_ms;
+};
+
+struct profiler_stats_t
+{
+    uint32_t dropped_frames; // Queries not done after PROFILER_FRAME_LAG frames.
+    uint32_t dropped_scopes; // Over PROFILER_MAX_SCOPES or PROFILER_MAX_DEPTH.
+};
+
+void init_profiler();
+void free_profiler();
+
+// Around everything the GL thread does in a frame, scopes outside are ignored.
+void begin_profiler_frame();
+void end_profiler_frame();
+
+void begin_profile_scope(char *name);
+void end_profile_scope();
+
+struct profile_scope_guard_t
+{
+    profile_scope_guard_t(char *name) { begin_profile_scope(name); }
+    ~profile_scope_guard_t() { end_profile_scope(); }
+};
+
+#define PROFILE_SCOPE_JOIN2(a, b) a##b
+#define PROFILE_SCOPE_JOIN(a, b) PROFILE_SCOPE_JOIN2(a, b)
+
+// Profiles the rest of the enclosing block.
+#define PROFILE_SCOPE(name) profile_scope_guard_t PROFILE_SCOPE_JOIN(profile_scope_, __LINE__)(name)
+
+// The latest frame read back, NULL until there is one.
+profiler_frame_t *get_profiler_frame();
+
+// CPU and GPU timelines of the latest frame, width pixels wide at pos, and the averages under them
+// if there is a font. Goes through the batch like any other sprites.
+void draw_profiler(sprite_batch_t *batch, font_t *font, vec2 pos, float width);
+
+// Every frame in the history as CSV, one row per scope.
+bool export_profiler(char *filepath);
+
+profiler_stats_t get_profiler_stats();
+
+#endif
@@ -0,0 +1,299 @@
+#include "render_queue.h"
+#include "mesh_cluster.h"
+#include "geometry_pool.h"
+#include "arena.h"
+#include "utils.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void
+init_render_queue(render_queue_t *queue, uint32_t max_commands)
+{
+    *queue = {};
+
+    queue->max_commands = max_commands;
+    queue->commands = (render_command_t *)malloc(max_commands * sizeof(render_command_t));
+    queue->packets = (render_packet_t *)malloc(max_commands * sizeof(render_packet_t));
+}
+
+void
+free_render_queue(render_queue_t *queue)
+{
+    free(queue->commands);
+    free(queue->packets);
+    free(queue->range_counts);
+    free(queue->range_offsets);
+    free(queue->range_base_vertices);
+
+    *queue = {};
+}
+
+void
+begin_render_queue(render_queue_t *queue)
+{
+    queue->command_count = 0;
+    queue->range_count = 0;
+}
+
+static void
+reserve_ranges(render_queue_t *queue, uint32_t count)
+{
+    uint32_t needed = queue->range_count + count;
+    if (needed <= queue->range_capacity) return;
+
+    uint32_t capacity = queue->range_capacity ? queue->range_capacity * 2 : 256;
+    while (capacity < needed) capacity *= 2;
+
+    queue->range_capacity = capacity;
+    queue->range_counts = (GLsizei *)realloc(queue->range_counts, capacity * sizeof(GLsizei));
+    queue->range_offsets = (void **)realloc(queue->range_offsets, capacity * sizeof(void *));
+    queue->range_base_vertices = (GLint *)realloc(queue->range_base_vertices, capacity * sizeof(GLint));
+}
+
+// Positive floats compare like their bit patterns, the top 24 bits keep the exponent and 15 bits of mantissa.
+static uint64_t
+quantize_depth(float view_depth)
+{
+    if (!(view_depth > 0.0f)) return 0;
+
+    uint32_t bits;
+    memcpy(&bits, &view_depth, sizeof(bits));
+    return bits >> 8;
+}
+
+uint64_t
+make_sort_key(render_layer_t layer, uint32_t shader_id, uint32_t material_id, uint32_t mesh_id, uint32_t lod_index, float view_depth)
+{
+    uint64_t depth = quantize_depth(view_depth);
+
+    uint64_t state = ((uint64_t)(shader_id & 0xFF) << 28) |
+                     ((uint64_t)(material_id & 0xFFF) << 16) |
+                     ((uint64_t)(mesh_id & 0xFFF) << 4) |
+                     (uint64_t)(lod_index & 0xF);
+
+    uint64_t result = (uint64_t)(layer & 0xF) << 60;
+    if (layer == RENDER_LAYER_TRANSLUCENT)
+    {
+        result |= ((~depth) & 0xFFFFFF) << 36;
+        result |= state;
+    }
+    else
+    {
+        result |= state << 24;
+        result |= depth;
+    }
+
+    return result;
+}
+
+bool
+push_render_command(render_queue_t *queue, render_layer_t layer, render_view_t *view, render_draw_t *draw)
+{
+    if (queue->command_count == queue->max_commands) return false;
+
+    material_t *material = get_material(draw->material);
+    if (!material) return false;
+
+    mesh_t *mesh = get_mesh(draw->mesh);
+    if (!mesh) return false;
+
+    uint32_t first_range = queue->range_count;
+    if (draw->kind == RENDER_COMMAND_MESH_CLUSTERS && mesh->cluster_count)
+    {
+        reserve_ranges(queue, mesh->cluster_count);
+        queue->range_count += cull_mesh_clusters(mesh, draw->object_to_world, view->world_to_proj, view->camera_position,
+                                                 queue->range_counts + first_range, queue->range_offsets + first_range,
+                                                 queue->range_base_vertices + first_range);
+
+        // Nothing survived, there is nothing to draw.
+        if (queue->range_count == first_range) return true;
+    }
+    else
+    {
+        mesh_lod_t *lod = &mesh->lods[draw->lod_index];
+
+        reserve_ranges(queue, 1);
+        queue->range_counts[first_range] = lod->index_count;
+        queue->range_offsets[first_range] = get_mesh_index_offset(mesh, lod->first_index);
+        queue->range_base_vertices[first_range] = get_mesh_base_vertex(mesh);
+        queue->range_count++;
+    }
+
+    uint32_t index = queue->command_count++;
+
+    render_packet_t *packet = &queue->packets[index];
+    packet->material = draw->material;
+    packet->mesh = draw->mesh;
+    packet->object_to_proj = view->world_to_proj * draw->object_to_world;
+    packet->first_range = first_range;
+    packet->range_count = queue->range_count - first_range;
+
+    vec3 center = transform_point(view->world_to_view * draw->object_to_world, mesh->bounds_center);
+
+    render_command_t *command = &queue->commands[index];
+    command->draw_index = index;
+    command->sort_key = make_sort_key(layer, material->shader->id, get_handle_index(draw->material),
+                                      mesh->geometry_id, draw->lod_index, -center.z);
+
+    return true;
+}
+
+bool
+append_render_queue(render_queue_t *queue, render_queue_t *source)
+{
+    uint32_t count = source->command_count;
+    bool result = true;
+    if (count > queue->max_commands - queue->command_count)
+    {
+        count = queue->max_commands - queue->command_count;
+        result = false;
+    }
+    if (!count) return result;
+
+    uint32_t first_command = queue->command_count;
+    uint32_t first_range = queue->range_count;
+
+    // Commands and packets come out of push_render_command in the same order, so the first count of
+    // each line up and draw_index just needs rebasing.
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        render_command_t *command = &queue->commands[first_command + i];
+        command->sort_key = source->commands[i].sort_key;
+        command->draw_index = source->commands[i].draw_index + first_command;
+
+        render_packet_t *packet = &queue->packets[first_command + i];
+        *packet = source->packets[i];
+        packet->first_range += first_range;
+    }
+
+    render_packet_t *last = &source->packets[count - 1];
+    uint32_t range_count = last->first_range + last->range_count;
+
+    reserve_ranges(queue, range_count);
+    memcpy(queue->range_counts + first_range, source->range_counts, range_count * sizeof(GLsizei));
+    memcpy(queue->range_offsets + first_range, source->range_offsets, range_count * sizeof(void *));
+    memcpy(queue->range_base_vertices + first_range, source->range_base_vertices, range_count * sizeof(GLint));
+
+    queue->command_count += count;
+    queue->range_count += range_count;
+
+    return result;
+}
+
+// LSD radix sort, 8 bits per pass. All histograms are built in one read and passes where
+// every key has the same digit are skipped, which is the common case for the high bytes.
+static void
+radix_sort_commands(render_command_t *commands, render_command_t *scratch, uint32_t count)
+{
+    uint32_t histograms[8][256] = {};
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        uint64_t key = commands[i].sort_key;
+        for (int pass = 0; pass < 8; ++pass)
+        {
+            histograms[pass][(key >> (pass * 8)) & 0xFF]++;
+        }
+    }
+
+    render_command_t *source = commands;
+    render_command_t *destination = scratch;
+
+    for (int pass = 0; pass < 8; ++pass)
+    {
+        uint32_t *histogram = histograms[pass];
+
+        uint32_t first_digit = (source[0].sort_key >> (pass * 8)) & 0xFF;
+        if (histogram[first_digit] == count) continue;
+
+        uint32_t offsets[256];
+        uint32_t sum = 0;
+        for (int digit = 0; digit < 256; ++digit)
+        {
+            offsets[digit] = sum;
+            sum += histogram[digit];
+        }
+
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            uint32_t digit = (source[i].sort_key >> (pass * 8)) & 0xFF;
+            destination[offsets[digit]++] = source[i];
+        }
+
+        render_command_t *temp = source;
+        source = destination;
+        destination = temp;
+    }
+
+    if (source != commands) memcpy(commands, source, count * sizeof(render_command_t));
+}
+
+void
+execute_render_queue(render_queue_t *queue)
+{
+    render_queue_stats_t *stats = &queue->stats;
+    *stats = {};
+    stats->command_count = queue->command_count;
+
+    if (!queue->command_count) return;
+
+    // Only the queue that gets executed needs room to sort, and only for the commands it has.
+    // If the frame arena is full it's drawn unsorted, slower and with translucent out of order.
+    arena_t *arena = get_frame_arena();
+    ARENA_SCOPE(arena);
+    render_command_t *scratch = PUSH_ARRAY(arena, render_command_t, queue->command_count);
+    if (scratch) radix_sort_commands(queue->commands, scratch, queue->command_count);
+
+    bind_geometry_pool();
+
+    shader_t *shader = NULL;
+    handle_t material = NULL_HANDLE;
+    handle_t mesh = NULL_HANDLE;
+
+    for (uint32_t i = 0; i < queue->command_count; ++i)
+    {
+        render_packet_t *packet = &queue->packets[queue->commands[i].draw_index];
+
+        // The material or mesh may have been destroyed since the packet was pushed. The ranges point
+        // into geometry the mesh no longer owns then, so the packet is dropped.
+        material_t *packet_material = get_material(packet->material);
+        if (!packet_material || !get_mesh(packet->mesh)) continue;
+
+        if (packet->material != material)
+        {
+            material = packet->material;
+            set_material(material);
+            stats->material_changes++;
+
+            shader_t *material_shader = packet_material->shader;
+            if (material_shader != shader)
+            {
+                shader = material_shader;
+                set_vertex_format_to_mesh();
+                stats->shader_changes++;
+            }
+        }
+
+        if (packet->mesh != mesh)
+        {
+            mesh = packet->mesh;
+            stats->mesh_changes++;
+        }
+
+        glUniformMatrix4fv(shader->object_to_proj_loc, 1, GL_TRUE, &packet->object_to_proj._11);
+
+        uint32_t range = packet->first_range;
+        if (packet->range_count == 1)
+        {
+            glDrawElementsBaseVertex(GL_TRIANGLES, queue->range_counts[range], GL_UNSIGNED_INT,
+                                     queue->range_offsets[range], queue->range_base_vertices[range]);
+        }
+        else
+        {
+            glMultiDrawElementsBaseVertex(GL_TRIANGLES, queue->range_counts + range, GL_UNSIGNED_INT,
+                                          queue->range_offsets + range, packet->range_count, queue->range_base_vertices + range);
+        }
+        stats->draw_calls++;
+    }
+}
@@ -0,0 +1,113 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <stdint.h>
+
+#include "mesh.h"
+#include "material.h"
+
+// Sort key layout, most significant bits first:
+//
+//   opaque:       layer:4 | shader:8 | material:12 | mesh:12 | lod:4 | depth:24 (front to back)
+//   translucent:  layer:4 | depth:24 (back to front) | shader:8 | material:12 | mesh:12 | lod:4
+//
+// Sorting by key therefore minimizes shader and material switches within a layer.
+
+enum render_layer_t
+{
+    RENDER_LAYER_OPAQUE = 0,
+    RENDER_LAYER_TRANSLUCENT = 1,
+};
+
+enum render_command_kind_t
+{
+    RENDER_COMMAND_MESH,
+
+    // Draws LOD 0 through the cluster culling path.
+    RENDER_COMMAND_MESH_CLUSTERS,
+};
+
+struct render_view_t
+{
+    mat4 world_to_view;
+    mat4 view_to_proj;
+    mat4 world_to_proj;
+    vec3 camera_position;
+};
+
+struct render_draw_t
+{
+    render_command_kind_t kind;
+    handle_t material;
+    handle_t mesh;
+    int lod_index;
+    mat4 object_to_world;
+};
+
+// A recorded draw, everything the GL thread needs is already worked out.
+// The draw covers index ranges [first_range, first_range + range_count) of the queue,
+// one range is a plain draw and several come from cluster culling.
+struct render_packet_t
+{
+    handle_t material;
+    handle_t mesh;
+    mat4 object_to_proj;
+
+    uint32_t first_range;
+    uint32_t range_count;
+};
+
+// What gets sorted, kept small so the radix passes move as little memory as possible.
+struct render_command_t
+{
+    uint64_t sort_key;
+    uint32_t draw_index;
+};
+
+struct render_queue_stats_t
+{
+    uint32_t command_count;
+    uint32_t draw_calls;
+    uint32_t shader_changes;
+    uint32_t material_changes;
+    uint32_t mesh_changes;
+};
+
+struct render_queue_t
+{
+    uint32_t max_commands;
+    uint32_t command_count;
+
+    render_command_t *commands;
+    render_packet_t *packets;
+
+    // Index ranges in glMultiDrawElementsBaseVertex layout, grown as needed.
+    uint32_t range_count;
+    uint32_t range_capacity;
+    GLsizei *range_counts;
+    void **range_offsets;
+    GLint *range_base_vertices;
+
+    render_queue_stats_t stats;
+};
+
+void init_render_queue(render_queue_t *queue, uint32_t max_commands);
+void free_render_queue(render_queue_t *queue);
+
+void begin_render_queue(render_queue_t *queue);
+
+uint64_t make_sort_key(render_layer_t layer, uint32_t shader_id, uint32_t material_id, uint32_t mesh_id, uint32_t lod_index, float view_depth);
+
+// Builds the sort key, object_to_proj and index ranges, culling clusters on the way. Doesn't touch GL,
+// so worker threads can record into queues of their own while meshes and the geometry pool stay put.
+// Returns false once max_commands is reached or if the material or mesh is gone.
+bool push_render_command(render_queue_t *queue, render_layer_t layer, render_view_t *view, render_draw_t *draw);
+
+// Appends everything recorded in source. Returns false if it didn't all fit.
+bool append_render_queue(render_queue_t *queue, render_queue_t *source);
+
+// Radix sorts everything pushed since begin_render_queue and issues the draws in key order.
+// Packets whose material or mesh has been destroyed since they were pushed are skipped.
+void execute_render_queue(render_queue_t *queue);
+
+#endif
@@ -0,0 +1,107 @@
+#include "render_recorder.h"
+#include "jobs.h"
+#include "trace.h"
+#include "utils.h"
+
+#include <stdlib.h>
+#include <GLFW/glfw3.h>
+
+static void
+init_command_list(render_command_list_t *list, uint32_t max_commands, uint32_t max_instances)
+{
+    *list = {};
+
+    init_render_queue(&list->queue, max_commands);
+    list->max_instances = max_instances;
+    list->instances = (instance_t *)malloc(max_instances * sizeof(instance_t));
+}
+
+static void
+free_command_list(render_command_list_t *list)
+{
+    free_render_queue(&list->queue);
+    free(list->instances);
+
+    *list = {};
+}
+
+bool
+record_instance(render_command_list_t *list, handle_t mesh, int lod_index, handle_t material, mat4 object_to_world)
+{
+    if (list->instance_count == list->max_instances) return false;
+
+    list->instances[list->instance_count++] = make_instance(mesh, lod_index, material, object_to_world);
+    return true;
+}
+
+static void
+record_range(uint32_t first, uint32_t count, void *data)
+{
+    TRACE_SCOPE("record_batches");
+
+    // Off the job threads parallel_for runs everything on the caller, the first list is free then.
+    render_recorder_t *recorder = (render_recorder_t *)data;
+    int index = get_job_thread_index();
+    render_command_list_t *list = &recorder->lists[index > 0 ? index : 0];
+
+    recorder->proc(list, first, count, recorder->data);
+}
+
+void
+init_render_recorder(render_recorder_t *recorder, uint32_t max_commands_per_list, uint32_t max_instances_per_list)
+{
+    recorder->list_count = get_job_thread_count();
+    if (recorder->list_count < 1) recorder->list_count = 1;
+
+    recorder->proc = NULL;
+    recorder->data = NULL;
+    recorder->record_seconds = 0.0;
+    recorder->merge_seconds = 0.0;
+
+    recorder->lists = (render_command_list_t *)malloc(recorder->list_count * sizeof(render_command_list_t));
+    for (int i = 0; i < recorder->list_count; ++i)
+    {
+        init_command_list(&recorder->lists[i], max_commands_per_list, max_instances_per_list);
+    }
+}
+
+void
+free_render_recorder(render_recorder_t *recorder)
+{
+    for (int i = 0; i < recorder->list_count; ++i) free_command_list(&recorder->lists[i]);
+    free(recorder->lists);
+    recorder->lists = NULL;
+
+    recorder->list_count = 0;
+}
+
+void
+record_render_commands(render_recorder_t *recorder, render_record_proc_t *proc, void *data, uint32_t item_count,
+                       render_queue_t *queue, instance_renderer_t *instances)
+{
+    double start = glfwGetTime();
+
+    for (int i = 0; i < recorder->list_count; ++i)
+    {
+        render_command_list_t *list = &recorder->lists[i];
+        begin_render_queue(&list->queue);
+        list->instance_count = 0;
+    }
+
+    recorder->proc = proc;
+    recorder->data = data;
+    parallel_for(item_count, 1, record_range, recorder);
+
+    double recorded = glfwGetTime();
+
+    // Merge on the calling thread, the queue's sort takes care of ordering across lists.
+    for (int i = 0; i < recorder->list_count; ++i)
+    {
+        render_command_list_t *list = &recorder->lists[i];
+        append_render_queue(queue, &list->queue);
+        append_instances(instances, list->instances, list->instance_count);
+    }
+
+    recorder->record_seconds = recorded - start;
+    recorder->merge_seconds = glfwGetTime() - recorded;
+}
@@ -0,0 +1,54 @@
+#ifndef RENDER_RECORDER_H
+#define RENDER_RECORDER_H
+
+#include <stdint.h>
+
+#include "render_queue.h"
+#include "instancing.h"
+
+// Records render commands on the job threads, the GL thread merges and replays them.
+// Every job thread has its own command list, so recording never takes a lock. The calling thread
+// records as well and is the only one that ever touches GL.
+
+// Everything one thread recorded.
+struct render_command_list_t
+{
+    render_queue_t queue;
+
+    instance_t *instances;
+    uint32_t instance_count;
+    uint32_t max_instances;
+};
+
+// Called from any thread for a range of the items passed to record_render_commands.
+// Must not touch GL, and only push into the list it is given.
+typedef void render_record_proc_t(render_command_list_t *list, uint32_t first_item, uint32_t item_count, void *data);
+
+struct render_recorder_t
+{
+    // One per job thread.
+    int list_count;
+    render_command_list_t *lists;
+
+    render_record_proc_t *proc;
+    void *data;
+
+    // Time the last record_render_commands spent recording and merging.
+    double record_seconds;
+    double merge_seconds;
+};
+
+// After init_jobs, there is a list for every job thread.
+void init_render_recorder(render_recorder_t *recorder, uint32_t max_commands_per_list, uint32_t max_instances_per_list);
+void free_render_recorder(render_recorder_t *recorder);
+
+// Same as add_instance, but into a command list.
+bool record_instance(render_command_list_t *list, handle_t mesh, int lod_index, handle_t material, mat4 object_to_world);
+
+// Hands out items [0, item_count) in batches to the job threads and blocks until they are recorded,
+// then appends every list to queue and instances. Call between begin_render_queue / begin_instances
+// and the draws.
+void record_render_commands(render_recorder_t *recorder, render_record_proc_t *proc, void *data, uint32_t item_count,
+                            render_queue_t *queue, instance_renderer_t *instances);
+
+#endif
@@ -1,13 +1,18 @@
 #include "shader.h"
+#include "gl_state.h"
+#include "arena.h"
+#include "trace.h"
 #include "utils.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 
 static shader_t *current_shader;
+static uint32_t next_shader_id = 1;
 
+// Zero terminated, in arena. Text mode can read fewer bytes than the file has, never more.
 static char *
-read_entire_text_file(char *filepath, size_t *out_length = NULL)
+read_entire_text_file(arena_t *arena, char *filepath, size_t *out_length = NULL)
 {
     char *result = NULL;
 
@@ -18,12 +23,14 @@ read_entire_text_file(char *filepath, size_t *out_length = NULL)
         size_t length = ftell(file);
         fseek(file, 0, SEEK_SET);
 
-        result = (char *)calloc(length, sizeof(char));
-        size_t num_read = fread(result, sizeof(char), length, file);
+        result = PUSH_ARRAY(arena, char, length + 1);
+        if (result)
+        {
+            size_t num_read = fread(result, sizeof(char), length, file);
+            result[num_read] = 0;
+            if (out_length) *out_length = num_read;
+        }
         fclose(file);
-
-        result[num_read] = 0;
-        if (out_length) *out_length = num_read;
     }
     return result;
 }
@@ -31,17 +38,28 @@ read_entire_text_file(char *filepath, size_t *out_length = NULL)
 bool
 load_shader(shader_t *shader, char *filepath)
 {
-    char *data = read_entire_text_file(filepath);
+    TRACE_SCOPE("load_shader");
+    ARENA_SCOPE(get_thread_arena());
+
+    char *data = read_entire_text_file(get_thread_arena(), filepath);
     if (!data)
     {
         fprintf(stderr, "Failed to read file '%s'.\n", filepath);
         return false;
     }
-    
+
+    return create_shader(shader, filepath, data);
+}
+
+bool
+create_shader(shader_t *shader, char *filepath, char *source)
+{
+    TRACE_SCOPE("create_shader");
+
     char *vertex_source[] =
     {
         "#version 330 core\n#define VERTEX_SHADER\n#define OUT_IN out\n",
-        data,
+        source,
     };
 
     GLuint v = glCreateShader(GL_VERTEX_SHADER);
@@ -55,14 +73,13 @@ load_shader(shader_t *shader, char *filepath)
         glGetShaderInfoLog(v, sizeof(info_log), NULL, info_log);
         fprintf(stderr, "Failed to compile '%s' vertex shader:\n%s\n", filepath, info_log);
         glDeleteShader(v);
-        free(data);
         return false;
     }
 
     char *fragment_source[] =
     {
         "#version 330 core\n#define FRAGMENT_SHADER\n#define OUT_IN in\n",
-        data,
+        source,
     };
 
     GLuint f = glCreateShader(GL_FRAGMENT_SHADER);
@@ -76,7 +93,6 @@ load_shader(shader_t *shader, char *filepath)
         fprintf(stderr, "Failed to compile '%s' fragment shader:\n%s\n", filepath, info_log);
         glDeleteShader(v);
         glDeleteShader(f);
-        free(data);
         return false;
     }
 
@@ -93,7 +109,6 @@ load_shader(shader_t *shader, char *filepath)
         glDeleteShader(v);
         glDeleteShader(f);
         glDeleteProgram(p);
-        free(data);
         return false; 
     }
     glValidateProgram(p);
@@ -106,19 +121,28 @@ load_shader(shader_t *shader, char *filepath)
         glDeleteShader(v);
         glDeleteShader(f);
         glDeleteProgram(p);
-        free(data);
         return false; 
     }
 
     shader->program = p;
+    if (!shader->id) shader->id = next_shader_id++;
 
     shader->input_position_loc = glGetAttribLocation(p, "input_position");
     shader->input_normal_loc = glGetAttribLocation(p, "input_normal");
     shader->input_uv_loc = glGetAttribLocation(p, "input_uv");
+    shader->input_color_loc = glGetAttribLocation(p, "input_color");
+    shader->input_layer_loc = glGetAttribLocation(p, "input_layer");
+    shader->input_instance_transform_loc = glGetAttribLocation(p, "input_instance_transform");
+
+    shader->object_to_proj_loc = glGetUniformLocation(p, "object_to_proj");
+    shader->world_to_proj_loc = glGetUniformLocation(p, "world_to_proj");
+    shader->material_color_loc = glGetUniformLocation(p, "material_color");
+    shader->texture_0_loc = glGetUniformLocation(p, "texture_0");
+    shader->texture_1_loc = glGetUniformLocation(p, "texture_1");
+    shader->texel_step_loc = glGetUniformLocation(p, "texel_step");
     
     glDeleteShader(v);
     glDeleteShader(f);
-    free(data);
     return true;
 }
 
@@ -129,14 +153,7 @@ set_shader(shader_t *shader)
 
     current_shader = shader;
 
-    if (shader)
-    {
-        glUseProgram(shader->program);
-    }
-    else
-    {
-        glUseProgram(0);
-    }
+    bind_program(shader ? shader->program : 0);
 }
 
 shader_t *
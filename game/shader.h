@@ -2,17 +2,38 @@
 #define SHADER_H
 
 #include <GL/glew.h>
+#include <stdint.h>
 
 struct shader_t
 {
     GLuint program;
 
+    // Small unique number, used to group draws by shader.
+    uint32_t id;
+
     GLint input_position_loc;
     GLint input_normal_loc;
     GLint input_uv_loc;
+    GLint input_color_loc;
+    GLint input_layer_loc;
+
+    // mat3x4 holding the first three rows of object_to_world, uses 3 consecutive locations.
+    GLint input_instance_transform_loc;
+
+    GLint object_to_proj_loc;
+    GLint world_to_proj_loc;
+    GLint material_color_loc;
+
+    // Samplers and the blur step of the fullscreen passes.
+    GLint texture_0_loc;
+    GLint texture_1_loc;
+    GLint texel_step_loc;
 };
 
 bool load_shader(shader_t *shader, char *filepath);
+
+// Compiles and links source that was already read, filepath only names it in errors.
+bool create_shader(shader_t *shader, char *filepath, char *source);
 void set_shader(shader_t *shader);
 
 shader_t *get_current_shader();
@@ -0,0 +1,242 @@
+#include "sprite_batch.h"
+#include "gl_state.h"
+#include "utils.h"
+
+#include <stdlib.h>
+
+#define SPRITE_VERTEX_OFFSET_position 0
+#define SPRITE_VERTEX_OFFSET_uv 8
+#define SPRITE_VERTEX_OFFSET_color 16
+#define SPRITE_VERTEX_OFFSET_layer 20
+
+void
+init_sprite_batch(sprite_batch_t *batch, uint32_t max_sprites)
+{
+    *batch = {};
+
+    batch->max_sprites = max_sprites;
+    init_stream_buffer(&batch->vertex_stream, GL_ARRAY_BUFFER, max_sprites * 4 * sizeof(sprite_vertex_t));
+
+    uint32_t *indices = (uint32_t *)malloc(max_sprites * 6 * sizeof(uint32_t));
+    for (uint32_t i = 0; i < max_sprites; ++i)
+    {
+        uint32_t *quad = indices + i * 6;
+        quad[0] = i * 4 + 0;
+        quad[1] = i * 4 + 1;
+        quad[2] = i * 4 + 2;
+        quad[3] = i * 4 + 2;
+        quad[4] = i * 4 + 3;
+        quad[5] = i * 4 + 0;
+    }
+
+    glGenBuffers(1, &batch->index_buffer);
+    bind_buffer(GL_ELEMENT_ARRAY_BUFFER, batch->index_buffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, max_sprites * 6 * sizeof(uint32_t), indices, GL_STATIC_DRAW);
+    free(indices);
+
+    uint32_t white = 0xFFFFFFFF;
+    batch->white_texture = create_texture_array(1, 1, 1, &white);
+}
+
+void
+free_sprite_batch(sprite_batch_t *batch)
+{
+    free_stream_buffer(&batch->vertex_stream);
+    delete_gl_buffer(batch->index_buffer);
+    delete_gl_texture(batch->white_texture);
+
+    *batch = {};
+}
+
+GLuint
+create_texture_array(int width, int height, int layer_count, uint32_t *pixels)
+{
+    GLuint texture;
+    glGenTextures(1, &texture);
+    bind_texture(0, GL_TEXTURE_2D_ARRAY, texture);
+
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, width, height, layer_count, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    return texture;
+}
+
+uint32_t
+pack_color(vec4 color)
+{
+    uint32_t r = (uint32_t)(clamp(0.0f, color.x, 1.0f) * 255.0f + 0.5f);
+    uint32_t g = (uint32_t)(clamp(0.0f, color.y, 1.0f) * 255.0f + 0.5f);
+    uint32_t b = (uint32_t)(clamp(0.0f, color.z, 1.0f) * 255.0f + 0.5f);
+    uint32_t a = (uint32_t)(clamp(0.0f, color.w, 1.0f) * 255.0f + 0.5f);
+    return r | (g << 8) | (b << 16) | (a << 24);
+}
+
+// Maps whatever is left of this frame's region, in whole quads.
+static void
+map_sprite_vertices(sprite_batch_t *batch)
+{
+    batch->count = 0;
+    batch->capacity = get_stream_buffer_space(&batch->vertex_stream, sizeof(float)) / (4 * sizeof(sprite_vertex_t));
+
+    if (!batch->capacity)
+    {
+        batch->vertices = NULL;
+        return;
+    }
+
+    batch->vertices = (sprite_vertex_t *)map_stream_buffer(&batch->vertex_stream, batch->capacity * 4 * sizeof(sprite_vertex_t),
+                                                           sizeof(float), &batch->vertices_offset);
+    if (!batch->vertices) batch->capacity = 0;
+}
+
+static void
+set_sprite_vertex_format(shader_t *shader, size_t offset)
+{
+    GLint loc = shader->input_position_loc;
+    if (loc != -1)
+    {
+        set_vertex_attrib_pointer(loc, 2, GL_FLOAT, GL_FALSE, sizeof(sprite_vertex_t), offset + SPRITE_VERTEX_OFFSET_position);
+        enable_vertex_attrib(loc, true);
+    }
+
+    loc = shader->input_uv_loc;
+    if (loc != -1)
+    {
+        set_vertex_attrib_pointer(loc, 2, GL_FLOAT, GL_FALSE, sizeof(sprite_vertex_t), offset + SPRITE_VERTEX_OFFSET_uv);
+        enable_vertex_attrib(loc, true);
+    }
+
+    loc = shader->input_color_loc;
+    if (loc != -1)
+    {
+        set_vertex_attrib_pointer(loc, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(sprite_vertex_t), offset + SPRITE_VERTEX_OFFSET_color);
+        enable_vertex_attrib(loc, true);
+    }
+
+    loc = shader->input_layer_loc;
+    if (loc != -1)
+    {
+        set_vertex_attrib_pointer(loc, 1, GL_FLOAT, GL_FALSE, sizeof(sprite_vertex_t), offset + SPRITE_VERTEX_OFFSET_layer);
+        enable_vertex_attrib(loc, true);
+    }
+}
+
+// Draws what has been written since the last flush and maps the rest of the region for the next batch.
+static void
+flush_sprites(sprite_batch_t *batch, bool remap)
+{
+    uint32_t count = batch->count;
+
+    if (batch->vertices)
+    {
+        trim_stream_buffer_mapping(&batch->vertex_stream, count * 4 * sizeof(sprite_vertex_t));
+        unmap_stream_buffer(&batch->vertex_stream);
+        batch->vertices = NULL;
+    }
+
+    if (count)
+    {
+        shader_t *shader = batch->shader;
+        set_shader(shader);
+        glUniformMatrix4fv(shader->world_to_proj_loc, 1, GL_TRUE, &batch->world_to_proj._11);
+        glUniform1i(shader->texture_0_loc, 0);
+
+        set_blend_state(true, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        set_depth_state(false, false, GL_LESS);
+
+        bind_buffer(GL_ARRAY_BUFFER, batch->vertex_stream.buffer);
+        bind_buffer(GL_ELEMENT_ARRAY_BUFFER, batch->index_buffer);
+        set_sprite_vertex_format(shader, batch->vertices_offset);
+        bind_texture(0, GL_TEXTURE_2D_ARRAY, batch->texture);
+
+        glDrawElements(GL_TRIANGLES, count * 6, GL_UNSIGNED_INT, NULL);
+        batch->stats.draw_calls++;
+    }
+
+    if (remap) map_sprite_vertices(batch);
+}
+
+void
+begin_sprites(sprite_batch_t *batch, shader_t *shader, mat4 world_to_proj)
+{
+    batch->shader = shader;
+    batch->world_to_proj = world_to_proj;
+    batch->texture = batch->white_texture;
+    batch->stats = {};
+
+    begin_stream_buffer_frame(&batch->vertex_stream);
+    map_sprite_vertices(batch);
+}
+
+void
+end_sprites(sprite_batch_t *batch)
+{
+    flush_sprites(batch, false);
+    end_stream_buffer_frame(&batch->vertex_stream);
+}
+
+void
+set_sprite_shader(sprite_batch_t *batch, shader_t *shader)
+{
+    if (batch->shader == shader) return;
+
+    if (batch->count) flush_sprites(batch, true);
+    batch->shader = shader;
+}
+
+bool
+draw_sprite(sprite_batch_t *batch, GLuint texture_array, float layer, vec2 min, vec2 max, vec2 uv_min, vec2 uv_max, vec4 color)
+{
+    if (batch->texture != texture_array)
+    {
+        if (batch->count) flush_sprites(batch, true);
+        batch->texture = texture_array;
+    }
+
+    if (batch->count == batch->capacity)
+    {
+        if (!batch->count) return false;
+
+        flush_sprites(batch, true);
+        if (!batch->capacity) return false;
+    }
+
+    uint32_t packed_color = pack_color(color);
+
+    // Written in order, the memory is probably write combined.
+    sprite_vertex_t *v = batch->vertices + batch->count * 4;
+    v[0].position = min;
+    v[0].uv = uv_min;
+    v[0].color = packed_color;
+    v[0].layer = layer;
+
+    v[1].position = make_vec2(max.x, min.y);
+    v[1].uv = make_vec2(uv_max.x, uv_min.y);
+    v[1].color = packed_color;
+    v[1].layer = layer;
+
+    v[2].position = max;
+    v[2].uv = uv_max;
+    v[2].color = packed_color;
+    v[2].layer = layer;
+
+    v[3].position = make_vec2(min.x, max.y);
+    v[3].uv = make_vec2(uv_min.x, uv_max.y);
+    v[3].color = packed_color;
+    v[3].layer = layer;
+
+    batch->count++;
+    batch->stats.sprite_count++;
+
+    return true;
+}
+
+bool
+draw_rect(sprite_batch_t *batch, vec2 min, vec2 max, vec4 color)
+{
+    return draw_sprite(batch, batch->white_texture, 0.0f, min, max, make_vec2(0.0f, 0.0f), make_vec2(1.0f, 1.0f), color);
+}
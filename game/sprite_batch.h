@@ -0,0 +1,70 @@
+#ifndef SPRITE_BATCH_H
+#define SPRITE_BATCH_H
+
+#include <GL/glew.h>
+#include <stdint.h>
+
+#include "my_math.h"
+#include "shader.h"
+#include "stream_buffer.h"
+
+// Batches textured, colored quads straight into a stream buffer. Sprites pick a layer of a
+// texture array, so one draw covers everything until the texture array or the shader changes.
+
+struct sprite_vertex_t
+{
+    vec2 position;
+    vec2 uv;
+    uint32_t color; // RGBA8
+    float layer;
+};
+
+struct sprite_batch_stats_t
+{
+    uint32_t sprite_count;
+    uint32_t draw_calls;
+};
+
+struct sprite_batch_t
+{
+    uint32_t max_sprites;
+    stream_buffer_t vertex_stream;
+
+    // Quad indices for max_sprites, the vertex offset moves instead of the indices.
+    GLuint index_buffer;
+
+    // One white layer, for untextured quads.
+    GLuint white_texture;
+
+    shader_t *shader;
+    mat4 world_to_proj;
+    GLuint texture;
+
+    // The part of the stream buffer currently mapped.
+    sprite_vertex_t *vertices;
+    uint32_t vertices_offset;
+    uint32_t capacity;
+    uint32_t count;
+
+    sprite_batch_stats_t stats;
+};
+
+void init_sprite_batch(sprite_batch_t *batch, uint32_t max_sprites);
+void free_sprite_batch(sprite_batch_t *batch);
+
+// Sprites are in the space world_to_proj maps from, usually pixels with an orthographic projection.
+void begin_sprites(sprite_batch_t *batch, shader_t *shader, mat4 world_to_proj);
+void end_sprites(sprite_batch_t *batch);
+
+void set_sprite_shader(sprite_batch_t *batch, shader_t *shader);
+
+// Returns false once max_sprites is reached for this frame.
+bool draw_sprite(sprite_batch_t *batch, GLuint texture_array, float layer, vec2 min, vec2 max, vec2 uv_min, vec2 uv_max, vec4 color);
+bool draw_rect(sprite_batch_t *batch, vec2 min, vec2 max, vec4 color);
+
+// pixels holds layer_count RGBA8 images of width * height, one after the other.
+GLuint create_texture_array(int width, int height, int layer_count, uint32_t *pixels);
+
+uint32_t pack_color(vec4 color);
+
+#endif
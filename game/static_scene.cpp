@@ -0,0 +1,239 @@
+#include "static_scene.h"
+#include "geometry_pool.h"
+#include "gl_state.h"
+#include "arena.h"
+#include "utils.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void
+init_static_scene(static_scene_t *scene, uint32_t max_objects)
+{
+    *scene = {};
+
+    scene->max_objects = max_objects;
+    scene->objects = (static_object_t *)malloc(max_objects * sizeof(static_object_t));
+    scene->objects_sorted = true;
+    scene->batches = (static_batch_t *)malloc(max_objects * sizeof(static_batch_t));
+
+    scene->use_indirect = GLEW_VERSION_4_3 || GLEW_ARB_multi_draw_indirect;
+    if (scene->use_indirect)
+    {
+        scene->commands = (draw_elements_indirect_command_t *)malloc(max_objects * sizeof(draw_elements_indirect_command_t));
+        init_stream_buffer(&scene->indirect_stream, GL_DRAW_INDIRECT_BUFFER, max_objects * sizeof(draw_elements_indirect_command_t));
+    }
+    else
+    {
+        scene->counts = (GLsizei *)malloc(max_objects * sizeof(GLsizei));
+        scene->offsets = (void **)malloc(max_objects * sizeof(void *));
+        scene->base_vertices = (GLint *)malloc(max_objects * sizeof(GLint));
+    }
+}
+
+void
+free_static_scene(static_scene_t *scene)
+{
+    for (uint32_t i = 0; i < scene->object_count; ++i) free_geometry(scene->objects[i].geometry_id);
+
+    if (scene->use_indirect) free_stream_buffer(&scene->indirect_stream);
+
+    free(scene->objects);
+    free(scene->commands);
+    free(scene->counts);
+    free(scene->offsets);
+    free(scene->base_vertices);
+    free(scene->batches);
+
+    *scene = {};
+}
+
+bool
+add_static_mesh(static_scene_t *scene, handle_t mesh_handle, int lod_index, handle_t material, mat4 object_to_world)
+{
+    if (scene->object_count == scene->max_objects) return false;
+
+    mesh_t *mesh = get_mesh(mesh_handle);
+    if (!mesh) return false;
+
+    mesh_lod_t *lod = &mesh->lods[lod_index];
+
+    // Coarse LODs only reference a fraction of the shared vertices, only bake the ones in use.
+    arena_t *arena = get_thread_arena();
+    ARENA_SCOPE(arena);
+
+    uint32_t *remap = PUSH_ARRAY(arena, uint32_t, mesh->vertex_count);
+    uint32_t *indices = PUSH_ARRAY(arena, uint32_t, lod->index_count);
+    mesh_vertex_t *vertices = PUSH_ARRAY(arena, mesh_vertex_t, mesh->vertex_count);
+    if (!remap || !indices || !vertices) return false;
+
+    memset(remap, 0xFF, mesh->vertex_count * sizeof(uint32_t));
+    uint32_t vertex_count = 0;
+
+    // Normals go through the inverse transpose so non uniform scale doesn't skew them.
+    mat4 normal_to_world = mat4_transpose(mat4_inverse(object_to_world));
+
+    for (uint32_t i = 0; i < lod->index_count; ++i)
+    {
+        uint32_t index = mesh->indices[lod->first_index + i];
+        if (remap[index] == 0xFFFFFFFF)
+        {
+            mesh_vertex_t *source = &mesh->vertices[index];
+            mesh_vertex_t *vertex = &vertices[vertex_count];
+            vertex->position = transform_point(object_to_world, source->position);
+            vertex->normal = normalize_or_zero(transform_direction(normal_to_world, source->normal));
+            vertex->uv = source->uv;
+
+            remap[index] = vertex_count++;
+        }
+        indices[i] = remap[index];
+    }
+
+    uint32_t geometry_id = allocate_geometry(vertex_count, lod->index_count);
+    if (geometry_id) upload_geometry(geometry_id, vertices, indices);
+
+    if (!geometry_id) return false;
+
+    float scale_sq = 0.0f;
+    for (int col = 0; col < 3; ++col)
+    {
+        vec3 axis = make_vec3(object_to_world.elements[0][col], object_to_world.elements[1][col], object_to_world.elements[2][col]);
+        float len_sq = length_squared(axis);
+        if (len_sq > scale_sq) scale_sq = len_sq;
+    }
+
+    static_object_t *object = &scene->objects[scene->object_count++];
+    object->material = material;
+    object->geometry_id = geometry_id;
+    object->bounds_center = transform_point(object_to_world, mesh->bounds_center);
+    object->bounds_radius = mesh->bounds_radius * sqrtf(scale_sq);
+
+    scene->objects_sorted = false;
+
+    return true;
+}
+
+static int
+compare_static_objects(const void *a, const void *b)
+{
+    static_object_t *oa = (static_object_t *)a;
+    static_object_t *ob = (static_object_t *)b;
+
+    // By shader first, then material, so shader switches happen once. Objects whose material is
+    // gone go first, they are skipped when drawing.
+    material_t *ma = get_material(oa->material);
+    material_t *mb = get_material(ob->material);
+    uint32_t shader_a = ma ? ma->shader->id : 0;
+    uint32_t shader_b = mb ? mb->shader->id : 0;
+    if (shader_a != shader_b) return shader_a < shader_b ? -1 : 1;
+    if (oa->material != ob->material) return oa->material < ob->material ? -1 : 1;
+    return 0;
+}
+
+void
+draw_static_scene(static_scene_t *scene, mat4 world_to_proj)
+{
+    scene->stats = {};
+    if (!scene->object_count) return;
+
+    if (!scene->objects_sorted)
+    {
+        qsort(scene->objects, scene->object_count, sizeof(static_object_t), compare_static_objects);
+        scene->objects_sorted = true;
+    }
+
+    // Cull and build the draw parameters, splitting into batches wherever the material changes.
+    frustum_t frustum = make_frustum(world_to_proj);
+
+    static_batch_t *batches = scene->batches;
+    uint32_t batch_count = 0;
+    uint32_t visible = 0;
+
+    for (uint32_t i = 0; i < scene->object_count; ++i)
+    {
+        static_object_t *object = &scene->objects[i];
+        if (!sphere_in_frustum(&frustum, object->bounds_center, object->bounds_radius)) continue;
+
+        if (!batch_count || batches[batch_count - 1].material != object->material)
+        {
+            static_batch_t *batch = &batches[batch_count++];
+            batch->material = object->material;
+            batch->first = visible;
+            batch->count = 0;
+        }
+        batches[batch_count - 1].count++;
+
+        geometry_range_t *range = get_geometry(object->geometry_id);
+        if (scene->use_indirect)
+        {
+            draw_elements_indirect_command_t *command = &scene->commands[visible];
+            command->count = range->index_count;
+            command->instance_count = 1;
+            command->first_index = range->first_index;
+            command->base_vertex = range->first_vertex;
+            command->base_instance = 0;
+        }
+        else
+        {
+            scene->counts[visible] = range->index_count;
+            scene->offsets[visible] = (void *)((size_t)range->first_index * sizeof(uint32_t));
+            scene->base_vertices[visible] = range->first_vertex;
+        }
+        visible++;
+    }
+
+    scene->stats.visible_objects = visible;
+
+    uint32_t commands_offset = 0;
+    if (visible && scene->use_indirect)
+    {
+        begin_stream_buffer_frame(&scene->indirect_stream);
+
+        uint32_t size = visible * sizeof(draw_elements_indirect_command_t);
+        void *memory = map_stream_buffer(&scene->indirect_stream, size, sizeof(GLuint), &commands_offset);
+        if (!memory)
+        {
+            end_stream_buffer_frame(&scene->indirect_stream);
+            return;
+        }
+
+        memcpy(memory, scene->commands, size);
+        unmap_stream_buffer(&scene->indirect_stream);
+    }
+
+    bind_geometry_pool();
+    if (scene->use_indirect) bind_buffer(GL_DRAW_INDIRECT_BUFFER, scene->indirect_stream.buffer);
+
+    shader_t *shader = NULL;
+    for (uint32_t i = 0; i < batch_count; ++i)
+    {
+        static_batch_t *batch = &batches[i];
+
+        material_t *material = get_material(batch->material);
+        if (!material) continue;
+
+        set_material(batch->material);
+        if (material->shader != shader)
+        {
+            shader = material->shader;
+            set_vertex_format_to_mesh();
+
+            // Vertices are already in world space.
+            glUniformMatrix4fv(shader->object_to_proj_loc, 1, GL_TRUE, &world_to_proj._11);
+        }
+
+        if (scene->use_indirect)
+        {
+            size_t offset = commands_offset + batch->first * sizeof(draw_elements_indirect_command_t);
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void *)offset, batch->count, sizeof(draw_elements_indirect_command_t));
+        }
+        else
+        {
+            glMultiDrawElementsBaseVertex(GL_TRIANGLES, scene->counts + batch->first, GL_UNSIGNED_INT,
+                                          scene->offsets + batch->first, batch->count, scene->base_vertices + batch->first);
+        }
+        scene->stats.draw_calls++;
+    }
+
+    if (visible && scene->use_indirect) end_stream_buffer_frame(&scene->indirect_stream);
+}
@@ -0,0 +1,84 @@
+#ifndef STATIC_SCENE_H
+#define STATIC_SCENE_H
+
+#include <GL/glew.h>
+#include <stdint.h>
+
+#include "mesh.h"
+#include "material.h"
+#include "stream_buffer.h"
+
+// Geometry that never moves, baked into world space in the geometry pool. Since every object
+// shares one transform, all visible objects of a material go out in a single multi draw:
+// glMultiDrawElementsIndirect with GL 4.3 / ARB_multi_draw_indirect, glMultiDrawElementsBaseVertex otherwise.
+// Materials must use a shader that reads object_to_proj, it gets world_to_proj.
+
+// Layout fixed by GL.
+struct draw_elements_indirect_command_t
+{
+    GLuint count;
+    GLuint instance_count;
+    GLuint first_index;
+    GLint base_vertex;
+    GLuint base_instance;
+};
+
+struct static_object_t
+{
+    handle_t material;
+    uint32_t geometry_id;
+
+    vec3 bounds_center;
+    float bounds_radius;
+};
+
+// Run of visible objects sharing a material, indexes into the scene's per visible object scratch.
+struct static_batch_t
+{
+    handle_t material;
+    uint32_t first;
+    uint32_t count;
+};
+
+struct static_scene_stats_t
+{
+    uint32_t visible_objects;
+    uint32_t draw_calls;
+};
+
+struct static_scene_t
+{
+    uint32_t max_objects;
+    uint32_t object_count;
+    static_object_t *objects;
+
+    // Objects are kept sorted by material so batches are contiguous, redone lazily after adds.
+    bool objects_sorted;
+
+    bool use_indirect;
+    stream_buffer_t indirect_stream;
+
+    // Per visible object scratch, for the indirect commands or the glMultiDrawElementsBaseVertex arrays.
+    draw_elements_indirect_command_t *commands;
+    GLsizei *counts;
+    void **offsets;
+    GLint *base_vertices;
+
+    static_batch_t *batches;
+
+    static_scene_stats_t stats;
+};
+
+void init_static_scene(static_scene_t *scene, uint32_t max_objects);
+
+// Frees the scene's geometry as well.
+void free_static_scene(static_scene_t *scene);
+
+// Bakes one LOD of mesh into world space and copies it into the geometry pool, the scene doesn't
+// need the mesh afterwards. Returns false if the scene or the pool is full or the mesh is gone.
+bool add_static_mesh(static_scene_t *scene, handle_t mesh_handle, int lod_index, handle_t material, mat4 object_to_world);
+
+// Frustum culls the objects and issues one multi draw per material.
+void draw_static_scene(static_scene_t *scene, mat4 world_to_proj);
+
+#endif
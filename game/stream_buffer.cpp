@@ -0,0 +1,152 @@
+#include "stream_buffer.h"
+#include "gl_state.h"
+#include "utils.h"
+
+#include <stdio.h>
+
+void
+init_stream_buffer(stream_buffer_t *stream, GLenum target, uint32_t region_size)
+{
+    *stream = {};
+
+    stream->target = target;
+    stream->region_size = region_size;
+    stream->persistent = GLEW_ARB_buffer_storage != 0;
+
+    GLsizeiptr total_size = (GLsizeiptr)region_size * STREAM_BUFFER_REGION_COUNT;
+
+    glGenBuffers(1, &stream->buffer);
+    bind_buffer(target, stream->buffer);
+
+    if (stream->persistent)
+    {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(target, total_size, NULL, flags);
+        stream->persistent_memory = (uint8_t *)glMapBufferRange(target, 0, total_size, flags);
+
+        if (!stream->persistent_memory)
+        {
+            fprintf(stderr, "Failed to persistently map a stream buffer, falling back to glMapBufferRange.\n");
+
+            // Storage from glBufferStorage is immutable, start over with a fresh buffer.
+            delete_gl_buffer(stream->buffer);
+            glGenBuffers(1, &stream->buffer);
+            bind_buffer(target, stream->buffer);
+            stream->persistent = false;
+        }
+    }
+
+    if (!stream->persistent)
+    {
+        glBufferData(target, total_size, NULL, GL_STREAM_DRAW);
+    }
+
+    // Start on the last region so the first begin_stream_buffer_frame wraps around to region 0.
+    stream->region_index = STREAM_BUFFER_REGION_COUNT - 1;
+}
+
+void
+free_stream_buffer(stream_buffer_t *stream)
+{
+    for (int i = 0; i < STREAM_BUFFER_REGION_COUNT; ++i)
+    {
+        if (stream->fences[i]) glDeleteSync(stream->fences[i]);
+    }
+
+    if (stream->persistent_memory)
+    {
+        bind_buffer(stream->target, stream->buffer);
+        glUnmapBuffer(stream->target);
+    }
+
+    delete_gl_buffer(stream->buffer);
+
+    *stream = {};
+}
+
+void
+begin_stream_buffer_frame(stream_buffer_t *stream)
+{
+    ASSERT(!stream->mapped);
+
+    stream->region_index = (stream->region_index + 1) % STREAM_BUFFER_REGION_COUNT;
+    stream->region_used = 0;
+
+    GLsync fence = stream->fences[stream->region_index];
+    if (fence)
+    {
+        // Normally the fence signalled long ago, we only block when the GPU is more than two frames behind.
+        GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+        for (;;)
+        {
+            GLenum status = glClientWaitSync(fence, flags, 1000000);
+            if (status != GL_TIMEOUT_EXPIRED) break;
+            flags = 0;
+        }
+
+        glDeleteSync(fence);
+        stream->fences[stream->region_index] = 0;
+    }
+}
+
+void
+end_stream_buffer_frame(stream_buffer_t *stream)
+{
+    ASSERT(!stream->mapped);
+    ASSERT(!stream->fences[stream->region_index]);
+
+    if (stream->region_used > stream->peak_used) stream->peak_used = stream->region_used;
+
+    stream->fences[stream->region_index] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void *
+map_stream_buffer(stream_buffer_t *stream, uint32_t size, uint32_t alignment, uint32_t *out_offset)
+{
+    ASSERT(!stream->mapped);
+    ASSERT(alignment && (alignment & (alignment - 1)) == 0);
+
+    uint32_t start = (stream->region_used + alignment - 1) & ~(alignment - 1);
+    if (start + size > stream->region_size) return NULL;
+
+    stream->region_used = start + size;
+    stream->map_start = start;
+
+    uint32_t offset = stream->region_index * stream->region_size + start;
+    *out_offset = offset;
+
+    if (stream->persistent) return stream->persistent_memory + offset;
+
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT;
+    bind_buffer(stream->target, stream->buffer);
+    void *result = glMapBufferRange(stream->target, offset, size, flags);
+    stream->mapped = result != NULL;
+
+    return result;
+}
+
+void
+unmap_stream_buffer(stream_buffer_t *stream)
+{
+    if (!stream->mapped) return;
+
+    bind_buffer(stream->target, stream->buffer);
+    glUnmapBuffer(stream->target);
+    stream->mapped = false;
+}
+
+uint32_t
+get_stream_buffer_space(stream_buffer_t *stream, uint32_t alignment)
+{
+    uint32_t start = (stream->region_used + alignment - 1) & ~(alignment - 1);
+    if (start >= stream->region_size) return 0;
+
+    return stream->region_size - start;
+}
+
+void
+trim_stream_buffer_mapping(stream_buffer_t *stream, uint32_t used_size)
+{
+    ASSERT(stream->map_start + used_size <= stream->region_used);
+    stream->region_used = stream->map_start + used_size;
+}
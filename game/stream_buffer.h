@@ -0,0 +1,54 @@
+#ifndef STREAM_BUFFER_H
+#define STREAM_BUFFER_H
+
+#include <GL/glew.h>
+#include <stdint.h>
+
+#define STREAM_BUFFER_REGION_COUNT 3
+
+// Ring of per frame regions inside one buffer. Each region is guarded by a fence so the CPU
+// only writes into memory the GPU has finished reading, no orphaning or driver side copies.
+// With GL_ARB_buffer_storage the whole buffer stays persistently and coherently mapped,
+// otherwise every write maps its range unsynchronized (the fence already did the syncing).
+struct stream_buffer_t
+{
+    GLuint buffer;
+    GLenum target;
+
+    uint32_t region_size;
+    int region_index;
+    uint32_t region_used;
+
+    bool persistent;
+    uint8_t *persistent_memory;
+    bool mapped;
+
+    // Region relative start of the last map_stream_buffer.
+    uint32_t map_start;
+
+    GLsync fences[STREAM_BUFFER_REGION_COUNT];
+
+    // High water mark of region_used, to size region_size.
+    uint32_t peak_used;
+};
+
+void init_stream_buffer(stream_buffer_t *stream, GLenum target, uint32_t region_size);
+void free_stream_buffer(stream_buffer_t *stream);
+
+// Waits until the GPU is done with the next region and makes it current.
+void begin_stream_buffer_frame(stream_buffer_t *stream);
+
+// Fences the current region, call after the last draw that reads from it.
+void end_stream_buffer_frame(stream_buffer_t *stream);
+
+// Returns memory to write size bytes into and the offset of that memory in the buffer, or NULL
+// if the region is full. The memory is valid until unmap_stream_buffer.
+void *map_stream_buffer(stream_buffer_t *stream, uint32_t size, uint32_t alignment, uint32_t *out_offset);
+void unmap_stream_buffer(stream_buffer_t *stream);
+
+// For writers that don't know their size up front: map everything that is left, then give back
+// what wasn't written before unmapping. used_size counts from the start of the last mapping.
+uint32_t get_stream_buffer_space(stream_buffer_t *stream, uint32_t alignment);
+void trim_stream_buffer_mapping(stream_buffer_t *stream, uint32_t used_size);
+
+#endif
@@ -0,0 +1,939 @@
+#include "texture_compression.h"
+#include "utils.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+//
+// Fitting helpers
+//
+
+static float
+clamp_channel(float value)
+{
+    if (value < 0.0f) return 0.0f;
+    if (value > 255.0f) return 255.0f;
+    return value;
+}
+
+// Mean and principal axis of count points with channels components, by power iteration on the covariance.
+static void
+find_principal_axis(float points[16][4], bool *mask, int channels, float *mean, float *axis)
+{
+    int count = 0;
+    for (int c = 0; c < 4; ++c) mean[c] = axis[c] = 0.0f;
+
+    for (int i = 0; i < 16; ++i)
+    {
+        if (!mask[i]) continue;
+        for (int c = 0; c < channels; ++c) mean[c] += points[i][c];
+        count++;
+    }
+    if (!count) return;
+    for (int c = 0; c < channels; ++c) mean[c] /= count;
+
+    float covariance[4][4] = {};
+    for (int i = 0; i < 16; ++i)
+    {
+        if (!mask[i]) continue;
+        for (int a = 0; a < channels; ++a)
+        {
+            for (int b = 0; b < channels; ++b)
+            {
+                covariance[a][b] += (points[i][a] - mean[a]) * (points[i][b] - mean[b]);
+            }
+        }
+    }
+
+    // Start from the covariance row of the channel that varies most, it can't be orthogonal to the axis.
+    int widest = 0;
+    for (int c = 1; c < channels; ++c)
+    {
+        if (covariance[c][c] > covariance[widest][widest]) widest = c;
+    }
+
+    float v[4];
+    for (int c = 0; c < 4; ++c) v[c] = covariance[widest][c];
+    for (int iteration = 0; iteration < 8; ++iteration)
+    {
+        float next[4] = {};
+        float length = 0.0f;
+        for (int a = 0; a < channels; ++a)
+        {
+            for (int b = 0; b < channels; ++b) next[a] += covariance[a][b] * v[b];
+            length += next[a] * next[a];
+        }
+        if (length < 1e-12f) break;
+
+        length = 1.0f / sqrtf(length);
+        for (int a = 0; a < channels; ++a) v[a] = next[a] * length;
+    }
+
+    for (int c = 0; c < channels; ++c) axis[c] = v[c];
+}
+
+// Endpoints at the extremes of the points projected onto the axis.
+static void
+find_endpoints(float points[16][4], bool *mask, int channels, float *e0, float *e1)
+{
+    float mean[4], axis[4];
+    find_principal_axis(points, mask, channels, mean, axis);
+
+    float min_t = 0.0f;
+    float max_t = 0.0f;
+    for (int i = 0; i < 16; ++i)
+    {
+        if (!mask[i]) continue;
+
+        float t = 0.0f;
+        for (int c = 0; c < channels; ++c) t += (points[i][c] - mean[c]) * axis[c];
+        if (t < min_t) min_t = t;
+        if (t > max_t) max_t = t;
+    }
+
+    for (int c = 0; c < channels; ++c)
+    {
+        e0[c] = clamp_channel(mean[c] + axis[c] * max_t);
+        e1[c] = clamp_channel(mean[c] + axis[c] * min_t);
+    }
+}
+
+// Least squares endpoints for fixed interpolation weights, weight 0 is all e0. Returns false if degenerate.
+static bool
+solve_endpoints(float points[16][4], bool *mask, float *weights, int channels, float *e0, float *e1)
+{
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+    float ax[4] = {}, bx[4] = {};
+
+    for (int i = 0; i < 16; ++i)
+    {
+        if (!mask[i]) continue;
+
+        float b = weights[i];
+        float a = 1.0f - b;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for (int c = 0; c < channels; ++c)
+        {
+            ax[c] += a * points[i][c];
+            bx[c] += b * points[i][c];
+        }
+    }
+
+    float det = aa * bb - ab * ab;
+    if (fabsf(det) < 1e-6f) return false;
+
+    float inv_det = 1.0f / det;
+    for (int c = 0; c < channels; ++c)
+    {
+        e0[c] = clamp_channel((bb * ax[c] - ab * bx[c]) * inv_det);
+        e1[c] = clamp_channel((aa * bx[c] - ab * ax[c]) * inv_det);
+    }
+    return true;
+}
+
+//
+// BC1, also the color half of BC3
+//
+
+static uint16_t
+pack_565(float *color)
+{
+    uint16_t r = (uint16_t)(color[0] * (31.0f / 255.0f) + 0.5f);
+    uint16_t g = (uint16_t)(color[1] * (63.0f / 255.0f) + 0.5f);
+    uint16_t b = (uint16_t)(color[2] * (31.0f / 255.0f) + 0.5f);
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+static void
+unpack_565(uint16_t packed, int *color)
+{
+    int r = (packed >> 11) & 31;
+    int g = (packed >> 5) & 63;
+    int b = packed & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+    color[3] = 255;
+}
+
+// c0 <= c1 selects three colors and transparent black, except in BC3 which always has four.
+static bool
+is_four_color_block(uint16_t c0, uint16_t c1, bool always_four)
+{
+    return always_four || c0 > c1;
+}
+
+static void
+get_color_palette(uint16_t c0, uint16_t c1, bool always_four, int palette[4][4])
+{
+    unpack_565(c0, palette[0]);
+    unpack_565(c1, palette[1]);
+
+    if (is_four_color_block(c0, c1, always_four))
+    {
+        for (int c = 0; c < 3; ++c)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        palette[2][3] = palette[3][3] = 255;
+    }
+    else
+    {
+        for (int c = 0; c < 3; ++c)
+        {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0;
+        }
+        palette[2][3] = 255;
+        palette[3][3] = 0;
+    }
+}
+
+// Nearest palette color for each opaque pixel, the rest get the transparent index 3. Returns the squared error.
+static int
+choose_color_indices(float points[16][4], bool *opaque, uint16_t c0, uint16_t c1, bool always_four, uint32_t *indices)
+{
+    int palette[4][4];
+    get_color_palette(c0, c1, always_four, palette);
+    int color_count = is_four_color_block(c0, c1, always_four) ? 4 : 3;
+
+    uint32_t result = 0;
+    int total_error = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        uint32_t best_index = 3;
+        if (opaque[i])
+        {
+            int best_error = 0x7fffffff;
+            for (int j = 0; j < color_count; ++j)
+            {
+                int error = 0;
+                for (int c = 0; c < 3; ++c)
+                {
+                    int d = (int)points[i][c] - palette[j][c];
+                    error += d * d;
+                }
+                if (error < best_error)
+                {
+                    best_error = error;
+                    best_index = j;
+                }
+            }
+            total_error += best_error;
+        }
+        result |= best_index << (2 * i);
+    }
+
+    *indices = result;
+    return total_error;
+}
+
+// BC1 keeps pixels with alpha below 128 as transparent, for BC3 use_alpha is false and the block has four colors.
+static void
+compress_color_block(float points[16][4], bool use_alpha, uint8_t *block)
+{
+    bool opaque[16];
+    bool any_transparent = false;
+    for (int i = 0; i < 16; ++i)
+    {
+        opaque[i] = !use_alpha || points[i][3] >= 128.0f;
+        if (!opaque[i]) any_transparent = true;
+    }
+    bool always_four = !use_alpha;
+
+    float e0[4], e1[4];
+    find_endpoints(points, opaque, 3, e0, e1);
+
+    uint16_t best_c0 = 0;
+    uint16_t best_c1 = 0;
+    uint32_t best_indices = 0xffffffff;
+    int best_error = 0x7fffffff;
+
+    // The extremes first, then refit the endpoints to the indices they gave a couple of times.
+    for (int pass = 0; pass < 3; ++pass)
+    {
+        uint16_t c0 = pack_565(e0);
+        uint16_t c1 = pack_565(e1);
+
+        // Transparency needs the three color ordering, otherwise prefer four colors.
+        if (any_transparent ? c0 > c1 : c0 < c1)
+        {
+            uint16_t temp = c0;
+            c0 = c1;
+            c1 = temp;
+        }
+
+        uint32_t indices;
+        int error = choose_color_indices(points, opaque, c0, c1, always_four, &indices);
+        if (error < best_error)
+        {
+            best_error = error;
+            best_c0 = c0;
+            best_c1 = c1;
+            best_indices = indices;
+        }
+        if (error == 0) break;
+
+        static const float four_color_weights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+        static const float three_color_weights[4] = { 0.0f, 1.0f, 0.5f, 0.0f };
+        const float *weight_table = is_four_color_block(c0, c1, always_four) ? four_color_weights : three_color_weights;
+
+        float weights[16];
+        for (int i = 0; i < 16; ++i) weights[i] = weight_table[(indices >> (2 * i)) & 3];
+        if (!solve_endpoints(points, opaque, weights, 3, e0, e1)) break;
+    }
+
+    block[0] = (uint8_t)best_c0;
+    block[1] = (uint8_t)(best_c0 >> 8);
+    block[2] = (uint8_t)best_c1;
+    block[3] = (uint8_t)(best_c1 >> 8);
+    for (int i = 0; i < 4; ++i) block[4 + i] = (uint8_t)(best_indices >> (8 * i));
+}
+
+static void
+decompress_color_block(uint8_t *block, bool always_four, uint8_t *pixels)
+{
+    uint16_t c0 = (uint16_t)(block[0] | (block[1] << 8));
+    uint16_t c1 = (uint16_t)(block[2] | (block[3] << 8));
+    uint32_t indices = block[4] | (block[5] << 8) | (block[6] << 16) | ((uint32_t)block[7] << 24);
+
+    int palette[4][4];
+    get_color_palette(c0, c1, always_four, palette);
+
+    for (int i = 0; i < 16; ++i)
+    {
+        int *color = palette[(indices >> (2 * i)) & 3];
+        for (int c = 0; c < 4; ++c) pixels[i * 4 + c] = (uint8_t)color[c];
+    }
+}
+
+//
+// BC4, single channel blocks for BC3 alpha and both BC5 channels
+//
+
+// a0 > a1 gives eight values, otherwise six and 0 and 255.
+static void
+get_single_palette(int a0, int a1, int palette[8])
+{
+    palette[0] = a0;
+    palette[1] = a1;
+    if (a0 > a1)
+    {
+        for (int i = 2; i < 8; ++i) palette[i] = ((8 - i) * a0 + (i - 1) * a1) / 7;
+    }
+    else
+    {
+        for (int i = 2; i < 6; ++i) palette[i] = ((6 - i) * a0 + (i - 1) * a1) / 5;
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+}
+
+static int
+choose_single_indices(int *values, int a0, int a1, uint64_t *indices)
+{
+    int palette[8];
+    get_single_palette(a0, a1, palette);
+
+    uint64_t result = 0;
+    int total_error = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        int best_index = 0;
+        int best_error = 0x7fffffff;
+        for (int j = 0; j < 8; ++j)
+        {
+            int d = values[i] - palette[j];
+            if (d * d < best_error)
+            {
+                best_error = d * d;
+                best_index = j;
+            }
+        }
+        total_error += best_error;
+        result |= (uint64_t)best_index << (3 * i);
+    }
+
+    *indices = result;
+    return total_error;
+}
+
+static void
+compress_single_block(float points[16][4], int channel, uint8_t *block)
+{
+    int values[16];
+    int min = 255, max = 0;
+    int inner_min = 255, inner_max = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        values[i] = (int)points[i][channel];
+        if (values[i] < min) min = values[i];
+        if (values[i] > max) max = values[i];
+
+        // Without the 0 and 255 the six value mode has for free.
+        if (values[i] != 0 && values[i] != 255)
+        {
+            if (values[i] < inner_min) inner_min = values[i];
+            if (values[i] > inner_max) inner_max = values[i];
+        }
+    }
+
+    int a0 = max;
+    int a1 = min;
+    uint64_t indices;
+    int error = choose_single_indices(values, a0, a1, &indices);
+
+    if (error && inner_min <= inner_max && (min == 0 || max == 255))
+    {
+        uint64_t six_indices;
+        int six_error = choose_single_indices(values, inner_min, inner_max, &six_indices);
+        if (six_error < error)
+        {
+            a0 = inner_min;
+            a1 = inner_max;
+            indices = six_indices;
+        }
+    }
+
+    block[0] = (uint8_t)a0;
+    block[1] = (uint8_t)a1;
+    for (int i = 0; i < 6; ++i) block[2 + i] = (uint8_t)(indices >> (8 * i));
+}
+
+static void
+decompress_single_block(uint8_t *block, uint8_t *pixels, int channel)
+{
+    int palette[8];
+    get_single_palette(block[0], block[1], palette);
+
+    uint64_t indices = 0;
+    for (int i = 0; i < 6; ++i) indices |= (uint64_t)block[2 + i] << (8 * i);
+
+    for (int i = 0; i < 16; ++i) pixels[i * 4 + channel] = (uint8_t)palette[(indices >> (3 * i)) & 7];
+}
+
+//
+// BC7
+//
+
+static const int bc7_weights2[4] = { 0, 21, 43, 64 };
+static const int bc7_weights3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+static const int bc7_weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// Blocks are little endian bit streams, first field in the lowest bits.
+struct bit_stream_t
+{
+    uint8_t *data;
+    int position;
+};
+
+static void
+write_bits(bit_stream_t *stream, uint32_t value, int count)
+{
+    for (int i = 0; i < count; ++i, ++stream->position)
+    {
+        if (value & (1u << i)) stream->data[stream->position >> 3] |= (uint8_t)(1 << (stream->position & 7));
+    }
+}
+
+static uint32_t
+read_bits(bit_stream_t *stream, int count)
+{
+    uint32_t value = 0;
+    for (int i = 0; i < count; ++i, ++stream->position)
+    {
+        value |= (uint32_t)((stream->data[stream->position >> 3] >> (stream->position & 7)) & 1) << i;
+    }
+    return value;
+}
+
+static int
+interpolate_bc7(int e0, int e1, int weight)
+{
+    return ((64 - weight) * e0 + weight * e1 + 32) >> 6;
+}
+
+// 7 bits per channel and a p bit shared by the endpoint, the p bit that lands closer wins.
+static void
+quantize_bc7_endpoint(float *endpoint, int *quantized, int *p_bit)
+{
+    float best_error = 1e30f;
+    for (int p = 0; p < 2; ++p)
+    {
+        int values[4];
+        float error = 0.0f;
+        for (int c = 0; c < 4; ++c)
+        {
+            int v = (int)((endpoint[c] - p) * 0.5f + 0.5f);
+            if (v < 0) v = 0;
+            if (v > 127) v = 127;
+            values[c] = v;
+
+            float d = (float)((v << 1) | p) - endpoint[c];
+            error += d * d;
+        }
+        if (error < best_error)
+        {
+            best_error = error;
+            *p_bit = p;
+            for (int c = 0; c < 4; ++c) quantized[c] = values[c];
+        }
+    }
+}
+
+// Nearest of the weight_count interpolated values for channels [first, first + count), returns the squared error.
+static int
+choose_bc7_indices(float points[16][4], int endpoints[2][4], int first, int count, const int *weights, int weight_count, uint8_t *indices)
+{
+    int palette[16][4];
+    for (int j = 0; j < weight_count; ++j)
+    {
+        for (int c = first; c < first + count; ++c) palette[j][c] = interpolate_bc7(endpoints[0][c], endpoints[1][c], weights[j]);
+    }
+
+    int total_error = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        int best_error = 0x7fffffff;
+        for (int j = 0; j < weight_count; ++j)
+        {
+            int error = 0;
+            for (int c = first; c < first + count; ++c)
+            {
+                int d = (int)points[i][c] - palette[j][c];
+                error += d * d;
+            }
+            if (error < best_error)
+            {
+                best_error = error;
+                indices[i] = (uint8_t)j;
+            }
+        }
+        total_error += best_error;
+    }
+    return total_error;
+}
+
+// The first index of a set is stored without its top bit, so it has to be in the lower half.
+static void
+fix_bc7_anchor(int endpoints[2][4], int first, int count, uint8_t *indices, int weight_count)
+{
+    if (indices[0] < weight_count / 2) return;
+
+    for (int c = first; c < first + count; ++c)
+    {
+        int temp = endpoints[0][c];
+        endpoints[0][c] = endpoints[1][c];
+        endpoints[1][c] = temp;
+    }
+    for (int i = 0; i < 16; ++i) indices[i] = (uint8_t)(weight_count - 1 - indices[i]);
+}
+
+static void
+write_bc7_indices(bit_stream_t *stream, uint8_t *indices, int bits)
+{
+    write_bits(stream, indices[0], bits - 1);
+    for (int i = 1; i < 16; ++i) write_bits(stream, indices[i], bits);
+}
+
+// Mode 6: RGBA 7.7.7.7 endpoints with p bits and 4 bit indices. Returns the squared error.
+static int
+compress_bc7_mode6(float points[16][4], uint8_t *block)
+{
+    bool all[16];
+    for (int i = 0; i < 16; ++i) all[i] = true;
+
+    float e0[4], e1[4];
+    find_endpoints(points, all, 4, e0, e1);
+
+    int best_quantized[2][4] = {};
+    int best_p_bits[2] = {};
+    uint8_t best_indices[16] = {};
+    int best_error = 0x7fffffff;
+
+    // The extremes first, then refit the endpoints to the indices they gave a couple of times.
+    for (int pass = 0; pass < 3; ++pass)
+    {
+        int quantized[2][4];
+        int p_bits[2];
+        quantize_bc7_endpoint(e0, quantized[0], &p_bits[0]);
+        quantize_bc7_endpoint(e1, quantized[1], &p_bits[1]);
+
+        int endpoints[2][4];
+        for (int e = 0; e < 2; ++e)
+        {
+            for (int c = 0; c < 4; ++c) endpoints[e][c] = (quantized[e][c] << 1) | p_bits[e];
+        }
+
+        uint8_t indices[16];
+        int error = choose_bc7_indices(points, endpoints, 0, 4, bc7_weights4, 16, indices);
+        if (error < best_error)
+        {
+            best_error = error;
+            memcpy(best_quantized, quantized, sizeof(quantized));
+            memcpy(best_p_bits, p_bits, sizeof(p_bits));
+            memcpy(best_indices, indices, sizeof(indices));
+        }
+        if (error == 0) break;
+
+        float weights[16];
+        for (int i = 0; i < 16; ++i) weights[i] = bc7_weights4[indices[i]] / 64.0f;
+        if (!solve_endpoints(points, all, weights, 4, e0, e1)) break;
+    }
+
+    // The p bits belong to the endpoints, so they swap along.
+    if (best_indices[0] >= 8)
+    {
+        int temp = best_p_bits[0];
+        best_p_bits[0] = best_p_bits[1];
+        best_p_bits[1] = temp;
+    }
+    fix_bc7_anchor(best_quantized, 0, 4, best_indices, 16);
+
+    memset(block, 0, 16);
+    bit_stream_t stream = { block, 0 };
+    write_bits(&stream, 1 << 6, 7);
+    for (int c = 0; c < 4; ++c)
+    {
+        write_bits(&stream, best_quantized[0][c], 7);
+        write_bits(&stream, best_quantized[1][c], 7);
+    }
+    write_bits(&stream, best_p_bits[0], 1);
+    write_bits(&stream, best_p_bits[1], 1);
+    write_bc7_indices(&stream, best_indices, 4);
+    return best_error;
+}
+
+// Mode 5 without rotation: RGB 7.7.7 and 8 bit alpha endpoints, each with their own 2 bit indices.
+// Coarser than mode 6 but alpha doesn't have to lie on the color line. Returns the squared error.
+static int
+compress_bc7_mode5(float points[16][4], uint8_t *block)
+{
+    bool all[16];
+    for (int i = 0; i < 16; ++i) all[i] = true;
+
+    float e0[4], e1[4];
+    find_endpoints(points, all, 3, e0, e1);
+
+    int best_endpoints[2][4] = {};
+    uint8_t best_color_indices[16] = {};
+    int best_color_error = 0x7fffffff;
+
+    for (int pass = 0; pass < 3; ++pass)
+    {
+        // 7 bit endpoints expand as (v << 1) | (v >> 6).
+        int quantized[2][4];
+        int endpoints[2][4];
+        for (int c = 0; c < 3; ++c)
+        {
+            quantized[0][c] = (int)(e0[c] * (127.0f / 255.0f) + 0.5f);
+            quantized[1][c] = (int)(e1[c] * (127.0f / 255.0f) + 0.5f);
+            for (int e = 0; e < 2; ++e) endpoints[e][c] = (quantized[e][c] << 1) | (quantized[e][c] >> 6);
+        }
+
+        uint8_t indices[16];
+        int error = choose_bc7_indices(points, endpoints, 0, 3, bc7_weights2, 4, indices);
+        if (error < best_color_error)
+        {
+            best_color_error = error;
+            memcpy(best_endpoints, quantized, sizeof(quantized));
+            memcpy(best_color_indices, indices, sizeof(indices));
+        }
+        if (error == 0) break;
+
+        float weights[16];
+        for (int i = 0; i < 16; ++i) weights[i] = bc7_weights2[indices[i]] / 64.0f;
+        if (!solve_endpoints(points, all, weights, 3, e0, e1)) break;
+    }
+
+    // Alpha endpoints are stored exactly, the range is as good as it gets.
+    int min_alpha = 255, max_alpha = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        int a = (int)points[i][3];
+        if (a < min_alpha) min_alpha = a;
+        if (a > max_alpha) max_alpha = a;
+    }
+    best_endpoints[0][3] = min_alpha;
+    best_endpoints[1][3] = max_alpha;
+
+    uint8_t alpha_indices[16];
+    int alpha_error = choose_bc7_indices(points, best_endpoints, 3, 1, bc7_weights2, 4, alpha_indices);
+
+    fix_bc7_anchor(best_endpoints, 0, 3, best_color_indices, 4);
+    fix_bc7_anchor(best_endpoints, 3, 1, alpha_indices, 4);
+
+    memset(block, 0, 16);
+    bit_stream_t stream = { block, 0 };
+    write_bits(&stream, 1 << 5, 6);
+    write_bits(&stream, 0, 2);
+    for (int c = 0; c < 4; ++c)
+    {
+        int bits = c < 3 ? 7 : 8;
+        write_bits(&stream, best_endpoints[0][c], bits);
+        write_bits(&stream, best_endpoints[1][c], bits);
+    }
+    write_bc7_indices(&stream, best_color_indices, 2);
+    write_bc7_indices(&stream, alpha_indices, 2);
+    return best_color_error + alpha_error;
+}
+
+// Encodes as mode 6 and, where alpha varies, also as mode 5 and keeps the closer one.
+static void
+compress_bc7_block(float points[16][4], uint8_t *block)
+{
+    int error = compress_bc7_mode6(points, block);
+
+    bool alpha_varies = false;
+    for (int i = 1; i < 16; ++i)
+    {
+        if (points[i][3] != points[0][3]) alpha_varies = true;
+    }
+
+    if (error && alpha_varies)
+    {
+        uint8_t mode5_block[16];
+        if (compress_bc7_mode5(points, mode5_block) < error) memcpy(block, mode5_block, 16);
+    }
+}
+
+static void
+decompress_bc7_block(uint8_t *block, uint8_t *pixels)
+{
+    int mode = 0;
+    while (mode < 8 && !(block[0] & (1 << mode))) mode++;
+
+    bit_stream_t stream = { block, mode + 1 };
+    int endpoints[2][4];
+
+    if (mode == 6)
+    {
+        for (int c = 0; c < 4; ++c)
+        {
+            endpoints[0][c] = read_bits(&stream, 7) << 1;
+            endpoints[1][c] = read_bits(&stream, 7) << 1;
+        }
+        int p0 = read_bits(&stream, 1);
+        int p1 = read_bits(&stream, 1);
+        for (int c = 0; c < 4; ++c)
+        {
+            endpoints[0][c] |= p0;
+            endpoints[1][c] |= p1;
+        }
+
+        for (int i = 0; i < 16; ++i)
+        {
+            int weight = bc7_weights4[read_bits(&stream, i == 0 ? 3 : 4)];
+            for (int c = 0; c < 4; ++c) pixels[i * 4 + c] = (uint8_t)interpolate_bc7(endpoints[0][c], endpoints[1][c], weight);
+        }
+        return;
+    }
+
+    if (mode == 4 || mode == 5)
+    {
+        int rotation = read_bits(&stream, 2);
+        int index_mode = mode == 4 ? read_bits(&stream, 1) : 0;
+        int color_bits = mode == 4 ? 5 : 7;
+        int alpha_bits = mode == 4 ? 6 : 8;
+
+        for (int c = 0; c < 4; ++c)
+        {
+            int bits = c < 3 ? color_bits : alpha_bits;
+            for (int e = 0; e < 2; ++e)
+            {
+                int v = read_bits(&stream, bits) << (8 - bits);
+                endpoints[e][c] = v | (v >> bits);
+            }
+        }
+
+        // Both modes have a 2 bit index set first, mode 4 then has a 3 bit set, mode 5 another 2 bit one.
+        int first[16], second[16];
+        for (int i = 0; i < 16; ++i) first[i] = bc7_weights2[read_bits(&stream, i == 0 ? 1 : 2)];
+        for (int i = 0; i < 16; ++i)
+        {
+            if (mode == 4) second[i] = bc7_weights3[read_bits(&stream, i == 0 ? 2 : 3)];
+            else second[i] = bc7_weights2[read_bits(&stream, i == 0 ? 1 : 2)];
+        }
+
+        int *color_weights = index_mode ? second : first;
+        int *alpha_weights = index_mode ? first : second;
+
+        for (int i = 0; i < 16; ++i)
+        {
+            uint8_t *pixel = &pixels[i * 4];
+            for (int c = 0; c < 4; ++c)
+            {
+                int weight = c < 3 ? color_weights[i] : alpha_weights[i];
+                pixel[c] = (uint8_t)interpolate_bc7(endpoints[0][c], endpoints[1][c], weight);
+            }
+
+            if (rotation)
+            {
+                uint8_t temp = pixel[3];
+                pixel[3] = pixel[rotation - 1];
+                pixel[rotation - 1] = temp;
+            }
+        }
+        return;
+    }
+
+    // Partitioned modes and invalid blocks.
+    for (int i = 0; i < 16; ++i)
+    {
+        pixels[i * 4 + 0] = 255;
+        pixels[i * 4 + 1] = 0;
+        pixels[i * 4 + 2] = 255;
+        pixels[i * 4 + 3] = 255;
+    }
+}
+
+//
+// Blocks and images
+//
+
+void
+compress_block(image_format_t format, uint8_t *pixels, uint8_t *block)
+{
+    float points[16][4];
+    for (int i = 0; i < 16; ++i)
+    {
+        for (int c = 0; c < 4; ++c) points[i][c] = pixels[i * 4 + c];
+    }
+
+    switch (format)
+    {
+        case IMAGE_FORMAT_BC1:
+            compress_color_block(points, true, block);
+            break;
+        case IMAGE_FORMAT_BC3:
+            compress_single_block(points, 3, block);
+            compress_color_block(points, false, block + 8);
+            break;
+        case IMAGE_FORMAT_BC5:
+            compress_single_block(points, 0, block);
+            compress_single_block(points, 1, block + 8);
+            break;
+        case IMAGE_FORMAT_BC7:
+            compress_bc7_block(points, block);
+            break;
+        default:
+            ASSERT(!"Not a block compressed format");
+            break;
+    }
+}
+
+void
+decompress_block(image_format_t format, uint8_t *block, uint8_t *pixels)
+{
+    switch (format)
+    {
+        case IMAGE_FORMAT_BC1:
+            decompress_color_block(block, false, pixels);
+            break;
+        case IMAGE_FORMAT_BC3:
+            decompress_color_block(block + 8, true, pixels);
+            decompress_single_block(block, pixels, 3);
+            break;
+        case IMAGE_FORMAT_BC5:
+            // Same as sampling an RG texture.
+            for (int i = 0; i < 16; ++i)
+            {
+                pixels[i * 4 + 2] = 0;
+                pixels[i * 4 + 3] = 255;
+            }
+            decompress_single_block(block, pixels, 0);
+            decompress_single_block(block + 8, pixels, 1);
+            break;
+        case IMAGE_FORMAT_BC7:
+            decompress_bc7_block(block, pixels);
+            break;
+        default:
+            ASSERT(!"Not a block compressed format");
+            break;
+    }
+}
+
+bool
+compress_image(image_t *dest, image_t *source, image_format_t format)
+{
+    if (source->format != IMAGE_FORMAT_RGBA8 || !is_compressed_format(format))
+    {
+        fprintf(stderr, "Can only compress RGBA8 images to block formats\n");
+        return false;
+    }
+    if (!allocate_image(dest, format, source->width, source->height, source->level_count)) return false;
+
+    uint32_t block_size = get_image_level_size(format, 4, 4);
+
+    for (int l = 0; l < source->level_count; ++l)
+    {
+        image_level_t *level = &source->levels[l];
+        uint8_t *pixels = source->data + level->offset;
+        uint8_t *blocks = dest->data + dest->levels[l].offset;
+
+        for (int by = 0; by < level->height; by += 4)
+        {
+            for (int bx = 0; bx < level->width; bx += 4)
+            {
+                // Levels that aren't a multiple of 4 repeat their edge pixels.
+                uint8_t block_pixels[16 * 4];
+                for (int y = 0; y < 4; ++y)
+                {
+                    int sy = by + y < level->height ? by + y : level->height - 1;
+                    for (int x = 0; x < 4; ++x)
+                    {
+                        int sx = bx + x < level->width ? bx + x : level->width - 1;
+                        memcpy(&block_pixels[(y * 4 + x) * 4], &pixels[(sy * level->width + sx) * 4], 4);
+                    }
+                }
+
+                compress_block(format, block_pixels, blocks);
+                blocks += block_size;
+            }
+        }
+    }
+    return true;
+}
+
+bool
+decompress_image(image_t *dest, image_t *source)
+{
+    if (!is_compressed_format(source->format))
+    {
+        fprintf(stderr, "Image isn't block compressed\n");
+        return false;
+    }
+    if (!allocate_image(dest, IMAGE_FORMAT_RGBA8, source->width, source->height, source->level_count)) return false;
+
+    uint32_t block_size = get_image_level_size(source->format, 4, 4);
+
+    for (int l = 0; l < source->level_count; ++l)
+    {
+        image_level_t *level = &dest->levels[l];
+        uint8_t *blocks = source->data + source->levels[l].offset;
+        uint8_t *pixels = dest->data + level->offset;
+
+        for (int by = 0; by < level->height; by += 4)
+        {
+            for (int bx = 0; bx < level->width; bx += 4)
+            {
+                uint8_t block_pixels[16 * 4];
+                decompress_block(source->format, blocks, block_pixels);
+                blocks += block_size;
+
+                for (int y = 0; y < 4 && by + y < level->height; ++y)
+                {
+                    for (int x = 0; x < 4 && bx + x < level->width; ++x)
+                    {
+                        memcpy(&pixels[((by + y) * level->width + bx + x) * 4], &block_pixels[(y * 4 + x) * 4], 4);
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,23 @@
+#ifndef TEXTURE_COMPRESSION_H
+#define TEXTURE_COMPRESSION_H
+
+#include <stdint.h>
+
+#include "image.h"
+
+// CPU block compression, so cooking textures needs no GPU, and decompression for GLs that can't
+// sample a format. BC1/BC3/BC5 cover everything their decoders can produce. BC7 is encoded
+// with the single subset modes only, 6 (RGBA endpoints, 4 bit indices) or 5 (separate alpha),
+// and decoding handles modes 4, 5 and 6. Blocks in the partitioned modes come out magenta.
+
+// source is RGBA8, every level is compressed.
+bool compress_image(image_t *dest, image_t *source, image_format_t format);
+
+// dest is RGBA8 with the same levels as source.
+bool decompress_image(image_t *dest, image_t *source);
+
+// 16 RGBA8 pixels in row order to one block, and back.
+void compress_block(image_format_t format, uint8_t *pixels, uint8_t *block);
+void decompress_block(image_format_t format, uint8_t *block, uint8_t *pixels);
+
+#endif
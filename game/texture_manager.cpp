@@ -0,0 +1,774 @@
+#include "texture_manager.h"
+#include "asset_loader.h"
+#include "texture_compression.h"
+#include "gl_state.h"
+#include "trace.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static uint64_t
+hash_path(char *path)
+{
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ull;
+    for (uint8_t *s = (uint8_t *)path; *s; ++s)
+    {
+        hash ^= *s;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static GLenum
+get_gl_internal_format(image_format_t format)
+{
+    switch (format)
+    {
+        case IMAGE_FORMAT_RGBA8: return GL_RGBA8;
+        case IMAGE_FORMAT_BC1: return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+        case IMAGE_FORMAT_BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case IMAGE_FORMAT_BC5: return GL_COMPRESSED_RG_RGTC2;
+        case IMAGE_FORMAT_BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+        default: return 0;
+    }
+}
+
+static bool
+is_format_supported(image_format_t format)
+{
+    switch (format)
+    {
+        case IMAGE_FORMAT_RGBA8: return true;
+        case IMAGE_FORMAT_BC1:
+        case IMAGE_FORMAT_BC3: return GLEW_EXT_texture_compression_s3tc != 0;
+        case IMAGE_FORMAT_BC5: return true; // RGTC is core since 3.0.
+        case IMAGE_FORMAT_BC7: return GLEW_VERSION_4_2 || GLEW_ARB_texture_compression_bptc;
+        default: return false;
+    }
+}
+
+// The finest level worth having, a texel per pixel of the footprint.
+static int
+get_wanted_level(int width, int height, int level_count, float pixels)
+{
+    if (pixels <= 0.0f) return 0;
+
+    int size = width > height ? width : height;
+    int level = (int)floorf(log2f(size / pixels));
+    if (level < 0) level = 0;
+    if (level > level_count - 1) level = level_count - 1;
+    return level;
+}
+
+// On the I/O thread. DDS and KTX seek to just the levels asked for, PNG and TGA can only be read
+// whole, the decode job skips making levels finer than the ones asked for.
+static void
+read_texture_file(void *data)
+{
+    texture_read_t *read = (texture_read_t *)data;
+    texture_manager_t *manager = read->manager;
+
+    // The path never changes once the texture exists, the decode fields not while this runs.
+    texture_t *texture = &manager->textures[read->index];
+    read->success = false;
+
+    FILE *file = fopen(texture->path, "rb");
+    if (file)
+    {
+        uint8_t header[IMAGE_LAYOUT_HEADER_SIZE];
+        uint32_t header_size = (uint32_t)fread(header, 1, sizeof(header), file);
+
+        image_layout_t layout;
+        if (read_image_layout(&layout, header, header_size))
+        {
+            int first_level = texture->decode_first_level;
+            if (first_level < 0) first_level = get_wanted_level(layout.width, layout.height, layout.level_count, texture->decode_pixels);
+            int level_count = texture->decode_level_count ? texture->decode_level_count : layout.level_count - first_level;
+
+            read->format = layout.format;
+            read->width = layout.width;
+            read->height = layout.height;
+            read->level_count = layout.level_count;
+            read->first_level = first_level;
+            read->success = read_image_levels(&read->image, file, &layout, first_level, level_count);
+        }
+        else
+        {
+            fseek(file, 0, SEEK_END);
+            long length = ftell(file);
+            fseek(file, 0, SEEK_SET);
+
+            if (length > 0 && length < UINT32_MAX)
+            {
+                read->file_data = (uint8_t *)malloc(length);
+                read->file_size = (uint32_t)length;
+                read->success = read->file_data && fread(read->file_data, 1, length, file) == (size_t)length;
+            }
+        }
+        fclose(file);
+    }
+
+    std::lock_guard<std::mutex> lock(manager->mutex);
+    manager->read_textures[manager->read_count++] = read->index;
+}
+
+static void
+decode_texture_job(void *data)
+{
+    TRACE_SCOPE("decode_texture");
+
+    texture_read_t *read = (texture_read_t *)data;
+    texture_manager_t *manager = read->manager;
+    texture_t *texture = &manager->textures[read->index];
+    image_t *image = &read->image;
+
+    if (read->file_data)
+    {
+        read->success = decode_image(image, read->file_data, read->file_size);
+        free(read->file_data);
+        read->file_data = NULL;
+
+        int first_level = texture->decode_first_level;
+        if (read->success)
+        {
+            read->format = image->format;
+            read->width = image->width;
+            read->height = image->height;
+            read->level_count = image->level_count;
+        }
+
+        if (read->success && image->format == IMAGE_FORMAT_RGBA8 && image->level_count == 1)
+        {
+            read->level_count = get_mip_level_count(image->width, image->height);
+            if (first_level < 0) first_level = get_wanted_level(image->width, image->height, read->level_count, texture->decode_pixels);
+            read->success = generate_image_mips(image, first_level);
+        }
+        else
+        {
+            // Only DDS and KTX come with levels of their own, and those aren't decoded here.
+            first_level = 0;
+        }
+
+        read->first_level = first_level;
+        int level_count = texture->decode_level_count;
+        if (read->success && level_count && level_count < image->level_count) image->level_count = level_count;
+    }
+
+    // Block compressed files this GL can't sample are expanded here rather than failing.
+    if (read->success && !manager->format_supported[image->format])
+    {
+        image_t expanded = {};
+        read->success = decompress_image(&expanded, image);
+        free_image(image);
+        *image = expanded;
+        read->format = IMAGE_FORMAT_RGBA8;
+    }
+}
+
+void
+init_texture_manager(texture_manager_t *manager, uint32_t upload_bytes_per_frame, uint64_t budget_bytes)
+{
+    manager->texture_count = 0;
+    memset(manager->hash_slots, 0, sizeof(manager->hash_slots));
+    manager->budget_bytes = budget_bytes;
+    manager->frame = 0;
+    manager->upload_count = 0;
+    manager->read_count = 0;
+    manager->decoding_count = 0;
+    manager->stats = {};
+
+    for (int i = 0; i < IMAGE_FORMAT_COUNT; ++i)
+    {
+        manager->format_supported[i] = is_format_supported((image_format_t)i);
+    }
+    manager->copy_supported = GLEW_VERSION_4_3 || GLEW_ARB_copy_image;
+
+    // Magenta and grey checkers, hard to miss.
+    uint32_t checker[4 * 4];
+    for (int i = 0; i < 16; ++i) checker[i] = ((i / 4 + i % 4) & 1) ? 0xFFFF00FF : 0xFF808080;
+
+    glGenTextures(1, &manager->placeholder);
+    bind_texture(0, GL_TEXTURE_2D, manager->placeholder);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 4, 4, 0, GL_RGBA, GL_UNSIGNED_BYTE, checker);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    init_stream_buffer(&manager->staging, GL_PIXEL_UNPACK_BUFFER, upload_bytes_per_frame);
+    bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void
+free_texture_manager(texture_manager_t *manager)
+{
+    // The asset loader is gone, so nothing is reading any more. Decodes still write into their reads.
+    for (uint32_t i = 0; i < manager->decoding_count; ++i) wait_for_jobs(&manager->decode_counters[manager->decoding_textures[i]]);
+    manager->decoding_count = 0;
+    manager->read_count = 0;
+
+    for (uint32_t i = 0; i < manager->texture_count; ++i)
+    {
+        texture_t *texture = &manager->textures[i];
+        free_image(&texture->read.image);
+        free(texture->read.file_data);
+        free_image(&texture->image);
+        if (texture->upload_texture && texture->upload_texture != texture->texture) delete_gl_texture(texture->upload_texture);
+        if (texture->texture) delete_gl_texture(texture->texture);
+        free(texture->path);
+    }
+    manager->texture_count = 0;
+
+    free_stream_buffer(&manager->staging);
+    delete_gl_texture(manager->placeholder);
+}
+
+// level_count 0 reads to the last level, first_level -1 picks it from the wanted footprint.
+static void
+queue_read(texture_manager_t *manager, uint32_t index, int first_level, int level_count, asset_priority_t priority)
+{
+    texture_t *texture = &manager->textures[index];
+    texture->decode_first_level = first_level;
+    texture->decode_level_count = level_count;
+    texture->decode_pixels = texture->wanted_pixels;
+
+    texture->read = {};
+    texture->read.manager = manager;
+    texture->read.index = index;
+
+    if (!queue_asset_io(read_texture_file, &texture->read, priority))
+    {
+        // Comes back as a failed read.
+        std::lock_guard<std::mutex> lock(manager->mutex);
+        manager->read_textures[manager->read_count++] = index;
+    }
+}
+
+texture_id_t
+load_texture(texture_manager_t *manager, char *filepath)
+{
+    uint64_t hash = hash_path(filepath);
+    uint32_t mask = ARRAY_SIZE(manager->hash_slots) - 1;
+
+    uint32_t slot = (uint32_t)hash & mask;
+    while (manager->hash_slots[slot])
+    {
+        texture_t *texture = &manager->textures[manager->hash_slots[slot] - 1];
+        if (texture->path_hash == hash && strcmp(texture->path, filepath) == 0) return manager->hash_slots[slot];
+
+        slot = (slot + 1) & mask;
+    }
+
+    if (manager->texture_count == TEXTURE_MANAGER_MAX_TEXTURES)
+    {
+        fprintf(stderr, "Out of texture slots loading '%s'.\n", filepath);
+        return 0;
+    }
+
+    uint32_t index = manager->texture_count++;
+    manager->hash_slots[slot] = index + 1;
+
+    texture_t *texture = &manager->textures[index];
+    *texture = {};
+
+    size_t length = strlen(filepath);
+    texture->path = (char *)malloc(length + 1);
+    memcpy(texture->path, filepath, length + 1);
+    texture->path_hash = hash;
+    texture->last_used_frame = manager->frame;
+
+    texture->state = TEXTURE_STATE_DECODING;
+    queue_read(manager, index, -1, 0, ASSET_PRIORITY_VISIBLE);
+    return index + 1;
+}
+
+GLuint
+get_texture(texture_manager_t *manager, texture_id_t id)
+{
+    if (!id || id > manager->texture_count) return manager->placeholder;
+
+    texture_t *texture = &manager->textures[id - 1];
+    texture->last_used_frame = manager->frame;
+
+    if (texture->state == TEXTURE_STATE_UNLOADED)
+    {
+        texture->state = TEXTURE_STATE_DECODING;
+        queue_read(manager, id - 1, -1, 0, ASSET_PRIORITY_VISIBLE);
+    }
+
+    return texture->texture && texture->base_level < texture->level_count - texture->first_level ? texture->texture : manager->placeholder;
+}
+
+texture_state_t
+get_texture_state(texture_manager_t *manager, texture_id_t id)
+{
+    if (!id || id > manager->texture_count) return TEXTURE_STATE_FAILED;
+    return manager->textures[id - 1].state;
+}
+
+float
+estimate_texture_pixels(vec3 center, float radius, float world_size, mat4 world_to_view, mat4 view_to_proj, float viewport_height)
+{
+    vec3 view_center = transform_point(world_to_view, center);
+
+    // Inside the bounds anything can be right in front of the camera.
+    float distance = -view_center.z - radius;
+    if (distance < 0.001f) return 1e9f;
+
+    float pixels_per_unit = view_to_proj._22 * 0.5f * viewport_height / distance;
+    return world_size * pixels_per_unit;
+}
+
+void
+request_texture_pixels(texture_manager_t *manager, texture_id_t id, float pixels)
+{
+    if (!id || id > manager->texture_count) return;
+
+    texture_t *texture = &manager->textures[id - 1];
+    if (pixels > texture->requested_pixels) texture->requested_pixels = pixels;
+}
+
+static int
+get_wanted_level(texture_t *texture)
+{
+    return get_wanted_level(texture->width, texture->height, texture->level_count, texture->wanted_pixels);
+}
+
+static int
+get_level_width(texture_t *texture, int level)
+{
+    int width = texture->width >> level;
+    return width ? width : 1;
+}
+
+static int
+get_level_height(texture_t *texture, int level)
+{
+    int height = texture->height >> level;
+    return height ? height : 1;
+}
+
+static uint32_t
+get_level_range_size(texture_t *texture, int first_level)
+{
+    uint32_t size = 0;
+    for (int i = first_level; i < texture->level_count; ++i)
+    {
+        size += get_image_level_size(texture->format, get_level_width(texture, i), get_level_height(texture, i));
+    }
+    return size;
+}
+
+// Creates a GL texture with storage for the levels from first_level on, the data comes later.
+static GLuint
+create_texture_storage(texture_t *texture, int first_level)
+{
+    if (!is_format_supported(texture->format))
+    {
+        fprintf(stderr, "'%s' uses a compressed format this GL can't sample.\n", texture->path);
+        return 0;
+    }
+
+    GLenum internal_format = get_gl_internal_format(texture->format);
+    int level_count = texture->level_count - first_level;
+
+    GLuint result;
+    glGenTextures(1, &result);
+    bind_texture(0, GL_TEXTURE_2D, result);
+
+    if (GLEW_ARB_texture_storage)
+    {
+        glTexStorage2D(GL_TEXTURE_2D, level_count, internal_format,
+                       get_level_width(texture, first_level), get_level_height(texture, first_level));
+    }
+    else
+    {
+        for (int i = 0; i < level_count; ++i)
+        {
+            int width = get_level_width(texture, first_level + i);
+            int height = get_level_height(texture, first_level + i);
+            if (is_compressed_format(texture->format))
+            {
+                glCompressedTexImage2D(GL_TEXTURE_2D, i, internal_format, width, height, 0,
+                                       get_image_level_size(texture->format, width, height), NULL);
+            }
+            else
+            {
+                glTexImage2D(GL_TEXTURE_2D, i, internal_format, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+            }
+        }
+    }
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level_count - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level_count - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    return result;
+}
+
+// Copies the file's levels from first_level on out of texture->texture into dest, whose level 0 is
+// the file's dest_first_level. Everything stays on the GPU.
+static void
+copy_resident_levels(texture_t *texture, GLuint dest, int dest_first_level, int first_level)
+{
+    for (int level = first_level; level < texture->level_count; ++level)
+    {
+        glCopyImageSubData(texture->texture, GL_TEXTURE_2D, level - texture->first_level, 0, 0, 0,
+                           dest, GL_TEXTURE_2D, level - dest_first_level, 0, 0, 0,
+                           get_level_width(texture, level), get_level_height(texture, level), 1);
+    }
+}
+
+// Uploads whole rows until staging is full. Returns true once every level is up.
+static bool
+upload_texture_rows(texture_manager_t *manager, texture_t *texture)
+{
+    image_t *image = &texture->image;
+    bool compressed = is_compressed_format(image->format);
+
+    while (texture->upload_level >= 0)
+    {
+        image_level_t *level = &image->levels[texture->upload_level];
+        uint32_t row_size = get_image_row_size(image->format, level->width);
+        int row_count = compressed ? (level->height + 3) / 4 : level->height;
+
+        // 16 covers both texel and block alignment.
+        uint32_t space = get_stream_buffer_space(&manager->staging, 16);
+        int rows = row_count - texture->upload_row;
+        if ((uint32_t)rows > space / row_size) rows = space / row_size;
+        if (rows <= 0) return false;
+
+        uint32_t size = rows * row_size;
+        uint32_t offset;
+        void *dest = map_stream_buffer(&manager->staging, size, 16, &offset);
+        if (!dest) return false;
+
+        memcpy(dest, image->data + level->offset + texture->upload_row * row_size, size);
+        unmap_stream_buffer(&manager->staging);
+
+        bind_buffer(GL_PIXEL_UNPACK_BUFFER, manager->staging.buffer);
+        bind_texture(0, GL_TEXTURE_2D, texture->upload_texture);
+
+        void *pixels = (void *)(uintptr_t)offset;
+        if (compressed)
+        {
+            int y = texture->upload_row * 4;
+            int height = rows * 4;
+            if (y + height > level->height) height = level->height - y;
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, texture->upload_level, 0, y, level->width, height,
+                                      get_gl_internal_format(image->format), size, pixels);
+        }
+        else
+        {
+            glTexSubImage2D(GL_TEXTURE_2D, texture->upload_level, 0, texture->upload_row, level->width, rows,
+                            GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+        }
+        manager->stats.uploaded_bytes += size;
+
+        texture->upload_row += rows;
+        if (texture->upload_row == row_count)
+        {
+            // The level is complete, let sampling reach it.
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, texture->upload_level);
+            if (texture->upload_texture == texture->texture) texture->base_level = texture->upload_level;
+
+            texture->upload_level--;
+            texture->upload_row = 0;
+        }
+    }
+
+    // A streamed range of levels replaces the old texture only now, so nothing ever samples a hole.
+    if (texture->upload_texture != texture->texture)
+    {
+        delete_gl_texture(texture->texture);
+        texture->texture = texture->upload_texture;
+        texture->first_level = texture->upload_first_level;
+        texture->memory_size = texture->upload_memory_size;
+        texture->base_level = 0;
+    }
+    texture->upload_texture = 0;
+
+    free_image(image);
+    texture->state = TEXTURE_STATE_RESIDENT;
+    return true;
+}
+
+// Moves the texture to the levels from first_level on, the current texture stays in use meanwhile.
+// Levels it already has are copied on the GPU, only the finer ones it lacks are read from the file.
+static void
+stream_texture_levels(texture_manager_t *manager, uint32_t index, int first_level)
+{
+    texture_t *texture = &manager->textures[index];
+    uint32_t memory_size = get_level_range_size(texture, first_level);
+
+    if (!manager->copy_supported)
+    {
+        texture->state = TEXTURE_STATE_STREAMING;
+        texture->upload_first_level = first_level;
+        texture->upload_memory_size = memory_size;
+        queue_read(manager, index, first_level, 0, ASSET_PRIORITY_NORMAL);
+        return;
+    }
+
+    if (first_level < texture->first_level)
+    {
+        texture->state = TEXTURE_STATE_STREAMING;
+        texture->upload_first_level = first_level;
+        texture->upload_memory_size = memory_size;
+        queue_read(manager, index, first_level, texture->first_level - first_level, ASSET_PRIORITY_NORMAL);
+        return;
+    }
+
+    // Dropping levels, the rest is all there already.
+    GLuint result = create_texture_storage(texture, first_level);
+    if (!result) return;
+
+    copy_resident_levels(texture, result, first_level, first_level);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+
+    delete_gl_texture(texture->texture);
+    texture->texture = result;
+    texture->first_level = first_level;
+    texture->memory_size = memory_size;
+    texture->base_level = 0;
+}
+
+static void
+evict_texture(texture_t *texture)
+{
+    delete_gl_texture(texture->texture);
+    texture->texture = 0;
+    texture->first_level = 0;
+    texture->base_level = texture->level_count;
+    texture->state = TEXTURE_STATE_UNLOADED;
+}
+
+// Memory a texture holds once whatever is in flight has landed.
+static uint32_t
+get_final_memory_size(texture_t *texture)
+{
+    if (texture->state == TEXTURE_STATE_STREAMING) return texture->upload_memory_size;
+    return texture->texture ? texture->memory_size : 0;
+}
+
+// A read is done and decoded, creates the texture for it or, when streaming, the one that replaces it.
+static void
+finish_texture_read(texture_manager_t *manager, uint32_t index)
+{
+    texture_t *texture = &manager->textures[index];
+    texture_read_t *read = &texture->read;
+    texture->image = read->image;
+    read->image = {};
+    bool streaming = texture->state == TEXTURE_STATE_STREAMING;
+
+    // Streaming relies on the file still having the levels it had.
+    if (read->success && streaming &&
+        (read->format != texture->format || read->width != texture->width ||
+         read->height != texture->height || read->level_count != texture->level_count ||
+         read->first_level != texture->upload_first_level))
+    {
+        fprintf(stderr, "Texture '%s' changed on disk.\n", texture->path);
+        read->success = false;
+    }
+
+    if (!read->success)
+    {
+        fprintf(stderr, "Failed to load texture '%s'.\n", texture->path);
+        free_image(&texture->image);
+        free(read->file_data);
+        read->file_data = NULL;
+
+        // A texture that has levels keeps them.
+        texture->state = streaming ? TEXTURE_STATE_RESIDENT : TEXTURE_STATE_FAILED;
+        return;
+    }
+
+    if (!streaming)
+    {
+        texture->format = read->format;
+        texture->width = read->width;
+        texture->height = read->height;
+        texture->level_count = read->level_count;
+        texture->upload_first_level = read->first_level;
+        texture->upload_memory_size = get_level_range_size(texture, texture->upload_first_level);
+    }
+
+    texture->upload_texture = create_texture_storage(texture, texture->upload_first_level);
+    if (!texture->upload_texture)
+    {
+        free_image(&texture->image);
+        texture->state = streaming ? TEXTURE_STATE_RESIDENT : TEXTURE_STATE_FAILED;
+        return;
+    }
+
+    // Whatever the file wasn't read for is already resident, the image only has the finer levels.
+    int read_level_count = texture->image.level_count;
+    if (streaming && read_level_count < texture->level_count - texture->upload_first_level)
+    {
+        copy_resident_levels(texture, texture->upload_texture, texture->upload_first_level,
+                             texture->upload_first_level + read_level_count);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, read_level_count);
+    }
+
+    texture->upload_level = read_level_count - 1;
+    texture->upload_row = 0;
+
+    if (!streaming)
+    {
+        texture->texture = texture->upload_texture;
+        texture->first_level = texture->upload_first_level;
+        texture->memory_size = texture->upload_memory_size;
+        texture->base_level = texture->level_count - texture->first_level;
+        texture->state = TEXTURE_STATE_UPLOADING;
+    }
+    manager->upload_queue[manager->upload_count++] = index;
+}
+
+void
+update_texture_manager(texture_manager_t *manager)
+{
+    manager->frame++;
+    manager->stats.uploaded_bytes = 0;
+    manager->stats.evicted_count = 0;
+
+    // Start decoding what the I/O thread has read, DDS and KTX in a format the GL samples need nothing more.
+    uint32_t read_textures[TEXTURE_MANAGER_MAX_TEXTURES];
+    uint32_t read_count;
+    {
+        std::lock_guard<std::mutex> lock(manager->mutex);
+        read_count = manager->read_count;
+        memcpy(read_textures, manager->read_textures, read_count * sizeof(uint32_t));
+        manager->read_count = 0;
+    }
+
+    for (uint32_t i = 0; i < read_count; ++i)
+    {
+        uint32_t index = read_textures[i];
+        texture_read_t *read = &manager->textures[index].read;
+        if (!read->success || (!read->file_data && manager->format_supported[read->image.format]))
+        {
+            finish_texture_read(manager, index);
+            continue;
+        }
+
+        job_t *job = &manager->decode_jobs[index];
+        job->proc = decode_texture_job;
+        job->data = read;
+        run_jobs(job, 1, &manager->decode_counters[index]);
+        manager->decoding_textures[manager->decoding_count++] = index;
+    }
+
+    // The GL work for finished decodes is done here, so the jobs never wait on it.
+    for (uint32_t i = 0; i < manager->decoding_count; ++i)
+    {
+        uint32_t index = manager->decoding_textures[i];
+        if (manager->decode_counters[index].count.load(std::memory_order_acquire) > 0) continue;
+
+        manager->decoding_textures[i--] = manager->decoding_textures[--manager->decoding_count];
+        finish_texture_read(manager, index);
+    }
+
+    if (manager->upload_count)
+    {
+        begin_stream_buffer_frame(&manager->staging);
+
+        uint32_t remaining = 0;
+        bool staging_full = false;
+        for (uint32_t i = 0; i < manager->upload_count; ++i)
+        {
+            uint32_t index = manager->upload_queue[i];
+            if (staging_full || !upload_texture_rows(manager, &manager->textures[index]))
+            {
+                staging_full = true;
+                manager->upload_queue[remaining++] = index;
+            }
+        }
+        manager->upload_count = remaining;
+
+        end_stream_buffer_frame(&manager->staging);
+
+        // Everything else uploads from client memory.
+        bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    // The budget is kept against what textures will hold once streaming finishes. One that is
+    // streaming briefly holds both ranges of levels.
+    uint64_t final_bytes = 0;
+    for (uint32_t i = 0; i < manager->texture_count; ++i)
+    {
+        texture_t *texture = &manager->textures[i];
+        if (texture->requested_pixels > 0.0f)
+        {
+            texture->wanted_pixels = texture->requested_pixels;
+            texture->requested_pixels = 0.0f;
+        }
+        final_bytes += get_final_memory_size(texture);
+    }
+
+    // Over budget, first drop levels finer than the footprint needs...
+    for (uint32_t i = 0; i < manager->texture_count && final_bytes > manager->budget_bytes; ++i)
+    {
+        texture_t *texture = &manager->textures[i];
+        if (texture->state != TEXTURE_STATE_RESIDENT) continue;
+
+        int wanted_level = get_wanted_level(texture);
+        if (wanted_level <= texture->first_level) continue;
+
+        // Done on the spot when the levels can be copied, otherwise once the file is read again.
+        uint32_t memory_size = texture->memory_size;
+        stream_texture_levels(manager, i, wanted_level);
+        final_bytes -= memory_size - get_final_memory_size(texture);
+    }
+
+    // ...then the least recently used textures, never ones used this frame.
+    while (final_bytes > manager->budget_bytes)
+    {
+        texture_t *oldest = NULL;
+        for (uint32_t i = 0; i < manager->texture_count; ++i)
+        {
+            texture_t *texture = &manager->textures[i];
+            if (texture->state != TEXTURE_STATE_RESIDENT || texture->last_used_frame + 1 >= manager->frame) continue;
+            if (!oldest || texture->last_used_frame < oldest->last_used_frame) oldest = texture;
+        }
+        if (!oldest) break;
+
+        final_bytes -= oldest->memory_size;
+        manager->stats.evicted_count++;
+        evict_texture(oldest);
+    }
+
+    // Stream in the finer levels textures in use need, as many as fit.
+    for (uint32_t i = 0; i < manager->texture_count; ++i)
+    {
+        texture_t *texture = &manager->textures[i];
+        if (texture->state != TEXTURE_STATE_RESIDENT || texture->last_used_frame + 1 < manager->frame) continue;
+
+        for (int level = get_wanted_level(texture); level < texture->first_level; ++level)
+        {
+            uint32_t size = get_level_range_size(texture, level);
+            if (final_bytes - texture->memory_size + size > manager->budget_bytes) continue;
+
+            final_bytes += size - texture->memory_size;
+            stream_texture_levels(manager, i, level);
+            break;
+        }
+    }
+
+    texture_manager_stats_t *stats = &manager->stats;
+    stats->resident_count = 0;
+    stats->pending_count = 0;
+    stats->streaming_count = 0;
+    stats->resident_bytes = 0;
+    for (uint32_t i = 0; i < manager->texture_count; ++i)
+    {
+        texture_t *texture = &manager->textures[i];
+        if (texture->state == TEXTURE_STATE_RESIDENT || texture->state == TEXTURE_STATE_STREAMING) stats->resident_count++;
+        if (texture->state == TEXTURE_STATE_DECODING || texture->state == TEXTURE_STATE_UPLOADING) stats->pending_count++;
+        if (texture->state == TEXTURE_STATE_STREAMING) stats->streaming_count++;
+        if (texture->texture) stats->resident_bytes += texture->memory_size;
+        if (texture->upload_texture && texture->upload_texture != texture->texture) stats->resident_bytes += texture->upload_memory_size;
+    }
+}
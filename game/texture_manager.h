@@ -0,0 +1,188 @@
+#ifndef TEXTURE_MANAGER_H
+#define TEXTURE_MANAGER_H
+
+#include <GL/glew.h>
+#include <stdint.h>
+#include <mutex>
+
+#include "image.h"
+#include "jobs.h"
+#include "stream_buffer.h"
+#include "my_math.h"
+
+// Loads textures in the background. Files are read on the asset loader's I/O thread, in priority
+// order with everything else being read, and decoded in jobs that also build missing mips. The GL
+// thread only copies finished levels into a staging ring of pixel unpack buffers and issues the
+// uploads, a fixed number of bytes per frame. Levels go up coarsest first, so a texture is
+// usable (blurry) long before its top level arrives. Until then get_texture hands out a placeholder.
+//
+// Textures are looked up by path, asking twice gives the same texture. Resident textures that
+// haven't been used for a while are dropped when the total goes over the memory budget, and
+// reloaded the next time they are asked for.
+//
+// Mips are streamed by screen size: callers estimate how many pixels a texture covers from the
+// bounds of what it's drawn on and request that, and only the levels that footprint needs are
+// kept on the GPU. Finer levels are streamed in as the camera gets closer: DDS and KTX read just
+// those levels' bytes, PNG and TGA filter straight down to the finest one wanted, and the levels
+// already resident are copied over on the GPU. When the budget runs short finer levels are dropped
+// by copying the rest into a smaller texture, without touching the file. Without copy_image both
+// go through the file instead. Textures nobody requested keep every level.
+
+#define TEXTURE_MANAGER_MAX_TEXTURES 1024
+
+// 0 is never a valid id.
+typedef uint32_t texture_id_t;
+
+enum texture_state_t
+{
+    TEXTURE_STATE_UNLOADED,
+    TEXTURE_STATE_DECODING,
+    TEXTURE_STATE_UPLOADING,
+    TEXTURE_STATE_RESIDENT,
+    TEXTURE_STATE_STREAMING, // Resident, and a different range of levels is on its way.
+    TEXTURE_STATE_FAILED,
+};
+
+struct texture_manager_t;
+
+struct texture_read_t
+{
+    texture_manager_t *manager;
+    uint32_t index;
+    bool success;
+
+    // DDS and KTX levels are read straight into image. PNG and TGA are read whole into file_data,
+    // the decode job turns that into image.
+    uint8_t *file_data;
+    uint32_t file_size;
+    image_t image;
+
+    // The whole file, after decompressing what the GL can't sample. image starts at first_level.
+    image_format_t format;
+    int width;
+    int height;
+    int level_count;
+    int first_level;
+};
+
+struct texture_t
+{
+    char *path;
+    uint64_t path_hash;
+    texture_state_t state;
+
+    GLuint texture;
+    image_format_t format;
+    int width;
+    int height;
+    int level_count;
+
+    // Level of the file that is level 0 of texture, the finer ones aren't loaded.
+    int first_level;
+    uint32_t memory_size;
+
+    // What a read is asked for: decode_level_count levels from decode_first_level on, 0 for all
+    // the rest. A decode_first_level of -1 leaves it to decode_pixels once the size is known.
+    // Written before queueing and left alone until the result is back.
+    int decode_first_level;
+    int decode_level_count;
+    float decode_pixels;
+
+    // The read in flight, filled in on the I/O thread and then by the decode job.
+    texture_read_t read;
+
+    // While uploading, the decoded levels from upload_first_level on, the GL texture being filled
+    // and how far it got: levels count down from the coarsest, rows are pixel rows or block rows.
+    // When streaming, that is a new texture holding the new range of levels, the ones the file
+    // wasn't read for are copied from texture, and it replaces texture once complete.
+    image_t image;
+    GLuint upload_texture;
+    int upload_first_level;
+    uint32_t upload_memory_size;
+    int upload_level;
+    int upload_row;
+
+    // Finest level of texture with data, past the last one while nothing is uploaded yet.
+    int base_level;
+
+    // Largest screen footprint in pixels requested this frame, and the one the levels follow.
+    // 0 means no request, which wants every level.
+    float requested_pixels;
+    float wanted_pixels;
+
+    uint32_t last_used_frame;
+};
+
+struct texture_manager_stats_t
+{
+    uint32_t resident_count;
+    uint32_t pending_count;
+    uint64_t resident_bytes;
+    uint32_t uploaded_bytes; // This frame.
+    uint32_t evicted_count; // This frame.
+    uint32_t streaming_count;
+};
+
+struct texture_manager_t
+{
+    texture_t textures[TEXTURE_MANAGER_MAX_TEXTURES];
+    uint32_t texture_count;
+
+    // Open addressing, path hash to index + 1.
+    uint32_t hash_slots[TEXTURE_MANAGER_MAX_TEXTURES * 2];
+
+    // Read by the decode jobs, they decompress anything the GL can't sample to RGBA8.
+    bool format_supported[IMAGE_FORMAT_COUNT];
+
+    // glCopyImageSubData, to move resident levels between textures instead of reading them again.
+    bool copy_supported;
+
+    GLuint placeholder;
+    stream_buffer_t staging;
+    uint64_t budget_bytes;
+    uint32_t frame;
+
+    // Textures with levels left to upload, oldest first.
+    uint32_t upload_queue[TEXTURE_MANAGER_MAX_TEXTURES];
+    uint32_t upload_count;
+
+    // Textures the I/O thread is done reading, guarded by mutex.
+    std::mutex mutex;
+    uint32_t read_textures[TEXTURE_MANAGER_MAX_TEXTURES];
+    uint32_t read_count;
+
+    // Textures being decoded, GL thread only. Jobs and counters by texture index.
+    uint32_t decoding_textures[TEXTURE_MANAGER_MAX_TEXTURES];
+    uint32_t decoding_count;
+    job_t decode_jobs[TEXTURE_MANAGER_MAX_TEXTURES];
+    job_counter_t decode_counters[TEXTURE_MANAGER_MAX_TEXTURES];
+
+    texture_manager_stats_t stats;
+};
+
+// upload_bytes_per_frame sizes the staging ring, budget_bytes is the resident memory to aim for.
+// Reads go through the asset loader, so it has to be initialized first, and freed first so
+// nothing is still reading into the manager.
+void init_texture_manager(texture_manager_t *manager, uint32_t upload_bytes_per_frame, uint64_t budget_bytes);
+void free_texture_manager(texture_manager_t *manager);
+
+// Starts loading if it isn't already, returns 0 when out of slots.
+texture_id_t load_texture(texture_manager_t *manager, char *filepath);
+
+// The GL texture to bind for id this frame, the placeholder while nothing is uploaded yet.
+GLuint get_texture(texture_manager_t *manager, texture_id_t id);
+
+texture_state_t get_texture_state(texture_manager_t *manager, texture_id_t id);
+
+// Pixels across one repeat of a texture that spans world_size units on the surface of a bounding
+// sphere, measured at the sphere's nearest point. Same estimate as select_mesh_lod.
+float estimate_texture_pixels(vec3 center, float radius, float world_size, mat4 world_to_view, mat4 view_to_proj, float viewport_height);
+
+// Asks for enough levels to cover pixels on screen, the largest request in a frame wins.
+void request_texture_pixels(texture_manager_t *manager, texture_id_t id, float pixels);
+
+// Once per frame on the GL thread: takes decoded textures, uploads what fits into staging, drops
+// levels and textures down to the budget and starts streaming the levels requests need.
+void update_texture_manager(texture_manager_t *manager);
+
+#endif
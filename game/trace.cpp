@@ -0,0 +1,201 @@
+#include "trace.h"
+
+#if TRACE
+
+#include "utils.h"
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mutex>
+
+// Atomic only so the dump may read a slot while it's being overwritten, all of it is relaxed.
+struct trace_event_t
+{
+    std::atomic<char *> name;
+    std::atomic<uint64_t> begin;
+    std::atomic<uint64_t> end;
+};
+
+struct trace_event_copy_t
+{
+    char *name;
+    uint64_t begin;
+    uint64_t end;
+};
+
+// Written only by its thread. count only grows, event i lives at i % TRACE_EVENTS_PER_THREAD.
+struct trace_thread_t
+{
+    trace_event_t events[TRACE_EVENTS_PER_THREAD];
+    std::atomic<uint64_t> count;
+    std::atomic<char *> name;
+    uint32_t id;
+};
+
+std::atomic<bool> trace_enabled(true);
+
+// Threads register once, the first time they trace anything, and are never freed: a thread
+// that exited still has events worth dumping.
+static std::mutex threads_mutex;
+static trace_thread_t *threads[TRACE_MAX_THREADS];
+static std::atomic<uint32_t> thread_count;
+
+static thread_local trace_thread_t *this_thread;
+static thread_local bool this_thread_failed;
+
+uint64_t
+get_trace_ticks()
+{
+    return glfwGetTimerValue();
+}
+
+static trace_thread_t *
+get_this_thread()
+{
+    if (this_thread || this_thread_failed) return this_thread;
+
+    std::lock_guard<std::mutex> lock(threads_mutex);
+
+    uint32_t index = thread_count.load(std::memory_order_relaxed);
+    if (index == TRACE_MAX_THREADS)
+    {
+        this_thread_failed = true;
+        return NULL;
+    }
+
+    trace_thread_t *thread = (trace_thread_t *)calloc(1, sizeof(trace_thread_t));
+    if (!thread)
+    {
+        this_thread_failed = true;
+        return NULL;
+    }
+    thread->id = index + 1;
+
+    threads[index] = thread;
+    thread_count.store(index + 1, std::memory_order_release);
+
+    this_thread = thread;
+    return thread;
+}
+
+void
+add_trace_event(char *name, uint64_t begin_ticks, uint64_t end_ticks)
+{
+    trace_thread_t *thread = get_this_thread();
+    if (!thread) return;
+
+    // Only this thread writes count, the release store makes the event visible before it. The fence
+    // keeps the slot stores from being seen ahead of the previous count, so dump_trace can tell when
+    // a slot it copied was being overwritten.
+    uint64_t count = thread->count.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    trace_event_t *event = &thread->events[count % TRACE_EVENTS_PER_THREAD];
+    event->name.store(name, std::memory_order_relaxed);
+    event->begin.store(begin_ticks, std::memory_order_relaxed);
+    event->end.store(end_ticks, std::memory_order_relaxed);
+    thread->count.store(count + 1, std::memory_order_release);
+}
+
+void
+set_trace_thread_name(char *name)
+{
+    trace_thread_t *thread = get_this_thread();
+    if (thread) thread->name.store(name, std::memory_order_relaxed);
+}
+
+void
+set_trace_enabled(bool enabled)
+{
+    trace_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+// Names are literals in our code, escaping quotes and backslashes is all it takes.
+static void
+write_json_string(FILE *file, char *s)
+{
+    fputc('"', file);
+    for (; *s; ++s)
+    {
+        if (*s == '"' || *s == '\\') fputc('\\', file);
+        fputc(*s, file);
+    }
+    fputc('"', file);
+}
+
+bool
+dump_trace(char *filepath)
+{
+    FILE *file = fopen(filepath, "w");
+    if (!file)
+    {
+        fprintf(stderr, "Could not open '%s' for writing.\n", filepath);
+        return false;
+    }
+
+    double ticks_to_us = 1e6 / (double)glfwGetTimerFrequency();
+    trace_event_copy_t *copy = (trace_event_copy_t *)malloc(TRACE_EVENTS_PER_THREAD * sizeof(trace_event_copy_t));
+    if (!copy)
+    {
+        fclose(file);
+        return false;
+    }
+    uint64_t event_count = 0;
+    bool first_event = true;
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    uint32_t count = thread_count.load(std::memory_order_acquire);
+    for (uint32_t t = 0; t < count; ++t)
+    {
+        trace_thread_t *thread = threads[t];
+
+        char *name = thread->name.load(std::memory_order_relaxed);
+        if (name)
+        {
+            fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", first_event ? "" : ",\n", thread->id);
+            write_json_string(file, name);
+            fprintf(file, "}}");
+            first_event = false;
+        }
+
+        // The thread keeps writing while we copy. Whatever it may have overwritten in the
+        // meantime, including the slot it may be halfway through, is thrown away afterwards.
+        uint64_t end = thread->count.load(std::memory_order_acquire);
+        uint64_t begin = end > TRACE_EVENTS_PER_THREAD ? end - TRACE_EVENTS_PER_THREAD : 0;
+        for (uint64_t i = begin; i < end; ++i)
+        {
+            trace_event_t *event = &thread->events[i % TRACE_EVENTS_PER_THREAD];
+            copy[i - begin].name = event->name.load(std::memory_order_relaxed);
+            copy[i - begin].begin = event->begin.load(std::memory_order_relaxed);
+            copy[i - begin].end = event->end.load(std::memory_order_relaxed);
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t now = thread->count.load(std::memory_order_relaxed) + 1;
+        uint64_t first_valid = now > TRACE_EVENTS_PER_THREAD ? now - TRACE_EVENTS_PER_THREAD : 0;
+        if (first_valid < begin) first_valid = begin;
+
+        for (uint64_t i = first_valid; i < end; ++i)
+        {
+            trace_event_copy_t *event = &copy[i - begin];
+            fprintf(file, "%s{\"name\":", first_event ? "" : ",\n");
+            write_json_string(file, event->name);
+            fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                    thread->id, event->begin * ticks_to_us, (event->end - event->begin) * ticks_to_us);
+            first_event = false;
+            event_count++;
+        }
+    }
+
+    fprintf(file, "\n]}\n");
+    fclose(file);
+    free(copy);
+
+    printf("Wrote %llu events from %u threads to '%s'.\n", (unsigned long long)event_count, count, filepath);
+    return true;
+}
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <atomic>
+
+// CPU instrumentation for any thread, dumped as Chrome trace JSON (chrome://tracing, or
+// ui.perfetto.dev). Every thread writes finished scopes into its own ring of events, nothing is
+// shared on the way in, so scopes are cheap enough to leave in release builds. When tracing is
+// switched off a scope is a single relaxed load, and defining TRACE to 0 compiles them out.
+
+#ifndef TRACE
+#define TRACE 1
+#endif
+
+// Per thread, the oldest events are overwritten.
+#define TRACE_EVENTS_PER_THREAD 16384
+#define TRACE_MAX_THREADS 64
+
+#if TRACE
+
+extern std::atomic<bool> trace_enabled;
+
+uint64_t get_trace_ticks();
+
+// name is kept as a pointer, use string literals.
+void add_trace_event(char *name, uint64_t begin_ticks, uint64_t end_ticks);
+
+// Shows up as the thread's name in the viewer, also a literal.
+void set_trace_thread_name(char *name);
+
+void set_trace_enabled(bool enabled);
+
+// Writes every thread's events, safe while other threads keep tracing.
+bool dump_trace(char *filepath);
+
+struct trace_scope_t
+{
+    char *name;
+    uint64_t begin;
+
+    trace_scope_t(char *scope_name)
+    {
+        name = scope_name;
+        begin = trace_enabled.load(std::memory_order_relaxed) ? get_trace_ticks() : 0;
+    }
+
+    ~trace_scope_t()
+    {
+        if (begin) add_trace_event(name, begin, get_trace_ticks());
+    }
+};
+
+#define TRACE_JOIN2(a, b) a##b
+#define TRACE_JOIN(a, b) TRACE_JOIN2(a, b)
+
+// Traces the rest of the enclosing block.
+#define TRACE_SCOPE(name) trace_scope_t TRACE_JOIN(trace_scope_, __LINE__)(name)
+
+#else
+
+#define TRACE_SCOPE(...)
+#define set_trace_thread_name(...)
+#define set_trace_enabled(...)
+#define dump_trace(...) false
+
+#endif
+
+#endif
@@ -0,0 +1,699 @@
+#include "truetype.h"
+#include "utils.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// Everything in a TrueType file is big endian.
+static uint16_t
+read_u16(uint8_t *p)
+{
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static int16_t
+read_s16(uint8_t *p)
+{
+    return (int16_t)read_u16(p);
+}
+
+static uint32_t
+read_u32(uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint32_t
+find_table(uint8_t *data, uint32_t size, char *tag)
+{
+    uint32_t table_count = read_u16(data + 4);
+    for (uint32_t i = 0; i < table_count; ++i)
+    {
+        uint8_t *record = data + 12 + i * 16;
+        if (12 + (i + 1) * 16 > size) break;
+
+        if (memcmp(record, tag, 4) == 0)
+        {
+            uint32_t offset = read_u32(record + 8);
+            uint32_t length = read_u32(record + 12);
+            if (offset + length > size) return 0;
+            return offset;
+        }
+    }
+    return 0;
+}
+
+bool
+init_truetype_font(truetype_font_t *font, uint8_t *data, uint32_t size)
+{
+    *font = {};
+
+    if (size < 12) return false;
+
+    // TrueType outlines only, 'OTTO' would be CFF.
+    uint32_t version = read_u32(data);
+    if (version != 0x00010000 && version != 0x74727565) return false;
+
+    font->data = data;
+    font->size = size;
+
+    uint32_t head = find_table(data, size, "head");
+    uint32_t hhea = find_table(data, size, "hhea");
+    uint32_t maxp = find_table(data, size, "maxp");
+    uint32_t cmap = find_table(data, size, "cmap");
+    font->loca = find_table(data, size, "loca");
+    font->glyf = find_table(data, size, "glyf");
+    font->hmtx = find_table(data, size, "hmtx");
+    font->kern = find_table(data, size, "kern");
+
+    if (!head || !hhea || !maxp || !cmap || !font->loca || !font->glyf || !font->hmtx) return false;
+
+    font->units_per_em = read_u16(data + head + 18);
+    font->bounds_min_x = read_s16(data + head + 36);
+    font->bounds_min_y = read_s16(data + head + 38);
+    font->bounds_max_x = read_s16(data + head + 40);
+    font->bounds_max_y = read_s16(data + head + 42);
+    font->index_to_loc_format = read_s16(data + head + 50);
+
+    font->ascent = read_s16(data + hhea + 4);
+    font->descent = read_s16(data + hhea + 6);
+    font->line_gap = read_s16(data + hhea + 8);
+    font->number_of_hmetrics = read_u16(data + hhea + 34);
+
+    font->glyph_count = read_u16(data + maxp + 4);
+
+    // Pick a Unicode subtable, full repertoire first.
+    uint32_t subtable_count = read_u16(data + cmap + 2);
+    uint32_t best = 0;
+    int best_rank = 0;
+    for (uint32_t i = 0; i < subtable_count; ++i)
+    {
+        uint8_t *record = data + cmap + 4 + i * 8;
+        uint16_t platform = read_u16(record);
+        uint16_t encoding = read_u16(record + 2);
+        uint32_t offset = cmap + read_u32(record + 4);
+        uint16_t format = read_u16(data + offset);
+
+        int rank = 0;
+        if (format == 12 && (platform == 0 || (platform == 3 && encoding == 10))) rank = 3;
+        else if (format == 4 && platform == 3 && encoding == 1) rank = 2;
+        else if (format == 4 && platform == 0) rank = 1;
+
+        if (rank > best_rank)
+        {
+            best = offset;
+            best_rank = rank;
+        }
+    }
+
+    if (!best) return false;
+    font->cmap = best;
+
+    return true;
+}
+
+uint32_t
+find_glyph_index(truetype_font_t *font, uint32_t codepoint)
+{
+    uint8_t *table = font->data + font->cmap;
+    uint16_t format = read_u16(table);
+
+    if (format == 4)
+    {
+        if (codepoint > 0xFFFF) return 0;
+
+        uint32_t segment_count = read_u16(table + 6) / 2;
+        uint8_t *end_codes = table + 14;
+        uint8_t *start_codes = end_codes + segment_count * 2 + 2;
+        uint8_t *deltas = start_codes + segment_count * 2;
+        uint8_t *range_offsets = deltas + segment_count * 2;
+
+        // Binary search for the first segment ending at or after codepoint.
+        uint32_t lo = 0;
+        uint32_t hi = segment_count;
+        while (lo < hi)
+        {
+            uint32_t mid = (lo + hi) / 2;
+            if (read_u16(end_codes + mid * 2) < codepoint) lo = mid + 1;
+            else hi = mid;
+        }
+        if (lo == segment_count) return 0;
+
+        uint16_t start = read_u16(start_codes + lo * 2);
+        if (start > codepoint) return 0;
+
+        uint16_t delta = read_u16(deltas + lo * 2);
+        uint16_t range_offset = read_u16(range_offsets + lo * 2);
+        if (!range_offset) return (codepoint + delta) & 0xFFFF;
+
+        uint8_t *glyph = range_offsets + lo * 2 + range_offset + (codepoint - start) * 2;
+        uint16_t result = read_u16(glyph);
+        return result ? (result + delta) & 0xFFFF : 0;
+    }
+    else if (format == 12)
+    {
+        uint32_t group_count = read_u32(table + 12);
+        uint8_t *groups = table + 16;
+
+        uint32_t lo = 0;
+        uint32_t hi = group_count;
+        while (lo < hi)
+        {
+            uint32_t mid = (lo + hi) / 2;
+            uint8_t *group = groups + mid * 12;
+            uint32_t start = read_u32(group);
+            uint32_t end = read_u32(group + 4);
+
+            if (codepoint < start) hi = mid;
+            else if (codepoint > end) lo = mid + 1;
+            else return read_u32(group + 8) + (codepoint - start);
+        }
+    }
+
+    return 0;
+}
+
+float
+get_truetype_scale(truetype_font_t *font, float pixel_height)
+{
+    return pixel_height / (float)(font->ascent - font->descent);
+}
+
+void
+get_glyph_hmetrics(truetype_font_t *font, uint32_t glyph, int *advance, int *left_side_bearing)
+{
+    uint8_t *hmtx = font->data + font->hmtx;
+    uint32_t count = font->number_of_hmetrics;
+
+    // Glyphs past the last full metric share its advance and only store a bearing.
+    if (glyph < count)
+    {
+        if (advance) *advance = read_u16(hmtx + glyph * 4);
+        if (left_side_bearing) *left_side_bearing = read_s16(hmtx + glyph * 4 + 2);
+    }
+    else
+    {
+        if (advance) *advance = read_u16(hmtx + (count - 1) * 4);
+        if (left_side_bearing) *left_side_bearing = read_s16(hmtx + count * 4 + (glyph - count) * 2);
+    }
+}
+
+int
+get_glyph_kerning(truetype_font_t *font, uint32_t left_glyph, uint32_t right_glyph)
+{
+    if (!font->kern) return 0;
+
+    uint8_t *kern = font->data + font->kern;
+    if (read_u16(kern) != 0 || read_u16(kern + 2) < 1) return 0;
+
+    // Only the first subtable, and only if it is horizontal format 0.
+    uint8_t *subtable = kern + 4;
+    uint16_t coverage = read_u16(subtable + 4);
+    if ((coverage & 0xFF01) != 0x0001) return 0;
+
+    uint32_t pair_count = read_u16(subtable + 6);
+    uint8_t *pairs = subtable + 14;
+    uint32_t key = (left_glyph << 16) | right_glyph;
+
+    uint32_t lo = 0;
+    uint32_t hi = pair_count;
+    while (lo < hi)
+    {
+        uint32_t mid = (lo + hi) / 2;
+        uint32_t mid_key = read_u32(pairs + mid * 6);
+
+        if (key < mid_key) hi = mid;
+        else if (key > mid_key) lo = mid + 1;
+        else return read_s16(pairs + mid * 6 + 4);
+    }
+
+    return 0;
+}
+
+// Returns the glyph's offset into glyf, or 0 with *length 0 for empty glyphs.
+static uint32_t
+get_glyph_offset(truetype_font_t *font, uint32_t glyph, uint32_t *length)
+{
+    *length = 0;
+    if (glyph >= font->glyph_count) return 0;
+
+    uint8_t *loca = font->data + font->loca;
+    uint32_t start, end;
+    if (font->index_to_loc_format == 0)
+    {
+        start = read_u16(loca + glyph * 2) * 2;
+        end = read_u16(loca + glyph * 2 + 2) * 2;
+    }
+    else
+    {
+        start = read_u32(loca + glyph * 4);
+        end = read_u32(loca + glyph * 4 + 4);
+    }
+
+    if (end <= start) return 0;
+
+    *length = end - start;
+    return font->glyf + start;
+}
+
+void
+get_glyph_bitmap_box(truetype_font_t *font, uint32_t glyph, float scale, int *x0, int *y0, int *x1, int *y1)
+{
+    uint32_t length;
+    uint32_t offset = get_glyph_offset(font, glyph, &length);
+    if (!length)
+    {
+        *x0 = *y0 = *x1 = *y1 = 0;
+        return;
+    }
+
+    uint8_t *header = font->data + offset;
+    float min_x = read_s16(header + 2) * scale;
+    float min_y = read_s16(header + 4) * scale;
+    float max_x = read_s16(header + 6) * scale;
+    float max_y = read_s16(header + 8) * scale;
+
+    *x0 = (int)floorf(min_x);
+    *y0 = (int)floorf(-max_y);
+    *x1 = (int)ceilf(max_x);
+    *y1 = (int)ceilf(-min_y);
+}
+
+//
+// Outlines
+//
+
+struct outline_line_t
+{
+    float x0, y0;
+    float x1, y1;
+};
+
+struct outline_t
+{
+    outline_line_t *lines;
+    uint32_t line_count;
+    uint32_t line_capacity;
+
+    // Font units to bitmap pixels: x' = a*x + b*y + e, y' = c*x + d*y + f.
+    float a, b, c, d, e, f;
+};
+
+static void
+add_line(outline_t *outline, float x0, float y0, float x1, float y1)
+{
+    if (outline->line_count == outline->line_capacity)
+    {
+        outline->line_capacity = outline->line_capacity ? outline->line_capacity * 2 : 256;
+        outline->lines = (outline_line_t *)realloc(outline->lines, outline->line_capacity * sizeof(outline_line_t));
+    }
+
+    outline_line_t *line = &outline->lines[outline->line_count++];
+    line->x0 = x0;
+    line->y0 = y0;
+    line->x1 = x1;
+    line->y1 = y1;
+}
+
+static void
+add_quadratic(outline_t *outline, float x0, float y0, float cx, float cy, float x1, float y1)
+{
+    // The second difference bounds how far the curve strays from its chord.
+    float ddx = x0 - 2.0f * cx + x1;
+    float ddy = y0 - 2.0f * cy + y1;
+    int steps = 1 + (int)sqrtf(sqrtf(ddx*ddx + ddy*ddy) * 3.0f);
+    if (steps > 16) steps = 16;
+
+    float px = x0;
+    float py = y0;
+    for (int i = 1; i <= steps; ++i)
+    {
+        float t = (float)i / (float)steps;
+        float mt = 1.0f - t;
+        float x = mt*mt*x0 + 2.0f*mt*t*cx + t*t*x1;
+        float y = mt*mt*y0 + 2.0f*mt*t*cy + t*t*y1;
+        add_line(outline, px, py, x, y);
+        px = x;
+        py = y;
+    }
+}
+
+struct outline_point_t
+{
+    float x, y;
+    bool on_curve;
+};
+
+static void
+add_contour(outline_t *outline, outline_point_t *points, int count)
+{
+    if (count < 2) return;
+
+    // Start on an on-curve point, or the midpoint of two off-curve ones.
+    int first = 0;
+    while (first < count && !points[first].on_curve) first++;
+
+    float start_x, start_y;
+    if (first == count)
+    {
+        start_x = (points[0].x + points[1].x) * 0.5f;
+        start_y = (points[0].y + points[1].y) * 0.5f;
+        first = 0;
+    }
+    else
+    {
+        start_x = points[first].x;
+        start_y = points[first].y;
+        first++;
+    }
+
+    float x = start_x;
+    float y = start_y;
+    bool has_control = false;
+    float cx = 0.0f, cy = 0.0f;
+
+    for (int i = 0; i < count; ++i)
+    {
+        outline_point_t *p = &points[(first + i) % count];
+
+        if (p->on_curve)
+        {
+            if (has_control) add_quadratic(outline, x, y, cx, cy, p->x, p->y);
+            else add_line(outline, x, y, p->x, p->y);
+
+            x = p->x;
+            y = p->y;
+            has_control = false;
+        }
+        else
+        {
+            if (has_control)
+            {
+                // Two controls in a row imply an on-curve point between them.
+                float mx = (cx + p->x) * 0.5f;
+                float my = (cy + p->y) * 0.5f;
+                add_quadratic(outline, x, y, cx, cy, mx, my);
+                x = mx;
+                y = my;
+            }
+
+            cx = p->x;
+            cy = p->y;
+            has_control = true;
+        }
+    }
+
+    if (has_control) add_quadratic(outline, x, y, cx, cy, start_x, start_y);
+    else add_line(outline, x, y, start_x, start_y);
+}
+
+static void
+add_glyph_outline(truetype_font_t *font, uint32_t glyph, outline_t *outline, int depth)
+{
+    uint32_t length;
+    uint32_t offset = get_glyph_offset(font, glyph, &length);
+    if (!length || depth > 8) return;
+
+    uint8_t *data = font->data + offset;
+    int16_t contour_count = read_s16(data);
+
+    if (contour_count >= 0)
+    {
+        uint8_t *end_points = data + 10;
+        uint32_t point_count = contour_count ? read_u16(end_points + (contour_count - 1) * 2) + 1 : 0;
+        uint32_t instruction_length = read_u16(end_points + contour_count * 2);
+        uint8_t *p = end_points + contour_count * 2 + 2 + instruction_length;
+
+        outline_point_t *points = (outline_point_t *)malloc(point_count * sizeof(outline_point_t) + 1);
+        uint8_t *flags = (uint8_t *)malloc(point_count + 1);
+
+        for (uint32_t i = 0; i < point_count;)
+        {
+            uint8_t flag = *p++;
+            flags[i++] = flag;
+
+            if (flag & 8)
+            {
+                uint8_t repeat = *p++;
+                while (repeat-- && i < point_count) flags[i++] = flag;
+            }
+        }
+
+        int value = 0;
+        for (uint32_t i = 0; i < point_count; ++i)
+        {
+            uint8_t flag = flags[i];
+            if (flag & 2)
+            {
+                int dx = *p++;
+                value += (flag & 16) ? dx : -dx;
+            }
+            else if (!(flag & 16))
+            {
+                value += read_s16(p);
+                p += 2;
+            }
+            points[i].x = (float)value;
+            points[i].on_curve = (flag & 1) != 0;
+        }
+
+        value = 0;
+        for (uint32_t i = 0; i < point_count; ++i)
+        {
+            uint8_t flag = flags[i];
+            if (flag & 4)
+            {
+                int dy = *p++;
+                value += (flag & 32) ? dy : -dy;
+            }
+            else if (!(flag & 32))
+            {
+                value += read_s16(p);
+                p += 2;
+            }
+            points[i].y = (float)value;
+        }
+
+        for (uint32_t i = 0; i < point_count; ++i)
+        {
+            float x = points[i].x;
+            float y = points[i].y;
+            points[i].x = outline->a * x + outline->b * y + outline->e;
+            points[i].y = outline->c * x + outline->d * y + outline->f;
+        }
+
+        uint32_t start = 0;
+        for (int c = 0; c < contour_count; ++c)
+        {
+            uint32_t end = read_u16(end_points + c * 2) + 1;
+            if (end > point_count) break;
+
+            add_contour(outline, points + start, end - start);
+            start = end;
+        }
+
+        free(flags);
+        free(points);
+    }
+    else
+    {
+        // Composite, each component is another glyph under a 2x2 transform and an offset.
+        uint8_t *p = data + 10;
+        for (;;)
+        {
+            uint16_t flags = read_u16(p);
+            uint16_t component = read_u16(p + 2);
+            p += 4;
+
+            float dx, dy;
+            if (flags & 1)
+            {
+                dx = read_s16(p);
+                dy = read_s16(p + 2);
+                p += 4;
+            }
+            else
+            {
+                dx = (int8_t)p[0];
+                dy = (int8_t)p[1];
+                p += 2;
+            }
+
+            // Matching point numbers instead of offsets are rare enough to ignore.
+            if (!(flags & 2)) dx = dy = 0.0f;
+
+            float m00 = 1.0f, m01 = 0.0f, m10 = 0.0f, m11 = 1.0f;
+            if (flags & 8)
+            {
+                m00 = m11 = read_s16(p) / 16384.0f;
+                p += 2;
+            }
+            else if (flags & 0x40)
+            {
+                m00 = read_s16(p) / 16384.0f;
+                m11 = read_s16(p + 2) / 16384.0f;
+                p += 4;
+            }
+            else if (flags & 0x80)
+            {
+                m00 = read_s16(p) / 16384.0f;
+                m10 = read_s16(p + 2) / 16384.0f;
+                m01 = read_s16(p + 4) / 16384.0f;
+                m11 = read_s16(p + 6) / 16384.0f;
+                p += 8;
+            }
+
+            // Component space to font space is x = m00*u + m01*v + dx, y = m10*u + m11*v + dy, then the parent transform.
+            outline_t child = *outline;
+            child.a = outline->a * m00 + outline->b * m10;
+            child.b = outline->a * m01 + outline->b * m11;
+            child.c = outline->c * m00 + outline->d * m10;
+            child.d = outline->c * m01 + outline->d * m11;
+            child.e = outline->a * dx + outline->b * dy + outline->e;
+            child.f = outline->c * dx + outline->d * dy + outline->f;
+
+            add_glyph_outline(font, component, &child, depth + 1);
+
+            outline->lines = child.lines;
+            outline->line_count = child.line_count;
+            outline->line_capacity = child.line_capacity;
+
+            if (!(flags & 0x20)) break;
+        }
+    }
+}
+
+//
+// Rasterizer: every line adds its signed area coverage into an accumulation buffer,
+// a running sum over the buffer then gives the coverage of each pixel.
+//
+
+static void
+accumulate_line(float *accumulation, int width, int height, outline_line_t *line)
+{
+    float x0 = line->x0, y0 = line->y0;
+    float x1 = line->x1, y1 = line->y1;
+    if (fabsf(y0 - y1) <= 1e-6f) return;
+
+    float direction = 1.0f;
+    if (y0 > y1)
+    {
+        direction = -1.0f;
+        float t;
+        t = x0; x0 = x1; x1 = t;
+        t = y0; y0 = y1; y1 = t;
+    }
+
+    float dxdy = (x1 - x0) / (y1 - y0);
+    float x = x0;
+    if (y0 < 0.0f) x -= y0 * dxdy;
+
+    int y_start = y0 < 0.0f ? 0 : (int)y0;
+    int y_end = (int)ceilf(y1);
+    if (y_end > height) y_end = height;
+
+    for (int y = y_start; y < y_end; ++y)
+    {
+        float *row = accumulation + y * width;
+
+        float dy = fminf((float)(y + 1), y1) - fmaxf((float)y, y0);
+        float x_next = x + dxdy * dy;
+        float d = dy * direction;
+
+        float left = fminf(x, x_next);
+        float right = fmaxf(x, x_next);
+        float left_floor = floorf(left);
+        int left_i = (int)left_floor;
+        float right_ceil = ceilf(right);
+        int right_i = (int)right_ceil;
+
+        if (left_i < 0)
+        {
+            x = x_next;
+            continue;
+        }
+
+        if (right_i <= left_i + 1)
+        {
+            // Within one pixel, split by the midpoint.
+            float mid = 0.5f * (x + x_next) - left_floor;
+            row[left_i] += d - d * mid;
+            row[left_i + 1] += d * mid;
+        }
+        else
+        {
+            float s = 1.0f / (right - left);
+            float left_frac = left - left_floor;
+            float a0 = 0.5f * s * (1.0f - left_frac) * (1.0f - left_frac);
+            float right_frac = right - right_ceil + 1.0f;
+            float am = 0.5f * s * right_frac * right_frac;
+
+            row[left_i] += d * a0;
+            if (right_i == left_i + 2)
+            {
+                row[left_i + 1] += d * (1.0f - a0 - am);
+            }
+            else
+            {
+                float a1 = s * (1.5f - left_frac);
+                row[left_i + 1] += d * (a1 - a0);
+                for (int xi = left_i + 2; xi < right_i - 1; ++xi) row[xi] += d * s;
+
+                float a2 = a1 + (right_i - left_i - 3) * s;
+                row[right_i - 1] += d * (1.0f - a2 - am);
+            }
+            row[right_i] += d * am;
+        }
+
+        x = x_next;
+    }
+}
+
+void
+rasterize_glyph(truetype_font_t *font, uint32_t glyph, float scale, int x0, int y0,
+                uint8_t *pixels, int width, int height, int stride)
+{
+    for (int y = 0; y < height; ++y) memset(pixels + y * stride, 0, width);
+
+    outline_t outline = {};
+    outline.a = scale;
+    outline.d = -scale;
+    outline.e = (float)-x0;
+    outline.f = (float)-y0;
+    add_glyph_outline(font, glyph, &outline, 0);
+
+    if (!outline.line_count)
+    {
+        free(outline.lines);
+        return;
+    }
+
+    // Lines may touch x == width, which spills into the start of the next row. That is fine since
+    // every row sums back to zero, the padding covers the spill of the last row.
+    float *accumulation = (float *)calloc(width * height + 2, sizeof(float));
+    for (uint32_t i = 0; i < outline.line_count; ++i)
+    {
+        outline_line_t *line = &outline.lines[i];
+
+        // Keep lines inside the bitmap horizontally, the accumulation can't go left of a row.
+        line->x0 = fminf(fmaxf(line->x0, 0.0f), (float)width);
+        line->x1 = fminf(fmaxf(line->x1, 0.0f), (float)width);
+        accumulate_line(accumulation, width, height, line);
+    }
+
+    float sum = 0.0f;
+    for (int y = 0; y < height; ++y)
+    {
+        uint8_t *row = pixels + y * stride;
+        for (int x = 0; x < width; ++x)
+        {
+            sum += accumulation[y * width + x];
+            float coverage = fminf(fabsf(sum), 1.0f);
+            row[x] = (uint8_t)(coverage * 255.0f + 0.5f);
+        }
+    }
+
+    free(accumulation);
+    free(outline.lines);
+}
@@ -0,0 +1,57 @@
+#ifndef TRUETYPE_H
+#define TRUETYPE_H
+
+#include <stdint.h>
+
+// Minimal TrueType reader in the spirit of stb_truetype: glyf outlines (simple and composite),
+// cmap formats 4 and 12, hmtx metrics and kern format 0 pairs. No hinting, no CFF, no GPOS.
+// Glyphs are rasterized with exact area coverage.
+
+struct truetype_font_t
+{
+    uint8_t *data;
+    uint32_t size;
+
+    uint32_t glyph_count;
+    int units_per_em;
+    int index_to_loc_format;
+
+    // Font units, y up.
+    int ascent;
+    int descent;
+    int line_gap;
+    int bounds_min_x;
+    int bounds_min_y;
+    int bounds_max_x;
+    int bounds_max_y;
+
+    uint32_t number_of_hmetrics;
+
+    // Table offsets, 0 if missing.
+    uint32_t cmap;
+    uint32_t loca;
+    uint32_t glyf;
+    uint32_t hmtx;
+    uint32_t kern;
+};
+
+// data has to outlive the font.
+bool init_truetype_font(truetype_font_t *font, uint8_t *data, uint32_t size);
+
+// 0 is the missing glyph.
+uint32_t find_glyph_index(truetype_font_t *font, uint32_t codepoint);
+
+// Scale from font units to pixels for a font whose ascent to descent is pixel_height.
+float get_truetype_scale(truetype_font_t *font, float pixel_height);
+
+void get_glyph_hmetrics(truetype_font_t *font, uint32_t glyph, int *advance, int *left_side_bearing);
+int get_glyph_kerning(truetype_font_t *font, uint32_t left_glyph, uint32_t right_glyph);
+
+// Pixel box of the glyph relative to the pen position on the baseline, y down. Empty glyphs give a zero box.
+void get_glyph_bitmap_box(truetype_font_t *font, uint32_t glyph, float scale, int *x0, int *y0, int *x1, int *y1);
+
+// Renders into an 8 bit coverage bitmap of width * height whose top left is (x0, y0) of the bitmap box.
+void rasterize_glyph(truetype_font_t *font, uint32_t glyph, float scale, int x0, int y0,
+                     uint8_t *pixels, int width, int height, int stride);
+
+#endif